@@ -20,7 +20,7 @@ A simple hash table library for C programs.
 Summary:	Development files for libsht
 Requires:	%{name}%{?_isa} = %{version}-%{release}
 %description devel
-Header file for libsht development.
+Header files for libsht development.
 
 %prep
 %autosetup -n sht
@@ -37,6 +37,7 @@ cd src
 %__mkdir_p %{buildroot}%{_includedir}
 %__cp src/sht.h %{buildroot}%{_includedir}/
 %__cp src/sht-ts.h %{buildroot}%{_includedir}/
+%__cp src/sht-hash.h %{buildroot}%{_includedir}/
 %__ln_s libsht.so.%{libver} %{buildroot}%{_libdir}/libsht.so
 
 %files
@@ -47,6 +48,7 @@ cd src
 %files devel
 %attr(0644, root, root) %{_includedir}/sht.h
 %attr(0644, root, root) %{_includedir}/sht-ts.h
+%attr(0644, root, root) %{_includedir}/sht-hash.h
 %attr(-, root, root) %{_libdir}/libsht.so
 
 %changelog
@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/*
+ *
+ * 	SHT - hash table with "Robin Hood" probing
+ *
+ *	Copyright 2025 Ian Pilcher <arequipeno@gmail.com>
+ *
+ */
+
+
+/**
+ * @file
+ * Built-in hash functions.
+ *
+ * These functions hash common key types (32- and 64-bit integers, fixed-size
+ * byte keys, and strings).  They are defined inline, so a hash function that is
+ * used by a type-safe table (see SHT_TABLE_TYPE()) is inlined into the
+ * generated wrapper function.
+ *
+ * When the compiler targets a CPU with the necessary instructions, the
+ * functions use the CRC32C instruction (SSE 4.2 or ARMv8 CRC32) and AES-NI;
+ * otherwise, they use portable multiply/shift mixing.  Therefore, the values
+ * that they return depend on the compiler's target, so a table file (see
+ * sht_save()) should only be mapped by programs built for the same target as
+ * the program that created it.
+ *
+ * These functions are fast, but they are not designed to resist hash flooding.
+ * A table whose keys are chosen by an untrusted party should use a keyed hash
+ * function.
+ */
+
+
+#ifndef SHT_HASH_H
+#define SHT_HASH_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE4_2__) || defined(__AES__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+
+/**
+ * @internal
+ * @brief
+ * Is the CRC32C instruction available?
+ */
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+#define SHT_HASH_CRC32C		1
+#else
+#define SHT_HASH_CRC32C		0
+#endif
+
+/**
+ * @internal
+ * @brief
+ * Is AES-NI available?
+ */
+#if defined(__AES__) && defined(__SSE2__)
+#define SHT_HASH_AES		1
+#else
+#define SHT_HASH_AES		0
+#endif
+
+/**
+ * @internal
+ * @brief
+ * 2⁶⁴ divided by the golden ratio.
+ */
+#define SHT_HASH_K		UINT64_C(0x9e3779b97f4a7c15)
+
+
+#if SHT_HASH_CRC32C
+
+/**
+ * @internal
+ * Update a CRC32C with a 32-bit value.
+ *
+ * @param	crc	The current CRC.
+ * @param	v	The value.
+ *
+ * @returns	The updated CRC.
+ */
+static inline uint32_t sht_crc32c_u32_(uint32_t crc, uint32_t v)
+{
+#if defined(__SSE4_2__)
+	return _mm_crc32_u32(crc, v);
+#else
+	return __crc32cw(crc, v);
+#endif
+}
+
+/**
+ * @internal
+ * Update a CRC32C with a 64-bit value.
+ *
+ * @param	crc	The current CRC.
+ * @param	v	The value.
+ *
+ * @returns	The updated CRC.
+ */
+static inline uint32_t sht_crc32c_u64_(uint32_t crc, uint64_t v)
+{
+#if defined(__SSE4_2__) && defined(__x86_64__)
+	return (uint32_t)_mm_crc32_u64(crc, v);
+#elif defined(__SSE4_2__)
+	crc = _mm_crc32_u32(crc, (uint32_t)v);
+	return _mm_crc32_u32(crc, (uint32_t)(v >> 32));
+#else
+	return __crc32cd(crc, v);
+#endif
+}
+
+/**
+ * @internal
+ * Update a CRC32C with an 8-bit value.
+ *
+ * @param	crc	The current CRC.
+ * @param	v	The value.
+ *
+ * @returns	The updated CRC.
+ */
+static inline uint32_t sht_crc32c_u8_(uint32_t crc, uint8_t v)
+{
+#if defined(__SSE4_2__)
+	return _mm_crc32_u8(crc, v);
+#else
+	return __crc32cb(crc, v);
+#endif
+}
+
+#endif		// SHT_HASH_CRC32C
+
+/**
+ * @internal
+ * Mix the bits of a 64-bit value (the MurmurHash3 64-bit finalizer).
+ *
+ * @param	x	The value.
+ *
+ * @returns	The low 32 bits of the mixed value.
+ */
+static inline uint32_t sht_hash_mix64_(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= UINT64_C(0xff51afd7ed558ccd);
+	x ^= x >> 33;
+	x *= UINT64_C(0xc4ceb9fe1a85ec53);
+	x ^= x >> 33;
+
+	return (uint32_t)x;
+}
+
+/**
+ * Hash a 32-bit integer key.
+ *
+ * ```c
+ * SHT_TABLE_TYPE(id_map, uint32_t, struct id_entry, sht_hash_u32, id_eqfn)
+ * ```
+ *
+ * @param	key	The key.
+ *
+ * @returns	The hash of the key.
+ */
+static inline uint32_t sht_hash_u32(const uint32_t *restrict key)
+{
+#if SHT_HASH_CRC32C
+	return sht_crc32c_u32_(UINT32_MAX, *key);
+#else
+	uint32_t x = *key;
+
+	// MurmurHash3 32-bit finalizer
+	x ^= x >> 16;
+	x *= UINT32_C(0x85ebca6b);
+	x ^= x >> 13;
+	x *= UINT32_C(0xc2b2ae35);
+	x ^= x >> 16;
+
+	return x;
+#endif
+}
+
+/**
+ * Hash a 64-bit integer key.
+ *
+ * @param	key	The key.
+ *
+ * @returns	The hash of the key.
+ */
+static inline uint32_t sht_hash_u64(const uint64_t *restrict key)
+{
+#if SHT_HASH_CRC32C
+	return sht_crc32c_u64_(UINT32_MAX, *key);
+#else
+	return sht_hash_mix64_(*key);
+#endif
+}
+
+/**
+ * Hash a sequence of bytes.
+ *
+ * This function is the basis of the other byte and string hash functions.  It
+ * can also be used to hash a length-prefixed string (or any other key whose
+ * data does not immediately follow its address).
+ *
+ * @param	key	The bytes to be hashed.
+ * @param	len	The number of bytes.
+ *
+ * @returns	The hash of the bytes.
+ *
+ * @see		SHT_HASH_BYTES_FN()
+ */
+static inline uint32_t sht_hash_bytes(const void *restrict key, size_t len)
+{
+	const uint8_t *p = key;
+
+#if SHT_HASH_AES
+	__m128i h, k, tail = _mm_setzero_si128();
+
+	k = _mm_set_epi64x((int64_t)SHT_HASH_K, (int64_t)~SHT_HASH_K);
+	h = _mm_set_epi64x((int64_t)len, (int64_t)SHT_HASH_K);
+
+	for (; len >= 16; p += 16, len -= 16) {
+		h = _mm_xor_si128(h, _mm_loadu_si128((const void *)p));
+		h = _mm_aesenc_si128(h, k);
+	}
+
+	if (len != 0) {
+		memcpy(&tail, p, len);
+		h = _mm_aesenc_si128(_mm_xor_si128(h, tail), k);
+	}
+
+	// Each round diffuses every byte across one 32-bit column
+	h = _mm_aesenc_si128(h, k);
+	h = _mm_aesenc_si128(h, k);
+	h = _mm_aesenc_si128(h, k);
+
+	return (uint32_t)_mm_cvtsi128_si32(h);
+#elif SHT_HASH_CRC32C
+	uint32_t crc;
+	uint64_t v;
+
+	crc = sht_crc32c_u64_(UINT32_MAX, len);
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, sizeof v);
+		crc = sht_crc32c_u64_(crc, v);
+	}
+
+	for (; len != 0; ++p, --len)
+		crc = sht_crc32c_u8_(crc, *p);
+
+	return crc;
+#else
+	uint64_t h, v;
+
+	h = len * SHT_HASH_K;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&v, p, sizeof v);
+		h = (h ^ v) * SHT_HASH_K;
+		h ^= h >> 32;
+	}
+
+	if (len != 0) {
+		v = 0;
+		memcpy(&v, p, len);
+		h = (h ^ v) * SHT_HASH_K;
+	}
+
+	return sht_hash_mix64_(h);
+#endif
+}
+
+/**
+ * Hash a NUL-terminated string.
+ *
+ * The hash of a string is the same as the hash of its characters (not
+ * including the terminating NUL), as calculated by sht_hash_bytes().
+ *
+ * ```c
+ * SHT_TABLE_TYPE(str_map, char, struct str_entry, sht_hash_str, str_eqfn)
+ * ```
+ *
+ * @param	key	The string.
+ *
+ * @returns	The hash of the string.
+ */
+static inline uint32_t sht_hash_str(const char *restrict key)
+{
+	return sht_hash_bytes(key, strlen(key));
+}
+
+/**
+ * Define a hash function for a fixed-size key type.
+ *
+ * The generated function hashes all of the bytes of its key with
+ * sht_hash_bytes(), so the key type must not contain any padding.
+ *
+ * ```c
+ * struct addr_key {
+ *     uint8_t		ip[16];
+ *     uint16_t		port;
+ * };
+ *
+ * SHT_HASH_BYTES_FN(addr_hash, struct addr_key)
+ * SHT_TABLE_TYPE(conn_map, struct addr_key, struct conn, addr_hash, conn_eqfn)
+ * ```
+ *
+ * @param	name	The name of the function.
+ * @param	ktype	The key type.
+ */
+#define SHT_HASH_BYTES_FN(name, ktype)					\
+	static inline uint32_t name(const ktype *restrict key)		\
+	{								\
+		return sht_hash_bytes(key, sizeof *key);		\
+	}
+
+/**
+ * Hash a 32-bit integer key (untyped).
+ *
+ * A #sht_hashfn_t that calls sht_hash_u32().  The context is ignored.
+ *
+ * @param	key	The key.
+ * @param	context	Ignored.
+ *
+ * @returns	The hash of the key.
+ */
+static inline uint32_t sht_hashfn_u32(const void *restrict key,
+				      void *restrict context)
+{
+	(void)context;
+	return sht_hash_u32(key);
+}
+
+/**
+ * Hash a 64-bit integer key (untyped).
+ *
+ * A #sht_hashfn_t that calls sht_hash_u64().  The context is ignored.
+ *
+ * @param	key	The key.
+ * @param	context	Ignored.
+ *
+ * @returns	The hash of the key.
+ */
+static inline uint32_t sht_hashfn_u64(const void *restrict key,
+				      void *restrict context)
+{
+	(void)context;
+	return sht_hash_u64(key);
+}
+
+/**
+ * Hash a NUL-terminated string (untyped).
+ *
+ * A #sht_hashfn_t that calls sht_hash_str().  The context is ignored.
+ *
+ * @param	key	The string.
+ * @param	context	Ignored.
+ *
+ * @returns	The hash of the string.
+ */
+static inline uint32_t sht_hashfn_str(const void *restrict key,
+				      void *restrict context)
+{
+	(void)context;
+	return sht_hash_str(key);
+}
+
+
+#endif		/* SHT_HASH_H */
@@ -22,6 +22,7 @@
 
 
 #include "sht.h"
+#include "sht-hash.h"
 
 
 /*******************************************************************************
@@ -492,6 +493,118 @@ static inline void *sht_strip_const_(const void *p)
 					 nullptr);			\
 	}
 
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_init_inplace_().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	name	Wrapper function name.
+ * @param	etype	Entry type.
+ * @param	hashfn	Hash function wrapper name.
+ * @param	eqfn	Equality function wrapper name.
+ * @param	freefn	Free function wrapper name or `nullptr`.
+ * @param	...	Absorbs `nullptr` argument , if free function exists.
+ */
+#define SHT_WRAP_INIT_INPLACE(sc, ttype, name, etype,			\
+			      hashfn, eqfn, freefn, ...)		\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc ttype *name(struct sht_storage *storage)			\
+	{								\
+		return (ttype *)sht_init_inplace_(storage,		\
+						  hashfn, eqfn, freefn,	\
+						  sizeof(etype),	\
+						  alignof(etype),	\
+						  nullptr);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_new_indirect_().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	name	Wrapper function name.
+ * @param	etype	Entry type.
+ * @param	hashfn	Hash function wrapper name.
+ * @param	eqfn	Equality function wrapper name.
+ * @param	freefn	Free function wrapper name or `nullptr`.
+ * @param	...	Absorbs `nullptr` argument , if free function exists.
+ */
+#define SHT_WRAP_NEW_INDIRECT(sc, ttype, name, etype,			\
+			      hashfn, eqfn, freefn, ...)		\
+	[[maybe_unused]]						\
+	sc ttype *name(void)						\
+	{								\
+		return (ttype *)sht_new_indirect_(hashfn, eqfn, freefn,	\
+						  sizeof(etype),	\
+						  alignof(etype),	\
+						  nullptr);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_new_keyed_().
+ *
+ * The generated table uses the library's built-in hash function.
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	name	Wrapper function name.
+ * @param	etype	Entry type.
+ * @param	kmember	Key member of entry type.
+ * @param	freefn	Free function wrapper name or `nullptr`.
+ * @param	...	Absorbs `nullptr` argument , if free function exists.
+ */
+#define SHT_WRAP_NEW_KEYED(sc, ttype, name, etype,			\
+			   kmember, freefn, ...)			\
+	[[maybe_unused]]						\
+	sc ttype *name(void)						\
+	{								\
+		return (ttype *)sht_new_keyed_(				\
+				nullptr, freefn,			\
+				sizeof(etype), alignof(etype),		\
+				offsetof(etype, kmember),		\
+				sizeof(((etype *)nullptr)->kmember),	\
+				nullptr);				\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper that creates a table with a blob arena.
+ *
+ * (Calls sht_new_keyed_() and sht_set_arena().)
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	name	Wrapper function name.
+ * @param	etype	Entry type.
+ * @param	kmember	Key blob member of entry type.
+ * @param	vmember	Value blob member of entry type.
+ * @param	freefn	Free function wrapper name or `nullptr`.
+ * @param	...	Absorbs `nullptr` argument , if free function exists.
+ */
+#define SHT_WRAP_NEW_ARENA(sc, ttype, name, etype,			\
+			   kmember, vmember, freefn, ...)		\
+	[[maybe_unused]]						\
+	sc ttype *name(void)						\
+	{								\
+		struct sht_ht *ht;					\
+									\
+		ht = sht_new_keyed_(nullptr, freefn,			\
+				    sizeof(etype), alignof(etype),	\
+				    offsetof(etype, kmember),		\
+				    sizeof(struct sht_blob), nullptr);	\
+		if (ht != nullptr)					\
+			sht_set_arena(ht, offsetof(etype, vmember));	\
+									\
+		return (ttype *)ht;					\
+	}
+
 /**
  * @internal
  * @brief
@@ -593,524 +706,1465 @@ static inline void *sht_strip_const_(const void *p)
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_init().
+ * Generate a type-safe wrapper for sht_set_key_array().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_INIT(sc, name, ttype)					\
+#define SHT_WRAP_SET_KEY_ARRAY(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(ttype *ht, uint32_t capacity)			\
+	sc void name(ttype *ht, size_t offset, size_t size)		\
 	{								\
-		return sht_init((struct sht_ht *)ht, capacity);		\
+		sht_set_key_array((struct sht_ht *)ht, offset, size);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_free().
+ * Generate a type-safe wrapper for sht_set_interleaved().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_FREE(sc, name, ttype)					\
+#define SHT_WRAP_SET_INTERLEAVED(sc, name, ttype)			\
 	[[maybe_unused, gnu::nonnull]]					\
 	sc void name(ttype *ht)						\
 	{								\
-		sht_free((struct sht_ht *)ht);				\
+		sht_set_interleaved((struct sht_ht *)ht);		\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_add().
+ * Generate a type-safe wrapper for sht_set_compact().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_ADD(sc, name, ttype, ktype, etype)			\
+#define SHT_WRAP_SET_COMPACT(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc int name(ttype *ht, const ktype *key, const etype *entry)	\
+	sc void name(ttype *ht)						\
 	{								\
-		return sht_add((struct sht_ht *)ht, key, entry);	\
+		sht_set_compact((struct sht_ht *)ht);			\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_set().
+ * Generate a type-safe wrapper for sht_set_int_keys().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_SET(sc, name, ttype, ktype, etype)			\
+#define SHT_WRAP_SET_INT_KEYS(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc int name(ttype *ht, const ktype *key, const etype *entry)	\
+	sc void name(ttype *ht)						\
 	{								\
-		return sht_set((struct sht_ht *)ht, key, entry);	\
+		sht_set_int_keys((struct sht_ht *)ht);			\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_get().
+ * Generate a type-safe wrapper for sht_arena_add().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_GET(sc, name, ttype, ktype, etype)			\
-	[[maybe_unused, gnu::nonnull]]					\
-	sc const etype *name(ttype *ht, const ktype *key)		\
+#define SHT_WRAP_ARENA_ADD(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull(1, 4)]]				\
+	sc bool name(ttype *ht, const void *data, size_t len,		\
+		     struct sht_blob *blob)				\
 	{								\
-		return sht_get((struct sht_ht *)ht, key);		\
+		return sht_arena_add((struct sht_ht *)ht, data, len,	\
+				     blob);				\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_size().
+ * Generate a type-safe wrapper for sht_blob().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_SIZE(sc, name, ttype)					\
+#define SHT_WRAP_BLOB(sc, name, ttype)					\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc uint32_t name(const ttype *ht)				\
+	sc const void *name(const ttype *ht, struct sht_blob blob)	\
 	{								\
-		return sht_size((const struct sht_ht *)ht);		\
+		return sht_blob((const struct sht_ht *)ht, blob);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_empty().
+ * Generate a type-safe wrapper for sht_set_bulk_free().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_EMPTY(sc, name, ttype)					\
+#define SHT_WRAP_SET_BULK_FREE(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(const ttype *ht)					\
+	sc void name(ttype *ht)						\
 	{								\
-		return sht_empty((const struct sht_ht *)ht);		\
+		sht_set_bulk_free((struct sht_ht *)ht);			\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_peakk_psl().
+ * Generate a type-safe wrapper for sht_set_cache().
+ *
+ * The generated function does not take an eviction function; evicted entries
+ * are freed by the table's free function (if any).
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_PEAK_PSL(sc, name, ttype)				\
+#define SHT_WRAP_SET_CACHE(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc uint8_t name(const ttype *ht)				\
+	sc void name(ttype *ht, uint32_t max)				\
 	{								\
-		return sht_peak_psl((const struct sht_ht *)ht);		\
+		sht_set_cache((struct sht_ht *)ht, max,			\
+			      nullptr, nullptr);			\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_delete().
+ * Generate a type-safe wrapper for sht_bulk_alloc().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
  */
-#define SHT_WRAP_DELETE(sc, name, ttype, ktype)				\
+#define SHT_WRAP_BULK_ALLOC(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(ttype *ht, const ktype *key)			\
+	sc void *name(ttype *ht, size_t size)				\
 	{								\
-		return sht_delete((struct sht_ht *)ht, key);		\
+		return sht_bulk_alloc((struct sht_ht *)ht, size);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_pop().
+ * Generate a type-safe wrapper for sht_set_buffer().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_POP(sc, name, ttype, ktype, etype)			\
+#define SHT_WRAP_SET_BUFFER(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(ttype *ht, const ktype *restrict key,		\
-		     etype *restrict out)				\
+	sc void name(ttype *ht, void *buf, size_t size)			\
 	{								\
-		return sht_pop((struct sht_ht *)ht, key, out);		\
+		sht_set_buffer((struct sht_ht *)ht, buf, size);		\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_replace().
+ * Generate a type-safe wrapper for sht_init().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_REPLACE(sc, name, ttype, ktype, etype)			\
+#define SHT_WRAP_INIT(sc, name, ttype)					\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(ttype *ht, const ktype *key, const etype *entry)	\
+	sc bool name(ttype *ht, uint32_t capacity)			\
 	{								\
-		return sht_replace((struct sht_ht *)ht, key, entry);	\
+		return sht_init((struct sht_ht *)ht, capacity);		\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_swap().
+ * Generate a type-safe wrapper for sht_buffer_size().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	ktype	Key referent type.
- * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_SWAP(sc, name, ttype, ktype, etype)			\
+#define SHT_WRAP_BUFFER_SIZE(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(ttype *ht, const ktype *key,			\
-		     const etype *entry, etype *out)			\
+	sc size_t name(ttype *ht, uint32_t capacity)			\
 	{								\
-		return sht_swap((struct sht_ht *)ht, key, entry, out);	\
+		return sht_buffer_size((struct sht_ht *)ht, capacity);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_new().
+ * Generate a type-safe wrapper for sht_reserve().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
- * @param	itype	Type-safe iterator type (incomplete).
  */
-#define SHT_WRAP_ITER_NEW(sc, name, ttype, itype)			\
+#define SHT_WRAP_RESERVE(sc, name, ttype)				\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc itype *name(ttype *ht, enum sht_iter_type type)		\
+	sc bool name(ttype *ht, uint32_t capacity)			\
 	{								\
-		return (itype *)sht_iter_new((struct sht_ht *)ht,	\
-					     type);			\
+		return sht_reserve((struct sht_ht *)ht, capacity);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_free().
+ * Generate a type-safe wrapper for sht_free().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_WRAP_ITER_FREE(sc, name, itype)				\
+#define SHT_WRAP_FREE(sc, name, ttype)					\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc void name(itype *iter)					\
+	sc void name(ttype *ht)						\
 	{								\
-		sht_iter_free((struct sht_iter *)iter);			\
+		sht_free((struct sht_ht *)ht);				\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_next().
+ * Generate a type-safe wrapper for sht_add().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_ITER_NEXT(sc, name, itype, etype)			\
+#define SHT_WRAP_ADD(sc, name, ttype, ktype, etype)			\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc const etype *name(itype *iter)				\
+	sc int name(ttype *ht, const ktype *key, const etype *entry)	\
 	{								\
-		return sht_iter_next((struct sht_iter *)iter);		\
+		return sht_add((struct sht_ht *)ht, key, entry);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_delete().
+ * Generate a type-safe wrapper for sht_set().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_ITER_DELETE(sc, name, itype)				\
+#define SHT_WRAP_SET(sc, name, ttype, ktype, etype)			\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(itype *iter)					\
+	sc int name(ttype *ht, const ktype *key, const etype *entry)	\
 	{								\
-		return sht_iter_delete((struct sht_iter *)iter);	\
+		return sht_set((struct sht_ht *)ht, key, entry);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_replace().
+ * Generate a type-safe wrapper for sht_upsert().
+ *
+ * The library calls a merge function with `void` entry pointers, so the
+ * generated wrapper passes the type-safe merge function and its context to the
+ * library through a (static) trampoline function.
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	tname	Trampoline function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_ITER_REPLACE(sc, name, itype, etype)			\
-	[[maybe_unused, gnu::nonnull]]					\
-	sc bool name(itype *iter, const etype *entry)			\
+#define SHT_WRAP_UPSERT(sc, name, tname, ttype, ktype, etype)		\
+	struct tname {							\
+		void (*merge)(etype *restrict, const etype *restrict,	\
+			      void *restrict);				\
+		void *context;						\
+	};								\
+									\
+	static void tname(void *restrict existing,			\
+			  const void *restrict entry,			\
+			  void *restrict context)			\
 	{								\
-		return sht_iter_replace((struct sht_iter *)iter,	\
-					entry);				\
+		const struct tname *t = context;			\
+		t->merge(existing, entry, t->context);			\
+	}								\
+									\
+	[[maybe_unused, gnu::nonnull(1, 2, 3, 4)]]			\
+	sc int name(ttype *ht, const ktype *key, const etype *entry,	\
+		    void (*merge)(etype *restrict,			\
+				  const etype *restrict,		\
+				  void *restrict),			\
+		    void *context)					\
+	{								\
+		struct tname t = {					\
+			.merge = merge,					\
+			.context = context				\
+		};							\
+		return sht_upsert((struct sht_ht *)ht, key, entry,	\
+				  tname, &t);				\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_get_err().
+ * Generate a type-safe wrapper for sht_get().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_GET_ERR(sc, name, ttype)				\
+#define SHT_WRAP_GET(sc, name, ttype, ktype, etype)			\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc enum sht_err name(ttype *ht)					\
+	sc const etype *name(ttype *ht, const ktype *key)		\
 	{								\
-		return sht_get_err((struct sht_ht *)ht);		\
+		return sht_get((struct sht_ht *)ht, key);		\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_get_msg().
+ * Generate a type-safe wrapper for sht_prefetch().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
  * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  */
-#define SHT_WRAP_GET_MSG(sc, name, ttype)				\
+#define SHT_WRAP_PREFETCH(sc, name, ttype, ktype)			\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc const char *name(ttype *ht)					\
+	sc uint32_t name(const ttype *ht, const ktype *key)		\
 	{								\
-		return sht_get_msg((struct sht_ht *)ht);		\
+		return sht_prefetch((const struct sht_ht *)ht, key);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_err().
+ * Generate a type-safe wrapper for sht_get_token().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
  */
-#define SHT_WRAP_ITER_ERR(sc, name, itype)				\
+#define SHT_WRAP_GET_TOKEN(sc, name, ttype, ktype, etype)		\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc enum sht_err name(itype *iter)				\
+	sc const etype *name(ttype *ht, const ktype *key,		\
+			     uint32_t token)				\
 	{								\
-		return sht_iter_err((struct sht_iter *)iter);		\
+		return sht_get_token((struct sht_ht *)ht, key, token);	\
 	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe wrapper for sht_iter_msg().
+ * Generate a type-safe wrapper for sht_set_ttl().
  *
  * @param	sc	Storage class (e.g., `static`).  May be empty.
  * @param	name	Wrapper function name.
- * @param	itype	Type-safe iterator type (incomplete).
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  */
-#define SHT_WRAP_ITER_MSG(sc, name, itype)				\
+#define SHT_WRAP_SET_TTL(sc, name, ttype, ktype)			\
 	[[maybe_unused, gnu::nonnull]]					\
-	sc  const char *name(itype *iter)				\
+	sc int name(ttype *ht, const ktype *key, uint64_t deadline)	\
 	{								\
-		return sht_iter_msg((struct sht_iter *)iter);		\
+		return sht_set_ttl((struct sht_ht *)ht, key, deadline);	\
 	}
 
-
-/*******************************************************************************
- *
- *
- *	Table type helpers
- *
- *
- ******************************************************************************/
-
-
-/*
- *
- * Function names
- *
- */
-
 /**
  * @internal
  * @brief
- * Generate a function name.
+ * Generate a type-safe wrapper for sht_expire().
  *
- * @param	ttspec	Table type spec.
- * @param	base	Function name base.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_FN_NAME(ttspec, base)	SHT_CONCAT(SHT_FOSR_REQ(ttspec), base)
+#define SHT_WRAP_EXPIRE(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc uint32_t name(ttype *ht, uint64_t now, uint32_t budget)	\
+	{								\
+		return sht_expire((struct sht_ht *)ht, now, budget);	\
+	}
 
 /**
  * @internal
  * @brief
- * Generate a hash function wrapper name.
+ * Generate a type-safe wrapper for sht_size().
  *
- * @param	ttspec	Table type spec.
- */
-#define SHT_HF_NAME(ttspec)		SHT_FN_NAME(ttspec, _hash_wrapper_)
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ */
+#define SHT_WRAP_SIZE(sc, name, ttype)					\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc uint32_t name(const ttype *ht)				\
+	{								\
+		return sht_size((const struct sht_ht *)ht);		\
+	}
 
 /**
  * @internal
  * @brief
- * Generate an equalify function wrapper name.
+ * Generate a type-safe wrapper for sht_empty().
  *
- * @param	ttspec	Table type spec.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_EF_NAME(ttspec)		SHT_FN_NAME(ttspec, _eq_wrapper_)
+#define SHT_WRAP_EMPTY(sc, name, ttype)					\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(const ttype *ht)					\
+	{								\
+		return sht_empty((const struct sht_ht *)ht);		\
+	}
 
 /**
  * @internal
  * @brief
- * Generate a free function wrapper name.
+ * Generate a type-safe wrapper for sht_peakk_psl().
  *
- * @param	ttspec	Table type spec.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_FF_NAME(ttspec)		SHT_FN_NAME(ttspec, _free_wrapper_)
-
+#define SHT_WRAP_PEAK_PSL(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc uint8_t name(const ttype *ht)				\
+	{								\
+		return sht_peak_psl((const struct sht_ht *)ht);		\
+	}
 
-/*
- *
- * Type names
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_delete().
  *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  */
+#define SHT_WRAP_DELETE(sc, name, ttype, ktype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const ktype *key)			\
+	{								\
+		return sht_delete((struct sht_ht *)ht, key);		\
+	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe table type name.
+ * Generate a type-safe wrapper for sht_delete_many().
  *
- * @param	ttspec Table type spec.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
  */
-#define SHT_HT_T(ttspec)		\
-	struct SHT_CONCAT(SHT_FOSR_REQ(ttspec), _ht)
+#define SHT_WRAP_DELETE_MANY(sc, name, ttype, ktype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc int32_t name(ttype *ht, const ktype *const *keys,		\
+			uint32_t n)					\
+	{								\
+		return sht_delete_many((struct sht_ht *)ht,		\
+				       (const void *const *)keys, n);	\
+	}
 
 /**
  * @internal
  * @brief
- * Generate a type-safe iterator type name.
+ * Generate a type-safe wrapper for sht_remove_if().
  *
- * @param	ttspec	Table type spec.
+ * The library calls a predicate function with a `void` entry pointer, so the
+ * generated wrapper passes the type-safe predicate and its context to the
+ * library through a (static) trampoline function.
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	tname	Trampoline function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	etype	Entry referent type.
  */
-#define SHT_ITER_T(ttspec)		\
-	struct SHT_CONCAT(SHT_FOSR_REQ(ttspec), _iter)
+#define SHT_WRAP_REMOVE_IF(sc, name, tname, ttype, etype)		\
+	struct tname {							\
+		bool (*pred)(const etype *restrict, void *restrict);	\
+		void *context;						\
+	};								\
+									\
+	static bool tname(const void *restrict entry,			\
+			  void *restrict context)			\
+	{								\
+		const struct tname *t = context;			\
+		return t->pred(entry, t->context);			\
+	}								\
+									\
+	[[maybe_unused, gnu::nonnull(1, 2)]]				\
+	sc uint32_t name(ttype *ht,					\
+			 bool (*pred)(const etype *restrict,		\
+				      void *restrict),			\
+			 void *context)					\
+	{								\
+		struct tname t = { .pred = pred, .context = context };	\
+		return sht_remove_if((struct sht_ht *)ht, tname, &t);	\
+	}
 
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_clear().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ */
+#define SHT_WRAP_CLEAR(sc, name, ttype)					\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc void name(ttype *ht)						\
+	{								\
+		sht_clear((struct sht_ht *)ht);				\
+	}
 
-/*
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_clone().
  *
- * Function storage class
+ * The library calls a copy function with `void` entry pointers, so the
+ * generated wrapper passes the type-safe copy function and its context to the
+ * library through a (static) trampoline function.
  *
- * (Callback functions are always static.)
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	tname	Trampoline function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	etype	Entry referent type.
+ */
+#define SHT_WRAP_CLONE(sc, name, tname, ttype, etype)			\
+	struct tname {							\
+		bool (*copy)(etype *restrict, const etype *restrict,	\
+			     void *restrict);				\
+		void *context;						\
+	};								\
+									\
+	static bool tname(void *restrict dest, const void *restrict src,\
+			  void *restrict context)			\
+	{								\
+		const struct tname *t = context;			\
+		return t->copy(dest, src, t->context);			\
+	}								\
+									\
+	[[maybe_unused, gnu::nonnull(1)]]				\
+	sc ttype *name(ttype *ht,					\
+		       bool (*copy)(etype *restrict,			\
+				    const etype *restrict,		\
+				    void *restrict),			\
+		       void *context)					\
+	{								\
+		struct tname t = { .copy = copy, .context = context };	\
+		return (ttype *)sht_clone((struct sht_ht *)ht,		\
+					  copy == nullptr ?		\
+						nullptr : tname,	\
+					  &t);				\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_save().
  *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
+#define SHT_WRAP_SAVE(sc, name, ttype)					\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, int fd)					\
+	{								\
+		return sht_save((struct sht_ht *)ht, fd);		\
+	}
 
 /**
  * @internal
  * @brief
- * Expands to nothing.
+ * Generate a type-safe wrapper for sht_checkpoint().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_FN_SC_PROBE_extern
+#define SHT_WRAP_CHECKPOINT(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, int fd)					\
+	{								\
+		return sht_checkpoint((struct sht_ht *)ht, fd);		\
+	}
 
 /**
  * @internal
  * @brief
- * Expands to nothing if (pre-expanded) @p sc is `extern`, otherwise @p sc.
+ * Generate a type-safe wrapper for sht_map().
  *
- * > **NOTE**
- * >
- * > This macro relies on the fact that `SHT_FN_SC_PROBE_##sc` is not defined
- * > for any value of @p sc other than `extern`.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ */
+#define SHT_WRAP_MAP(sc, name, ttype)					\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const char *path)			\
+	{								\
+		return sht_map((struct sht_ht *)ht, path);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_map_fd().
  *
- * @param	sc	The expanded storage class from the table type spec,
- *			with an empty value replaced by `static`.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_EXTERN_2_EMPTY_NX(sc)	SHT_IF_ELSE(sc, , SHT_FN_SC_PROBE_##sc)
+#define SHT_WRAP_MAP_FD(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, int fd)					\
+	{								\
+		return sht_map_fd((struct sht_ht *)ht, fd);		\
+	}
 
 /**
  * @internal
  * @brief
- * Forces expansion of @p sc before invoking SHT_EXTERN_2_EMPTY_NX().
+ * Generate a type-safe wrapper for sht_init_shared().
  *
- * @param	sc 	The unexpanded storage class from the table type spec,
- *			with an empty value replaced by `static`.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
  */
-#define SHT_EXTERN_2_EMPTY(sc)		SHT_EXTERN_2_EMPTY_NX(sc)
+#define SHT_WRAP_INIT_SHARED(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, uint32_t capacity, int fd)		\
+	{								\
+		return sht_init_shared((struct sht_ht *)ht, capacity,	\
+				       fd);				\
+	}
 
 /**
  * @internal
  * @brief
- * Expands to `static` if @p sc is empty; otherwise expands to @p sc.
+ * Generate a type-safe wrapper for sht_read().
  *
- * @param	sc	The storage class from the table type spec, which may be
- *			empty.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
  */
-#define SHT_EMPTY_2_STATIC(sc)		SHT_IF_ELSE(sc, static, sc)
+#define SHT_WRAP_READ(sc, name, ttype, ktype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const ktype *restrict key,		\
+		     etype *restrict out)				\
+	{								\
+		return sht_read((struct sht_ht *)ht, key, out);		\
+	}
 
 /**
  * @internal
  * @brief
- * Generates the storage class for a generated function.
+ * Generate a type-safe wrapper for sht_pop().
  *
- * Callback function wrappers are always `static`.  Other generated functions
- * default to `static`, if no storage class is specified in the table type spec.
- * but this can be changed by specifying a storage class of `extern`, which will
- * suppress the default `static`.  Any other storage class will be applied to
- * the generated functions unchanged.
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
+ */
+#define SHT_WRAP_POP(sc, name, ttype, ktype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const ktype *restrict key,		\
+		     etype *restrict out)				\
+	{								\
+		return sht_pop((struct sht_ht *)ht, key, out);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_replace().
  *
- * In summary:
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
+ */
+#define SHT_WRAP_REPLACE(sc, name, ttype, ktype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const ktype *key, const etype *entry)	\
+	{								\
+		return sht_replace((struct sht_ht *)ht, key, entry);	\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_swap().
  *
- * * (Nothing) → `static`
- * * `extern` → (nothing)
- * * (Anything else) → (unchanged)
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	ktype	Key referent type.
+ * @param	etype	Entry referent type.
  */
-#define SHT_FN_SC(ttspec)						\
-	SHT_EXTERN_2_EMPTY(						\
-		SHT_EMPTY_2_STATIC(					\
-			SHT_FOSR_OPT(ttspec)				\
-		)							\
+#define SHT_WRAP_SWAP(sc, name, ttype, ktype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(ttype *ht, const ktype *key,			\
+		     const etype *entry, etype *out)			\
+	{								\
+		return sht_swap((struct sht_ht *)ht, key, entry, out);	\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_new().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ * @param	itype	Type-safe iterator type (incomplete).
+ */
+#define SHT_WRAP_ITER_NEW(sc, name, ttype, itype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc itype *name(ttype *ht, enum sht_iter_type type)		\
+	{								\
+		return (itype *)sht_iter_new((struct sht_ht *)ht,	\
+					     type);			\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_free().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ */
+#define SHT_WRAP_ITER_FREE(sc, name, itype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc void name(itype *iter)					\
+	{								\
+		sht_iter_free((struct sht_iter *)iter);			\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_next().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ * @param	etype	Entry referent type.
+ */
+#define SHT_WRAP_ITER_NEXT(sc, name, itype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc const etype *name(itype *iter)				\
+	{								\
+		return sht_iter_next((struct sht_iter *)iter);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_delete().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ */
+#define SHT_WRAP_ITER_DELETE(sc, name, itype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(itype *iter)					\
+	{								\
+		return sht_iter_delete((struct sht_iter *)iter);	\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_replace().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ * @param	etype	Entry referent type.
+ */
+#define SHT_WRAP_ITER_REPLACE(sc, name, itype, etype)			\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc bool name(itype *iter, const etype *entry)			\
+	{								\
+		return sht_iter_replace((struct sht_iter *)iter,	\
+					entry);				\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_get_err().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ */
+#define SHT_WRAP_GET_ERR(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc enum sht_err name(ttype *ht)					\
+	{								\
+		return sht_get_err((struct sht_ht *)ht);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_get_msg().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	ttype	Type-safe table type (incomplete).
+ */
+#define SHT_WRAP_GET_MSG(sc, name, ttype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc const char *name(ttype *ht)					\
+	{								\
+		return sht_get_msg((struct sht_ht *)ht);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_err().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ */
+#define SHT_WRAP_ITER_ERR(sc, name, itype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc enum sht_err name(itype *iter)				\
+	{								\
+		return sht_iter_err((struct sht_iter *)iter);		\
+	}
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe wrapper for sht_iter_msg().
+ *
+ * @param	sc	Storage class (e.g., `static`).  May be empty.
+ * @param	name	Wrapper function name.
+ * @param	itype	Type-safe iterator type (incomplete).
+ */
+#define SHT_WRAP_ITER_MSG(sc, name, itype)				\
+	[[maybe_unused, gnu::nonnull]]					\
+	sc  const char *name(itype *iter)				\
+	{								\
+		return sht_iter_msg((struct sht_iter *)iter);		\
+	}
+
+
+/*******************************************************************************
+ *
+ *
+ *	Table type helpers
+ *
+ *
+ ******************************************************************************/
+
+
+/*
+ *
+ * Function names
+ *
+ */
+
+/**
+ * @internal
+ * @brief
+ * Generate a function name.
+ *
+ * @param	ttspec	Table type spec.
+ * @param	base	Function name base.
+ */
+#define SHT_FN_NAME(ttspec, base)	SHT_CONCAT(SHT_FOSR_REQ(ttspec), base)
+
+/**
+ * @internal
+ * @brief
+ * Generate a hash function wrapper name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_HF_NAME(ttspec)		SHT_FN_NAME(ttspec, _hash_wrapper_)
+
+/**
+ * @internal
+ * @brief
+ * Generate an equalify function wrapper name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_EF_NAME(ttspec)		SHT_FN_NAME(ttspec, _eq_wrapper_)
+
+/**
+ * @internal
+ * @brief
+ * Generate a free function wrapper name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_FF_NAME(ttspec)		SHT_FN_NAME(ttspec, _free_wrapper_)
+
+/**
+ * @internal
+ * @brief
+ * Generate a predicate function trampoline name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_RF_NAME(ttspec)		SHT_FN_NAME(ttspec, _pred_trampoline_)
+
+/**
+ * @internal
+ * @brief
+ * Generate a copy function trampoline name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_CF_NAME(ttspec)		SHT_FN_NAME(ttspec, _copy_trampoline_)
+
+/**
+ * @internal
+ * @brief
+ * Generate a merge function trampoline name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_MF_NAME(ttspec)		SHT_FN_NAME(ttspec, _merge_trampoline_)
+
+
+/*
+ *
+ * Type names
+ *
+ */
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe table type name.
+ *
+ * @param	ttspec Table type spec.
+ */
+#define SHT_HT_T(ttspec)		\
+	struct SHT_CONCAT(SHT_FOSR_REQ(ttspec), _ht)
+
+/**
+ * @internal
+ * @brief
+ * Generate a type-safe iterator type name.
+ *
+ * @param	ttspec	Table type spec.
+ */
+#define SHT_ITER_T(ttspec)		\
+	struct SHT_CONCAT(SHT_FOSR_REQ(ttspec), _iter)
+
+
+/*
+ *
+ * Function storage class
+ *
+ * (Callback functions are always static.)
+ *
+ */
+
+/**
+ * @internal
+ * @brief
+ * Expands to nothing.
+ */
+#define SHT_FN_SC_PROBE_extern
+
+/**
+ * @internal
+ * @brief
+ * Expands to nothing if (pre-expanded) @p sc is `extern`, otherwise @p sc.
+ *
+ * > **NOTE**
+ * >
+ * > This macro relies on the fact that `SHT_FN_SC_PROBE_##sc` is not defined
+ * > for any value of @p sc other than `extern`.
+ *
+ * @param	sc	The expanded storage class from the table type spec,
+ *			with an empty value replaced by `static`.
+ */
+#define SHT_EXTERN_2_EMPTY_NX(sc)	SHT_IF_ELSE(sc, , SHT_FN_SC_PROBE_##sc)
+
+/**
+ * @internal
+ * @brief
+ * Forces expansion of @p sc before invoking SHT_EXTERN_2_EMPTY_NX().
+ *
+ * @param	sc 	The unexpanded storage class from the table type spec,
+ *			with an empty value replaced by `static`.
+ */
+#define SHT_EXTERN_2_EMPTY(sc)		SHT_EXTERN_2_EMPTY_NX(sc)
+
+/**
+ * @internal
+ * @brief
+ * Expands to `static` if @p sc is empty; otherwise expands to @p sc.
+ *
+ * @param	sc	The storage class from the table type spec, which may be
+ *			empty.
+ */
+#define SHT_EMPTY_2_STATIC(sc)		SHT_IF_ELSE(sc, static, sc)
+
+/**
+ * @internal
+ * @brief
+ * Generates the storage class for a generated function.
+ *
+ * Callback function wrappers are always `static`.  Other generated functions
+ * default to `static`, if no storage class is specified in the table type spec.
+ * but this can be changed by specifying a storage class of `extern`, which will
+ * suppress the default `static`.  Any other storage class will be applied to
+ * the generated functions unchanged.
+ *
+ * In summary:
+ *
+ * * (Nothing) → `static`
+ * * `extern` → (nothing)
+ * * (Anything else) → (unchanged)
+ */
+#define SHT_FN_SC(ttspec)						\
+	SHT_EXTERN_2_EMPTY(						\
+		SHT_EMPTY_2_STATIC(					\
+			SHT_FOSR_OPT(ttspec)				\
+		)							\
+	)
+
+
+
+/*******************************************************************************
+ *
+ *
+ *	Table type macro
+ *
+ *
+ ******************************************************************************/
+
+/**
+ * @internal
+ * @brief
+ * Generate the type-safe functions that are common to all table types.
+ *
+ * (Everything except the callback function wrappers, the functions that create
+ * a table, and the hash and equality function context setters.)
+ *
+ * @param	ttspec	Table type spec.
+ * @param	ktype	The type of the table's keys.
+ * @param	etype	The type of the table's entries.
+ * @param	...	Optional free function spec.
+ */
+#define SHT_TABLE_OPS(ttspec, ktype, etype, ...)			\
+									\
+	/* sht_set_free_ctx() wrapper, if necessary */			\
+	__VA_OPT__(							\
+		SHT_WRAP_SET_FREE_CTX(					\
+			SHT_FN_SC(ttspec),		/* sc */	\
+			SHT_FN_NAME(ttspec,		/* name */	\
+				    _set_free_ctx),			\
+			SHT_HT_T(ttspec),		/* ttype */	\
+			SHT_FRSO_OPT(__VA_ARGS__)	/* ...? */	\
+		)							\
+	)								\
+									\
+	/* sht_set_lft() wrapper */					\
+	SHT_WRAP_SET_LFT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_lft),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_psl_limit() wrapper */				\
+	SHT_WRAP_SET_PSL_LIMIT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_psl_limit),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_key_array() wrapper */				\
+	SHT_WRAP_SET_KEY_ARRAY(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_key_array),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_interleaved() wrapper */				\
+	SHT_WRAP_SET_INTERLEAVED(					\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_interleaved),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_compact() wrapper */					\
+	SHT_WRAP_SET_COMPACT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_compact),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_bulk_free() wrapper */				\
+	SHT_WRAP_SET_BULK_FREE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_bulk_free),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_cache() wrapper */					\
+	SHT_WRAP_SET_CACHE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_cache),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_set_buffer() wrapper */					\
+	SHT_WRAP_SET_BUFFER(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_buffer),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_init() wrapper */					\
+	SHT_WRAP_INIT(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _init),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_buffer_size() wrapper */					\
+	SHT_WRAP_BUFFER_SIZE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _buffer_size),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_reserve() wrapper */					\
+	SHT_WRAP_RESERVE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _reserve),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_free() wrapper */					\
+	SHT_WRAP_FREE(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _free),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_add() wrapper */						\
+	SHT_WRAP_ADD(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _add),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_set() wrapper */						\
+	SHT_WRAP_SET(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_upsert() wrapper */					\
+	SHT_WRAP_UPSERT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _upsert),		/* name */	\
+		SHT_MF_NAME(ttspec),			/* tname */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_bulk_alloc() wrapper */					\
+	SHT_WRAP_BULK_ALLOC(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _bulk_alloc),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_get() wrapper */						\
+	SHT_WRAP_GET(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _get),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_prefetch() wrapper */					\
+	SHT_WRAP_PREFETCH(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _prefetch),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype					/* ktype */	\
+	)								\
+									\
+	/* sht_get_token() wrapper */					\
+	SHT_WRAP_GET_TOKEN(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _get_token),	/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_set_ttl() wrapper */					\
+	SHT_WRAP_SET_TTL(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _set_ttl),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype					/* ktype */	\
+	)								\
+									\
+	/* sht_expire() wrapper */					\
+	SHT_WRAP_EXPIRE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _expire),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_size() wrapper */					\
+	SHT_WRAP_SIZE(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _size),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_empty() wrapper */					\
+	SHT_WRAP_EMPTY(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _empty),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_peak_psl() wrapper */					\
+	SHT_WRAP_PEAK_PSL(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _peak_psl),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_delete() wrapper */					\
+	SHT_WRAP_DELETE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _delete),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype					/* ktype */	\
+	)								\
+									\
+	/* sht_delete_many() wrapper */					\
+	SHT_WRAP_DELETE_MANY(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _delete_many),	/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype					/* ktype */	\
+	)								\
+									\
+	/* sht_remove_if() wrapper */					\
+	SHT_WRAP_REMOVE_IF(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _remove_if),	/* name */	\
+		SHT_RF_NAME(ttspec),			/* tname */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_clear() wrapper */					\
+	SHT_WRAP_CLEAR(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _clear),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_pop() wrapper */						\
+	SHT_WRAP_POP(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _pop),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_replace() wrapper */					\
+	SHT_WRAP_REPLACE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _replace),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_swap() wrapper */					\
+	SHT_WRAP_SWAP(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _swap),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_clone() wrapper */					\
+	SHT_WRAP_CLONE(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _clone),		/* name */	\
+		SHT_CF_NAME(ttspec),			/* tname */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_save() wrapper */					\
+	SHT_WRAP_SAVE(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _save),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_checkpoint() wrapper */					\
+	SHT_WRAP_CHECKPOINT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _checkpoint),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_map() wrapper */						\
+	SHT_WRAP_MAP(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _map),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_map_fd() wrapper */					\
+	SHT_WRAP_MAP_FD(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _map_fd),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_init_shared() wrapper */					\
+	SHT_WRAP_INIT_SHARED(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _init_shared),	/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_read() wrapper */					\
+	SHT_WRAP_READ(							\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _read),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		ktype,					/* ktype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_iter_new() wrapper */					\
+	SHT_WRAP_ITER_NEW(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_new),		/* name */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		SHT_ITER_T(ttspec)			/* itype */	\
+	)								\
+									\
+	/* sht_iter_free() wrapper */					\
+	SHT_WRAP_ITER_FREE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_free),	/* name */	\
+		SHT_ITER_T(ttspec)			/* itype */	\
+	)								\
+									\
+	/* sht_iter_next() wrapper */					\
+	SHT_WRAP_ITER_NEXT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_next),	/* name */	\
+		SHT_ITER_T(ttspec),			/* itype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_iter_delete() wrapper */					\
+	SHT_WRAP_ITER_DELETE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_delete),	/* name */	\
+		SHT_ITER_T(ttspec)			/* itype */	\
+	)								\
+									\
+	/* sht_iter_replace() wrapper */				\
+	SHT_WRAP_ITER_REPLACE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_replace),	/* name */	\
+		SHT_ITER_T(ttspec),			/* itype */	\
+		etype					/* etype */	\
+	)								\
+									\
+	/* sht_get_err() wrapper */					\
+	SHT_WRAP_GET_ERR(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _get_err),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_get_msg() wrapper */					\
+	SHT_WRAP_GET_MSG(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _get_msg),		/* name */	\
+		SHT_HT_T(ttspec)			/* ttype */	\
+	)								\
+									\
+	/* sht_iter_err() wrapper */					\
+	SHT_WRAP_ITER_ERR(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_err),		/* name */	\
+		SHT_ITER_T(ttspec)			/* itype */	\
+	)								\
+									\
+	/* sht_iter_msg() wrapper */					\
+	SHT_WRAP_ITER_MSG(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_FN_NAME(ttspec, _iter_msg),		/* name */	\
+		SHT_ITER_T(ttspec)			/* itype */	\
 	)
 
-
-
-/*******************************************************************************
- *
- *
- *	Table type macro
- *
- *
- ******************************************************************************/
-
 /**
  * Generate types and functions for a type-safe hash table type.
  *
@@ -1210,6 +2264,30 @@ static inline void *sht_strip_const_(const void *p)
 		nullptr					/* freefn? */	\
 	)								\
 									\
+	/* sht_init_inplace_() wrapper */				\
+	SHT_WRAP_INIT_INPLACE(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		SHT_FN_NAME(ttspec, _init_inplace),	/* name */	\
+		etype,					/* etype */	\
+		SHT_HF_NAME(ttspec),			/* hashfn */	\
+		SHT_EF_NAME(ttspec),			/* eqfn */	\
+		__VA_OPT__(SHT_FF_NAME(ttspec),)	/* freefn? */	\
+		nullptr					/* freefn? */	\
+	)								\
+									\
+	/* sht_new_indirect_() wrapper */				\
+	SHT_WRAP_NEW_INDIRECT(						\
+		SHT_FN_SC(ttspec),			/* sc */	\
+		SHT_HT_T(ttspec),			/* ttype */	\
+		SHT_FN_NAME(ttspec, _new_indirect),	/* name */	\
+		etype,					/* etype */	\
+		SHT_HF_NAME(ttspec),			/* hashfn */	\
+		SHT_EF_NAME(ttspec),			/* eqfn */	\
+		__VA_OPT__(SHT_FF_NAME(ttspec),)	/* freefn? */	\
+		nullptr					/* freefn? */	\
+	)								\
+									\
 	/* sht_set_hash_ctx() wrapper */				\
 	SHT_WRAP_SET_HASH_CTX(						\
 		SHT_FN_SC(ttspec),			/* sc */	\
@@ -1226,192 +2304,177 @@ static inline void *sht_strip_const_(const void *p)
 		SHT_FRSO_OPT(efspec)			/* ...? */	\
 	)								\
 									\
-	/* sht_set_free_ctx() wrapper, if necessary */			\
-	__VA_OPT__(							\
-		SHT_WRAP_SET_FREE_CTX(					\
-			SHT_FN_SC(ttspec),		/* sc */	\
-			SHT_FN_NAME(ttspec,		/* name */	\
-				    _set_free_ctx),			\
-			SHT_HT_T(ttspec),		/* ttype */	\
-			SHT_FRSO_OPT(__VA_ARGS__)	/* ...? */	\
-		)							\
-	)								\
-									\
-	/* sht_set_lft() wrapper */					\
-	SHT_WRAP_SET_LFT(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _set_lft),		/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
-	)								\
-									\
-	/* sht_set_psl_limit() wrapper */				\
-	SHT_WRAP_SET_PSL_LIMIT(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _set_psl_limit),	/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
-	)								\
+	/* Everything else */						\
+	SHT_TABLE_OPS(ttspec, ktype, etype, __VA_ARGS__)
+
+/**
+ * Generate types and functions for a type-safe keyed hash table type.
+ *
+ * Each entry of a keyed table contains its key in the member @p kmember.  Keys
+ * are compared byte by byte and hashed by the library (see sht_new_keyed_()),
+ * so no hash or equality function is required.  The key type of the generated
+ * functions is the type of @p kmember.
+ *
+ * ```c
+ * struct session {
+ *     uint64_t        id;
+ *     time_t          expires;
+ * };
+ *
+ * SHT_KEYED_TABLE_TYPE(sessions, struct session, id)
+ * ```
+ *
+ * The generated types and functions are the same as those generated by
+ * SHT_TABLE_TYPE(), except that `_new()` creates a keyed table, there are no
+ * `_init_inplace()`, `_new_indirect()`, `_set_hash_ctx()`, or `_set_eq_ctx()`
+ * functions, and there is a `_set_int_keys()` function (see
+ * sht_set_int_keys()).
+ *
+ * @param	ttspec	Table type spec.  (See SHT_TABLE_TYPE().)
+ *
+ * @param	etype	The type of the table's entries.
+ *
+ * @param	kmember	The member of @p etype that holds the key.  The key
+ *			must not contain padding bytes.
+ *
+ * @param	...	**Optional** free function spec.  (See
+ *			SHT_TABLE_TYPE().)
+ */
+#define SHT_KEYED_TABLE_TYPE(ttspec, etype, kmember, ...)		\
 									\
-	/* sht_init() wrapper */					\
-	SHT_WRAP_INIT(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _init),		/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
-	)								\
+	/* Entry size check */						\
+	static_assert(sizeof(etype) <= SHT_MAX_ESIZE,			\
+		      SHT_STR(Entry type (etype) too large));		\
 									\
-	/* sht_free() wrapper */					\
-	SHT_WRAP_FREE(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _free),		/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
-	)								\
+	/* Incomplete type that represents a table */			\
+	SHT_HT_T(ttspec);						\
 									\
-	/* sht_add() wrapper */						\
-	SHT_WRAP_ADD(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _add),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
-	)								\
+	/* Incomplete type that represents an iterator */		\
+	SHT_ITER_T(ttspec);						\
 									\
-	/* sht_set() wrapper */						\
-	SHT_WRAP_SET(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _set),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
+	/* Free function wrapper, if necessary */			\
+	__VA_OPT__(							\
+		SHT_MKFREEFN(						\
+			SHT_FF_NAME(ttspec),		/* name */	\
+			etype,				/* etype */	\
+			SHT_FRSO_REQ(__VA_ARGS__),	/* freefn */	\
+			SHT_FRSO_OPT(__VA_ARGS__)	/* ...? */	\
+		)							\
 	)								\
 									\
-	/* sht_get() wrapper */						\
-	SHT_WRAP_GET(							\
+	/* sht_new_keyed_() wrapper */					\
+	SHT_WRAP_NEW_KEYED(						\
 		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _get),		/* name */	\
 		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
-	)								\
-									\
-	/* sht_size() wrapper */					\
-	SHT_WRAP_SIZE(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _size),		/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
+		SHT_FN_NAME(ttspec, _new),		/* name */	\
+		etype,					/* etype */	\
+		kmember,				/* kmember */	\
+		__VA_OPT__(SHT_FF_NAME(ttspec),)	/* freefn? */	\
+		nullptr					/* freefn? */	\
 	)								\
 									\
-	/* sht_empty() wrapper */					\
-	SHT_WRAP_EMPTY(							\
+	/* sht_set_int_keys() wrapper */				\
+	SHT_WRAP_SET_INT_KEYS(						\
 		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _empty),		/* name */	\
+		SHT_FN_NAME(ttspec, _set_int_keys),	/* name */	\
 		SHT_HT_T(ttspec)			/* ttype */	\
 	)								\
 									\
-	/* sht_peak_psl() wrapper */					\
-	SHT_WRAP_PEAK_PSL(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _peak_psl),		/* name */	\
-		SHT_HT_T(ttspec)			/* ttype */	\
-	)								\
+	/* Everything else */						\
+	SHT_TABLE_OPS(							\
+		ttspec,					/* ttspec */	\
+		typeof(((etype *)nullptr)->kmember),	/* ktype */	\
+		etype,					/* etype */	\
+		__VA_ARGS__				/* freefn? */	\
+	)
+
+/**
+ * Generate types and functions for a type-safe table type with a blob arena.
+ *
+ * The table is a keyed table whose string keys and values are stored in a
+ * table-owned blob arena (see sht_set_arena()).  @p kmember and @p vmember
+ * must be of type struct sht_blob.  The key type of the generated functions is
+ * `char` (keys are NUL-terminated strings).
+ *
+ * ```c
+ * struct header {
+ *     struct sht_blob name;
+ *     struct sht_blob value;
+ * };
+ *
+ * SHT_ARENA_TABLE_TYPE(headers, struct header, name, value)
+ * ```
+ *
+ * The generated types and functions are the same as those generated by
+ * SHT_KEYED_TABLE_TYPE(), except that `_new()` creates a table with a blob
+ * arena, there is no `_set_int_keys()` function, and there are `_arena_add()`
+ * and `_blob()` functions (see sht_arena_add() and sht_blob()).
+ *
+ * @param	ttspec	Table type spec.  (See SHT_TABLE_TYPE().)
+ *
+ * @param	etype	The type of the table's entries.
+ *
+ * @param	kmember	The member of @p etype that refers to the key.
+ *
+ * @param	vmember	The member of @p etype that refers to the value.
+ *
+ * @param	...	**Optional** free function spec.  (See
+ *			SHT_TABLE_TYPE().)
+ */
+#define SHT_ARENA_TABLE_TYPE(ttspec, etype, kmember, vmember, ...)	\
 									\
-	/* sht_delete() wrapper */					\
-	SHT_WRAP_DELETE(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _delete),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype					/* ktype */	\
-	)								\
+	/* Entry size check */						\
+	static_assert(sizeof(etype) <= SHT_MAX_ESIZE,			\
+		      SHT_STR(Entry type (etype) too large));		\
 									\
-	/* sht_pop() wrapper */						\
-	SHT_WRAP_POP(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _pop),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
-	)								\
+	/* Incomplete type that represents a table */			\
+	SHT_HT_T(ttspec);						\
 									\
-	/* sht_replace() wrapper */					\
-	SHT_WRAP_REPLACE(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _replace),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
-	)								\
+	/* Incomplete type that represents an iterator */		\
+	SHT_ITER_T(ttspec);						\
 									\
-	/* sht_swap() wrapper */					\
-	SHT_WRAP_SWAP(							\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _swap),		/* name */	\
-		SHT_HT_T(ttspec),			/* ttype */	\
-		ktype,					/* ktype */	\
-		etype					/* etype */	\
+	/* Free function wrapper, if necessary */			\
+	__VA_OPT__(							\
+		SHT_MKFREEFN(						\
+			SHT_FF_NAME(ttspec),		/* name */	\
+			etype,				/* etype */	\
+			SHT_FRSO_REQ(__VA_ARGS__),	/* freefn */	\
+			SHT_FRSO_OPT(__VA_ARGS__)	/* ...? */	\
+		)							\
 	)								\
 									\
-	/* sht_iter_new() wrapper */					\
-	SHT_WRAP_ITER_NEW(						\
+	/* sht_new_keyed_() and sht_set_arena() wrapper */		\
+	SHT_WRAP_NEW_ARENA(						\
 		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_new),		/* name */	\
 		SHT_HT_T(ttspec),			/* ttype */	\
-		SHT_ITER_T(ttspec)			/* itype */	\
-	)								\
-									\
-	/* sht_iter_free() wrapper */					\
-	SHT_WRAP_ITER_FREE(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_free),	/* name */	\
-		SHT_ITER_T(ttspec)			/* itype */	\
-	)								\
-									\
-	/* sht_iter_next() wrapper */					\
-	SHT_WRAP_ITER_NEXT(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_next),	/* name */	\
-		SHT_ITER_T(ttspec),			/* itype */	\
-		etype					/* etype */	\
-	)								\
-									\
-	/* sht_iter_delete() wrapper */					\
-	SHT_WRAP_ITER_DELETE(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_delete),	/* name */	\
-		SHT_ITER_T(ttspec)			/* itype */	\
-	)								\
-									\
-	/* sht_iter_replace() wrapper */				\
-	SHT_WRAP_ITER_REPLACE(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_replace),	/* name */	\
-		SHT_ITER_T(ttspec),			/* itype */	\
-		etype					/* etype */	\
+		SHT_FN_NAME(ttspec, _new),		/* name */	\
+		etype,					/* etype */	\
+		kmember,				/* kmember */	\
+		vmember,				/* vmember */	\
+		__VA_OPT__(SHT_FF_NAME(ttspec),)	/* freefn? */	\
+		nullptr					/* freefn? */	\
 	)								\
 									\
-	/* sht_get_err() wrapper */					\
-	SHT_WRAP_GET_ERR(						\
+	/* sht_arena_add() wrapper */					\
+	SHT_WRAP_ARENA_ADD(						\
 		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _get_err),		/* name */	\
+		SHT_FN_NAME(ttspec, _arena_add),	/* name */	\
 		SHT_HT_T(ttspec)			/* ttype */	\
 	)								\
 									\
-	/* sht_get_msg() wrapper */					\
-	SHT_WRAP_GET_MSG(						\
+	/* sht_blob() wrapper */					\
+	SHT_WRAP_BLOB(							\
 		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _get_msg),		/* name */	\
+		SHT_FN_NAME(ttspec, _blob),		/* name */	\
 		SHT_HT_T(ttspec)			/* ttype */	\
 	)								\
 									\
-	/* sht_iter_err() wrapper */					\
-	SHT_WRAP_ITER_ERR(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_err),		/* name */	\
-		SHT_ITER_T(ttspec)			/* itype */	\
-	)								\
-									\
-	/* sht_iter_msg() wrapper */					\
-	SHT_WRAP_ITER_MSG(						\
-		SHT_FN_SC(ttspec),			/* sc */	\
-		SHT_FN_NAME(ttspec, _iter_msg),		/* name */	\
-		SHT_ITER_T(ttspec)			/* itype */	\
+	/* Everything else */						\
+	SHT_TABLE_OPS(							\
+		ttspec,					/* ttspec */	\
+		char,					/* ktype */	\
+		etype,					/* etype */	\
+		__VA_ARGS__				/* freefn? */	\
 	)
 
 
@@ -15,15 +15,25 @@
  */
 
 
+#define _POSIX_C_SOURCE	200809L
+
 #include "sht.h"
+#include "sht-hash.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbit.h>
 #include <stdckdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 /**
@@ -61,19 +71,140 @@
  */
 #define SHT_MAX_ITERS		UINT16_C(0x7fff)
 
+/**
+ * @internal
+ * @brief
+ * Table file "magic number" ("SHTF").
+ *
+ * Also detects files that were written with a different byte order.
+ */
+#define SHT_FILE_MAGIC		UINT32_C(0x53485446)
+
+/**
+ * @internal
+ * @brief
+ * Table file format version.
+ */
+#define SHT_FILE_VERSION	UINT32_C(3)
+
+/**
+ * @internal
+ * @brief
+ * Size of the output buffer used by sht_save().
+ */
+#define SHT_WBUF_SIZE		65536
+
+/**
+ * @internal
+ * @brief
+ * Granularity of the dirty region tracking used by sht_checkpoint().
+ */
+#define SHT_CKPT_PAGE		4096
+
+/**
+ * @internal
+ * @brief
+ * Approximate size of the slabs in which indirect entries are allocated.
+ */
+#define SHT_SLAB_SIZE		65536
+
+/**
+ * @internal
+ * @brief
+ * Size (and alignment) of the lines of a table with an interleaved layout.
+ */
+#define SHT_LINE_SIZE		64
+
+/**
+ * @internal
+ * @brief
+ * Number of times that a shared table reader spins before it starts yielding
+ * the CPU while it waits for the writer.
+ */
+#define SHT_SHM_SPINS		1024
+
+/**
+ * @internal
+ * @brief
+ * Initial size of a table's blob arena.
+ */
+#define SHT_ARENA_MIN		256
+
+/**
+ * @internal
+ * @brief
+ * Size of the first chunk of a table's resource arena (see sht_bulk_alloc()).
+ */
+#define SHT_CHUNK_MIN		4096
+
+/**
+ * @internal
+ * @brief
+ * Maximum size of a (normal) chunk of a table's resource arena.
+ */
+#define SHT_CHUNK_MAX		(1 << 24)
+
+/**
+ * @internal
+ * @brief
+ * Positions per block (and blocks per group) in a table's deadline index.
+ */
+#define SHT_TTL_BLOCK		64
+
 /**
  * @private
  * Hash table bucket structure ("SHT bucket").
+ *
+ * An empty bucket is all zeros, so a newly allocated bucket array can come
+ * from `calloc()` (and the kernel's zero pages).
  */
 union sht_bckt {
 	struct {
 		uint32_t	hash:24;	/**< Hash (low 24 bits). */
 		uint32_t	psl:7;		/**< Probe sequence length. */
-		uint32_t	empty:1;	/**< Is this bucket empty? */
+		uint32_t	used:1;		/**< Is this bucket in use? */
 	};
 	uint32_t		all;		/**< All 32 bits. */
 };
 
+/**
+ * @private
+ * Compact hash table bucket structure (see sht_set_compact()).
+ *
+ * The fingerprint is the high 8 bits of the hash, which (unlike the low bits)
+ * are not used to select the entry's ideal position.
+ */
+union sht_cbckt {
+	struct {
+		uint16_t	fp:8;		/**< Hash fingerprint. */
+		uint16_t	psl:7;		/**< Probe sequence length. */
+		uint16_t	used:1;		/**< Is this bucket in use? */
+	};
+	uint16_t		all;		/**< All 16 bits. */
+};
+
+/**
+ * @private
+ * Slab of indirect entries.
+ *
+ * The header is followed by the entries, starting at the first multiple of the
+ * entry alignment.
+ */
+struct sht_slab {
+	struct sht_slab	*next;		/**< Next slab. */
+};
+
+/**
+ * @private
+ * A chunk of a table's resource arena.
+ *
+ * The chunk header is followed by memory that is allocated by sht_bulk_alloc(),
+ * starting at offset `alignof(max_align_t)`.
+ */
+struct sht_chunk {
+	struct sht_chunk *next;		/**< Next chunk. */
+};
+
 /**
  * @private
  * A hash table.
@@ -84,19 +215,93 @@ struct sht_ht {
 	//
 	union sht_bckt	*buckets;	/**< Array of SHT buckets. */
 	uint8_t		*entries;	/**< Array of entries. */
+	uint8_t		*keys;		/**< Array of keys (or `NULL`). */
+	bool		in_buf;		/**< Arrays in caller's buffer? */
+	//
+	// Set only if the caller provides a buffer for the initial arrays.
+	//
+	uint8_t		*buf;		/**< Caller-provided buffer. */
+	size_t		buf_size;	/**< Size of caller-provided buffer. */
 	//
-	// The next 9 members don't change once the table is initialized.
+	// Set only if the arrays are mapped from a file or shared memory.
 	//
-	sht_hashfn_t	hashfn;		/**< Hash function. */
+	void		*map;		/**< File mapping. */
+	size_t		map_size;	/**< Size of file mapping. */
+	struct sht_fhdr	*fhdr;		/**< File header (start of mapping). */
+	bool		read_only;	/**< Table mapped by sht_map(). */
+	//
+	// Set only after the table has been checkpointed.
+	//
+	uint64_t	*dirty;		/**< Bitmap of modified file pages. */
+	uint64_t	ckpt_boff;	/**< File offset of bucket array. */
+	uint64_t	ckpt_eoff;	/**< File offset of entry array. */
+	uint32_t	ckpt_gen;	/**< Last checkpoint generation. */
+	uint64_t	ckpt_id;	/**< Random checkpoint identifier. */
+	//
+	// Used only if the table stores its entries indirectly.
+	//
+	struct sht_slab	*slabs;		/**< Slabs of indirect entries. */
+	uint8_t		*free_list;	/**< Unused indirect entries. */
+	//
+	// Used only if the table has a blob arena.
+	//
+	uint8_t		*arena;		/**< Blob arena. */
+	uint8_t		*a_entry;	/**< Entry being inserted. */
+	uint32_t	a_size;		/**< Size of the arena. */
+	uint32_t	a_len;		/**< Bytes used in the arena. */
+	bool		a_pending;	/**< Insertion in progress? */
+	//
+	// Used only if the table frees its entries' resources in bulk.
+	//
+	struct sht_chunk *chunks;	/**< Resource arena chunks. */
+	uint8_t		*r_next;	/**< Next free byte in chunk. */
+	size_t		r_left;		/**< Free bytes in chunk. */
+	size_t		r_csize;	/**< Size of next chunk. */
+	//
+	// Used only if the table is a cache.
+	//
+	uint8_t		*refs;		/**< CLOCK reference bits. */
+	uint32_t	hand;		/**< CLOCK hand (position). */
+	//
+	// Used only after a deadline has been set for an entry.
+	//
+	uint64_t	*ttl;		/**< Deadlines and deadline index. */
+	uint64_t	now;		/**< Time of last expiry pass. */
+	uint64_t	t_rehash;	/**< Deadline of rehashed entry. */
+	//
+	// The next 31 members don't change once the table is initialized.
+	//
+	sht_hashfn_t	hashfn;		/**< Hash function (or NULL). */
 	void		*hash_ctx;	/**< Context for hash function. */
-	sht_eqfn_t	eqfn;		/**< Equality function. */
+	sht_eqfn_t	eqfn;		/**< Equality function (or NULL). */
 	void		*eq_ctx;	/**< Context for equality function. */
 	sht_freefn_t	freefn;		/**< Entry resource free function. */
 	void		*free_ctx;	/**< Context for free function. */
 	uint32_t	esize;		/**< Size of each entry in the table. */
 	uint32_t	ealign;		/**< Alignment of table entries. */
+	uint32_t	ssize;		/**< Size of each entry array slot. */
+	uint32_t	osize;		/**< Indirect entry size (in slab). */
+	uint32_t	slab_n;		/**< Indirect entries per slab. */
+	bool		indirect;	/**< Entries stored indirectly? */
+	bool		inplace;	/**< In caller-provided storage? */
 	uint32_t	lft;		/**< Load factor threshold * 100. */
+	uint32_t	koff;		/**< Offset of key within entry. */
+	uint32_t	ksize;		/**< Size of key (0 = use eqfn). */
+	bool		karray;		/**< Separate key array? */
 	uint8_t		psl_limit;	/**< Maximum allowed PSL. */
+	uint8_t		bsize;		/**< Size of each bucket. */
+	bool		compact;	/**< Compact (16-bit) buckets? */
+	bool		ikeys;		/**< Integer keys in buckets? */
+	bool		blobs;		/**< String keys in a blob arena? */
+	uint32_t	voff;		/**< Offset of value blob (or max). */
+	bool		bulk_free;	/**< Free resources in bulk? */
+	uint32_t	cache_max;	/**< Maximum entries (0 = no cache). */
+	sht_evictfn_t	evictfn;	/**< Eviction function (or NULL). */
+	void		*evict_ctx;	/**< Context for eviction function. */
+	uint8_t		line_n;		/**< Positions per line (or 0). */
+	uint8_t		line_eoff;	/**< Offset of entries in line. */
+	uint32_t	line_magic;	/**< 2^32 / line_n (rounded up). */
+	bool		plain;		/**< Default layout? (sht_plain()) */
 	//
 	// The next 3 members change whenever the arrays are (re)allocated.
 	//
@@ -117,6 +322,10 @@ struct sht_ht {
 	uint16_t	iter_lock;	/**< Iterator lock. */
 };
 
+// An embedded table is stored in a struct sht_storage
+static_assert(sizeof(struct sht_ht) <= sizeof(struct sht_storage));
+static_assert(alignof(struct sht_ht) <= alignof(struct sht_storage));
+
 /**
  * @private
  * Hash table iterator.
@@ -128,6 +337,54 @@ struct sht_iter {
 	enum sht_iter_type	type;	/**< Type of iterator (ro/rw). */
 };
 
+/**
+ * @private
+ * Table file header.
+ *
+ * The header is followed by the bucket array (at offset @p b_offset) and the
+ * entry array (at offset @p e_offset).  Files use the native byte order and
+ * bucket layout, so they can only be used on the platform on which they were
+ * created.
+ *
+ * In a shared table (see sht_init_shared()), the writer keeps the statistics
+ * in the header up to date, and @p seq is a sequence lock; it is odd while the
+ * writer is modifying the table.
+ *
+ * @p ckpt_id identifies the table, and @p ckpt_gen identifies the checkpoint
+ * (see sht_checkpoint()) that last wrote the file.  Both are zero in files that
+ * were written by sht_save().
+ */
+struct sht_fhdr {
+	uint32_t	magic;		/**< SHT_FILE_MAGIC. */
+	uint32_t	version;	/**< SHT_FILE_VERSION. */
+	uint32_t	esize;		/**< Size of each entry in the table. */
+	uint32_t	ealign;		/**< Alignment of table entries. */
+	uint32_t	lft;		/**< Load factor threshold * 100. */
+	uint32_t	tsize;		/**< Number of buckets (table size). */
+	uint32_t	count;		/**< Number of occupied buckets. */
+	uint32_t	psl_sum;	/**< Sum of all PSLs. */
+	uint32_t	max_psl_ct;	/**< Number of entries with max PSL. */
+	_Atomic uint32_t seq;		/**< Shared table sequence number. */
+	uint8_t		psl_limit;	/**< Maximum allowed PSL. */
+	uint8_t		peak_psl;	/**< Largest PSL in table. */
+	uint8_t		reserved[2];	/**< Reserved (zero). */
+	uint32_t	ckpt_gen;	/**< Checkpoint generation. */
+	uint64_t	ckpt_id;	/**< Checkpointed table identifier. */
+	uint64_t	b_offset;	/**< File offset of bucket array. */
+	uint64_t	e_offset;	/**< File offset of entry array. */
+	uint64_t	size;		/**< Total file size. */
+};
+
+/**
+ * @private
+ * Output buffer used by sht_save().
+ */
+struct sht_wbuf {
+	int		fd;			/**< Output file descriptor. */
+	size_t		len;			/**< Bytes in buffer. */
+	uint8_t		data[SHT_WBUF_SIZE];	/**< Buffered data. */
+};
+
 /**
  * Default critical error printing function.
  *
@@ -194,6 +451,9 @@ const char *sht_msg(enum sht_err err)
 		[SHT_ERR_ITER_LOCK]	= "Can't acquire iterator lock",
 		[SHT_ERR_ITER_COUNT]	= "Table has too many iterators",
 		[SHT_ERR_ITER_NO_LAST]	= "Iterator at beginning or end",
+		[SHT_ERR_COPY]		= "Entry copy function failed",
+		[SHT_ERR_IO]		= "I/O error",
+		[SHT_ERR_BAD_FILE]	= "Invalid or incompatible table file",
 	};
 
 	/* Ensure that we have a message for every code. */
@@ -255,6 +515,64 @@ static void sht_assert_nonnull(void (*p)(void), const char *msg)
 		sht_abort(msg);
 }
 
+/**
+ * Set up a new hash table.
+ *
+ * @param	ht	The (zero-filled) table to be set up.
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	esize	The size of the entries to be stored in the table.
+ * @param	ealign	The alignment of the entries to be stored in the table.
+ */
+static void sht_setup_ht(struct sht_ht *ht, sht_hashfn_t hashfn,
+			 sht_eqfn_t eqfn, sht_freefn_t freefn, size_t esize,
+			 size_t ealign)
+{
+	ht->hashfn = hashfn;
+	ht->eqfn = eqfn;
+	ht->freefn = freefn;
+	ht->esize = esize;
+	ht->ealign = ealign;
+	ht->ssize = esize;
+	ht->bsize = sizeof(union sht_bckt);
+	ht->plain = 1;
+	ht->lft = SHT_DEF_LFT;
+	ht->psl_limit = SHT_DEF_PSL_LIMIT;
+}
+
+/**
+ * Allocate and set up a new hash table.
+ *
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	esize	The size of the entries to be stored in the table.
+ * @param	ealign	The alignment of the entries to be stored in the table.
+ * @param[out]	err	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table is returned.  On
+ *		error, `NULL` is returned, and an error code is returned in
+ *		@p err (if it is not `NULL`).
+ */
+static struct sht_ht *sht_alloc_ht(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
+				   sht_freefn_t freefn, size_t esize,
+				   size_t ealign, enum sht_err *err)
+{
+	struct sht_ht *ht;
+
+	if ((ht = calloc(1, sizeof *ht)) == nullptr) {
+		err != nullptr && (*err = SHT_ERR_ALLOC);
+		return nullptr;
+	}
+
+	sht_setup_ht(ht, hashfn, eqfn, freefn, esize, ealign);
+
+	return ht;
+}
+
 /**
  * Create a new hash table (call via SHT_NEW()).
  *
@@ -284,8 +602,6 @@ struct sht_ht *sht_new_(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
 			sht_freefn_t freefn, size_t esize,
 			size_t ealign, enum sht_err *err)
 {
-	struct sht_ht *ht;
-
 	sht_assert_nonnull((void (*)(void))hashfn,
 			   "sht_new_: hashfn must not be NULL");
 	sht_assert_nonnull((void (*)(void))eqfn,
@@ -300,68 +616,262 @@ struct sht_ht *sht_new_(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
 		return nullptr;
 	}
 
-	if ((ht = calloc(1, sizeof *ht)) == nullptr) {
-		err != nullptr && (*err = SHT_ERR_ALLOC);
-		return nullptr;
-	}
-
-	ht->hashfn = hashfn;
-	ht->eqfn = eqfn;
-	ht->freefn = freefn;
-	ht->esize = esize;
-	ht->ealign = ealign;
-	ht->lft = SHT_DEF_LFT;
-	ht->psl_limit = SHT_DEF_PSL_LIMIT;
-
-	return ht;
+	return sht_alloc_ht(hashfn, eqfn, freefn, esize, ealign, err);
 }
 
 /**
- * Set the "context" for a table's hash function.
- *
- * Sets the value of the @p context argument for all calls to the table's hash
- * function.
+ * Create a new keyed hash table (call via SHT_NEW_KEYED()).
  *
  * > **NOTE**
  * >
- * > This function cannot be called after the table has been initialized.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * > Do not call this function directly.  Use SHT_NEW_KEYED().
  *
- * @param	ht	The hash table.
- * @param	context	The function-specific context.
+ * Each entry of a keyed table contains a fixed-size key at a known offset.
+ * Keys are compared byte by byte (without calling an equality function), so a
+ * key passed to functions such as sht_get() must have the same representation
+ * as the key within an entry, and keys must not contain padding bytes with
+ * unspecified values.  Keys of 4, 8, or 16 bytes are compared with inline word
+ * comparisons.
  *
- * @see		sht_hashfn_t
- * @see		[Abort conditions](index.html#abort-conditions)
+ * If @p hashfn is `NULL`, the table hashes its keys with the library's
+ * built-in hash functions (see `sht-hash.h`).
+ *
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ *			(May be `NULL`.)
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	esize	The size of the entries to be stored in the table.
+ * @param	ealign	The alignment of the entries to be stored in the table.
+ * @param	koff	The offset of the key within an entry.
+ * @param	ksize	The size of the key.
+ * @param[out]	err	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table is returned.  On
+ *		error, `NULL` is returned, and an error code is returned in
+ *		@p err (if it is not `NULL`).
+ *
+ * @see		SHT_NEW_KEYED()
  */
-void sht_set_hash_ctx(struct sht_ht *ht, void *context)
+struct sht_ht *sht_new_keyed_(sht_hashfn_t hashfn, sht_freefn_t freefn,
+			      size_t esize, size_t ealign, size_t koff,
+			      size_t ksize, enum sht_err *err)
 {
-	if (ht->tsize != 0)
-		sht_abort("sht_set_hash_ctx: Table already initialized");
-	ht->hash_ctx = context;
+	struct sht_ht *ht;
+
+	if (!stdc_has_single_bit(ealign))
+		sht_abort("sht_new_keyed_: ealign not a power of 2");
+	if (esize % ealign != 0) {
+		sht_abort("sht_new_keyed_: "
+			  "Incompatible values of esize and ealign");
+	}
+	if (ksize == 0 || koff > esize || ksize > esize - koff)
+		sht_abort("sht_new_keyed_: Invalid key offset or size");
+
+	if (esize > SHT_MAX_ESIZE) {
+		err != nullptr && (*err = SHT_ERR_BAD_ESIZE);
+		return nullptr;
+	}
+
+	ht = sht_alloc_ht(hashfn, nullptr, freefn, esize, ealign, err);
+	if (ht == nullptr)
+		return nullptr;
+
+	ht->koff = koff;
+	ht->ksize = ksize;
+
+	return ht;
 }
 
 /**
- * Set the "context" for a table's equality function.
- *
- * Sets the value of the @p context argument for all calls to the table's
- * equality function.
+ * Create a hash table in caller-provided storage (call via SHT_INIT_INPLACE()).
  *
  * > **NOTE**
  * >
- * > This function cannot be called after the table has been initialized.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * > Do not call this function directly.  Use SHT_INIT_INPLACE().
  *
- * @param	ht	The hash table.
- * @param	context	The function-specific context.
+ * This function is equivalent to sht_new_(), except that the table is created
+ * in @p storage, rather than in dynamically allocated memory, so a table can be
+ * embedded in another object (or an array of tables can be laid out
+ * contiguously).  The table's arrays are still allocated separately (unless a
+ * buffer is provided with sht_set_buffer()).
  *
- * @see		sht_eqfn_t
- * @see		[Abort conditions](index.html#abort-conditions)
+ * The table must be freed with sht_free(), which frees the table's arrays and
+ * entry resources, but not @p storage.  @p storage must not be moved or copied
+ * while it contains a table.  (A copy of an embedded table can be created with
+ * sht_clone().)
+ *
+ * @param	storage	Storage for the table.
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	esize	The size of the entries to be stored in the table.
+ * @param	ealign	The alignment of the entries to be stored in the table.
+ * @param[out]	err	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table (within @p storage)
+ *		is returned.  On error, `NULL` is returned, and an error code is
+ *		returned in @p err (if it is not `NULL`).
+ *
+ * @see		SHT_INIT_INPLACE()
  */
-void sht_set_eq_ctx(struct sht_ht *ht, void *context)
+struct sht_ht *sht_init_inplace_(struct sht_storage *storage,
+				 sht_hashfn_t hashfn, sht_eqfn_t eqfn,
+				 sht_freefn_t freefn, size_t esize,
+				 size_t ealign, enum sht_err *err)
 {
-	if (ht->tsize != 0)
-		sht_abort("sht_set_eq_ctx: Table already initialized");
-	ht->eq_ctx = context;
+	struct sht_ht *ht;
+
+	sht_assert_nonnull((void (*)(void))hashfn,
+			   "sht_init_inplace_: hashfn must not be NULL");
+	sht_assert_nonnull((void (*)(void))eqfn,
+			   "sht_init_inplace_: eqfn must not be NULL");
+	if (!stdc_has_single_bit(ealign))
+		sht_abort("sht_init_inplace_: ealign not a power of 2");
+	if (esize % ealign != 0) {
+		sht_abort("sht_init_inplace_: "
+			  "Incompatible values of esize and ealign");
+	}
+
+	if (esize > SHT_MAX_ESIZE) {
+		err != nullptr && (*err = SHT_ERR_BAD_ESIZE);
+		return nullptr;
+	}
+
+	ht = (struct sht_ht *)(void *)storage;
+	memset(ht, 0, sizeof *ht);
+	sht_setup_ht(ht, hashfn, eqfn, freefn, esize, ealign);
+	ht->inplace = 1;
+
+	return ht;
+}
+
+/**
+ * Create a new hash table with indirect entries (call via SHT_NEW_INDIRECT()).
+ *
+ * > **NOTE**
+ * >
+ * > Do not call this function directly.  Use SHT_NEW_INDIRECT().
+ *
+ * The entries of a table created by this function are not stored in the
+ * table's entry array.  Each entry is allocated separately (from slabs of
+ * entries that are owned by the table), and the entry array holds pointers to
+ * the entries.  This has several consequences.
+ *
+ * * An entry does not move when other entries are added to or removed from the
+ *   table, or when the table is resized, so a pointer returned by sht_get() (or
+ *   an iterator) remains valid until that entry is removed from the table.
+ * * Moving an entry within the table (during insertion, removal, or rehashing)
+ *   copies a pointer, rather than the entry itself, so large entries are much
+ *   cheaper to add and remove.
+ * * Entries may be larger than #SHT_MAX_ESIZE (up to
+ *   #SHT_MAX_INDIRECT_ESIZE).
+ * * Each lookup follows an additional pointer, and each entry uses additional
+ *   memory (a pointer, plus any padding required by the entry's alignment).
+ * * The table cannot be saved to or mapped from a file, or shared.
+ *
+ * Otherwise, a table with indirect entries is used in exactly the same way as
+ * any other table.
+ *
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	esize	The size of the entries to be stored in the table.
+ * @param	ealign	The alignment of the entries to be stored in the table.
+ * @param[out]	err	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table is returned.  On
+ *		error, `NULL` is returned, and an error code is returned in
+ *		@p err (if it is not `NULL`).
+ *
+ * @see		SHT_NEW_INDIRECT()
+ */
+struct sht_ht *sht_new_indirect_(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
+				 sht_freefn_t freefn, size_t esize,
+				 size_t ealign, enum sht_err *err)
+{
+	struct sht_ht *ht;
+	size_t align;
+
+	sht_assert_nonnull((void (*)(void))hashfn,
+			   "sht_new_indirect_: hashfn must not be NULL");
+	sht_assert_nonnull((void (*)(void))eqfn,
+			   "sht_new_indirect_: eqfn must not be NULL");
+	if (!stdc_has_single_bit(ealign))
+		sht_abort("sht_new_indirect_: ealign not a power of 2");
+	if (esize % ealign != 0) {
+		sht_abort("sht_new_indirect_: "
+			  "Incompatible values of esize and ealign");
+	}
+
+	if (esize > SHT_MAX_INDIRECT_ESIZE) {
+		err != nullptr && (*err = SHT_ERR_BAD_ESIZE);
+		return nullptr;
+	}
+
+	ht = sht_alloc_ht(hashfn, eqfn, freefn, esize, ealign, err);
+	if (ht == nullptr)
+		return nullptr;
+
+	// Each entry in a slab must be able to hold a free list pointer
+	align = ealign > alignof(uint8_t *) ? ealign : alignof(uint8_t *);
+	ht->osize = esize > sizeof(uint8_t *) ? esize : sizeof(uint8_t *);
+	ht->osize = (ht->osize + align - 1) & ~(align - 1);
+	ht->slab_n = ht->osize < SHT_SLAB_SIZE ? SHT_SLAB_SIZE / ht->osize : 1;
+	ht->ssize = sizeof(uint8_t *);
+	ht->indirect = 1;
+	ht->plain = 0;
+
+	return ht;
+}
+
+/**
+ * Set the "context" for a table's hash function.
+ *
+ * Sets the value of the @p context argument for all calls to the table's hash
+ * function.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	context	The function-specific context.
+ *
+ * @see		sht_hashfn_t
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void sht_set_hash_ctx(struct sht_ht *ht, void *context)
+{
+	if (ht->tsize != 0)
+		sht_abort("sht_set_hash_ctx: Table already initialized");
+	ht->hash_ctx = context;
+}
+
+/**
+ * Set the "context" for a table's equality function.
+ *
+ * Sets the value of the @p context argument for all calls to the table's
+ * equality function.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	context	The function-specific context.
+ *
+ * @see		sht_eqfn_t
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void sht_set_eq_ctx(struct sht_ht *ht, void *context)
+{
+	if (ht->tsize != 0)
+		sht_abort("sht_set_eq_ctx: Table already initialized");
+	ht->eq_ctx = context;
 }
 
 /**
@@ -449,525 +959,4792 @@ void sht_set_psl_limit(struct sht_ht *ht, uint8_t limit)
 }
 
 /**
- * Allocate new arrays for a table.
+ * Store a table's keys in a separate array.
+ *
+ * By default, the equality function is called to compare a key with an entry
+ * whenever the (partial) hash of the key matches the hash of an entry in the
+ * table, so a lookup in a table with large entries can touch several cache
+ * lines (or pages) of entries that do not match.  If the key of each entry is a
+ * fixed-size object at a known offset within the entry, this function can be
+ * used to store a copy of every key in a separate, dense array.  Keys are then
+ * compared (with `memcmp()`) to the copies in the key array, and an entry is
+ * only accessed when its key matches.
+ *
+ * Because keys are compared byte by byte, a key passed to functions such as
+ * sht_get() must have the same representation as the key within an entry,
+ * and keys must not contain padding bytes with unspecified values.  The
+ * table's equality function is not called.
+ *
+ * The key array adds @p size bytes per bucket to the memory used by the table.
+ * (A table that is mapped from a file does not have a key array; its keys are
+ * compared to the keys within its entries.)
  *
- * Allocates memory for a table's `buckets` and `entries` arrays.  If allocation
- * is successful, `ht->tsize`, `ht->mask`, and `ht->thold` are updated for the
- * new size, and `ht->count`, `ht->psl_sum`, `ht->peak_psl`, and
- * `ht->max_psl_ct` are reset to 0. If an error occurs, the state of the table
- *  is unchanged.
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called with a key that does not fit within an entry (or, in a
+ * > keyed table, that is not the table's key).  (See
+ * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	tsize	The new size (total number of buckets) of the table.
+ * @param	offset	The offset of the key within an entry.
+ * @param	size	The size of the key.
  *
- * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
- *		returned, and the table's error status is set.  (The state of
- *		the table is otherwise unchanged.)
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-static bool sht_alloc_arrays(struct sht_ht *ht, uint32_t tsize)
+void sht_set_key_array(struct sht_ht *ht, size_t offset, size_t size)
 {
-	size_t b_size;	// size of bucket array
-	size_t e_size;	// size of entry array
-	size_t pad;	// padding to align entry array
-	size_t size;	// total size
-	uint8_t *new;
+	if (ht->tsize != 0)
+		sht_abort("sht_set_key_array: Table already initialized");
+	if (ht->ikeys)
+		sht_abort("sht_set_key_array: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_set_key_array: Table has a blob arena");
+	if (size == 0 || offset > ht->esize || size > ht->esize - offset
+			|| (ht->eqfn == nullptr
+				&& (offset != ht->koff || size != ht->ksize)))
+		sht_abort("sht_set_key_array: Invalid key offset or size");
+	ht->koff = offset;
+	ht->ksize = size;
+	ht->karray = 1;
+	ht->plain = 0;
+}
 
-	static_assert(SHT_MAX_TSIZE == 1 << 24);
-	static_assert(sizeof(union sht_bckt) == 4);
-	static_assert(alignof(union sht_bckt) == 4);
+/**
+ * Calculate the required alignment of a table's arrays.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	The alignment.
+ */
+static size_t sht_arrays_align(const struct sht_ht *ht)
+{
+	size_t align;
 
-	assert(tsize <= SHT_MAX_TSIZE);
+	if (ht->line_n != 0)
+		return SHT_LINE_SIZE;
 
-	b_size = tsize * sizeof(union sht_bckt);  /* Max result is 2^26 */
+	align = ht->indirect ? alignof(uint8_t *) : ht->ealign;
 
-	if (ckd_mul(&e_size, tsize, ht->esize)) {
-		ht->err = SHT_ERR_TOOBIG;
-		return 0;
-	}
+	return align > alignof(uint32_t) ? align : alignof(uint32_t);
+}
+
+/**
+ * Calculate the layout of the lines of an interleaved table.
+ *
+ * Each line holds as many positions (buckets and entry array slots) as
+ * possible.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	True (`1`) if at least 2 positions fit in a line, in which case
+ *		the table's line layout is set; otherwise false (`0`).
+ */
+static bool sht_line_layout(struct sht_ht *ht)
+{
+	uint32_t n, eoff, align;
 
-	pad = (ht->ealign - b_size % ht->ealign) % ht->ealign;
+	align = ht->indirect ? alignof(uint8_t *) : ht->ealign;
 
-	if (ckd_add(&size, b_size + pad, e_size)) {
-		ht->err = SHT_ERR_TOOBIG;
-		return 0;
+	for (n = SHT_LINE_SIZE / ht->bsize; n > 1; --n) {
+		eoff = n * ht->bsize;
+		eoff = (eoff + align - 1) & ~(align - 1);
+		if (eoff + n * ht->ssize <= SHT_LINE_SIZE)
+			break;
 	}
 
-	if ((new = malloc(size)) == nullptr) {
-		ht->err = SHT_ERR_ALLOC;
+	if (n < 2)
 		return 0;
-	}
-
-	// Mark all of the newly allocated buckets as empty.
-	memset(new, 0xff, b_size);
 
-	ht->buckets = (union sht_bckt *)(void *)new;
-	ht->entries = new + b_size + pad;
-	ht->tsize = tsize;
-	ht->mask = tsize - 1;			// e.g. 0x8000 - 1 = 0x7fff
-	ht->thold = tsize * ht->lft / 100;	// 2^24 * 100 < 2^32
-	ht->count = 0;
-	ht->psl_sum = 0;
-	ht->peak_psl = 0;
-	ht->max_psl_ct = 0;
+	ht->line_n = n;
+	ht->line_eoff = eoff;
+	ht->line_magic = ((UINT64_C(1) << 32) + n - 1) / n;
+	ht->plain = 0;
 
 	return 1;
 }
 
 /**
- * Initialize a hash table.
+ * Interleave a table's buckets and entries.
+ *
+ * By default, a table's buckets and entries are stored in separate arrays, so a
+ * successful lookup touches (at least) 2 cache lines, one in the bucket array
+ * and one in the entry array.  If a table's entries are small (no more than 28
+ * bytes), this function can be used to interleave its buckets and entries
+ * instead.  Each 64-byte cache line holds the buckets of a group of consecutive
+ * positions, followed by the entries at those positions, so a lookup usually
+ * touches only 1 cache line.  The number of positions in each line depends on
+ * the size and alignment of the table's entries; for example, a line holds 5
+ * 8-byte entries or 3 16-byte entries.
+ *
+ * Any space at the end of each line is unused, so an interleaved table uses
+ * more memory than a table with the default layout, and adding or removing
+ * entries is somewhat slower, because blocks of entries cannot be moved with a
+ * single `memmove()`.  A table with an interleaved layout cannot be saved to or
+ * mapped from a file, or shared, and a buffer provided with sht_set_buffer()
+ * must be aligned to a multiple of 64 bytes.
+ *
+ * (In a table with indirect entries, each line holds pointers to the entries,
+ * so the size limit does not apply.)
  *
- * @p capacity, along with the table's load factor threshold, is used to
- * calculate the minimum initial size of the table.  Setting an appropriate
- * initial size will avoid the need to resize the table as it grows (but will
- * consume unnecessary memory if fewer keys are stored in the table than
- * expected).
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called on a table whose entries are too large or whose buffer is
+ * > misaligned.  (See [Abort conditions](index.html#abort-conditions).)
  *
- * If @p capacity is `0`, a default initial capacity (currently `6`) is used.
+ * @param	ht	The hash table.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void sht_set_interleaved(struct sht_ht *ht)
+{
+	if (ht->tsize != 0)
+		sht_abort("sht_set_interleaved: Table already initialized");
+	if (!sht_line_layout(ht))
+		sht_abort("sht_set_interleaved: Entries too large");
+	if ((uintptr_t)ht->buf % SHT_LINE_SIZE != 0)
+		sht_abort("sht_set_interleaved: Misaligned buffer");
+}
+
+/**
+ * Use compact (16-bit) buckets in a table.
+ *
+ * Each bucket normally holds 24 bits of the hash of its entry's key, along
+ * with the entry's probe sequence length (PSL).  This function halves the size
+ * of a table's buckets by storing only an 8-bit fingerprint of each hash, so
+ * twice as many buckets fit in each cache line while a lookup probes the
+ * table.  This can significantly improve the performance of lookup-heavy
+ * workloads on tables whose bucket arrays do not fit in the CPU's caches.
+ *
+ * A fingerprint matches the hash of a different key more often than a 24-bit
+ * partial hash does, so keys are compared somewhat more often.  Also, the full
+ * hash of each entry must be recomputed (by calling the table's hash function)
+ * whenever the table is resized, so the table must have a key array, and this
+ * function must be called after sht_set_key_array().  A table with compact
+ * buckets cannot be saved to or mapped from a file, or shared.
  *
  * > **NOTE**
  * >
- * > If this function succeeds, it must not be called again on the same table.
- * > A failed call may be retried, possibly with a lower @p capacity.  (See
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called on a table that does not have a key array.  (See
  * > [Abort conditions](index.html#abort-conditions).)
  *
- * @param	ht		The hash table to be initialized.
- * @param	capacity	The initial capacity of the hash table (or `0`).
- *
- * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
- *		returned, and the table's error status is set.
+ * @param	ht	The hash table.
  *
+ * @see		sht_set_key_array()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-bool sht_init(struct sht_ht *ht, uint32_t capacity)
+void sht_set_compact(struct sht_ht *ht)
 {
 	if (ht->tsize != 0)
-		sht_abort("sht_init: Table already initialized");
-
-	// Initial check avoids overflow below (SHT_MAX_TSIZE = 2^24)
-	if (capacity > SHT_MAX_TSIZE) {
-		ht->err = SHT_ERR_TOOBIG;
-		return 0;
-	}
-
-	if (capacity == 0)
-		capacity = SHT_DEF_CAPCITY;
-
-	// Calculate required size at LFT (max result is less than 2^31)
-	capacity = (capacity * 100 + ht->lft - 1) / ht->lft;
-
-	// Find smallest power of 2 that is >= capacity (max result 2^31)
-	capacity = stdc_bit_ceil(capacity);
+		sht_abort("sht_set_compact: Table already initialized");
+	if (!ht->karray)
+		sht_abort("sht_set_compact: Table has no key array");
 
-	// Check final capacity
-	if (capacity > SHT_MAX_TSIZE) {
-		ht->err = SHT_ERR_TOOBIG;
-		return 0;
-	}
+	ht->compact = 1;
+	ht->bsize = sizeof(union sht_cbckt);
+	ht->plain = 0;
 
-	return sht_alloc_arrays(ht, capacity);
+	// Smaller buckets may allow more positions in each line
+	if (ht->line_n != 0)
+		sht_line_layout(ht);
 }
 
 /**
- * Get the number of entries in a table.
+ * Store a keyed table's integer keys in its buckets.
+ *
+ * A lookup normally compares the hash of a key with the partial hash in each
+ * bucket that it probes, and compares the key itself with the key in the
+ * matching entry (or in the table's key array).  If each key of a
+ * [keyed table](index.html#keyed-tables) is a 32- or 64-bit integer, this
+ * function can be used to store a copy of each key in its bucket, immediately
+ * after the entry's partial hash and probe sequence length (PSL).  A lookup
+ * then compares keys as integers, without reading any entries (or a separate
+ * key array) until it finds a match, so a lookup usually touches only the
+ * cache line that holds its bucket (and, if the key is found, the cache line
+ * that holds its entry).  Each bucket grows from 4 bytes to 8 or 12 bytes.
+ *
+ * If the table has an [interleaved layout](index.html#interleaved-layout),
+ * fewer positions fit in each line.  A table with integer keys cannot have a
+ * separate key array or compact buckets, and it cannot be saved to or mapped
+ * from a file, or shared.
  *
  * > **NOTE**
  * >
- * > This function cannot be called on an unitialized table.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called on a table that is not a keyed table with a 4- or 8-byte
+ * > key, a table that has a key array, or an interleaved table whose entries
+ * > are too large.  (See [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
  *
- * @returns	The number of entries in the table.
- *
+ * @see		sht_new_keyed_()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-uint32_t sht_size(const struct sht_ht *ht)
+void sht_set_int_keys(struct sht_ht *ht)
 {
-	if (ht->tsize == 0)
-		sht_abort("sht_size: Table not initialized");
-	return ht->count;
+	if (ht->tsize != 0)
+		sht_abort("sht_set_int_keys: Table already initialized");
+	if (ht->eqfn != nullptr || (ht->ksize != 4 && ht->ksize != 8))
+		sht_abort("sht_set_int_keys: Table keys are not integers");
+	if (ht->karray)
+		sht_abort("sht_set_int_keys: Table has a key array");
+	if (ht->blobs)
+		sht_abort("sht_set_int_keys: Table has a blob arena");
+
+	ht->ikeys = 1;
+	ht->bsize = sizeof(union sht_bckt) + ht->ksize;
+	ht->plain = 0;
+
+	// Larger buckets may not leave room for entries in each line
+	if (ht->line_n != 0 && !sht_line_layout(ht))
+		sht_abort("sht_set_int_keys: Entries too large");
 }
 
 /**
- * Determine whether a table is empty.
+ * Store a keyed table's string keys (and values) in a blob arena.
+ *
+ * A table's entries have a fixed size, so a table with string keys normally
+ * stores a pointer to each key, every key comparison reads a separately
+ * allocated string, and the table's free function must free each string.  This
+ * function gives a [keyed table](index.html#keyed-tables) whose key member is a
+ * struct sht_blob a table-owned *blob arena*, instead.  When an entry is added
+ * to the table, its key is copied into the arena, and the key member of the
+ * stored entry refers to that copy (by offset and length).  Each entry may also
+ * contain a value blob (another struct sht_blob), whose contents must be copied
+ * into the arena with sht_arena_add() before the entry is added to the table.
+ *
+ * The keys that are passed to table operations (sht_add(), sht_get(), etc.) are
+ * NUL-terminated strings, and the key member of an entry that is passed to
+ * sht_add() or sht_set() is ignored.  (The key blob of a stored entry is also
+ * NUL-terminated, so sht_blob() returns a usable string.)  If the table has no
+ * hash function, its keys are hashed with sht_hash_str().
+ *
+ * Arena space used by entries that are removed or replaced is reclaimed when
+ * the arena is compacted.  That happens whenever the table grows, and whenever
+ * the arena is full.  The arena is freed by sht_free(), so the table's free
+ * function (if any) must not free blobs.  A table with a blob arena cannot be
+ * saved to or mapped from a file, or shared.
  *
  * > **NOTE**
  * >
- * > This function cannot be called on an unitialized table.  (See
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called on a table that is not a keyed table whose key is a
+ * > struct sht_blob, on a table with a key array or integer keys, or with an
+ * > invalid value offset.  (See
  * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
+ * @param	voff	The offset of the value blob within an entry, or
+ *			#SHT_NO_BLOB if entries do not have a value blob.
  *
- * @returns	True (`1`) if the table is empty; false (`0`) if it has at least
- *		one entry.
- *
+ * @see		sht_new_keyed_()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-bool sht_empty(const struct sht_ht *ht)
+void sht_set_arena(struct sht_ht *ht, size_t voff)
 {
-	if (ht->tsize == 0)
-		sht_abort("sht_empty: Table not initialized");
-	return ht->count == 0;
+	const size_t bsize = sizeof(struct sht_blob);
+
+	if (ht->tsize != 0)
+		sht_abort("sht_set_arena: Table already initialized");
+	if (ht->eqfn != nullptr || ht->ksize != bsize)
+		sht_abort("sht_set_arena: Table key is not a blob");
+	if (ht->karray || ht->ikeys)
+		sht_abort("sht_set_arena: "
+			  "Table has a key array or integer keys");
+	if (voff != SHT_NO_BLOB && (voff > ht->esize - bsize
+				    || (voff < ht->koff + bsize
+					&& ht->koff < voff + bsize)))
+		sht_abort("sht_set_arena: Invalid value offset");
+
+	ht->blobs = 1;
+	ht->voff = voff == SHT_NO_BLOB ? UINT32_MAX : voff;
+	ht->plain = 0;
 }
 
 /**
- * Get the "peak" probe sequence length (PSL) of a table.
+ * Free a table's entry resources in bulk.
  *
- * The peak PSL is the highest PSL value of any entry in the table since the
- * time that the table was expanded (or created).  It provides an indication of
- * the performance of the table's hash function.
+ * Normally, sht_free() and sht_clear() call the table's free function (if any)
+ * for each entry in the table, which can take a long time for a large table.
+ * If this function is called, the table gets a *resource arena* from which
+ * entry resources (such as strings) can be allocated with sht_bulk_alloc().
+ * sht_free() and sht_clear() then release the entire arena at once, without
+ * calling the free function or scanning the table's buckets.
  *
- * At the default load factor threshold (85%), PSL values should generally
- * remain in the single digits, or the low teens at most, unless the hash
- * function being used is extremely poor.
+ * The free function (if any) is still called when an individual entry is
+ * removed or replaced, but it must not free memory that was allocated with
+ * sht_bulk_alloc().  That memory is only released when the table is cleared or
+ * freed.  A table that frees its resources in bulk cannot be cloned.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized.
+ * > (See [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
+ *
+ * @see		sht_bulk_alloc()
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-uint8_t sht_peak_psl(const struct sht_ht *ht)
+void sht_set_bulk_free(struct sht_ht *ht)
 {
-	return ht->peak_psl;
+	if (ht->tsize != 0)
+		sht_abort("sht_set_bulk_free: Table already initialized");
+
+	ht->bulk_free = 1;
+	ht->r_csize = SHT_CHUNK_MIN;
 }
 
 /**
- * Low level insert function.
+ * Make a table a fixed-size cache.
+ *
+ * A cache never holds more than @p max entries.  It is initialized with room
+ * for @p max entries (the capacity passed to sht_init() or sht_reserve() is
+ * ignored), so it normally never grows.  When the cache is full, sht_add() and
+ * sht_set() make room for a new key by evicting an entry, which is chosen by
+ * the CLOCK ("second chance") algorithm.
+ *
+ * Each position in the table has a reference bit, which is set when an entry is
+ * added to the table, found by sht_get(), or replaced by sht_set().  To choose
+ * a victim, the clock hand sweeps through the table, clearing the reference
+ * bits that are set, until it reaches an entry whose bit is already clear.
+ * Recently used entries are therefore skipped once, and the reference bits
+ * take 1 byte per position, rather than the list pointers of an LRU cache.
+ *
+ * If @p evictfn is not `NULL`, it is called for each evicted entry, before the
+ * entry is removed.  The entry is then freed by the table's free function (if
+ * any), exactly as if it had been deleted.  A cache cannot be saved to or
+ * mapped from a file, or shared.
  *
- * Copies candidate entry & bucket into table and updates table statistics.
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called with a @p max of `0`.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	c_entry	The entry to be inserted.
- * @param	c_bckt	The bucket to be inserted.
- * @param	o_entry	Destination for @p c_entry.
- * @param	o_bckt	Destination for @p c_bckt.
+ * @param	max	The maximum number of entries in the cache.
+ * @param	evictfn	Function called for each evicted entry (or `NULL`).
+ * @param	context	Optional context for @p evictfn.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-static void sht_set_entry(struct sht_ht *ht, const uint8_t *restrict c_entry,
-			  const union sht_bckt *restrict c_bckt,
-			  uint8_t *restrict o_entry,
-			  union sht_bckt *restrict o_bckt)
+void sht_set_cache(struct sht_ht *ht, uint32_t max, sht_evictfn_t evictfn,
+		   void *context)
 {
-	*o_bckt = *c_bckt;
-	memcpy(o_entry, c_entry, ht->esize);
-
-	ht->count++;
-	ht->psl_sum += c_bckt->psl;
-
-	if (c_bckt->psl > ht->peak_psl)
-		ht->peak_psl = c_bckt->psl;
-
-	if (c_bckt->psl == ht->psl_limit) {
-		ht->max_psl_ct++;
-		assert(ht->max_psl_ct < ht->thold);  // should be much lower
-	}
+	if (ht->tsize != 0)
+		sht_abort("sht_set_cache: Table already initialized");
+	if (max == 0)
+		sht_abort("sht_set_cache: Invalid maximum size");
+
+	ht->cache_max = max;
+	ht->evictfn = evictfn;
+	ht->evict_ctx = context;
+	ht->plain = 0;
 }
 
 /**
- * Low level remove function.
+ * Provide a buffer for a table's initial arrays.
+ *
+ * By default, a table's arrays are allocated with `malloc()` when the table is
+ * initialized.  If a buffer is provided, and the table's initial arrays fit
+ * within it, sht_init() places the arrays in the buffer instead, so a small
+ * table that is embedded in another object (or on the stack) does not require
+ * a separate memory allocation.  (sht_buffer_size() calculates the size of the
+ * buffer that is required for a given capacity.)  If the arrays do not fit, the
+ * buffer is not used.
+ *
+ * If the table later grows beyond its initial size, its arrays are moved to
+ * memory allocated with `malloc()`, and the buffer is no longer used.  The
+ * buffer must remain valid until the table has been freed (or until it has
+ * grown), and it must not be used for any other purpose during that time.  The
+ * table never frees the buffer.
+ *
+ * The buffer must be aligned for both the table's entries and 32-bit integers
+ * (or to a multiple of 64 bytes, if the table has an interleaved layout; see
+ * sht_set_interleaved()).  A table that is mapped from a file or shared memory
+ * does not use its buffer.
  *
- * Copies entry & bucket from table to temporary storage and updates table
- * statistics.
+ * > **NOTE**
+ * >
+ * > This function cannot be called after the table has been initialized, nor
+ * > can it be called with a misaligned buffer.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	o_entry	The entry to be removed.
- * @param	o_bckt	The bucket to be removed.
- * @param	t_entry	Destination for @p o_entry.
- * @param	t_bckt	Destination for @p o_bckt.
+ * @param	buf	The buffer.
+ * @param	size	The size of the buffer.
+ *
+ * @see		sht_buffer_size()
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-static void sht_remove_entry(struct sht_ht *ht, const uint8_t *restrict o_entry,
-			     const union sht_bckt *restrict o_bckt,
-			     uint8_t *restrict t_entry,
-			     union sht_bckt *restrict t_bckt)
+void sht_set_buffer(struct sht_ht *ht, void *buf, size_t size)
 {
-	*t_bckt = *o_bckt;
-	memcpy(t_entry, o_entry, ht->esize);
+	if (ht->tsize != 0)
+		sht_abort("sht_set_buffer: Table already initialized");
 
-	ht->count--;
-	ht->psl_sum -= o_bckt->psl;
+	if ((uintptr_t)buf % sht_arrays_align(ht) != 0)
+		sht_abort("sht_set_buffer: Misaligned buffer");
 
-	if (o_bckt->psl == ht->psl_limit) {
-		assert(ht->max_psl_ct > 0);
-		ht->max_psl_ct--;
-	}
+	ht->buf = buf;
+	ht->buf_size = size;
 }
 
 /**
- * Finds or inserts the specified key or entry in the table.
+ * Calculate the layout of a table's arrays.
  *
- * Implements the core "Robin Hood" probing algorithm, used for lookup and
+ * The arrays are allocated as a single block of memory, which contains the
+ * bucket array, the key array (if the table has one), padding to align the
+ * entry array, and the entry array.
+ *
+ * In a table with an interleaved layout (see sht_set_interleaved()), the block
+ * begins with the lines that hold the table's buckets and entries, followed by
+ * the key array (if any) and padding to a multiple of the line size.  The
+ * bucket "array" begins at the start of the block, and the entry "array" begins
+ * at the offset of the entries within the first line.
+ *
+ * @param	ht	The hash table.
+ * @param	tsize	The size (total number of buckets) of the table.
+ * @param[out]	k_off	Offset of the key array.
+ * @param[out]	e_off	Offset of the entry array.
+ * @param[out]	size	Total size of the arrays.
+ *
+ * @returns	On success, true (`1`) is returned.  If the arrays are too
+ *		large, false (`0`) is returned, and the table's error status is
+ *		set.
+ */
+static bool sht_arrays_layout(struct sht_ht *ht, uint32_t tsize,
+			      size_t *k_off, size_t *e_off, size_t *size)
+{
+	size_t b_size;	// size of bucket array
+	size_t k_size;	// size of key array
+	size_t e_size;	// size of entry array
+	size_t pad;	// padding to align entry array
+	size_t align;	// alignment of entry array
+
+	static_assert(SHT_MAX_TSIZE == 1 << 24);
+	static_assert(sizeof(union sht_bckt) == 4);
+	static_assert(alignof(union sht_bckt) == 4);
+	static_assert(sizeof(union sht_cbckt) == 2);
+
+	assert(tsize <= SHT_MAX_TSIZE);
+
+	if (ht->line_n != 0) {
+
+		// Max result is 2^23 lines * 64 (line_n >= 2)
+		b_size = (tsize + ht->line_n - 1) / ht->line_n * SHT_LINE_SIZE;
+
+		if (ckd_mul(&k_size, tsize, ht->karray ? ht->ksize : 0)
+				|| ckd_add(size, b_size, k_size)
+				|| ckd_add(size, *size, SHT_LINE_SIZE - 1)) {
+			ht->err = SHT_ERR_TOOBIG;
+			return 0;
+		}
+
+		*size &= ~(size_t)(SHT_LINE_SIZE - 1);
+		*k_off = b_size;
+		*e_off = ht->line_eoff;
+
+		return 1;
+	}
+
+	b_size = tsize * ht->bsize;  /* Max result is 2^26 */
+
+	if (ckd_mul(&e_size, tsize, ht->ssize)
+			|| ckd_mul(&k_size, tsize, ht->karray ? ht->ksize : 0)
+			|| ckd_add(size, b_size, k_size)) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	align = ht->indirect ? alignof(uint8_t *) : ht->ealign;
+	pad = (align - *size % align) % align;
+
+	*k_off = b_size;
+	*e_off = *size + pad;
+
+	if (ckd_add(size, *e_off, e_size)) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Allocate memory for a table's arrays.
+ *
+ * The arrays of a table with an interleaved layout are aligned to the line
+ * size.  Zero-filled memory (in which every bucket is empty) is obtained from
+ * `calloc()` when possible, so the pages of a large, sparsely populated table
+ * are not touched until they are used.
+ *
+ * @param	ht	The hash table.
+ * @param	size	The size of the arrays (see sht_arrays_layout()).
+ * @param	zero	Should the memory be zero-filled?
+ *
+ * @returns	On success, a pointer to the memory is returned.  On failure,
+ *		`NULL` is returned.
+ */
+static uint8_t *sht_arrays_alloc(const struct sht_ht *ht, size_t size,
+				 bool zero)
+{
+	uint8_t *new;
+
+	if (ht->line_n == 0)
+		return zero ? calloc(1, size) : malloc(size);
+
+	new = aligned_alloc(SHT_LINE_SIZE, size);
+	if (zero && new != nullptr)
+		memset(new, 0, size);
+
+	return new;
+}
+
+/**
+ * Allocate new arrays for a table.
+ *
+ * Allocates memory for a table's `buckets`, `keys` (if the table has a key
+ * array), and `entries` arrays.  If allocation is successful, `ht->tsize`,
+ * `ht->mask`, and `ht->thold` are updated for the new size, and `ht->count`,
+ * `ht->psl_sum`, `ht->peak_psl`, and `ht->max_psl_ct` are reset to 0. If an
+ * error occurs, the state of the table is unchanged.
+ *
+ * When a table is initialized, its arrays are placed in the caller-provided
+ * buffer (see sht_set_buffer()), if it has one and the arrays fit.
+ *
+ * @param	ht	The hash table.
+ * @param	tsize	The new size (total number of buckets) of the table.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (The state of
+ *		the table is otherwise unchanged.)
+ */
+static bool sht_alloc_arrays(struct sht_ht *ht, uint32_t tsize)
+{
+	size_t k_off, e_off, size;
+	uint8_t *new;
+	bool in_buf;
+
+	if (!sht_arrays_layout(ht, tsize, &k_off, &e_off, &size))
+		return 0;
+
+	in_buf = ht->tsize == 0 && ht->buf != nullptr && size <= ht->buf_size;
+
+	// Mark all of the new buckets as empty.  (The key array follows the
+	// buckets, or the lines of an interleaved table.)
+	if (in_buf) {
+		new = ht->buf;
+		memset(new, 0, k_off);
+	}
+	else if ((new = sht_arrays_alloc(ht, size, 1)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return 0;
+	}
+
+	ht->buckets = (union sht_bckt *)(void *)new;
+	ht->keys = ht->karray ? new + k_off : nullptr;
+	ht->entries = new + e_off;
+	ht->in_buf = in_buf;
+	ht->tsize = tsize;
+	ht->mask = tsize - 1;			// e.g. 0x8000 - 1 = 0x7fff
+	ht->thold = tsize * ht->lft / 100;	// 2^24 * 100 < 2^32
+	ht->count = 0;
+	ht->psl_sum = 0;
+	ht->peak_psl = 0;
+	ht->max_psl_ct = 0;
+
+	return 1;
+}
+
+/**
+ * Calculate the table size required for a given capacity.
+ *
+ * @p capacity, along with the table's load factor threshold, is used to
+ * calculate the minimum size (a power of 2) of a table that can hold
+ * @p capacity entries without being expanded.
+ *
+ * @param	ht		The hash table.
+ * @param	capacity	The required capacity (or `0`, for the default
+ *				initial capacity).
+ * @param[out]	tsize		The required table size.
+ *
+ * @returns	On success, true (`1`) is returned, and the required table size
+ *		is stored in @p tsize.  On failure, false (`0`) is returned,
+ *		and the table's error status is set.
+ */
+static bool sht_capacity_tsize(struct sht_ht *ht, uint32_t capacity,
+			       uint32_t *tsize)
+{
+	// A cache always has room for its maximum size (and no more)
+	if (ht->cache_max != 0)
+		capacity = ht->cache_max;
+
+	// Initial check avoids overflow below (SHT_MAX_TSIZE = 2^24)
+	if (capacity > SHT_MAX_TSIZE) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	if (capacity == 0)
+		capacity = SHT_DEF_CAPCITY;
+
+	// Calculate required size at LFT (max result is less than 2^31)
+	capacity = (capacity * 100 + ht->lft - 1) / ht->lft;
+
+	// Find smallest power of 2 that is >= capacity (max result 2^31)
+	capacity = stdc_bit_ceil(capacity);
+
+	// Check final capacity
+	if (capacity > SHT_MAX_TSIZE) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	*tsize = capacity;
+	return 1;
+}
+
+/**
+ * Allocate a table's blob arena.
+ *
+ * Also allocates the buffer in which an entry is prepared for insertion (see
+ * sht_arena_prep()).  (If sht_init() fails, these allocations are kept for the
+ * next attempt.)
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
+ */
+static bool sht_arena_init(struct sht_ht *ht)
+{
+	if (ht->arena == nullptr) {
+		if ((ht->arena = malloc(SHT_ARENA_MIN)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return 0;
+		}
+		ht->a_size = SHT_ARENA_MIN;
+	}
+
+	if (ht->a_entry == nullptr) {
+		if ((ht->a_entry = malloc(ht->esize)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Initialize a hash table.
+ *
+ * @p capacity, along with the table's load factor threshold, is used to
+ * calculate the minimum initial size of the table.  Setting an appropriate
+ * initial size will avoid the need to resize the table as it grows (but will
+ * consume unnecessary memory if fewer keys are stored in the table than
+ * expected).
+ *
+ * If @p capacity is `0`, a default initial capacity (currently `6`) is used.
+ *
+ * > **NOTE**
+ * >
+ * > If this function succeeds, it must not be called again on the same table.
+ * > A failed call may be retried, possibly with a lower @p capacity.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht		The hash table to be initialized.
+ * @param	capacity	The initial capacity of the hash table (or `0`).
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_init(struct sht_ht *ht, uint32_t capacity)
+{
+	uint32_t tsize;
+
+	if (ht->tsize != 0)
+		sht_abort("sht_init: Table already initialized");
+
+	if (!sht_capacity_tsize(ht, capacity, &tsize))
+		return 0;
+
+	if (ht->blobs && !sht_arena_init(ht))
+		return 0;
+
+	if (ht->cache_max != 0 && ht->refs == nullptr) {
+		if ((ht->refs = calloc(tsize, 1)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return 0;
+		}
+	}
+
+	return sht_alloc_arrays(ht, tsize);
+}
+
+/**
+ * Calculate the buffer size required for a table's initial arrays.
+ *
+ * Calculates the size of the buffer that sht_init() requires in order to place
+ * the table's initial arrays in a caller-provided buffer (see
+ * sht_set_buffer()), when it is called with the same @p capacity.  The result
+ * depends on the table's configuration (its entry size, load factor threshold,
+ * and key array), so this function should be called after the table has been
+ * configured.
+ *
+ * @param	ht		The hash table.
+ * @param	capacity	The initial capacity of the hash table (or `0`).
+ *
+ * @returns	On success, the required buffer size is returned.  On failure,
+ *		`0` is returned, and the table's error status is set.
+ *
+ * @see		sht_set_buffer()
+ */
+size_t sht_buffer_size(struct sht_ht *ht, uint32_t capacity)
+{
+	size_t k_off, e_off, size;
+	uint32_t tsize;
+
+	if (!sht_capacity_tsize(ht, capacity, &tsize))
+		return 0;
+
+	if (!sht_arrays_layout(ht, tsize, &k_off, &e_off, &size))
+		return 0;
+
+	return size;
+}
+
+/**
+ * Begin a modification of a shared table.
+ *
+ * Makes the sequence number in the shared table header odd, so that readers
+ * (see sht_read()) will retry any lookup that overlaps the modification.  Does
+ * nothing if the table is not a shared table.
+ *
+ * @param	ht	The hash table.
+ *
+ * @see		sht_shm_write_end()
+ */
+static void sht_shm_write_begin(struct sht_ht *ht)
+{
+	uint32_t seq;
+
+	if (ht->fhdr == nullptr || ht->read_only)
+		return;
+
+	seq = atomic_load_explicit(&ht->fhdr->seq, memory_order_relaxed);
+	atomic_store_explicit(&ht->fhdr->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * End a modification of a shared table.
+ *
+ * Publishes the table's statistics in the shared table header and makes the
+ * sequence number even again.  Does nothing if the table is not a shared table.
+ *
+ * @param	ht	The hash table.
+ *
+ * @see		sht_shm_write_begin()
+ */
+static void sht_shm_write_end(struct sht_ht *ht)
+{
+	uint32_t seq;
+
+	if (ht->fhdr == nullptr || ht->read_only)
+		return;
+
+	ht->fhdr->count = ht->count;
+	ht->fhdr->psl_sum = ht->psl_sum;
+	ht->fhdr->max_psl_ct = ht->max_psl_ct;
+	ht->fhdr->peak_psl = ht->peak_psl;
+
+	seq = atomic_load_explicit(&ht->fhdr->seq, memory_order_relaxed);
+	atomic_store_explicit(&ht->fhdr->seq, seq + 1, memory_order_release);
+}
+
+/**
+ * Tell the CPU that the current thread is spinning.
+ *
+ * This reduces the power used by the spin loop, and it gives the CPU's
+ * resources to the other hardware thread (if any) on the same core, which
+ * may be the writer that the loop is waiting for.
+ */
+static void sht_cpu_relax(void)
+{
+#if defined __x86_64__ || defined __i386__
+	__builtin_ia32_pause();
+#elif defined __aarch64__
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * Begin a lookup in a shared table.
+ *
+ * If the writer is modifying the table, this function waits for the
+ * modification to complete.  It spins briefly and then yields the CPU between
+ * checks, so a writer that has been preempted can run.  If the writer process
+ * terminates during a modification, the modification never completes, and
+ * this function never returns (see sht_init_shared()).
+ *
+ * @param	hdr	The shared table header.
+ *
+ * @returns	The (even) sequence number at the start of the lookup.
+ *
+ * @see		sht_shm_read_end()
+ */
+static uint32_t sht_shm_read_begin(const struct sht_fhdr *hdr)
+{
+	uint32_t seq, spins;
+
+	// Wait for any modification in progress to complete
+	for (spins = 0; ; ++spins) {
+		seq = atomic_load_explicit(&hdr->seq, memory_order_acquire);
+		if (!(seq & 1))
+			return seq;
+		if (spins < SHT_SHM_SPINS)
+			sht_cpu_relax();
+		else
+			sched_yield();
+	}
+}
+
+/**
+ * End a lookup in a shared table.
+ *
+ * @param	hdr	The shared table header.
+ * @param	seq	The sequence number returned by sht_shm_read_begin().
+ *
+ * @returns	True (`1`) if the table was not modified during the lookup (so
+ *		its result is valid); false (`0`) if the lookup must be retried.
+ */
+static bool sht_shm_read_end(const struct sht_fhdr *hdr, uint32_t seq)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&hdr->seq, memory_order_relaxed) == seq;
+}
+
+/**
+ * Get the current number of entries in a table.
+ *
+ * If the table was mapped by sht_map() or sht_map_fd(), the count is read from
+ * the file header, because the table may be a shared table that is being
+ * modified by another process.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	The number of entries in the table.
+ */
+static uint32_t sht_count(const struct sht_ht *ht)
+{
+	uint32_t seq, count;
+
+	if (!ht->read_only)
+		return ht->count;
+
+	do {
+		seq = sht_shm_read_begin(ht->fhdr);
+		count = ht->fhdr->count;
+	} while (!sht_shm_read_end(ht->fhdr, seq));
+
+	return count;
+}
+
+/**
+ * Get the number of entries in a table.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	The number of entries in the table.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+uint32_t sht_size(const struct sht_ht *ht)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_size: Table not initialized");
+	return sht_count(ht);
+}
+
+/**
+ * Determine whether a table is empty.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	True (`1`) if the table is empty; false (`0`) if it has at least
+ *		one entry.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_empty(const struct sht_ht *ht)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_empty: Table not initialized");
+	return sht_count(ht) == 0;
+}
+
+/**
+ * Get the "peak" probe sequence length (PSL) of a table.
+ *
+ * The peak PSL is the highest PSL value of any entry in the table since the
+ * time that the table was expanded (or created).  It provides an indication of
+ * the performance of the table's hash function.
+ *
+ * At the default load factor threshold (85%), PSL values should generally
+ * remain in the single digits, or the low teens at most, unless the hash
+ * function being used is extremely poor.
+ *
+ * @param	ht	The hash table.
+ */
+uint8_t sht_peak_psl(const struct sht_ht *ht)
+{
+	return ht->peak_psl;
+}
+
+/**
+ * Get the line that holds a given position in an interleaved table.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position.
+ *
+ * @returns	The index of the line.
+ */
+static uint32_t sht_line(const struct sht_ht *ht, uint32_t pos)
+{
+	// Exact, because pos < 2^24 and line_n < 2^8
+	return ((uint64_t)pos * ht->line_magic) >> 32;
+}
+
+/**
+ * Get the address of the bucket at a given position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the bucket.
+ *
+ * @returns	A pointer to the bucket.
+ */
+static uint8_t *sht_bckt_addr(const struct sht_ht *ht, uint32_t pos)
+{
+	uint32_t line;
+
+	if (ht->line_n == 0)
+		return (uint8_t *)ht->buckets + (size_t)pos * ht->bsize;
+
+	line = sht_line(ht, pos);
+
+	return (uint8_t *)ht->buckets + (size_t)line * SHT_LINE_SIZE
+		+ (pos - line * ht->line_n) * ht->bsize;
+}
+
+/**
+ * Get the bucket at a given position.
+ *
+ * A compact bucket is returned as a regular bucket, whose hash is the
+ * fingerprint.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the bucket.
+ *
+ * @returns	The bucket.
+ */
+static union sht_bckt sht_bckt(const struct sht_ht *ht, uint32_t pos)
+{
+	union sht_cbckt cb;
+	union sht_bckt b;
+
+	if (!ht->compact)
+		return *(union sht_bckt *)(void *)sht_bckt_addr(ht, pos);
+
+	cb = *(union sht_cbckt *)(void *)sht_bckt_addr(ht, pos);
+	b.hash = cb.fp;
+	b.psl = cb.psl;
+	b.used = cb.used;
+
+	return b;
+}
+
+/**
+ * Change the bucket at a given position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the bucket.
+ * @param	b	The new bucket.  (In a table with compact buckets,
+ *			its hash is the fingerprint.)
+ */
+static void sht_set_bckt(struct sht_ht *ht, uint32_t pos, union sht_bckt b)
+{
+	union sht_cbckt cb;
+
+	if (!ht->compact) {
+		*(union sht_bckt *)(void *)sht_bckt_addr(ht, pos) = b;
+		return;
+	}
+
+	cb.fp = b.hash;
+	cb.psl = b.psl;
+	cb.used = b.used;
+	*(union sht_cbckt *)(void *)sht_bckt_addr(ht, pos) = cb;
+}
+
+/**
+ * Get the entry array slot at a given position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the slot.
+ *
+ * @returns	A pointer to the slot.
+ */
+static uint8_t *sht_slot(const struct sht_ht *ht, uint32_t pos)
+{
+	uint32_t line;
+
+	if (ht->line_n == 0)
+		return ht->entries + (size_t)pos * ht->ssize;
+
+	line = sht_line(ht, pos);
+
+	return ht->entries + (size_t)line * SHT_LINE_SIZE
+		+ (pos - line * ht->line_n) * ht->ssize;
+}
+
+/**
+ * Copy the bucket and entry array slot at one position to another position.
+ *
+ * (Keys in a separate key array are not copied; see sht_move_keys().)
+ *
+ * @param	ht	The hash table.
+ * @param	dest	Destination position.
+ * @param	src	Source position.
+ */
+static void sht_copy_pos(struct sht_ht *ht, uint32_t dest, uint32_t src)
+{
+	memcpy(sht_bckt_addr(ht, dest), sht_bckt_addr(ht, src), ht->bsize);
+	memcpy(sht_slot(ht, dest), sht_slot(ht, src), ht->ssize);
+}
+
+/**
+ * Mark the buckets at the beginning of a table as empty.
+ *
+ * @param	ht	The hash table.
+ * @param	n	The number of buckets to be marked empty.
+ */
+static void sht_empty_bckts(struct sht_ht *ht, uint32_t n)
+{
+	uint32_t i;
+
+	if (ht->line_n == 0) {
+		memset(ht->buckets, 0, (size_t)n * ht->bsize);
+		return;
+	}
+
+	for (i = 0; i < n; ++i)
+		memset(sht_bckt_addr(ht, i), 0, ht->bsize);
+}
+
+/**
+ * Get the entry stored in an entry array slot.
+ *
+ * For a table with indirect entries, each slot holds a pointer to the entry;
+ * otherwise, the slot is the entry.
+ *
+ * @param	ht	The hash table.
+ * @param	slot	The slot.
+ *
+ * @returns	A pointer to the entry.
+ */
+static const uint8_t *sht_slot_entry(const struct sht_ht *ht,
+				     const uint8_t *slot)
+{
+	if (ht->indirect)
+		memcpy(&slot, slot, sizeof slot);
+
+	return slot;
+}
+
+/**
+ * Get the entry at a given position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry.
+ *
+ * @returns	A pointer to the entry.
+ */
+static uint8_t *sht_entry(const struct sht_ht *ht, uint32_t pos)
+{
+	uint8_t *e;
+
+	e = sht_slot(ht, pos);
+
+	if (ht->indirect)
+		memcpy(&e, e, sizeof e);
+
+	return e;
+}
+
+/**
+ * Get the key stored in the bucket at a given position.
+ *
+ * (Only valid for a table with integer keys; see sht_set_int_keys().)
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the bucket.
+ *
+ * @returns	A pointer to the key, which immediately follows the bucket's
+ *		hash and PSL.
+ */
+static uint8_t *sht_bckt_key(const struct sht_ht *ht, uint32_t pos)
+{
+	return sht_bckt_addr(ht, pos) + sizeof(union sht_bckt);
+}
+
+/**
+ * Calculate the offset of the first entry in a slab.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	The offset of the first entry.
+ */
+static size_t sht_slab_offset(const struct sht_ht *ht)
+{
+	size_t align;
+
+	align = ht->ealign > alignof(uint8_t *) ? ht->ealign
+						: alignof(uint8_t *);
+
+	return (sizeof(struct sht_slab) + align - 1) & ~(align - 1);
+}
+
+/**
+ * Add all of the entries in a slab to a table's free list.
+ *
+ * @param	ht	The hash table.
+ * @param	slab	The slab.
+ */
+static void sht_slab_release(struct sht_ht *ht, struct sht_slab *slab)
+{
+	uint8_t *e;
+	uint32_t i;
+
+	e = (uint8_t *)slab + sht_slab_offset(ht)
+		+ (size_t)ht->slab_n * ht->osize;
+
+	// Push in reverse order, so entries are allocated in address order
+	for (i = 0; i < ht->slab_n; ++i) {
+		e -= ht->osize;
+		memcpy(e, &ht->free_list, sizeof e);
+		ht->free_list = e;
+	}
+}
+
+/**
+ * Allocate an indirect entry.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	On success, a pointer to the (uninitialized) entry is returned.
+ *		On failure, `NULL` is returned, and the table's error status is
+ *		set.
+ */
+static uint8_t *sht_pool_get(struct sht_ht *ht)
+{
+	struct sht_slab *slab;
+	size_t align, size;
+	uint8_t *e;
+
+	if (ht->free_list == nullptr) {
+
+		align = ht->ealign > alignof(max_align_t)
+				? ht->ealign : alignof(max_align_t);
+
+		// Can't overflow (slab_n == 1 if osize > SHT_SLAB_SIZE)
+		size = sht_slab_offset(ht) + (size_t)ht->slab_n * ht->osize;
+		size = (size + align - 1) & ~(align - 1);
+
+		if ((slab = aligned_alloc(align, size)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return nullptr;
+		}
+
+		slab->next = ht->slabs;
+		ht->slabs = slab;
+		sht_slab_release(ht, slab);
+	}
+
+	e = ht->free_list;
+	memcpy(&ht->free_list, e, sizeof e);
+
+	return e;
+}
+
+/**
+ * Return an indirect entry to a table's free list.
+ *
+ * @param	ht	The hash table.
+ * @param	e	The entry.
+ */
+static void sht_pool_put(struct sht_ht *ht, uint8_t *e)
+{
+	memcpy(e, &ht->free_list, sizeof e);
+	ht->free_list = e;
+}
+
+/**
+ * Return all of a table's indirect entries to its free list.
+ *
+ * @param	ht	The hash table.
+ */
+static void sht_pool_reset(struct sht_ht *ht)
+{
+	struct sht_slab *slab;
+
+	ht->free_list = nullptr;
+
+	for (slab = ht->slabs; slab != nullptr; slab = slab->next)
+		sht_slab_release(ht, slab);
+}
+
+/**
+ * Free all of a table's indirect entry slabs.
+ *
+ * @param	ht	The hash table.
+ */
+static void sht_pool_free(struct sht_ht *ht)
+{
+	struct sht_slab *slab;
+
+	while ((slab = ht->slabs) != nullptr) {
+		ht->slabs = slab->next;
+		free(slab);
+	}
+
+	ht->free_list = nullptr;
+}
+
+/**
+ * Free all of the chunks of a table's resource arena.
+ *
+ * @param	ht	The hash table.
+ */
+static void sht_chunks_free(struct sht_ht *ht)
+{
+	struct sht_chunk *chunk;
+
+	while ((chunk = ht->chunks) != nullptr) {
+		ht->chunks = chunk->next;
+		free(chunk);
+	}
+
+	ht->r_next = nullptr;
+	ht->r_left = 0;
+	ht->r_csize = SHT_CHUNK_MIN;
+}
+
+/**
+ * Copy a blob into a new arena, and update the reference to it.
+ *
+ * @param	ht	The hash table.
+ * @param	new	The new arena.
+ * @param	len	The number of bytes used in the new arena.
+ * @param	ref	The blob reference (within an entry).
+ * @param	nul	Is the blob followed by a NUL?  (Keys are.)
+ *
+ * @returns	The number of bytes used in the new arena.
+ */
+static uint32_t sht_blob_move(const struct sht_ht *ht, uint8_t *new,
+			      uint32_t len, uint8_t *ref, bool nul)
+{
+	struct sht_blob b;
+
+	memcpy(&b, ref, sizeof b);
+	memcpy(new + len, ht->arena + b.off, b.len + nul);
+	b.off = len;
+	memcpy(ref, &b, sizeof b);
+
+	return len + b.len + nul;
+}
+
+/**
+ * Get the number of bytes in a table's blob arena that are in use.
+ *
+ * The blobs of the table's entries are in use, along with the value blob of an
+ * entry that is being inserted (if any).
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	The number of bytes in use.
+ */
+static uint64_t sht_arena_live(const struct sht_ht *ht)
+{
+	struct sht_blob b;
+	uint64_t live;
+	uint32_t i;
+	uint8_t *e;
+
+	for (i = 0, live = 0; i < ht->tsize; ++i) {
+
+		if (!sht_bckt(ht, i).used)
+			continue;
+
+		e = sht_entry(ht, i);
+		memcpy(&b, e + ht->koff, sizeof b);
+		live += b.len + 1;
+
+		if (ht->voff != UINT32_MAX) {
+			memcpy(&b, e + ht->voff, sizeof b);
+			live += b.len;
+		}
+	}
+
+	if (ht->a_pending && ht->voff != UINT32_MAX) {
+		memcpy(&b, ht->a_entry + ht->voff, sizeof b);
+		live += b.len;
+	}
+
+	return live;
+}
+
+/**
+ * Compact a table's blob arena into a new arena.
+ *
+ * The blobs that are in use (see sht_arena_live()) are copied into the new
+ * arena in table order, so the blobs of neighboring entries are adjacent.
+ *
+ * @param	ht	The hash table.
+ * @param	size	The size of the new arena.  Must be large enough to hold
+ *			the blobs that are in use.
+ *
+ * @returns	On success, true (`1`) is returned.  If memory allocation
+ *		fails, false (`0`) is returned, and the arena is unchanged.
+ *		(The table's error status is not set.)
+ */
+static bool sht_arena_compact(struct sht_ht *ht, uint32_t size)
+{
+	uint32_t i, len;
+	uint8_t *new, *e;
+
+	if ((new = malloc(size)) == nullptr)
+		return 0;
+
+	for (i = 0, len = 0; i < ht->tsize; ++i) {
+
+		if (!sht_bckt(ht, i).used)
+			continue;
+
+		e = sht_entry(ht, i);
+		len = sht_blob_move(ht, new, len, e + ht->koff, 1);
+
+		if (ht->voff != UINT32_MAX)
+			len = sht_blob_move(ht, new, len, e + ht->voff, 0);
+	}
+
+	if (ht->a_pending && ht->voff != UINT32_MAX)
+		len = sht_blob_move(ht, new, len, ht->a_entry + ht->voff, 0);
+
+	assert(len <= size);
+
+	free(ht->arena);
+	ht->arena = new;
+	ht->a_size = size;
+	ht->a_len = len;
+
+	return 1;
+}
+
+/**
+ * Ensure that a table's blob arena has room for a number of bytes.
+ *
+ * If the arena is full, it is compacted into a new arena that is at least
+ * twice as large as the blobs that are in use (including the new bytes).
+ *
+ * @param	ht	The hash table.
+ * @param	n	The number of bytes.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (The state of
+ *		the table is otherwise unchanged.)
+ */
+static bool sht_arena_reserve(struct sht_ht *ht, size_t n)
+{
+	uint64_t need, size;
+
+	if (n <= ht->a_size - ht->a_len)
+		return 1;
+
+	// Blob offsets and lengths are 32 bits
+	need = sht_arena_live(ht);
+	if (n > UINT32_MAX - need) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	need += n;
+
+	for (size = ht->a_size; size < need * 2; size *= 2)
+		;
+
+	if (size > UINT32_MAX)
+		size = UINT32_MAX;
+
+	if (!sht_arena_compact(ht, size)) {
+		ht->err = SHT_ERR_ALLOC;
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Check the value blob of an entry that will be stored in a table.
+ *
+ * @param	ht	The hash table.
+ * @param	entry	The entry.
+ * @param	msg	Abort message, if the value blob is not within the
+ *			table's blob arena.
+ */
+static void sht_arena_check(const struct sht_ht *ht, const uint8_t *entry,
+			    const char *msg)
+{
+	struct sht_blob b;
+
+	if (ht->voff == UINT32_MAX)
+		return;
+
+	memcpy(&b, entry + ht->voff, sizeof b);
+
+	if (b.off > ht->a_len || b.len > ht->a_len - b.off)
+		sht_abort(msg);
+}
+
+/**
+ * Prepare an entry for insertion into a table with a blob arena.
+ *
+ * Copies the entry into the table's insertion buffer, reserves room in the
+ * arena for its key, and sets the entry's key blob to refer to that room.  The
+ * key is copied into the arena by sht_arena_commit(), only if the entry is
+ * actually added to the table.  (The entry's value blob must already have been
+ * checked; see sht_arena_check().)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key of the new entry.
+ * @param	entry	The new entry.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
+ */
+static bool sht_arena_prep(struct sht_ht *ht, const char *key,
+			   const void *entry)
+{
+	struct sht_blob b;
+	size_t klen;
+
+	memcpy(ht->a_entry, entry, ht->esize);
+
+	// Protects the entry's value blob if the arena is compacted
+	ht->a_pending = 1;
+
+	klen = strlen(key);
+	if (!sht_arena_reserve(ht, klen + 1)) {
+		ht->a_pending = 0;
+		return 0;
+	}
+
+	b.off = ht->a_len;
+	b.len = klen;
+	memcpy(ht->a_entry + ht->koff, &b, sizeof b);
+
+	return 1;
+}
+
+/**
+ * Copy the key of a newly inserted entry into a table's blob arena.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key of the new entry.
+ */
+static void sht_arena_commit(struct sht_ht *ht, const char *key)
+{
+	struct sht_blob b;
+
+	memcpy(&b, ht->a_entry + ht->koff, sizeof b);
+	assert(b.off == ht->a_len && b.len + 1 <= ht->a_size - ht->a_len);
+
+	memcpy(ht->arena + b.off, key, b.len + 1);
+	ht->a_len += b.len + 1;
+	ht->a_pending = 0;
+}
+
+/**
+ * Overwrite an existing entry in a table.
+ *
+ * In a table with a blob arena, the entry keeps its key blob.
+ *
+ * @param	ht	The hash table.
+ * @param	dest	The existing entry.
+ * @param	src	The new entry.
+ */
+static void sht_overwrite(const struct sht_ht *ht, uint8_t *dest,
+			  const void *src)
+{
+	struct sht_blob kb;
+
+	if (!ht->blobs) {
+		memcpy(dest, src, ht->esize);
+		return;
+	}
+
+	memcpy(&kb, dest + ht->koff, sizeof kb);
+	memcpy(dest, src, ht->esize);
+	memcpy(dest + ht->koff, &kb, sizeof kb);
+}
+
+/**
+ * Compare a string key with the key blob of an entry.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key.
+ * @param	ref	The key blob reference (within the entry).
+ *
+ * @returns	True (`1`) if the keys are equal; otherwise false (`0`).
+ */
+static bool sht_blob_eq(const struct sht_ht *ht, const char *key,
+			const uint8_t *ref)
+{
+	struct sht_blob b;
+
+	memcpy(&b, ref, sizeof b);
+
+	// Stops at the end of a shorter key
+	return strncmp(key, (const char *)ht->arena + b.off, b.len) == 0
+		&& key[b.len] == 0;
+}
+
+/**
+ * Compute the hash of a key.
+ *
+ * A keyed table without a hash function (see sht_new_keyed_()) hashes its
+ * keys with the built-in hash functions.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key.
+ *
+ * @returns	The hash of the key.
+ */
+static uint32_t sht_hash(const struct sht_ht *ht, const void *key)
+{
+	uint32_t k32;
+	uint64_t k64;
+
+	if (ht->hashfn != nullptr)
+		return ht->hashfn(key, ht->hash_ctx);
+
+	if (ht->blobs)
+		return sht_hash_str(key);
+
+	// Keys may not be aligned
+	switch (ht->ksize) {
+	case 4:
+		memcpy(&k32, key, sizeof k32);
+		return sht_hash_u32(&k32);
+	case 8:
+		memcpy(&k64, key, sizeof k64);
+		return sht_hash_u64(&k64);
+	default:
+		return sht_hash_bytes(key, ht->ksize);
+	}
+}
+
+/**
+ * Compare two fixed-size keys byte by byte.
+ *
+ * @param	ht	The hash table.
+ * @param	k1	The first key.
+ * @param	k2	The second key.
+ *
+ * @returns	True (`1`) if the keys are equal; otherwise false (`0`).
+ */
+static bool sht_bytes_eq(const struct sht_ht *ht, const void *k1,
+			 const void *k2)
+{
+	// With a constant size, the compiler inlines memcmp() as word compares
+	switch (ht->ksize) {
+	case 4:		return memcmp(k1, k2, 4) == 0;
+	case 8:		return memcmp(k1, k2, 8) == 0;
+	case 16:	return memcmp(k1, k2, 16) == 0;
+	default:	return memcmp(k1, k2, ht->ksize) == 0;
+	}
+}
+
+/**
+ * Compare a key with the key of the entry at a given position.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key.
+ * @param	pos	The position of the entry.
+ *
+ * @returns	True (`1`) if the keys are equal; otherwise false (`0`).
+ */
+static bool sht_key_eq(const struct sht_ht *ht, const void *key, uint32_t pos)
+{
+	const uint8_t *e;
+
+	if (ht->ikeys)
+		return sht_bytes_eq(ht, key, sht_bckt_key(ht, pos));
+
+	if (ht->keys != nullptr)
+		return sht_bytes_eq(ht, key, ht->keys + pos * ht->ksize);
+
+	e = sht_entry(ht, pos);
+
+	if (ht->blobs)
+		return sht_blob_eq(ht, key, e + ht->koff);
+
+	if (ht->ksize != 0)
+		return sht_bytes_eq(ht, key, e + ht->koff);
+
+	return ht->eqfn(key, e, ht->eq_ctx);
+}
+
+/**
+ * Calculate the number of blocks in a table's deadline index.
+ *
+ * @param	tsize	The size of the table.
+ *
+ * @returns	The number of blocks.
+ */
+static uint32_t sht_ttl_blocks(uint32_t tsize)
+{
+	return (tsize + SHT_TTL_BLOCK - 1) / SHT_TTL_BLOCK;
+}
+
+/**
+ * Calculate the number of values in a table's deadline array.
+ *
+ * @param	tsize	The size of the table.
+ *
+ * @returns	The number of values.
+ */
+static size_t sht_ttl_len(uint32_t tsize)
+{
+	uint32_t blocks = sht_ttl_blocks(tsize);
+
+	return (size_t)tsize + blocks + sht_ttl_blocks(blocks);
+}
+
+/**
+ * Allocate a table's deadline array.
+ *
+ * The array holds the deadline of the entry at each position (`0` if the entry
+ * has no deadline), followed by a 2-level index that is used to find expired
+ * entries without examining every position.  The first level holds the
+ * earliest deadline in each block of #SHT_TTL_BLOCK positions, and the second
+ * level holds the earliest deadline in each group of #SHT_TTL_BLOCK blocks.
+ *
+ * An index value is never later than any deadline in its block or group, but
+ * it may be earlier.  (Entries that are removed or moved are not subtracted
+ * from the index; the value is corrected by the next sht_expire() call that
+ * examines the block.)
+ *
+ * @param	tsize	The size of the table.
+ *
+ * @returns	On success, a pointer to the new array is returned.  On failure,
+ *		`NULL` is returned.
+ */
+static uint64_t *sht_ttl_alloc(uint32_t tsize)
+{
+	uint64_t *ttl;
+	size_t i, len;
+
+	len = sht_ttl_len(tsize);
+
+	if ((ttl = malloc(len * sizeof *ttl)) == nullptr)
+		return nullptr;
+
+	memset(ttl, 0, tsize * sizeof *ttl);
+
+	for (i = tsize; i < len; ++i)
+		ttl[i] = UINT64_MAX;
+
+	return ttl;
+}
+
+/**
+ * Record an entry's deadline in a table's deadline index.
+ *
+ * @param	ht		The hash table.
+ * @param	pos		The position of the entry.
+ * @param	deadline	The entry's deadline (or `0`).
+ */
+static void sht_ttl_note(struct sht_ht *ht, uint32_t pos, uint64_t deadline)
+{
+	uint64_t *blocks, *groups;
+
+	blocks = ht->ttl + ht->tsize;
+	groups = blocks + sht_ttl_blocks(ht->tsize);
+	pos /= SHT_TTL_BLOCK;
+
+	if (deadline == 0 || deadline >= blocks[pos])
+		return;
+
+	blocks[pos] = deadline;
+
+	// A group's value is never later than those of its blocks
+	pos /= SHT_TTL_BLOCK;
+	if (deadline < groups[pos])
+		groups[pos] = deadline;
+}
+
+/**
+ * Check whether the entry at a position has expired.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry.
+ *
+ * @returns	True (`1`) if the entry's deadline is not later than the time of
+ *		the last sht_expire() call; otherwise false (`0`).
+ */
+static bool sht_expired(const struct sht_ht *ht, uint32_t pos)
+{
+	return ht->ttl != nullptr && ht->ttl[pos] != 0
+		&& ht->ttl[pos] <= ht->now;
+}
+
+/**
+ * Move keys within a table's key array (if it has one).
+ *
+ * Also moves the reference bits of a cache and the deadlines of entries, which
+ * follow their entries.
+ *
+ * @param	ht	The hash table.
+ * @param	dest	Destination position.
+ * @param	src	Source position.
+ * @param	n	Number of keys to be moved.
+ */
+static void sht_move_keys(struct sht_ht *ht, uint32_t dest, uint32_t src,
+			  uint32_t n)
+{
+	uint32_t i;
+
+	if (ht->keys != nullptr) {
+		memmove(ht->keys + dest * ht->ksize, ht->keys + src * ht->ksize,
+			n * ht->ksize);
+	}
+
+	if (ht->refs != nullptr)
+		memmove(ht->refs + dest, ht->refs + src, n);
+
+	if (ht->ttl != nullptr) {
+		memmove(ht->ttl + dest, ht->ttl + src, n * sizeof *ht->ttl);
+		for (i = dest; i < dest + n; ++i)
+			sht_ttl_note(ht, i, ht->ttl[i]);
+	}
+}
+
+/**
+ * Mark a range of a table's file image as modified.
+ *
+ * Does nothing unless the table has been checkpointed.
+ *
+ * @param	ht	The hash table.
+ * @param	offset	File offset of the modified range.
+ * @param	len	Length of the modified range (non-zero).
+ *
+ * @see		sht_checkpoint()
+ */
+static void sht_dirty(struct sht_ht *ht, uint64_t offset, uint64_t len)
+{
+	uint64_t page, last;
+
+	if (ht->dirty == nullptr)
+		return;
+
+	last = (offset + len - 1) / SHT_CKPT_PAGE;
+
+	for (page = offset / SHT_CKPT_PAGE; page <= last; ++page)
+		ht->dirty[page / 64] |= UINT64_C(1) << (page % 64);
+}
+
+/**
+ * Mark a range of buckets as modified.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	Position of the first modified bucket.
+ * @param	n	Number of modified buckets (non-zero).
+ */
+static void sht_dirty_bckts(struct sht_ht *ht, uint32_t pos, uint32_t n)
+{
+	if (ht->dirty != nullptr) {
+		sht_dirty(ht, ht->ckpt_boff + pos * sizeof(union sht_bckt),
+			  n * sizeof(union sht_bckt));
+	}
+}
+
+/**
+ * Mark a range of entries as modified.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	Position of the first modified entry.
+ * @param	n	Number of modified entries (non-zero).
+ */
+static void sht_dirty_entries(struct sht_ht *ht, uint32_t pos, uint32_t n)
+{
+	if (ht->dirty != nullptr) {
+		sht_dirty(ht, ht->ckpt_eoff + (uint64_t)pos * ht->esize,
+			  (uint64_t)n * ht->esize);
+	}
+}
+
+/**
+ * Check whether a table can use the fast paths for the default layout.
+ *
+ * A table has the default layout if none of the options that change how its
+ * buckets, entries, or keys are stored (an indirect, interleaved, or cache
+ * table, a key array, compact buckets, integer keys, or a blob arena) were set.
+ * The layout is fixed when the table is created, but the fast paths that modify
+ * the table also require that it has no entry deadlines and is not being
+ * checkpointed.  (sht_probe() only checks the layout.)
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	True (`1`) if the table can use the fast paths; otherwise false
+ *		(`0`).
+ */
+static bool sht_plain(const struct sht_ht *ht)
+{
+	return ht->plain && ht->ttl == nullptr && ht->dirty == nullptr;
+}
+
+/**
+ * Update the PSL statistics of a table for an entry whose PSL has been set or
+ * increased.
+ *
+ * @param	ht	The hash table.
+ * @param	psl	The entry's new PSL.
+ */
+static void sht_psl_note(struct sht_ht *ht, uint8_t psl)
+{
+	if (psl > ht->peak_psl)
+		ht->peak_psl = psl;
+
+	if (psl == ht->psl_limit) {
+		ht->max_psl_ct++;
+		assert(ht->max_psl_ct < ht->thold);  // should be much lower
+	}
+}
+
+/**
+ * Low level insert function.
+ *
+ * Copies candidate entry & bucket into table and updates table statistics.
+ *
+ * @param	ht	The hash table.
+ * @param	c_entry	The entry to be inserted.
+ * @param	c_bckt	The bucket to be inserted.
+ * @param	pos	Destination position.
+ */
+static void sht_set_entry(struct sht_ht *ht, const uint8_t *restrict c_entry,
+			  const union sht_bckt *restrict c_bckt, uint32_t pos)
+{
+	sht_set_bckt(ht, pos, *c_bckt);
+	memcpy(sht_slot(ht, pos), c_entry, ht->ssize);
+
+	if (ht->keys != nullptr) {
+		memcpy(ht->keys + pos * ht->ksize,
+		       sht_slot_entry(ht, c_entry) + ht->koff, ht->ksize);
+	}
+
+	if (ht->ikeys) {
+		memcpy(sht_bckt_key(ht, pos),
+		       sht_slot_entry(ht, c_entry) + ht->koff, ht->ksize);
+	}
+
+	if (ht->refs != nullptr)
+		ht->refs[pos] = 1;
+
+	if (ht->ttl != nullptr) {
+		ht->ttl[pos] = ht->t_rehash;
+		sht_ttl_note(ht, pos, ht->t_rehash);
+	}
+
+	sht_dirty_bckts(ht, pos, 1);
+	sht_dirty_entries(ht, pos, 1);
+
+	ht->count++;
+	ht->psl_sum += c_bckt->psl;
+	sht_psl_note(ht, c_bckt->psl);
+}
+
+/**
+ * Update the statistics of a table for an entry that has been shifted "up" by 1
+ * position (away from its ideal position).
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The new position of the entry.
+ */
+static void sht_psl_inc(struct sht_ht *ht, uint32_t pos)
+{
+	union sht_bckt b;
+
+	b = sht_bckt(ht, pos);
+
+	// https://github.com/ipilcher/sht/blob/main/docs/psl-limits.md
+	assert(b.psl < ht->psl_limit);
+	b.psl++;
+	sht_set_bckt(ht, pos, b);
+	sht_psl_note(ht, b.psl);
+}
+
+/**
+ * Shift a block of entries (and buckets) up by 1 position.
+ *
+ * This function does **not** handle wrap-around.
+ *
+ * @param	ht	The hash table.
+ * @param	src	Position of the first entry to be moved.
+ * @param	count	The number of entries and buckets to be moved.
+ */
+static void sht_shift_up(struct sht_ht *ht, uint32_t src, uint32_t count)
+{
+	uint32_t i;
+
+	assert(src + count < ht->tsize);
+
+	if (ht->line_n != 0) {
+		// Move buckets and entries (one at a time, starting at the top)
+		for (i = src + count; i > src; --i)
+			sht_copy_pos(ht, i, i - 1);
+	}
+	else {
+		// Move entries
+		memmove(ht->entries + (src + 1) * ht->ssize,
+			ht->entries + src * ht->ssize,
+			count * ht->ssize);
+
+		// Move buckets
+		memmove((uint8_t *)ht->buckets + (src + 1) * ht->bsize,
+			(uint8_t *)ht->buckets + src * ht->bsize,
+			count * ht->bsize);
+	}
+
+	// Move keys
+	sht_move_keys(ht, src + 1, src, count);
+
+	if (count != 0) {
+		sht_dirty_bckts(ht, src + 1, count);
+		sht_dirty_entries(ht, src + 1, count);
+	}
+
+	// Every shifted entry is now 1 position farther from its ideal position
+	for (i = src + 1; i <= src + count; ++i)
+		sht_psl_inc(ht, i);
+
+	// PSL total increased by 1x number of moved entries
+	ht->psl_sum += count;
+}
+
+/**
+ * Shift the entry at the last position in the table "up" to position 0.
+ *
+ * @param	ht	The hash table.
+ */
+static void sht_shift_up_wrap(struct sht_ht *ht)
+{
+	// ht->mask is also index of last position
+
+	// Move entry, bucket, and key
+	sht_copy_pos(ht, 0, ht->mask);
+	sht_move_keys(ht, 0, ht->mask, 1);
+
+	sht_dirty_bckts(ht, 0, 1);
+	sht_dirty_entries(ht, 0, 1);
+
+	// Entry is now 1 position farther from its ideal position
+	sht_psl_inc(ht, 0);
+	ht->psl_sum++;
+}
+
+/**
+ * Shift a block of entries (and buckets) up by 1 position, in a table with the
+ * default layout.
+ *
+ * This function does **not** handle wrap-around.
+ *
+ * @param	ht	The hash table.
+ * @param	src	Position of the first entry to be moved.
+ * @param	count	The number of entries and buckets to be moved.
+ *
+ * @see		sht_shift_up()
+ */
+static void sht_shift_up_plain(struct sht_ht *ht, uint32_t src, uint32_t count)
+{
+	uint32_t i;
+
+	assert(src + count < ht->tsize);
+
+	// Move entries
+	memmove(ht->entries + (size_t)(src + 1) * ht->esize,
+		ht->entries + (size_t)src * ht->esize,
+		(size_t)count * ht->esize);
+
+	// Move buckets
+	memmove(ht->buckets + src + 1,
+		ht->buckets + src,
+		count * sizeof(union sht_bckt));
+
+	// Every shifted entry is now 1 position farther from its ideal position
+	for (i = src + 1; i <= src + count; ++i) {
+		// https://github.com/ipilcher/sht/blob/main/docs/psl-limits.md
+		assert(ht->buckets[i].psl < ht->psl_limit);
+		ht->buckets[i].psl++;
+		sht_psl_note(ht, ht->buckets[i].psl);
+	}
+
+	// PSL total increased by 1x number of moved entries
+	ht->psl_sum += count;
+}
+
+/**
+ * Make room for a new entry, in a table with the default layout.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position at which the new entry will be stored.
+ *
+ * @see		sht_make_room()
+ */
+static void sht_make_room_plain(struct sht_ht *ht, uint32_t pos)
+{
+	uint32_t end;
+
+	// Find the end of the run; the table is never full
+	for (end = pos; ht->buckets[end].used; end = (end + 1) & ht->mask)
+		assert(((end + 1) & ht->mask) != pos);
+
+	if (pos < end) {
+		// no wrap-around
+		sht_shift_up_plain(ht, pos, end - pos);
+		return;
+	}
+
+	// Shift entries at the beginning of the table (if any)
+	sht_shift_up_plain(ht, 0, end);
+
+	// Shift entry from the end of the table "up" to position 0 (ht->mask
+	// is also index of last position)
+	memcpy(ht->entries, ht->entries + (size_t)ht->mask * ht->esize,
+	       ht->esize);
+	ht->buckets[0] = ht->buckets[ht->mask];
+	assert(ht->buckets[0].psl < ht->psl_limit);
+	ht->buckets[0].psl++;
+	sht_psl_note(ht, ht->buckets[0].psl);
+	ht->psl_sum++;
+
+	// Shift entries up to end of table (if any)
+	sht_shift_up_plain(ht, pos, ht->mask - pos);
+}
+
+/**
+ * Make room for a new entry by shifting the entries at and after a position up
+ * by 1 position.
+ *
+ * Every entry from @p pos up to the next empty position is moved (once), so the
+ * order of the entries (and the bucket groups) is unchanged.  The table's
+ * statistics are updated for the moved entries.  The contents of @p pos are
+ * left unchanged, and they must be overwritten by the caller (without updating
+ * the table's statistics for the previous occupant).
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position at which the new entry will be stored.
+ */
+static void sht_make_room(struct sht_ht *ht, uint32_t pos)
+{
+	uint32_t end;
+
+	// Find the end of the run; the table is never full
+	for (end = pos; sht_bckt(ht, end).used; end = (end + 1) & ht->mask)
+		assert(((end + 1) & ht->mask) != pos);
+
+	if (pos < end) {
+		// no wrap-around
+		sht_shift_up(ht, pos, end - pos);
+	}
+	else {
+		// Shift entries at the beginning of the table (if any)
+		sht_shift_up(ht, 0, end);
+
+		// Shift entry from the end of the table "up" to position 0
+		sht_shift_up_wrap(ht);
+
+		// Shift entries up to end of table (if any)
+		sht_shift_up(ht, pos, ht->mask - pos);
+	}
+}
+
+/**
+ * Find a key (or its insertion position) in a table with the default layout.
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of the key.
+ * @param	key	The key to be found (or `NULL`).
+ * @param[out]	ins	Insertion position output (or `NULL`).
+ *
+ * @returns	See sht_probe().
+ */
+static int32_t sht_probe_plain(const struct sht_ht *ht, uint32_t hash,
+			       const void *key, uint32_t *ins)
+{
+	union sht_bckt cb;		// candidate bucket
+	union sht_bckt ob;		// current position occupant bucket
+	const uint8_t *oe;		// current position occupant entry
+	uint32_t p;			// current position (index)
+
+	cb.hash = hash;
+	cb.psl = 0;
+	cb.used = 1;
+
+	p = hash;  // masked to table size in loop
+
+	while (1) {
+
+		p &= ht->mask;
+		ob = ht->buckets[p];
+
+		// Empty position or later bucket group?
+		if (!ob.used || cb.psl > ob.psl)
+			break;
+
+		// Found key?
+		if (key != nullptr && cb.all == ob.all) {
+			oe = ht->entries + (size_t)p * ht->esize;
+			if (ht->ksize != 0
+				? sht_bytes_eq(ht, key, oe + ht->koff)
+				: ht->eqfn(key, oe, ht->eq_ctx)
+			) {
+				return p;
+			}
+		}
+
+		// https://github.com/ipilcher/sht/blob/main/docs/psl-limits.md
+		assert(cb.psl < ht->psl_limit);
+		cb.psl++;
+		p++;
+	}
+
+	if (ins != nullptr)
+		*ins = p;
+
+	return -1;
+}
+
+/**
+ * Finds the specified key in the table, or the position at which it would be
+ * inserted.
+ *
+ * Implements the core "Robin Hood" probing algorithm, used for lookup and
  * insertion, as well as populating newly allocated bucket and entry arrays
- * during rehashing.
+ * during rehashing.  The probe stops at the key's position, at an empty
+ * position, or at the first entry of a later bucket group.  In the latter 2
+ * cases, the key is not present, and the position is where it would be
+ * inserted (see sht_place()).
+ *
+ * If @p key is `NULL`, the key is known to not be present in the table (as
+ * when rehashing), so only its insertion position is found.
+ *
+ * A table with the default layout is probed by sht_probe_plain().
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of the key.
+ * @param	key	The key to be found (or `NULL`).
+ * @param[out]	ins	Insertion position output (or `NULL`).
+ *
+ * @returns	If @p key is present in the table, its position (index) is
+ *		returned.  Otherwise, `-1` is returned, and the position at
+ *		which the key would be inserted is stored in @p ins (if it is
+ *		not `NULL`).
+ */
+static int32_t sht_probe(const struct sht_ht *ht, uint32_t hash,
+			 const void *key, uint32_t *ins)
+{
+	union sht_bckt cb;		// candidate bucket
+	union sht_bckt ob;		// current position occupant bucket
+	uint32_t p;			// current position (index)
+
+	if (ht->plain)
+		return sht_probe_plain(ht, hash, key, ins);
+
+	cb.hash = ht->compact ? hash >> 24 : hash;  // fingerprint or hash
+	cb.psl = 0;
+	cb.used = 1;
+
+	p = hash;  // masked to table size in loop
+
+	while (1) {
+
+		p &= ht->mask;
+		ob = sht_bckt(ht, p);
+
+		// Empty position or later bucket group?
+		if (!ob.used || cb.psl > ob.psl)
+			break;
+
+		// Found key?
+		if (key != nullptr
+			&& cb.all == ob.all
+			&& sht_key_eq(ht, key, p)
+		) {
+			return p;
+		}
+
+		// https://github.com/ipilcher/sht/blob/main/docs/psl-limits.md
+		assert(cb.psl < ht->psl_limit);
+		cb.psl++;
+		p++;
+	}
+
+	if (ins != nullptr)
+		*ins = p;
+
+	return -1;
+}
+
+/**
+ * Store a new entry at its insertion position, in a table with the default
+ * layout.
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of the new entry's key.
+ * @param	pos	The insertion position, found by sht_probe().
+ * @param	ce	The entry to be stored.
+ *
+ * @see		sht_place()
+ */
+static void sht_place_plain(struct sht_ht *ht, uint32_t hash, uint32_t pos,
+			    const uint8_t *ce)
+{
+	union sht_bckt cb;
+
+	assert(ht->count < ht->thold);
+
+	cb.hash = hash;
+	cb.psl = (pos - hash) & ht->mask;
+	cb.used = 1;
+
+	if (ht->buckets[pos].used)
+		sht_make_room_plain(ht, pos);
+
+	ht->buckets[pos] = cb;
+	memcpy(ht->entries + (size_t)pos * ht->esize, ce, ht->esize);
+
+	ht->count++;
+	ht->psl_sum += cb.psl;
+	sht_psl_note(ht, cb.psl);
+}
+
+/**
+ * Store a new entry at its insertion position.
+ *
+ * If the position is occupied (by the first entry of a later bucket group),
+ * the rest of the run is shifted up by 1 position in a single pass (see
+ * sht_make_room()), so each displaced entry is copied only once.
+ *
+ * The table must not be full (`ht->count < ht->thold`), and it must not have
+ * been modified since @p pos was found by sht_probe().
+ *
+ * A table with the default layout uses sht_place_plain().
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of the new entry's key.
+ * @param	pos	The insertion position, found by sht_probe().
+ * @param	ce	"Candidate" entry (array slot contents) to be stored.
+ */
+static void sht_place(struct sht_ht *ht, uint32_t hash, uint32_t pos,
+		      const uint8_t *ce)
+{
+	union sht_bckt cb;
+
+	if (sht_plain(ht)) {
+		sht_place_plain(ht, hash, pos, ce);
+		return;
+	}
+
+	assert(ht->count < ht->thold);
+
+	cb.hash = ht->compact ? hash >> 24 : hash;  // fingerprint or hash
+	cb.psl = (pos - hash) & ht->mask;
+	cb.used = 1;
+
+	if (sht_bckt(ht, pos).used)
+		sht_make_room(ht, pos);
+
+	sht_set_entry(ht, ce, &cb, pos);
+}
+
+
+/**
+ * Rehash the table into new (larger) arrays.
+ *
+ * @param	ht	The hash table.
+ * @param	tsize	The new size of the table.  Must be a power of 2, larger
+ *			than the current size.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (The state of
+ *		the table is otherwise unchanged.)
+ */
+static bool sht_ht_resize(struct sht_ht *ht, uint32_t tsize)
+{
+	struct sht_ht old;  // for access to the old arrays
+	union sht_bckt b;
+	uint32_t i, hash, pos;
+	bool ok;
+
+	assert(tsize > ht->tsize && tsize <= SHT_MAX_TSIZE);
+
+	// The arrays of a shared table can't be reallocated
+	if (ht->map != nullptr) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	old = *ht;
+
+	// Rehashed entries' reference bits and deadlines are set by
+	// sht_set_entry()
+	if (old.refs != nullptr)
+		ht->refs = calloc(tsize, 1);
+	if (old.ttl != nullptr)
+		ht->ttl = sht_ttl_alloc(tsize);
+
+	if ((old.refs != nullptr && ht->refs == nullptr)
+			|| (old.ttl != nullptr && ht->ttl == nullptr)) {
+		ht->err = SHT_ERR_ALLOC;
+		ok = 0;
+	}
+	else {
+		ok = sht_alloc_arrays(ht, tsize);
+	}
+
+	if (!ok) {
+		if (ht->refs != old.refs) {
+			free(ht->refs);
+			ht->refs = old.refs;
+		}
+		if (ht->ttl != old.ttl) {
+			free(ht->ttl);
+			ht->ttl = old.ttl;
+		}
+		return 0;
+	}
+
+	// The file layout has changed; the next checkpoint must be complete
+	free(ht->dirty);
+	ht->dirty = nullptr;
+
+	if (sht_plain(ht)) {
+		// Default layout (and no deadlines to carry over)
+		for (i = 0; i < old.tsize; ++i) {
+			b = old.buckets[i];
+			if (!b.used)
+				continue;
+			sht_probe(ht, b.hash, nullptr, &pos);
+			sht_place_plain(ht, b.hash, pos,
+					old.entries + (size_t)i * ht->esize);
+		}
+	}
+	else {
+		for (i = 0; i < old.tsize; ++i) {
+
+			b = sht_bckt(&old, i);
+			if (!b.used)
+				continue;
+
+			// A compact bucket doesn't hold enough of the hash
+			if (ht->compact)
+				hash = sht_hash(ht, old.keys + i * ht->ksize);
+			else
+				hash = b.hash;
+
+			if (old.ttl != nullptr)
+				ht->t_rehash = old.ttl[i];
+
+			sht_probe(ht, hash, nullptr, &pos);
+			sht_place(ht, hash, pos, sht_slot(&old, i));
+		}
+	}
+
+	ht->t_rehash = 0;
+
+	if (!old.in_buf)
+		free(old.buckets);
+
+	free(old.refs);
+	free(old.ttl);
+
+	// Reclaim the space used by removed entries (failure is harmless)
+	if (ht->blobs)
+		sht_arena_compact(ht, ht->a_size);
+
+	return 1;
+}
+
+/**
+ * Doubles the size of the table.
+ *
+ * @param	ht	The hash table.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (The state of
+ *		the table is otherwise unchanged.)
+ */
+static bool sht_ht_grow(struct sht_ht *ht)
+{
+	if (ht->tsize == SHT_MAX_TSIZE) {
+		ht->err = SHT_ERR_TOOBIG;
+		return 0;
+	}
+
+	return sht_ht_resize(ht, ht->tsize * 2);
+}
+
+/**
+ * Ensure that a table can hold a number of entries without being expanded.
+ *
+ * @p capacity, along with the table's load factor threshold, is used to
+ * calculate the minimum size of the table, exactly as it is by sht_init().  If
+ * the table is smaller than that size, it is expanded to that size with a
+ * single rehash.  This avoids a series of expansions (each of which rehashes
+ * every entry in the table) when a known number of entries is about to be
+ * added to the table.
+ *
+ * @p capacity is the total number of entries that the table should be able to
+ * hold, including any entries that it already contains.  This function never
+ * shrinks a table.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht		The hash table.
+ * @param	capacity	The required capacity of the table.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (The state of
+ *		the table is otherwise unchanged.)
+ *
+ * @see		sht_init()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_reserve(struct sht_ht *ht, uint32_t capacity)
+{
+	uint32_t tsize;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_reserve: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_reserve: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_reserve: Table is read-only");
+
+	if (!sht_capacity_tsize(ht, capacity, &tsize))
+		return 0;
+
+	if (tsize <= ht->tsize)
+		return 1;
+
+	return sht_ht_resize(ht, tsize);
+}
+
+/**
+ * Shift a block of entries (and buckets) down by 1 position, in a table with
+ * the default layout.
+ *
+ * This function does **not** handle wrap-around.
+ *
+ * @param	ht	The hash table.
+ * @param	dest	Position to which the block should be moved.
+ * @param	count	The number of entries and buckets to be moved.
+ *
+ * @see		sht_shift()
+ */
+static void sht_shift_plain(struct sht_ht *ht, uint32_t dest, uint32_t count)
+{
+	uint32_t i;
+
+	assert(dest + count < ht->tsize);
+
+	// Move entries
+	memmove(ht->entries + (size_t)dest * ht->esize,
+		ht->entries + (size_t)(dest + 1) * ht->esize,
+		(size_t)count * ht->esize);
+
+	// Move buckets
+	memmove(ht->buckets + dest,
+		ht->buckets + dest + 1,
+		count * sizeof(union sht_bckt));
+
+	// Every shifted entry is now 1 position closer to its ideal position
+	for (i = dest; i < dest + count; ++i) {
+
+		if (ht->buckets[i].psl == ht->psl_limit) {
+			assert(ht->max_psl_ct > 0);
+			ht->max_psl_ct--;
+		}
+
+		ht->buckets[i].psl--;
+	}
+
+	// PSL total decreased by 1x number of moved entries
+	ht->psl_sum -= count;
+}
+
+/**
+ * Remove and possibly return an entry at a known position, in a table with the
+ * default layout.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry to be removed.
+ * @param[out]	out	Entry output buffer (or `NULL`).
+ *
+ * @returns	See sht_remove_at().
+ */
+static uint32_t sht_remove_at_plain(struct sht_ht *ht, uint32_t pos,
+				    void *restrict out)
+{
+	uint32_t end, next;
+	uint8_t *e;
+
+	sht_shm_write_begin(ht);
+
+	// Copy entry to output buffer or free its resources
+	e = ht->entries + (size_t)pos * ht->esize;
+
+	if (out != nullptr)
+		memcpy(out, e, ht->esize);
+	else if (ht->freefn != nullptr)
+		ht->freefn(e, ht->free_ctx);
+
+	// Update table stats for removal
+	ht->psl_sum -= ht->buckets[pos].psl;
+	ht->count--;
+
+	// Find range to shift (if any)
+	end = pos;
+	next = (pos + 1) & ht->mask;
+	while (ht->buckets[next].used && ht->buckets[next].psl != 0) {
+		end = next;
+		next = (next + 1) & ht->mask;
+	}
+
+	// Do any necessary shifts
+	if (pos == end) {
+		// no shifts needed
+	}
+	else if (pos < end) {
+		// no wrap-around
+		sht_shift_plain(ht, pos, end - pos);
+	}
+	else {
+		// Shift entries up to end of table (if any)
+		if (pos < ht->mask)	// mask is also max index
+			sht_shift_plain(ht, pos, ht->mask - pos);
+
+		// Shift entry from position 0 "down" to the end of table
+		memcpy(ht->entries + (size_t)ht->mask * ht->esize,
+		       ht->entries, ht->esize);
+		ht->buckets[ht->mask] = ht->buckets[0];
+
+		if (ht->buckets[ht->mask].psl == ht->psl_limit) {
+			assert(ht->max_psl_ct > 0);
+			ht->max_psl_ct--;
+		}
+
+		ht->buckets[ht->mask].psl--;
+		ht->psl_sum--;
+
+		// Shift entries at the beginning of the table
+		sht_shift_plain(ht, 0, end);
+	}
+
+	// Mark position at end of range as empty
+	ht->buckets[end].all = 0;
+
+	sht_shm_write_end(ht);
+
+	return end;
+}
+
+/**
+ * Shift a block of entries (and buckets) down by 1 position.
+ *
+ * This function does **not** handle wrap-around.
+ *
+ * @param	ht	The hash table.
+ * @param	dest	Position to which the block should be moved.
+ * @param	count	The number of entries and buckets to be moved.
+ */
+static void sht_shift(struct sht_ht *ht, uint32_t dest, uint32_t count)
+{
+	union sht_bckt b;
+	uint32_t i;
+
+	assert(dest + count < ht->tsize);
+
+	if (ht->line_n != 0) {
+		// Move buckets and entries (one at a time)
+		for (i = dest; i < dest + count; ++i)
+			sht_copy_pos(ht, i, i + 1);
+	}
+	else {
+		// Move entries
+		memmove(ht->entries + dest * ht->ssize,
+			ht->entries + (dest + 1) * ht->ssize,
+			count * ht->ssize);
+
+		// Move buckets
+		memmove((uint8_t *)ht->buckets + dest * ht->bsize,
+			(uint8_t *)ht->buckets + (dest + 1) * ht->bsize,
+			count * ht->bsize);
+	}
+
+	// Move keys
+	sht_move_keys(ht, dest, dest + 1, count);
+
+	if (count != 0) {
+		sht_dirty_bckts(ht, dest, count);
+		sht_dirty_entries(ht, dest, count);
+	}
+
+	// Every shifted entry is now 1 position closer to its ideal position
+	for (i = dest; i < dest + count; ++i) {
+
+		b = sht_bckt(ht, i);
+
+		if (b.psl == ht->psl_limit) {
+			assert(ht->max_psl_ct > 0);
+			ht->max_psl_ct--;
+		}
+
+		b.psl--;
+		sht_set_bckt(ht, i, b);
+	}
+
+	// PSL total decreased by 1x number of moved entries
+	ht->psl_sum -= count;
+}
+
+/**
+ * Shift the entry at position 0 "down" to the last position in the table.
+ *
+ * @param	ht	The hash table.
+ */
+static void sht_shift_wrap(struct sht_ht *ht)
+{
+	union sht_bckt b;
+
+	// ht->mask is also index of last position
+
+	// Move entry, bucket, and key
+	sht_copy_pos(ht, ht->mask, 0);
+	sht_move_keys(ht, ht->mask, 0, 1);
+
+	sht_dirty_bckts(ht, ht->mask, 1);
+	sht_dirty_entries(ht, ht->mask, 1);
+
+	// Entry is now 1 position closer to its ideal position
+	b = sht_bckt(ht, ht->mask);
+
+	if (b.psl == ht->psl_limit) {
+		assert(ht->max_psl_ct > 0);
+		ht->max_psl_ct--;
+	}
+
+	b.psl--;
+	sht_set_bckt(ht, ht->mask, b);
+	ht->psl_sum--;
+}
+
+/**
+ * Remove and possibly return an entry at a known position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry to be removed.
+ * @param[out]	out	Entry output buffer (or `NULL`).
+ *
+ * @returns	The position that was left empty.  The contents of every
+ *		position from @p pos through that position (inclusive) may have
+ *		changed.
+ *
+ * @see		sht_remove()
+ * @see		sht_remove_at_plain()
+ */
+static uint32_t sht_remove_at(struct sht_ht *ht, uint32_t pos,
+			      void *restrict out)
+{
+	union sht_bckt b;
+	uint32_t end, next;
+	uint8_t *e;
+
+	if (sht_plain(ht))
+		return sht_remove_at_plain(ht, pos, out);
+
+	sht_shm_write_begin(ht);
+
+	// Copy entry to output buffer or free its resources
+	e = sht_entry(ht, pos);
+
+	if (out != nullptr)
+		memcpy(out, e, ht->esize);
+	else if (ht->freefn != nullptr)
+		ht->freefn(e, ht->free_ctx);
+
+	if (ht->indirect)
+		sht_pool_put(ht, e);
+
+	// Update table stats for removal
+	ht->psl_sum -= sht_bckt(ht, pos).psl;
+	ht->count--;
+
+	// Find range to shift (if any)
+	end = pos;
+	next = (pos + 1) & ht->mask;
+	while (sht_bckt(ht, next).used && sht_bckt(ht, next).psl != 0) {
+		end = next;
+		next = (next + 1) & ht->mask;
+	}
+
+	// Do any necessary shifts
+	if ((uint32_t)pos == end) {
+		// no shifts needed
+	}
+	else if ((uint32_t)pos < end) {
+		// no wrap-around
+		sht_shift(ht, pos, end - pos);
+	}
+	else {
+		// Shift entries up to end of table (if any)
+		if ((uint32_t)pos < ht->mask)	// mask is also max index
+			sht_shift(ht, pos, ht->mask - pos);
+
+		// Shift entry from position 0 "down" to the end of table
+		sht_shift_wrap(ht);
+
+		// Shift entries at the beginning of the table
+		sht_shift(ht, 0, end);
+	}
+
+	// Mark position at end of range as empty
+	b = sht_bckt(ht, end);
+	b.all = 0;
+	sht_set_bckt(ht, end, b);
+	sht_dirty_bckts(ht, end, 1);
+	sht_dirty_entries(ht, end, 1);
+
+	sht_shm_write_end(ht);
+
+	return end;
+}
+
+/**
+ * Evict an entry from a full cache.
+ *
+ * The victim is chosen by the CLOCK algorithm.  The hand sweeps through the
+ * table, clearing any reference bits that are set, and stops at the first
+ * entry whose reference bit is already clear.  (Every entry's bit is clear
+ * after one full sweep, so the hand never goes around more than twice.)
+ *
+ * Removing the victim shifts the rest of its run down, so the insertion
+ * position of the new key (found before the eviction) is only still valid if
+ * none of the positions on its probe path were changed.
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of the new key.
+ * @param	ins	Insertion position of the new key (see sht_probe()).
+ *
+ * @returns	True (`1`) if the insertion position of the new key must be
+ *		found again; otherwise false (`0`).
+ *
+ * @see		sht_set_cache()
+ */
+static bool sht_evict(struct sht_ht *ht, uint32_t hash, uint32_t ins)
+{
+	uint32_t pos, end, home;
+
+	assert(ht->count != 0);
+
+	for (pos = ht->hand; ; pos = (pos + 1) & ht->mask) {
+
+		if (!sht_bckt(ht, pos).used)
+			continue;
+
+		if (ht->refs[pos] == 0)
+			break;
+
+		ht->refs[pos] = 0;
+	}
+
+	if (ht->evictfn != nullptr)
+		ht->evictfn(sht_entry(ht, pos), ht->evict_ctx);
+
+	end = sht_remove_at(ht, pos, nullptr);
+
+	// The entry that was shifted into the victim's position (if any) has
+	// not been examined yet
+	ht->hand = pos;
+
+	// Do the changed positions (pos ... end) overlap the probe path of the
+	// new key (home ... ins)?  (Both ranges may wrap around.)
+	home = hash & ht->mask;
+
+	return ((pos - home) & ht->mask) <= ((ins - home) & ht->mask)
+		|| ((home - pos) & ht->mask) <= ((end - pos) & ht->mask);
+}
+
+/**
+ * Check that a merge function did not change the key of an entry.
+ *
+ * The entry must still match @p key.  In a table with a key array or integer
+ * keys, the key in the entry must also still match the table's copy of it.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key with which the entry was found.
+ * @param	pos	The position of the entry.
+ *
+ * @returns	True (`1`) if the key is unchanged; otherwise false (`0`).
+ */
+[[maybe_unused]]
+static bool sht_key_intact(const struct sht_ht *ht, const void *key,
+			   uint32_t pos)
+{
+	const uint8_t *copy;
+
+	if (!sht_key_eq(ht, key, pos))
+		return 0;
+
+	if (ht->ikeys)
+		copy = sht_bckt_key(ht, pos);
+	else if (ht->keys != nullptr)
+		copy = ht->keys + (size_t)pos * ht->ksize;
+	else
+		return 1;
+
+	return memcmp(sht_entry(ht, pos) + ht->koff, copy, ht->ksize) == 0;
+}
+
+/**
+ * Add an entry to a table.
+ *
+ * If @p key is already present in the table, the behavior depends on the
+ * values of @p replace and @p mergefn.  If @p replace is true (`1`), the
+ * existing entry will be replaced by @p entry.  Otherwise, @p entry will be
+ * merged into the existing entry by @p mergefn, or (if @p mergefn is `NULL`)
+ * the existing entry will be left in place.  An expired entry (see
+ * sht_expire()) is always replaced, as if its key was not present.
+ *
+ * @param	ht		The hash table.
+ * @param	key		The key of the new entry.
+ * @param	entry		The new entry.
+ * @param	replace		How to handle duplicate key.
+ * @param	mergefn		Merge function (or `NULL`).
+ * @param	merge_ctx	Context for merge function.
+ *
+ * @returns	If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *		On success, `0` is returned if the key was not already present
+ *		in the table, and `1` is returned if the key was already
+ *		present.
+ *
+ * @see		sht_add()
+ * @see		sht_set()
+ * @see		sht_upsert()
+ */
+static int sht_insert(struct sht_ht *ht, const void *key, const void *entry,
+		      bool replace, sht_mergefn_t mergefn, void *merge_ctx)
+{
+	const void *const new = entry;
+	struct sht_blob kb;
+	uint32_t hash, pos;
+	int32_t result;
+	uint8_t *current, *obj = nullptr;
+	bool expired;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_add/sht_set/sht_upsert: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_add/sht_set/sht_upsert: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_add/sht_set/sht_upsert: Table is read-only");
+
+	assert(key != nullptr && entry != nullptr);
+
+	if (ht->max_psl_ct != 0) {
+		ht->err = SHT_ERR_BAD_HASH;
+		return -1;
+	}
+
+	hash = sht_hash(ht, key);
+
+	// The value blob of the new entry is checked even if its key is present
+	if (ht->blobs)
+		sht_arena_check(ht, new, "sht_add/sht_set: Invalid value blob");
+
+	result = sht_probe(ht, hash, key, &pos);
+
+	if (result >= 0) {
+		expired = sht_expired(ht, result);
+		if (replace || expired || mergefn != nullptr) {
+			current = sht_entry(ht, result);
+			if (replace || expired) {
+				if (ht->freefn != nullptr)
+					ht->freefn(current, ht->free_ctx);
+				sht_overwrite(ht, current, new);
+			}
+			else {
+				mergefn(current, new, merge_ctx);
+				assert(sht_key_intact(ht, key, result));
+			}
+			sht_dirty_entries(ht, result, 1);
+			if (ht->refs != nullptr)
+				ht->refs[result] = 1;
+		}
+		if (expired)
+			ht->ttl[result] = 0;
+		return !expired;
+	}
+
+	// An indirect entry is inserted by inserting a pointer to it
+	if (ht->indirect) {
+		if ((obj = sht_pool_get(ht)) == nullptr)
+			return -1;
+		memcpy(obj, entry, ht->esize);
+		entry = &obj;
+	}
+
+	// A new key is copied into the blob arena
+	if (ht->blobs) {
+		if (!sht_arena_prep(ht, key, entry))
+			return -1;
+		entry = ht->a_entry;
+	}
+
+	// A full cache makes room for a new key by evicting an entry, which
+	// may shift the entries on the key's probe path
+	if (ht->cache_max != 0 && ht->count >= ht->cache_max
+			&& sht_evict(ht, hash, pos))
+		sht_probe(ht, hash, nullptr, &pos);
+
+	if (ht->count == ht->thold) {
+
+		if (!sht_ht_grow(ht)) {
+			if (ht->indirect)
+				sht_pool_put(ht, obj);
+			ht->a_pending = 0;
+			return -1;
+		}
+
+		// Growing the table compacts the arena, so the key's room has
+		// moved
+		if (ht->blobs) {
+			memcpy(&kb, ht->a_entry + ht->koff, sizeof kb);
+			kb.off = ht->a_len;
+			memcpy(ht->a_entry + ht->koff, &kb, sizeof kb);
+		}
+
+		sht_probe(ht, hash, nullptr, &pos);
+	}
+
+	sht_place(ht, hash, pos, entry);
+
+	if (ht->blobs)
+		sht_arena_commit(ht, key);
+
+	return 0;
+}
+
+/**
+ * Add an entry to the table, if its key is not already present.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key of the new entry.
+ * @param	entry	The new entry.
+ *
+ * @returns	If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *		On success, `0` is returned if the key was not already present
+ *		in the table, and the new entry has been added; `1` indicates
+ *		that the key was already present in the table, and the state of
+ *		the table is unchanged.
+ *
+ * @see		sht_set()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+int sht_add(struct sht_ht *ht, const void *key, const void *entry)
+{
+	int result;
+
+	sht_shm_write_begin(ht);
+	result = sht_insert(ht, key, entry, 0, nullptr, nullptr);
+	sht_shm_write_end(ht);
+
+	return result;
+}
+
+/**
+ * Unconditionally set the value associated with a key.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key of the new entry.
+ * @param	entry	The new entry.
+ *
+ * @returns	If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *		On success, `0` is returned if the key was not already present
+ *		in the table, and the new entry has been added; `1` indicates
+ *		that the key was already present in the table, and the new entry
+ *		has replaced it.
+ *
+ * @see		sht_add()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+int sht_set(struct sht_ht *ht, const void *key, const void *entry)
+{
+	int result;
+
+	sht_shm_write_begin(ht);
+	result = sht_insert(ht, key, entry, 1, nullptr, nullptr);
+	sht_shm_write_end(ht);
+
+	return result;
+}
+
+/**
+ * Add an entry to a table, or merge it into the existing entry for its key.
+ *
+ * If @p key is not present in the table, @p entry is added, exactly as it would
+ * be by sht_add().  If @p key is present, @p mergefn is called to combine
+ * @p entry with the existing entry, which it updates in place.  Either way, the
+ * key is hashed and the table is searched only once, so a read-modify-write
+ * operation (such as adding to a counter) doesn't require a call to sht_get()
+ * followed by a call to sht_replace().
+ *
+ * The table's free function is not called for the existing entry or for
+ * @p entry, and @p entry is not copied into the table when it is merged.
+ * (An expired entry is replaced by @p entry, rather than merged; see
+ * sht_set_ttl().)
+ *
+ * > **WARNING**
+ * >
+ * > @p mergefn must not change the key of the existing entry.  In a table with
+ * > a key array, integer keys, or a blob arena, the table's own copy of the key
+ * > would no longer match the entry, and lookups would silently fail.  (Debug
+ * > builds assert that the key is unchanged.)  See #sht_mergefn_t.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key of the new entry.
+ * @param	entry	The new entry.
+ * @param	mergefn	Function that merges @p entry into an existing entry.
+ * @param	context	Optional context for @p mergefn.
+ *
+ * @returns	If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *		On success, `0` is returned if the key was not already present
+ *		in the table, and the new entry has been added; `1` indicates
+ *		that the key was already present in the table, and the new entry
+ *		has been merged into the existing entry.
+ *
+ * @see		sht_add()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+int sht_upsert(struct sht_ht *ht, const void *key, const void *entry,
+	       sht_mergefn_t mergefn, void *context)
+{
+	int result;
+
+	sht_shm_write_begin(ht);
+	result = sht_insert(ht, key, entry, 0, mergefn, context);
+	sht_shm_write_end(ht);
+
+	return result;
+}
+
+/**
+ * Add a blob to a table's blob arena.
+ *
+ * Copies @p len bytes of @p data into the table's blob arena, and sets @p blob
+ * to refer to the copy.  The blob can then be used as the value blob of an
+ * entry that is passed to sht_add(), sht_set(), sht_replace(), sht_swap(), or
+ * sht_iter_replace().
+ *
+ * > **WARNING**
+ * >
+ * > A blob that is not (yet) used by an entry in the table is only valid until
+ * > the arena is compacted, which can happen during any call to this function,
+ * > sht_add(), sht_set(), or sht_reserve().  The blob should be stored in the
+ * > table immediately.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that
+ * > does not have a blob arena.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	data	The contents of the blob.  (May be `NULL` if @p len is
+ *			`0`.)
+ * @param	len	The length of the blob.
+ * @param[out]	blob	Set to refer to the new blob.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  (@p blob is
+ *		not changed.)
+ *
+ * @see		sht_set_arena()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_arena_add(struct sht_ht *ht, const void *data, size_t len,
+		   struct sht_blob *blob)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_arena_add: Table not initialized");
+	if (!ht->blobs)
+		sht_abort("sht_arena_add: Table has no blob arena");
+
+	if (!sht_arena_reserve(ht, len))
+		return 0;
+
+	if (len != 0)
+		memcpy(ht->arena + ht->a_len, data, len);
+
+	blob->off = ht->a_len;
+	blob->len = len;
+	ht->a_len += len;
+
+	return 1;
+}
+
+/**
+ * Get the contents of a blob in a table's blob arena.
+ *
+ * The contents of a key blob are followed by a NUL, so the returned pointer
+ * can be used as a string.
+ *
+ * > **WARNING**
+ * >
+ * > The pointer returned by this function is only valid until the arena is
+ * > compacted, which can happen during any call to sht_arena_add(), sht_add(),
+ * > sht_set(), or sht_reserve().
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that
+ * > does not have a blob arena.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	blob	The blob (the key or value blob of an entry).
+ *
+ * @returns	A pointer to the contents of the blob.
+ *
+ * @see		sht_set_arena()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+const void *sht_blob(const struct sht_ht *ht, struct sht_blob blob)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_blob: Table not initialized");
+	if (!ht->blobs)
+		sht_abort("sht_blob: Table has no blob arena");
+
+	return ht->arena + blob.off;
+}
+
+/**
+ * Allocate memory for an entry's resources from a table's resource arena.
+ *
+ * The memory is aligned for any type (`alignof(max_align_t)`).  It cannot be
+ * freed individually; it is released when the table is cleared (sht_clear()) or
+ * freed (sht_free()).  Memory is allocated from chunks that start at 4 KiB and
+ * double in size (up to 16 MiB), so each allocation is usually just a pointer
+ * increment.  Larger requests are given their own chunks.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that
+ * > does not free its resources in bulk.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	size	The size of the memory.
+ *
+ * @returns	On success, a pointer to the memory is returned.  On failure,
+ *		`NULL` is returned, and the table's error status is set.
+ *
+ * @see		sht_set_bulk_free()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void *sht_bulk_alloc(struct sht_ht *ht, size_t size)
+{
+	const size_t align = alignof(max_align_t);
+	struct sht_chunk *chunk;
+	size_t csize;
+	uint8_t *p;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_bulk_alloc: Table not initialized");
+	if (!ht->bulk_free)
+		sht_abort("sht_bulk_alloc: "
+			  "Table does not free resources in bulk");
+
+	if (size > SIZE_MAX - 2 * align) {
+		ht->err = SHT_ERR_ALLOC;
+		return nullptr;
+	}
+
+	size = (size + align - 1) & ~(align - 1);
+
+	if (size <= ht->r_left) {
+		p = ht->r_next;
+		ht->r_next += size;
+		ht->r_left -= size;
+		return p;
+	}
+
+	// Large requests get their own chunks, behind the current chunk
+	csize = align + size;
+	if (csize > ht->r_csize / 2) {
+		if ((chunk = malloc(csize)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return nullptr;
+		}
+		if (ht->chunks != nullptr) {
+			chunk->next = ht->chunks->next;
+			ht->chunks->next = chunk;
+		}
+		else {
+			chunk->next = nullptr;
+			ht->chunks = chunk;
+		}
+		return (uint8_t *)chunk + align;
+	}
+
+	if ((chunk = malloc(ht->r_csize)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return nullptr;
+	}
+
+	chunk->next = ht->chunks;
+	ht->chunks = chunk;
+	p = (uint8_t *)chunk + align;
+	ht->r_next = p + size;
+	ht->r_left = ht->r_csize - align - size;
+
+	if (ht->r_csize < SHT_CHUNK_MAX)
+		ht->r_csize *= 2;
+
+	return p;
+}
+
+/**
+ * Find the entry for a key whose hash has already been computed.
+ *
+ * @param	ht	The hash table.
+ * @param	hash	Hash of @p key.
+ * @param	key	The key.
+ *
+ * @returns	A pointer to the key's entry, or `NULL` if the key is not
+ *		present in the table (or its entry has expired).
+ */
+static const void *sht_lookup(struct sht_ht *ht, uint32_t hash,
+			      const void *key)
+{
+	int32_t result;
+
+	result = sht_probe(ht, hash, key, nullptr);
+
+	if (result < 0) {
+		assert(result == -1);
+		return nullptr;
+	}
+
+	if (sht_expired(ht, result))
+		return nullptr;
+
+	if (ht->refs != nullptr)
+		ht->refs[result] = 1;
+
+	return sht_entry(ht, result);
+}
+
+/**
+ * Lookup an entry in a table.
+ *
+ * > **WARNING**
+ * >
+ * > The pointer returned by this function is only valid until the next time the
+ * > table is changed.  Structural changes to the table (adding or removing
+ * > keys) can cause other entries to be moved within the table, making pointers
+ * > to those entries invalid.
+ * >
+ * > (In a table with indirect entries, a pointer to an entry remains valid
+ * > until that entry is removed from the table.  See sht_new_indirect_().)
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the entry is to be retrieved.
+ *
+ * @returns	If the the key is present in the table (and its entry has not
+ *		expired), a pointer to the key's entry is returned.  Otherwise,
+ *		`NULL` is returned.
+ *
+ * @see		sht_set_ttl()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+const void *sht_get(struct sht_ht *ht, const void *restrict key)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_get: Table not initialized");
+
+	return sht_lookup(ht, sht_hash(ht, key), key);
+}
+
+/**
+ * Start a lookup, by hashing a key and prefetching its home position.
+ *
+ * This function is the first half of a two-phase lookup.  It computes the hash
+ * of @p key and asks the CPU to begin loading the memory that the probe will
+ * read first &mdash; the bucket and entry array slot at the key's ideal
+ * position (and its slot in the key array, if the table has one).  It does not
+ * wait for that memory, so the caller can do other work (or start other
+ * lookups) while it is loaded, and then finish the lookup with
+ * sht_get_token().
+ *
+ * The returned token depends only on the key and the table's hash function.
+ * It remains valid if the table is changed (even resized) before the lookup
+ * is finished; the prefetch is simply wasted.
+ *
+ * ```c
+ * uint32_t tokens[BURST];
+ *
+ * for (i = 0; i < n; ++i)
+ *         tokens[i] = sht_prefetch(ht, &pkts[i].flow);
+ *
+ * // ... parse packet headers, etc. ...
+ *
+ * for (i = 0; i < n; ++i)
+ *         pkts[i].state = sht_get_token(ht, &pkts[i].flow, tokens[i]);
+ * ```
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key to be looked up.
+ *
+ * @returns	A token that must be passed to sht_get_token(), along with the
+ *		same key.
+ *
+ * @see		sht_get_token()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+uint32_t sht_prefetch(const struct sht_ht *ht, const void *restrict key)
+{
+	uint32_t hash, pos;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_prefetch: Table not initialized");
+
+	hash = sht_hash(ht, key);
+	pos = hash & ht->mask;
+
+	__builtin_prefetch(sht_bckt_addr(ht, pos));
+	__builtin_prefetch(sht_slot(ht, pos));
+
+	if (ht->keys != nullptr)
+		__builtin_prefetch(ht->keys + pos * ht->ksize);
+
+	return hash;
+}
+
+/**
+ * Finish a lookup that was started by sht_prefetch().
+ *
+ * This function is equivalent to sht_get(), but it does not hash @p key.  (The
+ * same warning about the lifetime of the returned pointer applies.)
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the entry is to be retrieved.
+ * @param	token	The token returned by sht_prefetch() for @p key.  (If
+ *			the token was returned for a different key, the result
+ *			is unpredictable.)
+ *
+ * @returns	If the the key is present in the table (and its entry has not
+ *		expired), a pointer to the key's entry is returned.  Otherwise,
+ *		`NULL` is returned.
+ *
+ * @see		sht_prefetch()
+ * @see		sht_get()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+const void *sht_get_token(struct sht_ht *ht, const void *restrict key,
+			  uint32_t token)
+{
+	if (ht->tsize == 0)
+		sht_abort("sht_get_token: Table not initialized");
+
+	return sht_lookup(ht, token, key);
+}
+
+/**
+ * Remove the expired entries in one block of a table's deadline index.
+ *
+ * If every position in the block is examined (i.e., @p budget is not
+ * exhausted), the block's index value is set to the earliest remaining
+ * deadline in the block.
+ *
+ * @param	ht	The hash table.
+ * @param	block	The block.
+ * @param	budget	The maximum number of entries to be removed.
+ *
+ * @returns	The number of entries that were removed.
+ */
+static uint32_t sht_expire_block(struct sht_ht *ht, uint32_t block,
+				 uint32_t budget)
+{
+	uint32_t pos, end, removed = 0;
+	uint64_t bmin = UINT64_MAX, d;
+
+	pos = block * SHT_TTL_BLOCK;
+	end = pos + SHT_TTL_BLOCK;
+	if (end > ht->tsize)
+		end = ht->tsize;
+
+	// Removing an entry shifts the following entries down, so the position
+	// is examined again.  (No entry is shifted into a position of this
+	// block that has already been examined.)
+	while (pos < end) {
+
+		d = ht->ttl[pos];
+
+		if (!sht_bckt(ht, pos).used || d == 0) {
+			++pos;
+		}
+		else if (d > ht->now) {
+			if (d < bmin)
+				bmin = d;
+			++pos;
+		}
+		else if (removed < budget) {
+			sht_remove_at(ht, pos, nullptr);
+			++removed;
+		}
+		else {
+			return removed;
+		}
+	}
+
+	ht->ttl[ht->tsize + block] = bmin;
+
+	return removed;
+}
+
+/**
+ * Set the deadline of an entry.
+ *
+ * Once @p deadline has passed (i.e., once sht_expire() has been called with a
+ * time that is not earlier than @p deadline), the entry is treated as absent
+ * by sht_get(), sht_add(), and sht_set(), and it is removed by sht_expire().
+ * The table does not read any clock; deadlines and times are in any units
+ * that the caller chooses (e.g., milliseconds since an epoch).
+ *
+ * The first call to this function allocates an array that holds the deadline
+ * of every entry in the table (8 bytes per position, plus a small index).  An
+ * entry's deadline is not changed when the entry is replaced, and a new entry
+ * has no deadline.
+ *
+ * Other functions (sht_replace(), sht_swap(), sht_pop(), sht_delete(), and
+ * iterators) do not check deadlines.  An entry that has expired but has not
+ * yet been removed can be found or removed by those functions.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that is
+ * > mapped from a file or shared memory.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht		The hash table.
+ * @param	key		The key of the entry.
+ * @param	deadline	The entry's new deadline, or `0` to remove the
+ *				entry's deadline.
+ *
+ * @returns	If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *		On success, `1` is returned if the key is present in the table
+ *		(and its entry has not expired), and `0` is returned if it is
+ *		not.
+ *
+ * @see		sht_expire()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+int sht_set_ttl(struct sht_ht *ht, const void *restrict key, uint64_t deadline)
+{
+	int32_t pos;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_set_ttl: Table not initialized");
+	if (ht->read_only)
+		sht_abort("sht_set_ttl: Table is read-only");
+	if (ht->map != nullptr)
+		sht_abort("sht_set_ttl: Table is mapped");
+
+	pos = sht_probe(ht, sht_hash(ht, key), key, nullptr);
+	if (pos < 0 || sht_expired(ht, pos))
+		return 0;
+
+	if (ht->ttl == nullptr) {
+		if (deadline == 0)
+			return 1;
+		if ((ht->ttl = sht_ttl_alloc(ht->tsize)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			return -1;
+		}
+	}
+
+	ht->ttl[pos] = deadline;
+	sht_ttl_note(ht, pos, deadline);
+
+	return 1;
+}
+
+/**
+ * Remove expired entries from a table.
+ *
+ * Records @p now as the current time, which determines which entries are
+ * treated as absent by sht_get() (see sht_set_ttl()), and removes up to
+ * @p budget entries whose deadlines are not later than @p now.  (The table's
+ * free function, if any, is called for each removed entry.)  Times should not
+ * go backwards; if @p now is earlier than the time recorded by a previous
+ * call, the previous time is used.
+ *
+ * Expired entries are found through an index of the earliest deadline in each
+ * block of positions, so blocks that contain no expired entries are skipped.
+ * When @p budget is exhausted, the remaining expired entries are left in place
+ * (still treated as absent) until a later call.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	now	The current time.
+ * @param	budget	The maximum number of entries to be removed.
+ *
+ * @returns	The number of entries that were removed.
+ *
+ * @see		sht_set_ttl()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+uint32_t sht_expire(struct sht_ht *ht, uint64_t now, uint32_t budget)
+{
+	uint32_t nblocks, ngroups, g, b, last, removed = 0;
+	uint64_t *blocks, *groups, gmin;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_expire: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_expire: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_expire: Table is read-only");
+
+	if (now > ht->now)
+		ht->now = now;
+
+	if (ht->ttl == nullptr)
+		return 0;
+
+	nblocks = sht_ttl_blocks(ht->tsize);
+	ngroups = sht_ttl_blocks(nblocks);
+	blocks = ht->ttl + ht->tsize;
+	groups = blocks + nblocks;
+
+	for (g = 0; g < ngroups && removed < budget; ++g) {
+
+		if (groups[g] > ht->now)
+			continue;
+
+		last = (g + 1) * SHT_TTL_BLOCK;
+		if (last > nblocks)
+			last = nblocks;
+
+		gmin = UINT64_MAX;
+
+		for (b = g * SHT_TTL_BLOCK; b < last; ++b) {
+			if (blocks[b] <= ht->now && removed < budget) {
+				removed += sht_expire_block(ht, b,
+							    budget - removed);
+			}
+			if (blocks[b] < gmin)
+				gmin = blocks[b];
+		}
+
+		groups[g] = gmin;
+	}
+
+	return removed;
+}
+
+/**
+ * Exchange the contents of two (non-overlapping) memory areas.
+ *
+ * @param	a	The first memory area.
+ * @param	b	The second memory area.
+ * @param	n	The size of the memory areas.
+ */
+static void sht_memswap(void *restrict a, void *restrict b, size_t n)
+{
+	uint8_t tmp[256], *pa = a, *pb = b;
+	size_t len;
+
+	for (; n != 0; n -= len, pa += len, pb += len) {
+		len = n < sizeof tmp ? n : sizeof tmp;
+		memcpy(tmp, pa, len);
+		memcpy(pa, pb, len);
+		memcpy(pb, tmp, len);
+	}
+}
+
+/**
+ * Change the entry at a known position.
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry to be replaced.
+ * @param	entry	The new entry.
+ * @param[out]	out	Output buffer for previous entry (or `NULL`).  @p out
+ *			may point to the same object as @p entry.
+ *
+ * @see		sht_change()
+ */
+static void sht_change_at(struct sht_ht *ht, uint32_t pos,
+			  const void *entry, void *out)
+{
+	struct sht_blob kb;
+	uint8_t *e;
+
+	sht_shm_write_begin(ht);
+
+	e = sht_entry(ht, pos);
+	sht_dirty_entries(ht, pos, 1);
+
+	if (out == nullptr) {
+		if (ht->freefn != nullptr)
+			ht->freefn(e, ht->free_ctx);
+		sht_overwrite(ht, e, entry);
+	}
+	else if (out == entry && !ht->blobs) {
+		sht_memswap(e, out, ht->esize);
+	}
+	else if (out == entry) {
+		memcpy(&kb, e + ht->koff, sizeof kb);
+		sht_memswap(e, out, ht->esize);
+		memcpy(e + ht->koff, &kb, sizeof kb);
+	}
+	else {
+		memcpy(out, e, ht->esize);
+		sht_overwrite(ht, e, entry);
+	}
+
+	sht_shm_write_end(ht);
+}
+
+/**
+ * Change the entry associated with an existing key.
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the value is to be changed.
+ * @param	entry	The new entry.
+ * @param[out]	out	Output buffer for previous entry (or `NULL`).  @p out
+ *			may point to the same object as @p entry.
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned, the
+ *		entry associated with the key is replaced with the new entry,
+ *		and the previous entry is copied to @p out (if it is not
+ *		`NULL`).  Otherwise, false (`0`) is returned (and the contents
+ *		of @p out are unchanged).
+ *
+ * @see		sht_replace()
+ * @see		sht_swap()
+ */
+static bool sht_change(struct sht_ht *ht, const void *key,
+			const void *entry, void *out)
+{
+	uint32_t hash;
+	int32_t pos;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_replace/sht_swap: Table not initialized");
+	if (ht->read_only)
+		sht_abort("sht_replace/sht_swap: Table is read-only");
+
+	if (ht->blobs)
+		sht_arena_check(ht, entry,
+				"sht_replace/sht_swap: Invalid value blob");
+
+	hash = sht_hash(ht, key);
+	pos = sht_probe(ht, hash, key, nullptr);
+
+	if (pos < 0) {
+		assert(pos == -1);
+		return 0;
+	}
+
+	sht_change_at(ht, pos, entry, out);
+
+	return 1;
+}
+
+/**
+ * Replace the entry associated with an existing key.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the value is to be replaced.
+ * @param	entry	The new entry for the key.
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned, and
+ *		the entry associated with the key is replaced with the new
+ *		entry.  Otherwise, false (`0`) is returned.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_replace(struct sht_ht *ht, const void *key, const void *entry)
+{
+	return sht_change(ht, key, entry, nullptr);
+}
+
+/**
+ * Exchange an existing entry and a new entry.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the value is to be replaced.
+ * @param	entry	The new entry for the key.
+ * @param	out	Output buffer for the previous entry.  Must be large
+ *			enough to hold an entry.  (@p out may point to the same
+ *			object as @p entry.)
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned, the
+ *		entry associated with the key is replaced with the new entry,
+ *		and the previous entry is copied to @p out.  Otherwise, false
+ *		(`0`) is returned, and the contents of @p out are unchanged.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_swap(struct sht_ht *ht, const void *key, const void *entry, void *out)
+{
+	return sht_change(ht, key, entry, out);
+}
+
+/**
+ * Remove and possibly return an entry from the table.
+ *
+ * (If @p out is `NULL`, the entry is simply removed from the table.)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the entry is to be retrieved and
+ *			removed.
+ * @param[out]	out	Entry output buffer (or `NULL`).
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned, and
+ *		its entry is stored in @p out (if it is not `NULL`).  Otherwise,
+ *		false (`0`) is returned (and the contents of @p out are
+ *		unchanged).
+ *
+ * @see		sht_pop()
+ * @see		sht_delete()
+ */
+static bool sht_remove(struct sht_ht *ht, const void *restrict key,
+			void *restrict out)
+{
+	uint32_t hash;
+	int32_t pos;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_pop/sht_delete: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_pop/sht_delete: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_pop/sht_delete: Table is read-only");
+
+	// Find the entry
+	hash = sht_hash(ht, key);
+	pos = sht_probe(ht, hash, key, nullptr);
+	if (pos < 0) {
+		assert(pos == -1);
+		return 0;
+	}
+
+	sht_remove_at(ht, pos, out);
+	return 1;
+}
+
+/**
+ * Remove and return an entry from the table.
  *
- * The mode of operation depends on the values of @p key, @p ce, and @p c_uniq.
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	key	The key for which the entry is to be "popped."
+ * @param[out]	out	Entry output buffer.  Must be large enough to hold an
+ *			entry.
+ * @returns	If the key was present in the table, true (`1`) is returned, and
+ *		its entry is stored in @p out.  Otherwise, false (`0`) is
+ *		returned (and the contents of @p out are unchanged).
+ *
+ * @see		sht_delete()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_pop(struct sht_ht *ht, const void *restrict key, void *restrict out)
+{
+	return sht_remove(ht, key, out);
+}
+
+/**
+ * Remove an entry from the table.
  *
- * |      |  **key** |  **ce**  |**c_uniq**|
- * |------|:--------:|:--------:|:---------|
- * |search|non-`NULL`|  `NULL`  |  `false` |
- * |insert|non-`NULL`|non-`NULL`|  `false` |
- * |rehash|  `NULL`  |non-`NULL`|  `true`  |
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	hash	Hash of @p key.
- * @param	key	The key to be found or added.
- * @param	ce	"Candidate" entry to insert (if not already present).
- * @param	c_uniq	Is @p key known to not be present in the table?
- *
- * @returns	If @p key is already present in the table, its position (index)
- *		is returned.
- * @returns	`-1` indicates that @p key was not present in the table.  In
- *		insert mode, this indicates that it has been successfully added.
- * @returns	`-2` is returned only in insert mode.  It indicates that @p key
- *		is not present in the table, but the table must be expanded
- *		before it can be added.
- * @returns	The state of the table is unchanged, except when this function
- *		is called in insert mode and returns `-1`.
- */
-static int32_t sht_probe(struct sht_ht *ht, uint32_t hash, const void *key,
-			 const uint8_t *ce, bool c_uniq)
-{
-	uint8_t e_tmp[2][ht->esize];	// temp storage for displaced entries
-	union sht_bckt b_tmp[2];	// temp storage for displaced buckets
-	bool ti;			// index for e_tmp and b_tmp
-	union sht_bckt *cb;		// candidate bucket
-	union sht_bckt *ob;		// current position occupant bucket
-	uint8_t *oe;			// current position occupant entry
-	uint32_t p;			// current position (index)
+ * @param	key	The key for which the entry is to be removed.
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned.
+ *		Otherwise, false (`0`) is returned.
+ *
+ * @see		sht_pop()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+bool sht_delete(struct sht_ht *ht, const void *restrict key)
+{
+	return sht_remove(ht, key, nullptr);
+}
+
+/**
+ * Remove the entry at a known position, without shifting any other entries.
+ *
+ * Frees the entry's resources (if the table has a free function), updates the
+ * table statistics, and marks the position as empty.  The caller is
+ * responsible for closing the resulting gap (see sht_close_gap()).
+ *
+ * @param	ht	The hash table.
+ * @param	pos	The position of the entry to be removed.
+ */
+static void sht_drop_at(struct sht_ht *ht, uint32_t pos)
+{
+	union sht_bckt b;
+	uint8_t *e;
 
-	assert(	(key != nullptr && ce == nullptr && c_uniq == 0)    /* search */
-		|| (key != nullptr && ce != nullptr && c_uniq == 0) /* insert */
-		|| (key == nullptr && ce != nullptr && c_uniq == 1) /* rehash */
-	);
+	b = sht_bckt(ht, pos);
+	e = sht_entry(ht, pos);
 
-	cb = b_tmp;  // Initial candidate bucket goes in b_tmp[0]
-	cb->hash = hash;
-	cb->psl = 0;
-	cb->empty = 0;
-	ti = 1;  // so 1st displacement doesn't overwrite the candidate bucket
+	if (ht->freefn != nullptr)
+		ht->freefn(e, ht->free_ctx);
 
-	p = hash;  // masked to table size in loop
+	if (ht->indirect)
+		sht_pool_put(ht, e);
 
-	while (1) {
+	ht->count--;
+	ht->psl_sum -= b.psl;
 
-		p &= ht->mask;
-		ob = ht->buckets + p;
-		oe = ht->entries + p * ht->esize;
-
-		// Empty position?
-		if (ob->empty) {
-			if (ce != nullptr) {
-				if (ht->count == ht->thold)  // rehash needed?
-					return -2;
-				sht_set_entry(ht, ce, cb, oe, ob);
+	if (b.psl == ht->psl_limit) {
+		assert(ht->max_psl_ct > 0);
+		ht->max_psl_ct--;
+	}
+
+	b.all = 0;
+	sht_set_bckt(ht, pos, b);
+	sht_dirty_bckts(ht, pos, 1);
+	sht_dirty_entries(ht, pos, 1);
+}
+
+/**
+ * Move an entry toward its ideal position, into a gap left by removals.
+ *
+ * The entry at @p src is moved down by @p gap positions, or by its PSL if that
+ * is smaller (an entry is never moved before its ideal position).  Each entry
+ * is copied (at most) once, so a run of entries that follows a gap can be
+ * compacted by calling this function on each entry in turn.
+ *
+ * @param	ht	The hash table.
+ * @param	src	The position of the entry to be moved.
+ * @param	gap	The number of empty positions immediately preceding
+ *			@p src.
+ *
+ * @returns	The number of empty positions immediately following @p src,
+ *		after the entry has been moved.  (I.e., the size of the gap
+ *		that the next entry may be moved into.)
+ */
+static uint32_t sht_close_gap(struct sht_ht *ht, uint32_t src, uint32_t gap)
+{
+	union sht_bckt b;
+	uint32_t shift, dest;
+
+	b = sht_bckt(ht, src);
+	shift = b.psl < gap ? b.psl : gap;
+
+	if (shift == 0)
+		return 0;
+
+	dest = (src - shift) & ht->mask;
+
+	// Copies the bucket's key, if any (bucket is updated below)
+	sht_copy_pos(ht, dest, src);
+	sht_move_keys(ht, dest, src, 1);
+
+	// Entry is now shift positions closer to its ideal position
+	if (b.psl == ht->psl_limit) {
+		assert(ht->max_psl_ct > 0);
+		ht->max_psl_ct--;
+	}
+
+	b.psl -= shift;
+	sht_set_bckt(ht, dest, b);
+	b.all = 0;
+	sht_set_bckt(ht, src, b);
+	ht->psl_sum -= shift;
+
+	sht_dirty_bckts(ht, dest, 1);
+	sht_dirty_bckts(ht, src, 1);
+	sht_dirty_entries(ht, dest, 1);
+	sht_dirty_entries(ht, src, 1);
+
+	return shift;
+}
+
+/**
+ * Comparison function for sorting positions with qsort().
+ *
+ * @param	a	Pointer to the first position.
+ * @param	b	Pointer to the second position.
+ *
+ * @returns	A negative, zero, or positive value, as @p a is less than, equal
+ *		to, or greater than @p b.
+ */
+static int sht_pos_cmp(const void *a, const void *b)
+{
+	const uint32_t *pa = a, *pb = b;
+
+	return (*pa > *pb) - (*pa < *pb);
+}
+
+/**
+ * Remove multiple entries from the table.
+ *
+ * This function is equivalent to calling sht_delete() for each key in @p keys,
+ * but it is much more efficient when many keys are deleted from the same
+ * table.  All of the entries to be removed are located first, and then each
+ * affected run of entries is compacted in a single pass, rather than once per
+ * deletion.
+ *
+ * Keys that are not present in the table are ignored, as are duplicate keys.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	keys	The keys for which the entries are to be removed.
+ * @param	n	The number of keys in @p keys.
+ *
+ * @returns	On success, the number of entries that were removed is returned.
+ *		If an error occurs, `-1` is returned, the error status of the
+ *		table is set, and the state of the table is otherwise unchanged.
+ *
+ * @see		sht_delete()
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+int32_t sht_delete_many(struct sht_ht *ht, const void *const *keys, uint32_t n)
+{
+	uint32_t *pos;		// positions of entries to be removed
+	uint32_t count;		// number of positions in pos
+	uint32_t hash, gap, src, i, j;
+	size_t size;
+	int32_t p;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_delete_many: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_delete_many: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_delete_many: Table is read-only");
+
+	if (n == 0 || ht->count == 0)
+		return 0;
+
+	if (ckd_mul(&size, n, sizeof *pos) || (pos = malloc(size)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return -1;
+	}
+
+	// Find all of the entries before anything is moved
+	for (i = 0, count = 0; i < n; ++i) {
+		hash = sht_hash(ht, keys[i]);
+		p = sht_probe(ht, hash, keys[i], nullptr);
+		if (p >= 0)
+			pos[count++] = p;
+	}
+
+	// Sort positions and remove duplicates
+	qsort(pos, count, sizeof *pos, sht_pos_cmp);
+
+	for (i = 1, j = 0; i < count; ++i) {
+		if (pos[i] != pos[j])
+			pos[++j] = pos[i];
+	}
+
+	if (count != 0)
+		count = j + 1;
+
+	// Remove the entries and close the gaps, one run at a time.  A run
+	// ends when it reaches an empty position or an entry that is already
+	// in its ideal position (gap == 0).  If the last run wraps around to
+	// the beginning of the table, it is compacted against the (already
+	// compacted) runs at the beginning of the table.
+	sht_shm_write_begin(ht);
+
+	for (i = 0, gap = 0, src = 0; i < count || gap != 0; ) {
+
+		if (gap == 0)
+			src = pos[i];
+
+		if (i < count && src == pos[i]) {
+			sht_drop_at(ht, src);
+			gap++;
+			i++;
+		}
+		else if (!sht_bckt(ht, src).used) {
+			gap = 0;
+		}
+		else {
+			gap = sht_close_gap(ht, src, gap);
+		}
+
+		src = (src + 1) & ht->mask;
+	}
+
+	sht_shm_write_end(ht);
+	free(pos);
+
+	return count;
+}
+
+/**
+ * Remove all entries that match a predicate.
+ *
+ * Calls @p pred once for each entry in the table, and removes each entry for
+ * which it returns true (`1`).  The table is compacted in a single linear
+ * sweep, so this function is much more efficient than deleting the same entries
+ * with a read/write iterator (or sht_delete_many()) when a large fraction of
+ * the table's entries is removed.
+ *
+ * The table's free function (if any) is called for each entry that is removed.
+ * @p pred must not modify the table.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ * @param	pred	Function that selects the entries to be removed.
+ * @param	context	Optional context for @p pred.
+ *
+ * @returns	The number of entries that were removed.
+ *
+ * @see		sht_predfn_t
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+uint32_t sht_remove_if(struct sht_ht *ht, sht_predfn_t pred, void *context)
+{
+	uint32_t start, src, gap, removed, i;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_remove_if: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_remove_if: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_remove_if: Table is read-only");
+
+	sht_assert_nonnull((void (*)(void))pred,
+			   "sht_remove_if: pred must not be NULL");
+
+	if (ht->count == 0)
+		return 0;
+
+	// Start at an empty position or an entry in its ideal position, so no
+	// entry will need to be moved back past the start of the sweep
+	for (start = 0; start < ht->mask; ++start) {
+		if (!sht_bckt(ht, start).used || sht_bckt(ht, start).psl == 0)
+			break;
+	}
+
+	sht_shm_write_begin(ht);
+
+	for (i = 0, src = start, gap = 0, removed = 0; i < ht->tsize; ++i) {
+
+		if (!sht_bckt(ht, src).used) {
+			gap = 0;
+		}
+		else if (pred(sht_entry(ht, src), context)) {
+			sht_drop_at(ht, src);
+			gap++;
+			removed++;
+		}
+		else {
+			gap = sht_close_gap(ht, src, gap);
+		}
+
+		src = (src + 1) & ht->mask;
+	}
+
+	// Only possible if the sweep didn't start at an empty position or an
+	// entry with a PSL of 0 (i.e. the table was full); entries at the start
+	// of the sweep may now be able to move back into the gap.
+	while (gap != 0 && sht_bckt(ht, src).used) {
+		gap = sht_close_gap(ht, src, gap);
+		src = (src + 1) & ht->mask;
+	}
+
+	sht_shm_write_end(ht);
+
+	return removed;
+}
+
+/**
+ * Remove all entries from a table.
+ *
+ * If the table has a free function, it is called for each entry in the table,
+ * unless the table frees its resources in bulk (see sht_set_bulk_free()), in
+ * which case its resource arena is released instead.  The table's memory is
+ * retained, so the table can be reused without being reallocated or
+ * reinitialized.  (Its size is unchanged.)  The array of entry deadlines (see
+ * sht_set_ttl()), if any, is freed.
+ *
+ * Clearing a table that is not empty takes time proportional to the size of
+ * the table, not the number of entries.  If the table has a free function (and
+ * does not free its resources in bulk), the bucket array is scanned (and reset)
+ * up to the position of the last entry in the table, but entries are placed by
+ * hash, so that position is usually near the end of the table.  Otherwise, the
+ * bucket array is reset in a single pass.  Clearing an empty table does not
+ * touch any buckets.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that has
+ * > one or more iterators.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void sht_clear(struct sht_ht *ht)
+{
+	uint32_t found, i;
+
+	if (ht->tsize == 0)
+		sht_abort("sht_clear: Table not initialized");
+	if (ht->iter_lock != 0)
+		sht_abort("sht_clear: Table has iterator(s)");
+	if (ht->read_only)
+		sht_abort("sht_clear: Table is read-only");
+
+	if (ht->bulk_free)
+		sht_chunks_free(ht);
+
+	free(ht->ttl);
+	ht->ttl = nullptr;
+
+	if (ht->count == 0)
+		return;
+
+	sht_shm_write_begin(ht);
+
+	if (ht->freefn != nullptr && !ht->bulk_free) {
+
+		// Stop after the last entry; all subsequent buckets are empty
+		for (found = 0, i = 0; found < ht->count; ++i) {
+			if (sht_bckt(ht, i).used) {
+				ht->freefn(sht_entry(ht, i), ht->free_ctx);
+				++found;
 			}
-			return -1;
 		}
 
-		// Found key?
-		if (!c_uniq
-			&& cb->all == ob->all
-			&& ht->eqfn(key, oe, ht->eq_ctx)
-		) {
-			return p;
+		sht_empty_bckts(ht, i);
+		sht_dirty_bckts(ht, 0, i);
+		sht_dirty_entries(ht, 0, i);
+	}
+	else {
+		sht_empty_bckts(ht, ht->tsize);
+		sht_dirty_bckts(ht, 0, ht->tsize);
+		sht_dirty_entries(ht, 0, ht->tsize);
+	}
+
+	if (ht->indirect)
+		sht_pool_reset(ht);
+
+	ht->a_len = 0;
+	ht->hand = 0;
+	ht->count = 0;
+	ht->psl_sum = 0;
+	ht->peak_psl = 0;
+	ht->max_psl_ct = 0;
+
+	sht_shm_write_end(ht);
+}
+
+/**
+ * Free the resources used by a hash table.
+ *
+ * If the table has a free function, it is called for each entry in the table,
+ * unless the table frees its resources in bulk (see sht_set_bulk_free()).  If
+ * the table was created with SHT_INIT_INPLACE(), its storage is not freed; it
+ * may be reused for another table.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on a table that has one or more iterators.
+ * > (See [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
+ */
+void sht_free(struct sht_ht *ht)
+{
+	uint32_t i;
+	uint8_t *e;
+
+	if (ht->iter_lock != 0)
+		sht_abort("sht_free: Table has iterator(s)");
+
+	free(ht->dirty);
+
+	if (ht->map != nullptr) {
+		munmap(ht->map, ht->map_size);
+		if (!ht->inplace)
+			free(ht);
+		return;
+	}
+
+	if (ht->freefn != nullptr && !ht->bulk_free) {
+
+		for (i = 0; i < ht->tsize; ++i) {
+
+			if (sht_bckt(ht, i).used) {
+				e = sht_entry(ht, i);
+				ht->freefn(e, ht->free_ctx);
+			}
+		}
+	}
+
+	sht_pool_free(ht);
+	sht_chunks_free(ht);
+	free(ht->refs);
+	free(ht->ttl);
+	free(ht->arena);
+	free(ht->a_entry);
+	if (!ht->in_buf)
+		free(ht->buckets);
+	if (!ht->inplace)
+		free(ht);
+}
+
+/**
+ * Copy the entries of a table into a clone of the table.
+ *
+ * Copies the table's indirect entries (if it has them) into the clone's slabs,
+ * and calls the copy function (if any) for each entry.
+ *
+ * @param	clone	The clone, whose arrays have already been copied.
+ * @param	ht	The table from which the clone was copied.
+ * @param	copyfn	Function used to copy entry resources (or `NULL`).
+ * @param	context	Optional context for @p copyfn.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, the error status of @p ht is set, and the resources of
+ *		any entries that were copied by @p copyfn have been freed.
+ */
+static bool sht_clone_entries(struct sht_ht *clone, struct sht_ht *ht,
+			      sht_copyfn_t copyfn, void *context)
+{
+	uint32_t i, j;
+	uint8_t *e;
+
+	for (i = 0; i < clone->tsize; ++i) {
+
+		if (!sht_bckt(clone, i).used)
+			continue;
+
+		// Indirect entries are copied into the clone's slabs
+		if (clone->indirect) {
+			if ((e = sht_pool_get(clone)) == nullptr) {
+				ht->err = SHT_ERR_ALLOC;
+				break;
+			}
+			memcpy(e, sht_entry(ht, i), ht->esize);
+			memcpy(sht_slot(clone, i), &e, sizeof e);
 		}
 
-		// Found later bucket group?
-		if (cb->psl > ob->psl) {
-			// If we're just searching, we're done
-			if (ce == nullptr)
-				return -1;
-			// Only need this check before 1st displacement
-			if (!c_uniq && ht->count == ht->thold)
-				return -2;
-			// Move occupant to temp slot & adjust table stats
-			sht_remove_entry(ht, oe, ob, e_tmp[ti], b_tmp + ti);
-			// Move candidate to current pos'n & adjust table stats
-			sht_set_entry(ht, ce, cb, oe, ob);
-			// Old occupant (in temp slot) is new candidate
-			cb = b_tmp + ti;
-			ce = e_tmp[ti];
-			// Use other temp slot next time (don't overwrite)
-			ti ^= 1;
-			// New candidate was in table; must be unique
-			c_uniq = 1;
+		if (copyfn != nullptr && !copyfn(sht_entry(clone, i),
+						 sht_entry(ht, i), context)) {
+			ht->err = SHT_ERR_COPY;
+			break;
 		}
+	}
 
-		// https://github.com/ipilcher/sht/blob/main/docs/psl-limits.md
-		assert(cb->psl < ht->psl_limit);
-		cb->psl++;
-		p++;
+	if (i == clone->tsize)
+		return 1;
+
+	// Free resources of the entries that were copied
+	if (copyfn != nullptr && clone->freefn != nullptr) {
+		for (j = 0; j < i; ++j) {
+			if (sht_bckt(clone, j).used)
+				clone->freefn(sht_entry(clone, j),
+					      clone->free_ctx);
+		}
 	}
-}
 
+	return 0;
+}
 
 /**
- * Doubles the size of the table.
+ * Copy a table's blob arena into its clone.
  *
- * @param	ht	The hash table.
+ * @param	clone	The new table.
+ * @param	ht	The source table.
  *
  * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
- *		returned, and the table's error status is set.  (The state of
- *		the table is otherwise unchanged.)
+ *		returned, and the error status of @p ht is set.
  */
-static bool sht_ht_grow(struct sht_ht *ht)
+static bool sht_clone_arena(struct sht_ht *clone, struct sht_ht *ht)
 {
-	union sht_bckt *b, *old;
-	uint8_t *e;
-	int result;
-	uint32_t i;
-
-	if (ht->tsize == SHT_MAX_TSIZE) {
-		ht->err = SHT_ERR_TOOBIG;
-		return 0;
-	}
+	clone->arena = malloc(ht->a_size);
+	clone->a_entry = malloc(ht->esize);
 
-	old = ht->buckets;  // save to free
-	b = ht->buckets;
-	e = ht->entries;
-
-	if (!sht_alloc_arrays(ht, ht->tsize * 2))
+	if (clone->arena == nullptr || clone->a_entry == nullptr) {
+		free(clone->arena);
+		free(clone->a_entry);
+		ht->err = SHT_ERR_ALLOC;
 		return 0;
-
-	for (i = 0; i < ht->tsize / 2; ++i, ++b, e += ht->esize) {
-		if (!b->empty) {
-			result = sht_probe(ht, b->hash, nullptr, e, 1);
-			assert(result == -1);
-		}
 	}
 
-	free(old);
+	memcpy(clone->arena, ht->arena, ht->a_len);
+	clone->a_pending = 0;
 
 	return 1;
 }
 
 /**
- * Add an entry to a table.
+ * Create a copy of a table.
  *
- * If @p key is already present in the table, the behavior depends on the value
- * of @p replace.  If it is true (`1`), the existing entry will be replaced by
- * @p entry; if it is false (`0`), the existing entry will be left in place.
+ * The new table has the same configuration (functions, contexts, load factor
+ * threshold, and PSL limit) as @p ht, and it contains copies of all of the
+ * entries in @p ht.  The table's arrays are copied in a single operation, so
+ * no entries are rehashed.
  *
- * @param	ht	The hash table.
- * @param	key	The key of the new entry.
- * @param	entry	The new entry.
- * @param	replace	How to handle duplicate key.
+ * If the table's entries own resources (such as dynamically allocated
+ * strings), a copy function must be used to copy those resources.  It is
+ * called once for each entry in the table, after the entry has been copied.  If
+ * the copy function fails, the free function (if any) is called for each entry
+ * that has already been copied, and no table is created.  (A table that has a
+ * free function cannot be cloned without a copy function, because both tables
+ * would then free the same resources.)
  *
- * @returns	If an error occurs, `-1` is returned, the error status of the
- *		table is set, and the state of the table is otherwise unchanged.
- *		On success, `0` is returned if the key was not already present
- *		in the table, and `1` is returned if the key was already
- *		present.
+ * The new table does not have any iterators, even if @p ht does.  If @p ht has
+ * indirect entries, the new table has its own copies of them.
  *
- * @see		sht_add()
- * @see		sht_set()
+ * > **NOTE**
+ * >
+ * > This function cannot be called on an unitialized table or a table that
+ * > frees its resources in bulk, and @p copyfn cannot be `NULL` if the table
+ * > has a free function.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table to be copied.
+ * @param	copyfn	Function used to copy entry resources (or `NULL`, if the
+ *			table does not have a free function).
+ * @param	context	Optional context for @p copyfn.
+ *
+ * @returns	On success, a pointer to the new table is returned.  On
+ *		failure, `NULL` is returned, and the error status of @p ht is
+ *		set.
+ *
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-static int sht_insert(struct sht_ht *ht, const void *key,
-		      const void *entry, bool replace)
+struct sht_ht *sht_clone(struct sht_ht *ht, sht_copyfn_t copyfn,
+			 void *context)
 {
-	uint32_t hash;
-	int32_t result;
-	uint8_t *current;
+	struct sht_ht *clone;
+	size_t k_off, e_off, size;
+	uint8_t *new;
 
 	if (ht->tsize == 0)
-		sht_abort("sht_add/sht_set: Table not initialized");
-	if (ht->iter_lock != 0)
-		sht_abort("sht_add/sht_set: Table has iterator(s)");
-
-	assert(key != nullptr && entry != nullptr);
-
-	if (ht->max_psl_ct != 0) {
-		ht->err = SHT_ERR_BAD_HASH;
-		return -1;
+		sht_abort("sht_clone: Table not initialized");
+	if (ht->bulk_free)
+		sht_abort("sht_clone: Table frees resources in bulk");
+	if (ht->freefn != nullptr && copyfn == nullptr)
+		sht_abort("sht_clone: "
+			  "Table has free function but no copy function");
+
+	// Sizes were validated when the source arrays were allocated.  (The
+	// layout of a mapped table's arrays isn't calculated by
+	// sht_arrays_layout(), but a mapped table isn't interleaved.)
+	if (ht->line_n != 0) {
+		sht_arrays_layout(ht, ht->tsize, &k_off, &e_off, &size);
+	}
+	else {
+		e_off = (size_t)(ht->entries - (uint8_t *)ht->buckets);
+		size = e_off + (size_t)ht->tsize * ht->ssize;
 	}
 
-	hash = ht->hashfn(key, ht->hash_ctx);
+	if ((clone = malloc(sizeof *clone)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return nullptr;
+	}
 
-	result = sht_probe(ht, hash, key, entry, 0);
+	if ((new = sht_arrays_alloc(ht, size, 0)) == nullptr) {
+		free(clone);
+		ht->err = SHT_ERR_ALLOC;
+		return nullptr;
+	}
 
-	if (result >= 0) {
-		if (replace) {
-			current = ht->entries + result * ht->esize;
-			if (ht->freefn != nullptr)
-				ht->freefn(current, ht->free_ctx);
-			memcpy(current, entry, ht->esize);
+	memcpy(new, ht->buckets, size);
+
+	*clone = *ht;
+	clone->buckets = (union sht_bckt *)(void *)new;
+	clone->keys = ht->keys != nullptr
+			? new + (ht->keys - (uint8_t *)ht->buckets) : nullptr;
+	clone->entries = new + e_off;
+	clone->in_buf = 0;
+	clone->inplace = 0;
+	clone->buf = nullptr;
+	clone->buf_size = 0;
+	clone->map = nullptr;
+	clone->map_size = 0;
+	clone->fhdr = nullptr;
+	clone->read_only = 0;
+	clone->dirty = nullptr;
+	clone->ckpt_gen = 0;
+	clone->ckpt_id = 0;
+	clone->slabs = nullptr;
+	clone->free_list = nullptr;
+	clone->err = SHT_ERR_OK;
+	clone->iter_lock = 0;
+
+	if (clone->refs != nullptr) {
+		if ((clone->refs = malloc(ht->tsize)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			free(new);
+			free(clone);
+			return nullptr;
 		}
-		return 1;
+		memcpy(clone->refs, ht->refs, ht->tsize);
 	}
 
-	if (result == -1)
-		return 0;
+	if (clone->ttl != nullptr) {
+		size = sht_ttl_len(ht->tsize) * sizeof *ht->ttl;
+		if ((clone->ttl = malloc(size)) == nullptr) {
+			ht->err = SHT_ERR_ALLOC;
+			free(clone->refs);
+			free(new);
+			free(clone);
+			return nullptr;
+		}
+		memcpy(clone->ttl, ht->ttl, size);
+	}
 
-	assert(result == -2);
+	if (clone->blobs && !sht_clone_arena(clone, ht)) {
+		free(clone->refs);
+		free(clone->ttl);
+		free(new);
+		free(clone);
+		return nullptr;
+	}
 
-	if (!sht_ht_grow(ht))
-		return -1;
+	if (copyfn == nullptr && !clone->indirect)
+		return clone;
+
+	if (!sht_clone_entries(clone, ht, copyfn, context)) {
+		sht_pool_free(clone);
+		free(clone->refs);
+		free(clone->ttl);
+		free(clone->arena);
+		free(clone->a_entry);
+		free(new);
+		free(clone);
+		return nullptr;
+	}
 
-	result = sht_probe(ht, hash, nullptr, entry, 1);
-	assert(result == -1);
-	return 0;
+	return clone;
 }
 
 /**
- * Add an entry to the table, if its key is not already present.
+ * Calculate the layout of a table file.
  *
- * > **NOTE**
- * >
- * > This function cannot be called on an unitialized table or a table that has
- * > one or more iterators.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * The padding between the bucket array and the entry array is the same as in
+ * the arrays allocated by sht_alloc_arrays() for a table without a key array.
+ * (Key arrays are not stored in table files.)
  *
- * @param	ht	The hash table.
- * @param	key	The key of the new entry.
- * @param	entry	The new entry.
+ * @param[in,out]	hdr	The file header.  The @p tsize, @p esize, and
+ *				@p ealign members must be set; the offset and
+ *				size members are set by this function.
+ */
+static void sht_file_layout(struct sht_fhdr *hdr)
+{
+	uint64_t b_size, pad;
+
+	hdr->b_offset = (sizeof *hdr + hdr->ealign - 1) & ~(hdr->ealign - 1ULL);
+	b_size = (uint64_t)hdr->tsize * sizeof(union sht_bckt);
+	pad = (hdr->ealign - b_size % hdr->ealign) % hdr->ealign;
+	hdr->e_offset = hdr->b_offset + b_size + pad;
+	hdr->size = hdr->e_offset + (uint64_t)hdr->tsize * hdr->esize;
+}
+
+/**
+ * Write the contents of an output buffer to its file.
  *
- * @returns	If an error occurs, `-1` is returned, the error status of the
- *		table is set, and the state of the table is otherwise unchanged.
- *		On success, `0` is returned if the key was not already present
- *		in the table, and the new entry has been added; `1` indicates
- *		that the key was already present in the table, and the state of
- *		the table is unchanged.
+ * @param	ht	The hash table (for error reporting).
+ * @param	wb	The output buffer.
  *
- * @see		sht_set()
- * @see		[Abort conditions](index.html#abort-conditions)
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, the table's error status is set, and `errno` is set
+ *		by the failed system call.
  */
-int sht_add(struct sht_ht *ht, const void *key, const void *entry)
+static bool sht_wbuf_flush(struct sht_ht *ht, struct sht_wbuf *wb)
 {
-	return sht_insert(ht, key, entry, 0);
+	size_t done;
+	ssize_t ret;
+
+	for (done = 0; done < wb->len; done += ret) {
+
+		ret = write(wb->fd, wb->data + done, wb->len - done);
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			ht->err = SHT_ERR_IO;
+			return 0;
+		}
+	}
+
+	wb->len = 0;
+	return 1;
 }
 
 /**
- * Unconditionally set the value associated with a key.
+ * Append data to an output buffer.
  *
- * > **NOTE**
- * >
- * > This function cannot be called on an unitialized table or a table that has
- * > one or more iterators.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * @param	ht	The hash table (for error reporting).
+ * @param	wb	The output buffer.
+ * @param	src	The data to be written (or `NULL` to write zeroes).
+ * @param	n	The number of bytes to be written.
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
+ */
+static bool sht_wbuf_put(struct sht_ht *ht, struct sht_wbuf *wb,
+			 const void *src, size_t n)
+{
+	size_t chunk;
+
+	while (n > 0) {
+
+		chunk = SHT_WBUF_SIZE - wb->len;
+		if (chunk > n)
+			chunk = n;
+
+		if (src != nullptr) {
+			memcpy(wb->data + wb->len, src, chunk);
+			src = (const uint8_t *)src + chunk;
+		}
+		else {
+			memset(wb->data + wb->len, 0, chunk);
+		}
+
+		wb->len += chunk;
+		n -= chunk;
+
+		if (wb->len == SHT_WBUF_SIZE && !sht_wbuf_flush(ht, wb))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Fill in the header of a table file.
  *
  * @param	ht	The hash table.
- * @param	key	The key of the new entry.
- * @param	entry	The new entry.
+ * @param[out]	hdr	The file header.
+ */
+static void sht_fhdr_init(const struct sht_ht *ht, struct sht_fhdr *hdr)
+{
+	memset(hdr, 0, sizeof *hdr);
+	hdr->magic = SHT_FILE_MAGIC;
+	hdr->version = SHT_FILE_VERSION;
+	hdr->esize = ht->esize;
+	hdr->ealign = ht->ealign;
+	hdr->lft = ht->lft;
+	hdr->tsize = ht->tsize;
+	hdr->count = ht->count;
+	hdr->psl_sum = ht->psl_sum;
+	hdr->max_psl_ct = ht->max_psl_ct;
+	hdr->psl_limit = ht->psl_limit;
+	hdr->peak_psl = ht->peak_psl;
+	sht_file_layout(hdr);
+}
+
+/**
+ * Append a range of a table's file image to an output buffer.
  *
- * @returns	If an error occurs, `-1` is returned, the error status of the
- *		table is set, and the state of the table is otherwise unchanged.
- *		On success, `0` is returned if the key was not already present
- *		in the table, and the new entry has been added; `1` indicates
- *		that the key was already present in the table, and the new entry
- *		has replaced it.
+ * The file image consists of the header, the bucket array, and the entry
+ * array, at the offsets given by the header.  Padding and unused entry
+ * positions are written as zeroes.
  *
- * @see		sht_add()
- * @see		[Abort conditions](index.html#abort-conditions)
+ * @param	ht	The hash table.
+ * @param	wb	The output buffer.
+ * @param	hdr	The file header.
+ * @param	start	File offset of the start of the range.
+ * @param	end	File offset of the end of the range (exclusive).
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
  */
-int sht_set(struct sht_ht *ht, const void *key, const void *entry)
+static bool sht_wbuf_image(struct sht_ht *ht, struct sht_wbuf *wb,
+			   const struct sht_fhdr *hdr, uint64_t start,
+			   uint64_t end)
 {
-	return sht_insert(ht, key, entry, 1);
+	uint64_t b_end, n, pos, off;
+	const void *src;
+
+	b_end = hdr->b_offset + (uint64_t)ht->tsize * sizeof(union sht_bckt);
+
+	for (; start < end; start += n) {
+
+		if (start < sizeof *hdr) {
+			n = sizeof *hdr - start;
+			src = (const uint8_t *)hdr + start;
+		}
+		else if (start < hdr->b_offset) {
+			n = hdr->b_offset - start;
+			src = nullptr;
+		}
+		else if (start < b_end) {
+			n = b_end - start;
+			src = (const uint8_t *)ht->buckets
+						+ (start - hdr->b_offset);
+		}
+		else if (start < hdr->e_offset) {
+			n = hdr->e_offset - start;
+			src = nullptr;
+		}
+		else {
+			pos = (start - hdr->e_offset) / ht->esize;
+			off = (start - hdr->e_offset) % ht->esize;
+			n = ht->esize - off;
+			src = ht->buckets[pos].used
+					? ht->entries + pos * ht->esize + off
+					: nullptr;
+		}
+
+		if (n > end - start)
+			n = end - start;
+
+		if (!sht_wbuf_put(ht, wb, src, n))
+			return 0;
+	}
+
+	return 1;
 }
 
 /**
- * Lookup an entry in a table.
+ * Save a table to a file.
  *
- * > **WARNING**
- * >
- * > The pointer returned by this function is only valid until the next time the
- * > table is changed.  Structural changes to the table (adding or removing
- * > keys) can cause other entries to be moved within the table, making pointers
- * > to those entries invalid.
+ * Writes the table's bucket array, entry array, and the parameters needed to
+ * use them to @p fd (starting at its current offset).  The file can be mapped
+ * into memory, as a read-only table, with sht_map().
+ *
+ * Entries are written exactly as they are stored in the table, so this
+ * function should only be used with tables whose entries contain plain data
+ * (no pointers).  Unused entry positions are written as zeroes.
+ *
+ * Files use the native byte order and data layout; they are not portable
+ * between different platforms.
  *
  * > **NOTE**
  * >
@@ -975,132 +5752,188 @@ int sht_set(struct sht_ht *ht, const void *key, const void *entry)
  * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	key	The key for which the entry is to be retrieved.
+ * @param	fd	The file descriptor to which the table is written.
  *
- * @returns	If the the key is present in the table, a pointer to the key's
- *		entry is returned.  Otherwise, `NULL` is returned.
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  If the error is
+ *		#SHT_ERR_IO, `errno` is set by the failed system call.
  *
+ * @see		sht_map()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-const void *sht_get(struct sht_ht *ht, const void *restrict key)
+bool sht_save(struct sht_ht *ht, int fd)
 {
-	uint32_t hash;
-	int32_t result;
+	struct sht_fhdr hdr;
+	struct sht_wbuf *wb;
+	bool ok;
 
 	if (ht->tsize == 0)
-		sht_abort("sht_get: Table not initialized");
+		sht_abort("sht_save: Table not initialized");
+	if (ht->indirect)
+		sht_abort("sht_save: Table has indirect entries");
+	if (ht->line_n != 0)
+		sht_abort("sht_save: Table is interleaved");
+	if (ht->compact)
+		sht_abort("sht_save: Table has compact buckets");
+	if (ht->ikeys)
+		sht_abort("sht_save: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_save: Table has a blob arena");
+	if (ht->cache_max != 0)
+		sht_abort("sht_save: Table is a cache");
+	if (ht->ttl != nullptr)
+		sht_abort("sht_save: Table has entry deadlines");
+
+	sht_fhdr_init(ht, &hdr);
+
+	if ((wb = malloc(sizeof *wb)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return 0;
+	}
 
-	hash = ht->hashfn(key, ht->hash_ctx);
-	result = sht_probe(ht, hash, key, nullptr, 0);
+	wb->fd = fd;
+	wb->len = 0;
 
-	if (result < 0) {
-		assert(result == -1);
-		return nullptr;
-	}
+	ok = sht_wbuf_image(ht, wb, &hdr, 0, hdr.size)
+		&& sht_wbuf_flush(ht, wb);
 
-	return ht->entries + result * ht->esize;
+	free(wb);
+	return ok;
 }
 
 /**
- * Change the entry at a known position.
+ * Check whether a file contains the last checkpoint of a table.
  *
  * @param	ht	The hash table.
- * @param	pos	The position of the entry to be replaced.
- * @param	entry	The new entry.
- * @param[out]	out	Output buffer for previous entry (or `NULL`).  @p out
- *			may point to the same object as @p entry.
+ * @param	fd	The checkpoint file descriptor.
+ * @param	hdr	The header of the next checkpoint.
  *
- * @see		sht_change()
+ * @returns	True (`1`) if the file was written by the last checkpoint of
+ *		@p ht (and has the same layout as the next checkpoint);
+ *		otherwise false (`0`).
  */
-static void sht_change_at(struct sht_ht *ht, uint32_t pos,
-			  const void *entry, void *out)
+static bool sht_ckpt_match(const struct sht_ht *ht, int fd,
+			   const struct sht_fhdr *hdr)
 {
-	uint8_t *e;
-
-	e = ht->entries + pos * ht->esize;
-
-	if (out == nullptr) {
-		if (ht->freefn != nullptr)
-			ht->freefn(e, ht->free_ctx);
-		memcpy(e, entry, ht->esize);
-	}
-	else if (out == entry) {
-		uint8_t tmp[ht->esize];
-		memcpy(tmp, e, ht->esize);
-		memcpy(e, entry, ht->esize);
-		memcpy(out, tmp, ht->esize);
-	}
-	else {
-		memcpy(out, e, ht->esize);
-		memcpy(e, entry, ht->esize);
-	}
+	struct sht_fhdr old;
+	ssize_t ret;
+
+	do {
+		ret = pread(fd, &old, sizeof old, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret == sizeof old
+		&& old.magic == SHT_FILE_MAGIC
+		&& old.version == SHT_FILE_VERSION
+		&& old.ckpt_id == ht->ckpt_id
+		&& old.ckpt_gen == ht->ckpt_gen
+		&& old.esize == hdr->esize
+		&& old.ealign == hdr->ealign
+		&& old.tsize == hdr->tsize
+		&& old.size == hdr->size;
 }
 
 /**
- * Change the entry associated with an existing key.
+ * Check whether a page of a table's file image has been modified.
  *
  * @param	ht	The hash table.
- * @param	key	The key for which the value is to be changed.
- * @param	entry	The new entry.
- * @param[out]	out	Output buffer for previous entry (or `NULL`).  @p out
- *			may point to the same object as @p entry.
- *
- * @returns	If the key was present in the table, true (`1`) is returned, the
- *		entry associated with the key is replaced with the new entry,
- *		and the previous entry is copied to @p out (if it is not
- *		`NULL`).  Otherwise, false (`0`) is returned (and the contents
- *		of @p out are unchanged).
+ * @param	page	The page number.
  *
- * @see		sht_replace()
- * @see		sht_swap()
+ * @returns	True (`1`) if the page has been modified since the last
+ *		checkpoint; otherwise false (`0`).
  */
-static bool sht_change(struct sht_ht *ht, const void *key,
-			const void *entry, void *out)
+static bool sht_page_dirty(const struct sht_ht *ht, uint64_t page)
 {
-	uint32_t hash;
-	int32_t pos;
-
-	if (ht->tsize == 0)
-		sht_abort("sht_replace/sht_swap: Table not initialized");
-
-	hash = ht->hashfn(key, ht->hash_ctx);
-	pos = sht_probe(ht, hash, key, nullptr, 0);
+	return ht->dirty[page / 64] & UINT64_C(1) << (page % 64);
+}
 
-	if (pos < 0) {
-		assert(pos == -1);
+/**
+ * Write a range of a table's file image at the same offset in a file.
+ *
+ * @param	ht	The hash table.
+ * @param	wb	The (empty) output buffer.
+ * @param	hdr	The file header.
+ * @param	start	File offset of the start of the range.
+ * @param	end	File offset of the end of the range (exclusive).
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.
+ */
+static bool sht_ckpt_write(struct sht_ht *ht, struct sht_wbuf *wb,
+			   const struct sht_fhdr *hdr, uint64_t start,
+			   uint64_t end)
+{
+	if (lseek(wb->fd, start, SEEK_SET) < 0) {
+		ht->err = SHT_ERR_IO;
 		return 0;
 	}
 
-	sht_change_at(ht, pos, entry, out);
-
-	return 1;
+	return sht_wbuf_image(ht, wb, hdr, start, end)
+		&& sht_wbuf_flush(ht, wb);
 }
 
 /**
- * Replace the entry associated with an existing key.
- *
- * > **NOTE**
- * >
- * > This function cannot be called on an unitialized table.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * Generate a table's checkpoint identifier.
  *
- * @param	ht	The hash table.
- * @param	key	The key for which the value is to be replaced.
- * @param	entry	The new entry for the key.
+ * The identifier is random, so that a file written by the checkpoints of one
+ * table is not mistaken for the file of another table that has the same
+ * layout and checkpoint generation.  If `/dev/urandom` cannot be read, the
+ * identifier is derived from the address of the table, the process ID, and a
+ * counter.
  *
- * @returns	If the key was present in the table, true (`1`) is returned, and
- *		the entry associated with the key is replaced with the new
- *		entry.  Otherwise, false (`0`) is returned.
+ * @param	ht	The hash table.
  *
- * @see		[Abort conditions](index.html#abort-conditions)
+ * @returns	A non-zero identifier.
  */
-bool sht_replace(struct sht_ht *ht, const void *key, const void *entry)
+static uint64_t sht_ckpt_new_id(const struct sht_ht *ht)
 {
-	return sht_change(ht, key, entry, nullptr);
+	static _Atomic uint64_t counter;
+	uint64_t id;
+	ssize_t ret;
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) >= 0) {
+		do {
+			ret = read(fd, &id, sizeof id);
+		} while (ret < 0 && errno == EINTR);
+		close(fd);
+		if (ret == sizeof id && id != 0)
+			return id;
+	}
+
+	id = (uint64_t)(uintptr_t)ht ^ (uint64_t)getpid() << 32;
+	id += atomic_fetch_add(&counter, 1) * UINT64_C(0x9e3779b97f4a7c15);
+	id ^= id >> 31;
+
+	return id != 0 ? id : 1;
 }
 
 /**
- * Exchange an existing entry and a new entry.
+ * Write an incremental checkpoint of a table to a file.
+ *
+ * The first checkpoint of a table writes a complete table file (like
+ * sht_save()) and starts tracking the regions of the file that are modified
+ * as entries are added, changed, moved, and removed.  Each subsequent
+ * checkpoint to the same file writes only the regions that have changed since
+ * the previous checkpoint, so the cost of a checkpoint is proportional to the
+ * amount of the table that has changed, rather than the size of the table.
+ * After each checkpoint, the file is a complete table file that can be mapped
+ * into memory with sht_map().
+ *
+ * A complete file is written (and truncated to the correct size) instead if:
+ *
+ * - @p fd does not refer to the file written by the table's previous
+ *   checkpoint (as identified by a random table identifier and a generation
+ *   number in the file header),
+ * - the table has been resized since its previous checkpoint, or
+ * - the previous checkpoint failed.
+ *
+ * As with sht_save(), this function should only be used with tables whose
+ * entries contain plain data (no pointers).  A checkpoint is not atomic; if it
+ * is interrupted (for example, by a system crash), the file may be
+ * inconsistent.  Use `fsync()` (or `fdatasync()`) to make a completed
+ * checkpoint durable, and keep a previous copy of the file if recovery from an
+ * interrupted checkpoint is required.
  *
  * > **NOTE**
  * >
@@ -1108,269 +5941,548 @@ bool sht_replace(struct sht_ht *ht, const void *key, const void *entry)
  * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
- * @param	key	The key for which the value is to be replaced.
- * @param	entry	The new entry for the key.
- * @param	out	Output buffer for the previous entry.  Must be large
- *			enough to hold an entry.  (@p out may point to the same
- *			object as @p entry.)
+ * @param	fd	The file descriptor to which the checkpoint is written.
+ *			Must be open for reading and writing, and must be
+ *			seekable.
  *
- * @returns	If the key was present in the table, true (`1`) is returned, the
- *		entry associated with the key is replaced with the new entry,
- *		and the previous entry is copied to @p out.  Otherwise, false
- *		(`0`) is returned, and the contents of @p out are unchanged.
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  If the error is
+ *		#SHT_ERR_IO, `errno` is set by the failed system call.
  *
+ * @see		sht_save()
+ * @see		sht_map()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-bool sht_swap(struct sht_ht *ht, const void *key, const void *entry, void *out)
-{
-	return sht_change(ht, key, entry, out);
-}
-
-/**
- * Shift a block of entries (and buckets) down by 1 position.
- *
- * This function does **not** handle wrap-around.
- *
- * @param	ht	The hash table.
- * @param	dest	Position to which the block should be moved.
- * @param	count	The number of entries and buckets to be moved.
- */
-static void sht_shift(struct sht_ht *ht, uint32_t dest, uint32_t count)
+bool sht_checkpoint(struct sht_ht *ht, int fd)
 {
-	uint32_t i;
-
-	assert(dest + count < ht->tsize);
+	uint64_t npages, words, page, first, end;
+	struct sht_fhdr hdr;
+	struct sht_wbuf *wb;
+	bool full, ok;
 
-	// Move entries
-	memmove(ht->entries + dest * ht->esize,
-		ht->entries + (dest + 1) * ht->esize,
-		count * ht->esize);
+	if (ht->tsize == 0)
+		sht_abort("sht_checkpoint: Table not initialized");
+	if (ht->indirect)
+		sht_abort("sht_checkpoint: Table has indirect entries");
+	if (ht->line_n != 0)
+		sht_abort("sht_checkpoint: Table is interleaved");
+	if (ht->compact)
+		sht_abort("sht_checkpoint: Table has compact buckets");
+	if (ht->ikeys)
+		sht_abort("sht_checkpoint: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_checkpoint: Table has a blob arena");
+	if (ht->cache_max != 0)
+		sht_abort("sht_checkpoint: Table is a cache");
+	if (ht->ttl != nullptr)
+		sht_abort("sht_checkpoint: Table has entry deadlines");
+
+	if (ht->ckpt_id == 0)
+		ht->ckpt_id = sht_ckpt_new_id(ht);
+
+	sht_fhdr_init(ht, &hdr);
+	hdr.ckpt_id = ht->ckpt_id;
+	hdr.ckpt_gen = ht->ckpt_gen + 1;
+	if (hdr.ckpt_gen == 0)
+		hdr.ckpt_gen = 1;
+
+	npages = (hdr.size + SHT_CKPT_PAGE - 1) / SHT_CKPT_PAGE;
+	words = (npages + 63) / 64;
+
+	full = ht->dirty == nullptr || !sht_ckpt_match(ht, fd, &hdr);
+
+	if ((wb = malloc(sizeof *wb)) == nullptr) {
+		ht->err = SHT_ERR_ALLOC;
+		return 0;
+	}
 
-	// Move buckets
-	memmove(ht->buckets + dest,
-		ht->buckets + dest + 1,
-		count * sizeof(union sht_bckt));
+	if (ht->dirty == nullptr
+			&& (ht->dirty = calloc(words, sizeof *ht->dirty))
+								== nullptr) {
+		free(wb);
+		ht->err = SHT_ERR_ALLOC;
+		return 0;
+	}
 
-	// Every shifted entry is now 1 position closer to its ideal position
-	for (i = dest; i < dest + count; ++i) {
+	wb->fd = fd;
+	wb->len = 0;
 
-		if (ht->buckets[i].psl == ht->psl_limit) {
-			assert(ht->max_psl_ct > 0);
-			ht->max_psl_ct--;
+	if (full) {
+		ok = sht_ckpt_write(ht, wb, &hdr, 0, hdr.size);
+		if (ok && ftruncate(fd, hdr.size) < 0) {
+			ht->err = SHT_ERR_IO;
+			ok = 0;
 		}
-
-		ht->buckets[i].psl--;
 	}
+	else {
+		// Write each run of dirty pages; the first page (which contains
+		// the header) is written last
+		for (page = 1, ok = 1; ok && page < npages; ) {
 
-	// PSL total decreased by 1x number of moved entries
-	ht->psl_sum -= count;
-}
+			if (!sht_page_dirty(ht, page)) {
+				++page;
+				continue;
+			}
 
-/**
- * Shift the entry at position 0 "down" to the last position in the table.
- *
- * @param	ht	The hash table.
- */
-static void sht_shift_wrap(struct sht_ht *ht)
-{
-	// ht->mask is also index of last position
+			first = page;
+			while (page < npages && sht_page_dirty(ht, page))
+				++page;
 
-	// Move entry
-	memcpy(ht->entries + ht->mask * ht->esize, ht->entries, ht->esize);
+			end = page * SHT_CKPT_PAGE;
+			if (end > hdr.size)
+				end = hdr.size;
 
-	// Move bucket
-	ht->buckets[ht->mask] = ht->buckets[0];
+			ok = sht_ckpt_write(ht, wb, &hdr, first * SHT_CKPT_PAGE,
+					    end);
+		}
 
-	// Entry is now 1 position closer to its ideal position
-	if (ht->buckets[ht->mask].psl == ht->psl_limit) {
-		assert(ht->max_psl_ct > 0);
-		ht->max_psl_ct--;
+		end = SHT_CKPT_PAGE < hdr.size ? SHT_CKPT_PAGE : hdr.size;
+		ok = ok && sht_ckpt_write(ht, wb, &hdr, 0, end);
 	}
 
-	ht->buckets[ht->mask].psl--;
-	ht->psl_sum--;
+	free(wb);
+
+	// If anything went wrong, the next checkpoint will be complete
+	if (!ok) {
+		free(ht->dirty);
+		ht->dirty = nullptr;
+		return 0;
+	}
+
+	memset(ht->dirty, 0, words * sizeof *ht->dirty);
+	ht->ckpt_boff = hdr.b_offset;
+	ht->ckpt_eoff = hdr.e_offset;
+	ht->ckpt_gen = hdr.ckpt_gen;
+
+	return 1;
 }
 
 /**
- * Remove and possibly return an entry at a known position.
+ * Check the header of a table file.
  *
- * @param	ht	The hash table.
- * @param	pos	The position of the entry to be removed.
- * @param[out]	out	Entry output buffer (or `NULL`).
+ * @param	ht	The hash table into which the file is being mapped.
+ * @param	hdr	The file header.
+ * @param	size	The size of the file.
  *
- * @see		sht_remove()
+ * @returns	True (`1`) if the file is a valid table file that is compatible
+ *		with @p ht; otherwise false (`0`).
  */
-static void sht_remove_at(struct sht_ht *ht, uint32_t pos, void *restrict out)
+static bool sht_fhdr_ok(const struct sht_ht *ht, const struct sht_fhdr *hdr,
+			size_t size)
 {
-	uint32_t end, next;
+	struct sht_fhdr layout;
 
-	// Copy entry to output buffer or free its resources
-	if (out != nullptr) {
-		memcpy(out, ht->entries + pos * ht->esize, ht->esize);
-	}
-	else if (ht->freefn != nullptr) {
-		ht->freefn(ht->entries + pos * ht->esize, ht->free_ctx);
-	}
+	if (hdr->magic != SHT_FILE_MAGIC || hdr->version != SHT_FILE_VERSION)
+		return 0;
 
-	// Update table stats for removal
-	ht->psl_sum -= ht->buckets[pos].psl;
-	ht->count--;
+	if (hdr->esize != ht->esize || hdr->ealign != ht->ealign)
+		return 0;
 
-	// Find range to shift (if any)
-	end = pos;
-	next = (pos + 1) & ht->mask;
-	while (!ht->buckets[next].empty && ht->buckets[next].psl != 0) {
-		end = next;
-		next = (next + 1) & ht->mask;
-	}
+	if (!stdc_has_single_bit(hdr->tsize) || hdr->tsize > SHT_MAX_TSIZE
+			|| hdr->count > hdr->tsize)
+		return 0;
 
-	// Do any necessary shifts
-	if ((uint32_t)pos == end) {
-		// no shifts needed
-	}
-	else if ((uint32_t)pos < end) {
-		// no wrap-around
-		sht_shift(ht, pos, end - pos);
-	}
-	else {
-		// Shift entries up to end of table (if any)
-		if ((uint32_t)pos < ht->mask)	// mask is also max index
-			sht_shift(ht, pos, ht->mask - pos);
+	if (hdr->lft < 1 || hdr->lft > 100)
+		return 0;
 
-		// Shift entry from position 0 "down" to the end of table
-		sht_shift_wrap(ht);
+	if (hdr->psl_limit < 1 || hdr->psl_limit > SHT_DEF_PSL_LIMIT)
+		return 0;
 
-		// Shift entries at the beginning of the table
-		sht_shift(ht, 0, end);
-	}
+	layout.tsize = hdr->tsize;
+	layout.esize = hdr->esize;
+	layout.ealign = hdr->ealign;
+	sht_file_layout(&layout);
 
-	// Mark position at end of range as empty
-	ht->buckets[end].empty = 1;
+	return layout.b_offset == hdr->b_offset
+		&& layout.e_offset == hdr->e_offset
+		&& layout.size == hdr->size
+		&& hdr->size == size;
 }
 
 /**
- * Remove and possibly return an entry from the table.
+ * Use a file mapping as a table's arrays.
  *
- * (If @p out is `NULL`, the entry is simply removed from the table.)
+ * @param	ht		The hash table.
+ * @param	map		The mapping (which starts with a valid header).
+ * @param	size		The size of the mapping.
+ * @param	read_only	Is the mapping read-only?
+ */
+static void sht_attach(struct sht_ht *ht, void *map, size_t size,
+		       bool read_only)
+{
+	struct sht_fhdr *hdr = map;
+
+	ht->map = map;
+	ht->map_size = size;
+	ht->fhdr = hdr;
+	ht->read_only = read_only;
+	ht->buckets = (union sht_bckt *)(void *)
+					((uint8_t *)map + hdr->b_offset);
+	ht->entries = (uint8_t *)map + hdr->e_offset;
+	ht->lft = hdr->lft;
+	ht->psl_limit = hdr->psl_limit;
+	ht->tsize = hdr->tsize;
+	ht->mask = hdr->tsize - 1;
+	ht->thold = hdr->tsize * hdr->lft / 100;
+	ht->count = hdr->count;
+	ht->psl_sum = hdr->psl_sum;
+	ht->max_psl_ct = hdr->max_psl_ct;
+	ht->peak_psl = hdr->peak_psl;
+}
+
+/**
+ * Map a table file into memory, using an open file descriptor.
  *
- * @param	ht	The hash table.
- * @param	key	The key for which the entry is to be retrieved and
- *			removed.
- * @param[out]	out	Entry output buffer (or `NULL`).
+ * Initializes @p ht by mapping a file that was created by sht_save() (or the
+ * shared memory segment of a shared table) into memory.  The table's buckets
+ * and entries are used in place; no entries are rehashed or copied, and the
+ * memory used by the table is shared with any other processes that map the
+ * same file.
  *
- * @returns	If the key was present in the table, true (`1`) is returned, and
- *		its entry is stored in @p out (if it is not `NULL`).  Otherwise,
- *		false (`0`) is returned (and the contents of @p out are
- *		unchanged).
+ * The table is **read-only**.  It can be used with functions such as sht_get()
+ * and read-only iterators, but functions that modify the table cannot be used.
+ * (To obtain a modifiable copy of a mapped table, use sht_clone().)  If the
+ * file is the segment of a shared table that may be modified by its writer,
+ * use sht_read() to look up entries.  (See sht_init_shared().)
  *
- * @see		sht_pop()
- * @see		sht_delete()
+ * @p ht must be created with the same entry size and alignment as the table
+ * that was saved, and with compatible hash and equality functions.  The load
+ * factor threshold and PSL limit of the saved table replace any values that
+ * were set on @p ht.  The table's free function (if any) is never called.
+ *
+ * The contents of the bucket and entry arrays are not validated; files must
+ * come from a trusted source.  @p fd is not used after this function returns;
+ * it may be closed.
+ *
+ * > **NOTE**
+ * >
+ * > This function cannot be called on a table that has already been
+ * > initialized.  (See [Abort conditions](index.html#abort-conditions).)
+ *
+ * @param	ht	The hash table to be initialized.
+ * @param	fd	A file descriptor for the table file (open for reading).
+ *
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  If the error is
+ *		#SHT_ERR_IO, `errno` is set by the failed system call.
+ *
+ * @see		sht_map()
+ * @see		sht_save()
+ * @see		[Abort conditions](index.html#abort-conditions)
  */
-static bool sht_remove(struct sht_ht *ht, const void *restrict key,
-			void *restrict out)
+bool sht_map_fd(struct sht_ht *ht, int fd)
 {
-	uint32_t hash;
-	int32_t pos;
+	struct stat st;
+	void *map;
 
-	if (ht->tsize == 0)
-		sht_abort("sht_pop/sht_delete: Table not initialized");
-	if (ht->iter_lock != 0)
-		sht_abort("sht_pop/sht_delete: Table has iterator(s)");
+	if (ht->tsize != 0)
+		sht_abort("sht_map_fd: Table already initialized");
+	if (ht->indirect)
+		sht_abort("sht_map_fd: Table has indirect entries");
+	if (ht->line_n != 0)
+		sht_abort("sht_map_fd: Table is interleaved");
+	if (ht->compact)
+		sht_abort("sht_map_fd: Table has compact buckets");
+	if (ht->ikeys)
+		sht_abort("sht_map_fd: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_map_fd: Table has a blob arena");
+	if (ht->cache_max != 0)
+		sht_abort("sht_map_fd: Table is a cache");
+
+	if (fstat(fd, &st) < 0) {
+		ht->err = SHT_ERR_IO;
+		return 0;
+	}
 
-	// Find the entry
-	hash = ht->hashfn(key, ht->hash_ctx);
-	pos = sht_probe(ht, hash, key, nullptr, 0);
-	if (pos < 0) {
-		assert(pos == -1);
+	if (st.st_size < (off_t)sizeof(struct sht_fhdr)
+			|| (uintmax_t)st.st_size > SIZE_MAX) {
+		ht->err = SHT_ERR_BAD_FILE;
 		return 0;
 	}
 
-	sht_remove_at(ht, pos, out);
+	map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		ht->err = SHT_ERR_IO;
+		return 0;
+	}
+
+	if (!sht_fhdr_ok(ht, map, st.st_size)
+			|| (uintptr_t)map % ht->ealign != 0) {
+		munmap(map, st.st_size);
+		ht->err = SHT_ERR_BAD_FILE;
+		return 0;
+	}
+
+	sht_attach(ht, map, st.st_size, 1);
+
 	return 1;
 }
 
 /**
- * Remove and return an entry from the table.
+ * Map a table file into memory.
+ *
+ * Opens @p path and maps it with sht_map_fd().  (See sht_map_fd() for
+ * details.)
  *
  * > **NOTE**
  * >
- * > This function cannot be called on an unitialized table or a table that has
- * > one or more iterators.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * > This function cannot be called on a table that has already been
+ * > initialized.  (See [Abort conditions](index.html#abort-conditions).)
  *
- * @param	ht	The hash table.
- * @param	key	The key for which the entry is to be "popped."
- * @param[out]	out	Entry output buffer.  Must be large enough to hold an
- *			entry.
- * @returns	If the key was present in the table, true (`1`) is returned, and
- *		its entry is stored in @p out.  Otherwise, false (`0`) is
- *		returned (and the contents of @p out are unchanged).
+ * @param	ht	The hash table to be initialized.
+ * @param	path	The path of the table file.
  *
- * @see		sht_delete()
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  If the error is
+ *		#SHT_ERR_IO, `errno` is set by the failed system call.
+ *
+ * @see		sht_map_fd()
+ * @see		sht_save()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-bool sht_pop(struct sht_ht *ht, const void *restrict key, void *restrict out)
+bool sht_map(struct sht_ht *ht, const char *path)
 {
-	return sht_remove(ht, key, out);
+	int fd, saved;
+	bool result;
+
+	if (ht->tsize != 0)
+		sht_abort("sht_map: Table already initialized");
+	if (ht->indirect)
+		sht_abort("sht_map: Table has indirect entries");
+	if (ht->line_n != 0)
+		sht_abort("sht_map: Table is interleaved");
+	if (ht->compact)
+		sht_abort("sht_map: Table has compact buckets");
+	if (ht->ikeys)
+		sht_abort("sht_map: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_map: Table has a blob arena");
+	if (ht->cache_max != 0)
+		sht_abort("sht_map: Table is a cache");
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		ht->err = SHT_ERR_IO;
+		return 0;
+	}
+
+	result = sht_map_fd(ht, fd);
+
+	saved = errno;
+	close(fd);
+	errno = saved;
+
+	return result;
 }
 
 /**
- * Remove an entry from the table.
+ * Initialize a shared table.
+ *
+ * A shared table is a table whose arrays (and a header that describes them)
+ * are stored in a shared memory segment, such as a POSIX shared memory object
+ * (`shm_open()`) or an anonymous file (`memfd_create()`).  The process that
+ * calls this function is the table's **writer**; it uses the table normally.
+ * Other processes (**readers**) map the same segment with sht_map() or
+ * sht_map_fd(), which creates a read-only view of the table that does not use
+ * any private memory for buckets or entries.
+ *
+ * Readers must use sht_read() to look up entries while the writer may be
+ * modifying the table.  Each modification is protected by a sequence lock in
+ * the shared header; sht_read() retries any lookup that overlaps a
+ * modification, so it never returns a partially updated entry.  (sht_get()
+ * and iterators do not retry, so readers can only use them while the writer is
+ * known to be idle.)  There must be only one writer.
+ *
+ * If the writer process terminates while it is modifying the table, the
+ * modification never completes, and the sequence lock is never released.
+ * Readers then wait forever in sht_read() (and sht_size()), so the process
+ * that manages the table must not let readers use the segment after its writer
+ * has crashed; a new writer must initialize a new table.
+ *
+ * A shared table cannot be resized, so @p capacity (calculated in the same way
+ * as by sht_init()) must be large enough for the maximum number of entries in
+ * the table.  Adding an entry to a full shared table fails with
+ * #SHT_ERR_TOOBIG.
+ *
+ * Because readers in other processes use the entries directly, entries must
+ * contain plain data (no pointers), and the table's free function (if any) is
+ * not called when the table is freed.
  *
  * > **NOTE**
  * >
- * > This function cannot be called on an unitialized table or a table that has
- * > one or more iterators.  (See
- * > [Abort conditions](index.html#abort-conditions).)
+ * > This function cannot be called on a table that has already been
+ * > initialized.  (See [Abort conditions](index.html#abort-conditions).)
  *
- * @param	ht	The hash table.
- * @param	key	The key for which the entry is to be removed.
+ * @param	ht		The hash table to be initialized.
+ * @param	capacity	The capacity of the hash table (or `0`).
+ * @param	fd		A file descriptor for the shared memory segment
+ *				(open for reading and writing).  The segment is
+ *				resized to fit the table.
  *
- * @returns	If the key was present in the table, true (`1`) is returned.
- *		Otherwise, false (`0`) is returned.
+ * @returns	On success, true (`1`) is returned.  On failure, false (`0`) is
+ *		returned, and the table's error status is set.  If the error is
+ *		#SHT_ERR_IO, `errno` is set by the failed system call.
  *
- * @see		sht_pop()
+ * @see		sht_read()
+ * @see		sht_map_fd()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-bool sht_delete(struct sht_ht *ht, const void *restrict key)
+bool sht_init_shared(struct sht_ht *ht, uint32_t capacity, int fd)
 {
-	return sht_remove(ht, key, nullptr);
+	struct sht_fhdr *hdr, layout = {};
+	uint32_t tsize;
+	void *map;
+
+	if (ht->tsize != 0)
+		sht_abort("sht_init_shared: Table already initialized");
+	if (ht->indirect)
+		sht_abort("sht_init_shared: Table has indirect entries");
+	if (ht->line_n != 0)
+		sht_abort("sht_init_shared: Table is interleaved");
+	if (ht->compact)
+		sht_abort("sht_init_shared: Table has compact buckets");
+	if (ht->ikeys)
+		sht_abort("sht_init_shared: Table has integer keys");
+	if (ht->blobs)
+		sht_abort("sht_init_shared: Table has a blob arena");
+	if (ht->cache_max != 0)
+		sht_abort("sht_init_shared: Table is a cache");
+
+	if (!sht_capacity_tsize(ht, capacity, &tsize))
+		return 0;
+
+	layout.tsize = tsize;
+	layout.esize = ht->esize;
+	layout.ealign = ht->ealign;
+	sht_file_layout(&layout);	// max size < 2^39
+
+	if (ftruncate(fd, layout.size) < 0) {
+		ht->err = SHT_ERR_IO;
+		return 0;
+	}
+
+	map = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+	if (map == MAP_FAILED) {
+		ht->err = SHT_ERR_IO;
+		return 0;
+	}
+
+	if ((uintptr_t)map % ht->ealign != 0) {
+		munmap(map, layout.size);
+		ht->err = SHT_ERR_BAD_FILE;
+		return 0;
+	}
+
+	hdr = map;
+	memset(hdr, 0, sizeof *hdr);
+	hdr->magic = SHT_FILE_MAGIC;
+	hdr->version = SHT_FILE_VERSION;
+	hdr->esize = ht->esize;
+	hdr->ealign = ht->ealign;
+	hdr->lft = ht->lft;
+	hdr->tsize = tsize;
+	hdr->psl_limit = ht->psl_limit;
+	hdr->b_offset = layout.b_offset;
+	hdr->e_offset = layout.e_offset;
+	hdr->size = layout.size;
+
+	// Mark all of the buckets as empty
+	memset((uint8_t *)map + hdr->b_offset, 0,
+	       tsize * sizeof(union sht_bckt));
+
+	sht_attach(ht, map, layout.size, 0);
+
+	return 1;
 }
 
 /**
- * Free the resources used by a hash table.
+ * Copy an entry from a table.
+ *
+ * This function is like sht_get(), except that it copies the entry to
+ * @p out, rather than returning a pointer to the entry within the table.  It
+ * is intended for the readers of shared tables (see sht_init_shared()); if the
+ * table is being modified by its writer, the lookup is retried until it does
+ * not overlap a modification.  (If the writer process terminates while it is
+ * modifying the table, this function waits forever; see sht_init_shared().)
+ *
+ * The table's equality function may be called with an entry that is being
+ * modified, so it must not follow any pointers in the entry.
  *
  * > **NOTE**
  * >
- * > This function cannot be called on a table that has one or more iterators.
- * > (See [Abort conditions](index.html#abort-conditions).)
+ * > This function cannot be called on an unitialized table.  (See
+ * > [Abort conditions](index.html#abort-conditions).)
  *
  * @param	ht	The hash table.
+ * @param	key	The key for which the entry is to be retrieved.
+ * @param[out]	out	Entry output buffer.  Must be large enough to hold an
+ *			entry.
+ *
+ * @returns	If the key was present in the table, true (`1`) is returned,
+ *		and its entry is copied to @p out.  Otherwise, false (`0`) is
+ *		returned (and the contents of @p out are unspecified).
  *
+ * @see		sht_get()
  * @see		[Abort conditions](index.html#abort-conditions)
  */
-void sht_free(struct sht_ht *ht)
+bool sht_read(struct sht_ht *ht, const void *restrict key, void *restrict out)
 {
-	uint32_t i;
-	uint8_t *e;
-	union sht_bckt *b;
+	union sht_bckt cb, ob;
+	uint32_t hash, seq, p;
+	bool found;
 
-	if (ht->iter_lock != 0)
-		sht_abort("sht_free: Table has iterator(s)");
+	if (ht->tsize == 0)
+		sht_abort("sht_read: Table not initialized");
 
-	if (ht->freefn != nullptr) {
+	// Only a reader can see concurrent modifications
+	if (!ht->read_only) {
+		const void *e;
 
-		for (i = 0, b = ht->buckets; i < ht->tsize; ++i, ++b) {
+		if ((e = sht_get(ht, key)) == nullptr)
+			return 0;
 
-			if (!b->empty) {
-				e = ht->entries + i * ht->esize;
-				ht->freefn(e, ht->free_ctx);
+		memcpy(out, e, ht->esize);
+		return 1;
+	}
+
+	hash = sht_hash(ht, key);
+
+	do {
+		seq = sht_shm_read_begin(ht->fhdr);
+
+		cb.hash = hash;
+		cb.psl = 0;
+		cb.used = 1;
+		p = hash;
+		found = 0;
+
+		// Like sht_probe(), but the table may change
+		// underneath us, so the PSL is bounded explicitly
+		while (1) {
+			p &= ht->mask;
+			ob = ht->buckets[p];
+
+			if (!ob.used || cb.psl > ob.psl)
+				break;
+
+			if (cb.all == ob.all && sht_key_eq(ht, key, p)) {
+				memcpy(out, ht->entries + p * ht->esize,
+				       ht->esize);
+				found = 1;
+				break;
 			}
+
+			if (cb.psl == ht->psl_limit)
+				break;
+
+			cb.psl++;
+			p++;
 		}
-	}
 
-	free(ht->buckets);
-	free(ht);
+	} while (!sht_shm_read_end(ht->fhdr, seq));
+
+	return found;
 }
 
 /**
@@ -1404,6 +6516,9 @@ struct sht_iter *sht_iter_new(struct sht_ht *ht, enum sht_iter_type type)
 		}
 	}
 	else {	// SHT_ITER_RW
+		if (ht->read_only)
+			sht_abort("sht_iter_new: Table is read-only");
+
 		if (ht->iter_lock != 0) {
 			ht->err = SHT_ERR_ITER_LOCK;
 			return nullptr;
@@ -1481,9 +6596,9 @@ const void *sht_iter_next(struct sht_iter *iter)
 
 	for (ht = iter->ht; next < ht->tsize; ++next) {
 
-		if (!ht->buckets[next].empty) {
+		if (sht_bckt(ht, next).used) {
 			iter->last = next;
-			return ht->entries + next * ht->esize;
+			return sht_entry(ht, next);
 		}
 	}
 
@@ -1515,7 +6630,7 @@ bool sht_iter_delete(struct sht_iter *iter)
 	}
 
 	assert(iter->last >= 0 && (uint32_t)iter->last < iter->ht->tsize);
-	assert(!iter->ht->buckets[iter->last].empty);
+	assert(sht_bckt(iter->ht, iter->last).used);
 
 	sht_remove_at(iter->ht, iter->last, nullptr);
 
@@ -1543,13 +6658,21 @@ bool sht_iter_delete(struct sht_iter *iter)
  */
 bool sht_iter_replace(struct sht_iter *iter, const void *restrict entry)
 {
+	if (iter->ht->read_only)
+		sht_abort("sht_iter_replace: Table is read-only");
+
 	if (iter->last == -1 || iter->last == INT32_MAX) {
 		iter->err = SHT_ERR_ITER_NO_LAST;
 		return 0;
 	}
 
 	assert(iter->last >= 0 && (uint32_t)iter->last < iter->ht->tsize);
-	assert(!iter->ht->buckets[iter->last].empty);
+	assert(sht_bckt(iter->ht, iter->last).used);
+
+	if (iter->ht->blobs) {
+		sht_arena_check(iter->ht, entry,
+				"sht_iter_replace: Invalid value blob");
+	}
 
 	sht_change_at(iter->ht, iter->last, entry, nullptr);
 
@@ -30,6 +30,13 @@
  */
 #define SHT_MAX_ESIZE		16384
 
+/**
+ * Maximum entry size for a table with indirect entries (1 GiB).
+ *
+ * @see		SHT_NEW_INDIRECT()
+ */
+#define SHT_MAX_INDIRECT_ESIZE	(UINT32_C(1) << 30)
+
 /**
  * Critical error printing function.
  *
@@ -162,6 +169,150 @@ typedef bool (*sht_eqfn_t)(const void *restrict key,
 typedef void (*sht_freefn_t)(const void *restrict entry,
 			     void *restrict context);
 
+/**
+ * Predicate function type.
+ *
+ * Callback function type used by sht_remove_if() to select the entries that
+ * should be removed from a table.  For example:
+ *
+ * ```c
+ * struct my_entry {
+ *     const char      *name;
+ *     time_t          expires;
+ * };
+ *
+ * bool my_expired(const void *restrict entry, void *restrict context)
+ * {
+ *     const struct my_entry *const e = entry;
+ *     const time_t *const now = context;
+ *
+ *     return e->expires <= *now;
+ * }
+ * ```
+ *
+ * A predicate function must not modify the table.
+ *
+ * @param	entry	The entry to be tested.
+ * @param	context	Optional function-specific context.
+ *
+ * @returns	A boolean value that indicates whether @p entry should be
+ *		removed.
+ */
+typedef bool (*sht_predfn_t)(const void *restrict entry,
+			     void *restrict context);
+
+/**
+ * Copy function type.
+ *
+ * Callback function type used by sht_clone() to copy entry resources.  When the
+ * function is called, @p dest already contains a bitwise copy of @p src, so
+ * the function only needs to replace any pointers to resources that are owned
+ * by the entry.  For example:
+ *
+ * ```c
+ * struct my_entry {
+ *     const char      *name;
+ *     struct in_addr  address;
+ * };
+ *
+ * bool my_copy(void *restrict dest, const void *restrict src,
+ *              void *restrict context)
+ * {
+ *     struct my_entry *const d = dest;
+ *     const struct my_entry *const s = src;
+ *
+ *     return (d->name = strdup(s->name)) != NULL;
+ * }
+ * ```
+ *
+ * If the function fails, it must free any resources that it has allocated for
+ * @p dest.
+ *
+ * @param	dest	The new entry (in the new table).
+ * @param	src	The original entry.
+ * @param	context	Optional function-specific context.
+ *
+ * @returns	On success, true (`1`).  On failure, false (`0`).
+ */
+typedef bool (*sht_copyfn_t)(void *restrict dest, const void *restrict src,
+			     void *restrict context);
+
+/**
+ * Eviction function type.
+ *
+ * Callback function type used by a cache (see sht_set_cache()) to report the
+ * entries that it evicts.  For example:
+ *
+ * ```c
+ * struct my_entry {
+ *     uint64_t        id;
+ *     bool            dirty;
+ * };
+ *
+ * void my_evict(const void *restrict entry, void *restrict context)
+ * {
+ *     const struct my_entry *const e = entry;
+ *
+ *     if (e->dirty)
+ *         my_write_back(context, e);
+ * }
+ * ```
+ *
+ * The entry is removed from the table (and freed by the table's free function,
+ * if any) after the function returns.  An eviction function must not modify
+ * the table.
+ *
+ * @param	entry	The evicted entry.
+ * @param	context	Optional function-specific context.
+ */
+typedef void (*sht_evictfn_t)(const void *restrict entry,
+			      void *restrict context);
+
+/**
+ * Merge function type.
+ *
+ * Callback function type used by sht_upsert() to combine a new entry with the
+ * existing entry for the same key.  The function updates @p existing in place.
+ * For example:
+ *
+ * ```c
+ * struct my_entry {
+ *     const char      *name;
+ *     uint64_t        count;
+ *     uint64_t        max;
+ * };
+ *
+ * void my_merge(void *restrict existing, const void *restrict entry,
+ *               void *restrict context)
+ * {
+ *     struct my_entry *const e = existing;
+ *     const struct my_entry *const n = entry;
+ *
+ *     e->count += n->count;
+ *     if (n->max > e->max)
+ *         e->max = n->max;
+ * }
+ * ```
+ *
+ * The function must not change the key of @p existing (including any pointer
+ * or blob reference through which the key is reached), and it must not modify
+ * the table.  A table with a key array, integer keys, or a blob arena keeps a
+ * second copy of each key outside of its entry, so a changed key would not
+ * be noticed; later lookups would silently fail to find the entry (or find it
+ * under its old key).  In debug builds (without `NDEBUG`), sht_upsert()
+ * asserts that the key is unchanged after the function returns.
+ *
+ * The new entry is not stored in the table, so any resources that it owns
+ * remain the responsibility of the caller.
+ *
+ * @param	existing	The entry in the table.
+ * @param	entry		The new entry.
+ * @param	context		Optional function-specific context.
+ */
+typedef void (*sht_mergefn_t)(void *restrict existing,
+			      const void *restrict entry,
+			      void *restrict context);
+
 
 /*******************************************************************************
  *
@@ -176,6 +327,28 @@ typedef void (*sht_freefn_t)(const void *restrict entry,
  */
 struct sht_ht;
 
+/**
+ * Size of the storage for an embedded table.
+ *
+ * @see		struct sht_storage
+ */
+#define SHT_STORAGE_SIZE	512
+
+/**
+ * Storage for an embedded table.
+ *
+ * An object of this type can hold a table that is created with
+ * SHT_INIT_INPLACE(), so that the table can be embedded in another object (or
+ * an array).  Its size and alignment do not change between versions of the
+ * library.  Its contents are private.
+ *
+ * @see		SHT_INIT_INPLACE()
+ */
+struct sht_storage {
+	/** @private */
+	alignas(8) unsigned char opaque_[SHT_STORAGE_SIZE];
+};
+
 /**
  * Iterator types.
  */
@@ -189,6 +362,23 @@ enum sht_iter_type: bool {
  */
 struct sht_iter;
 
+/**
+ * A reference to a byte string in a table's blob arena.
+ *
+ * @see		sht_set_arena()
+ */
+struct sht_blob {
+	uint32_t	off;	/**< Offset of the string within the arena. */
+	uint32_t	len;	/**< Length of the string. */
+};
+
+/**
+ * Value blob offset for a table whose entries do not have a value blob.
+ *
+ * @see		sht_set_arena()
+ */
+#define SHT_NO_BLOB		SIZE_MAX
+
 /**
  * Error codes.
  */
@@ -201,6 +391,9 @@ enum sht_err: uint8_t {
 	SHT_ERR_ITER_LOCK,	/**< Can't acquire iterator lock. */
 	SHT_ERR_ITER_COUNT,	/**< Table has too many iterators. */
 	SHT_ERR_ITER_NO_LAST,	/**< Iterator at beginning or end. */
+	SHT_ERR_COPY,		/**< Entry copy function failed. */
+	SHT_ERR_IO,		/**< I/O error (see `errno`). */
+	SHT_ERR_BAD_FILE,	/**< Invalid or incompatible table file. */
 		//
 		// 	Add all values above this comment
 		//
@@ -230,6 +423,24 @@ struct sht_ht *sht_new_(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
 			sht_freefn_t freefn, size_t esize,
 			size_t ealign, enum sht_err *err);
 
+// Create a hash table in caller-provided storage (call via SHT_INIT_INPLACE()).
+[[gnu::nonnull(1, 2, 3)]]
+struct sht_ht *sht_init_inplace_(struct sht_storage *storage,
+				 sht_hashfn_t hashfn, sht_eqfn_t eqfn,
+				 sht_freefn_t freefn, size_t esize,
+				 size_t ealign, enum sht_err *err);
+
+// Create a new hash table with indirect entries (call via SHT_NEW_INDIRECT()).
+[[gnu::nonnull(1, 2)]]
+struct sht_ht *sht_new_indirect_(sht_hashfn_t hashfn, sht_eqfn_t eqfn,
+				 sht_freefn_t freefn, size_t esize,
+				 size_t ealign, enum sht_err *err);
+
+// Create a new keyed hash table (call via SHT_NEW_KEYED()).
+struct sht_ht *sht_new_keyed_(sht_hashfn_t hashfn, sht_freefn_t freefn,
+			      size_t esize, size_t ealign, size_t koff,
+			      size_t ksize, enum sht_err *err);
+
 // Set the "context" for a table's hash function.
 [[gnu::nonnull(1)]]
 void sht_set_hash_ctx(struct sht_ht *ht, void *context);
@@ -250,14 +461,84 @@ void sht_set_lft(struct sht_ht *ht, uint8_t lft);
 [[gnu::nonnull]]
 void sht_set_psl_limit(struct sht_ht *ht, uint8_t limit);
 
+// Store a table's keys in a separate array.
+[[gnu::nonnull]]
+void sht_set_key_array(struct sht_ht *ht, size_t offset, size_t size);
+
+// Interleave a table's buckets and entries.
+[[gnu::nonnull]]
+void sht_set_interleaved(struct sht_ht *ht);
+
+// Use compact (16-bit) buckets in a table.
+[[gnu::nonnull]]
+void sht_set_compact(struct sht_ht *ht);
+
+// Store a keyed table's integer keys in its buckets.
+[[gnu::nonnull]]
+void sht_set_int_keys(struct sht_ht *ht);
+
+// Store a keyed table's string keys (and values) in a blob arena.
+[[gnu::nonnull]]
+void sht_set_arena(struct sht_ht *ht, size_t voff);
+
+// Free a table's entry resources in bulk.
+[[gnu::nonnull]]
+void sht_set_bulk_free(struct sht_ht *ht);
+
+// Make a table a fixed-size cache.
+[[gnu::nonnull(1)]]
+void sht_set_cache(struct sht_ht *ht, uint32_t max, sht_evictfn_t evictfn,
+		   void *context);
+
+// Provide a buffer for a table's initial arrays.
+[[gnu::nonnull]]
+void sht_set_buffer(struct sht_ht *ht, void *buf, size_t size);
+
 // Initialize a hash table.
 [[gnu::nonnull]]
 bool sht_init(struct sht_ht *ht, uint32_t capacity);
 
+// Calculate the buffer size required for a table's initial arrays.
+[[gnu::nonnull]]
+size_t sht_buffer_size(struct sht_ht *ht, uint32_t capacity);
+
+// Ensure that a table can hold a number of entries without being expanded.
+[[gnu::nonnull]]
+bool sht_reserve(struct sht_ht *ht, uint32_t capacity);
+
 // Free the resources used by a hash table.
 [[gnu::nonnull]]
 void sht_free(struct sht_ht *ht);
 
+// Create a copy of a table.
+[[gnu::nonnull(1)]]
+struct sht_ht *sht_clone(struct sht_ht *ht, sht_copyfn_t copyfn,
+			 void *context);
+
+// Save a table to a file.
+[[gnu::nonnull]]
+bool sht_save(struct sht_ht *ht, int fd);
+
+// Write an incremental checkpoint of a table to a file.
+[[gnu::nonnull]]
+bool sht_checkpoint(struct sht_ht *ht, int fd);
+
+// Map a table file into memory (read-only table).
+[[gnu::nonnull]]
+bool sht_map(struct sht_ht *ht, const char *path);
+
+// Map a table file into memory, using an open file descriptor.
+[[gnu::nonnull]]
+bool sht_map_fd(struct sht_ht *ht, int fd);
+
+// Initialize a shared table.
+[[gnu::nonnull]]
+bool sht_init_shared(struct sht_ht *ht, uint32_t capacity, int fd);
+
+// Copy an entry from a table (safe for readers of shared tables).
+[[gnu::nonnull]]
+bool sht_read(struct sht_ht *ht, const void *restrict key, void *restrict out);
+
 
 /*
  * Table operations - get, set, delete, etc.
@@ -271,10 +552,32 @@ int sht_add(struct sht_ht *ht, const void *key, const void *entry);
 [[gnu::nonnull]]
 int sht_set(struct sht_ht *ht, const void *key, const void *entry);
 
+// Add an entry, or merge it into the existing entry for its key.
+[[gnu::nonnull(1, 2, 3, 4)]]
+int sht_upsert(struct sht_ht *ht, const void *key, const void *entry,
+	       sht_mergefn_t mergefn, void *context);
+
 // Lookup an entry in a table.
 [[gnu::nonnull]]
 const void *sht_get(struct sht_ht *ht, const void *restrict key);
 
+// Start a lookup, by hashing a key and prefetching its home position.
+[[gnu::nonnull]]
+uint32_t sht_prefetch(const struct sht_ht *ht, const void *restrict key);
+
+// Finish a lookup that was started by sht_prefetch().
+[[gnu::nonnull]]
+const void *sht_get_token(struct sht_ht *ht, const void *restrict key,
+			  uint32_t token);
+
+// Set the deadline of an entry.
+[[gnu::nonnull]]
+int sht_set_ttl(struct sht_ht *ht, const void *restrict key, uint64_t deadline);
+
+// Remove expired entries from a table.
+[[gnu::nonnull]]
+uint32_t sht_expire(struct sht_ht *ht, uint64_t now, uint32_t budget);
+
 // Get the number of entries in a table.
 [[gnu::nonnull]]
 uint32_t sht_size(const struct sht_ht *ht);
@@ -291,6 +594,18 @@ uint8_t  sht_peak_psl(const struct sht_ht *ht);
 [[gnu::nonnull]]
 bool sht_delete(struct sht_ht *ht, const void *restrict key);
 
+// Remove multiple entries from the table.
+[[gnu::nonnull]]
+int32_t sht_delete_many(struct sht_ht *ht, const void *const *keys, uint32_t n);
+
+// Remove all entries that match a predicate.
+[[gnu::nonnull(1, 2)]]
+uint32_t sht_remove_if(struct sht_ht *ht, sht_predfn_t pred, void *context);
+
+// Remove all entries from a table.
+[[gnu::nonnull]]
+void sht_clear(struct sht_ht *ht);
+
 // Remove and return an entry from the table.
 [[gnu::nonnull]]
 bool sht_pop(struct sht_ht *ht, const void *restrict key, void *restrict out);
@@ -305,6 +620,19 @@ bool sht_replace(struct sht_ht *ht, const void *key,
 bool sht_swap(struct sht_ht *ht, const void *key,
 	       const void *entry, void *out);
 
+// Copy a byte string into a table's blob arena.
+[[gnu::nonnull(1, 4)]]
+bool sht_arena_add(struct sht_ht *ht, const void *data, size_t len,
+		   struct sht_blob *blob);
+
+// Get the address of a byte string in a table's blob arena.
+[[gnu::nonnull]]
+const void *sht_blob(const struct sht_ht *ht, struct sht_blob blob);
+
+// Allocate memory for an entry's resources from a table's resource arena.
+[[gnu::nonnull]]
+void *sht_bulk_alloc(struct sht_ht *ht, size_t size);
+
 
 /*
  * Iterators
@@ -432,5 +760,111 @@ const char *sht_iter_msg(const struct sht_iter *iter);
 			 SHT_ARG2(_, ##__VA_ARGS__, nullptr));		\
 	})
 
+/**
+ * Create a hash table in caller-provided storage.
+ *
+ * This macro is a wrapper for sht_init_inplace_().  It is used in the same way
+ * as SHT_NEW(), except that its first argument is a pointer to the storage for
+ * the table.
+ *
+ * ```c
+ * struct conn {
+ *     int                 fd;
+ *     struct sht_storage  sessions;
+ * };
+ *
+ * ht = SHT_INIT_INPLACE(&conn->sessions, hashfn, eqfn, NULL, struct entry);
+ * ```
+ *
+ * @param	storage	Storage for the table.
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	etype	The type of the entries to be stored in the table.
+ * @param[out]	...	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table (within @p storage)
+ *		is returned.  On error, `NULL` is returned, and an error code is
+ *		returned in @p err (if it is not `NULL`).
+ *
+ * @see		sht_init_inplace_()
+ */
+#define SHT_INIT_INPLACE(storage, hashfn, eqfn, freefn, etype, ...)	\
+	({								\
+		static_assert(sizeof(etype) <= SHT_MAX_ESIZE,		\
+			       "Entry type (" #etype ") too large");	\
+		sht_init_inplace_(storage, hashfn, eqfn, freefn,	\
+				  sizeof(etype), alignof(etype),	\
+				  SHT_ARG2(_, ##__VA_ARGS__, nullptr));	\
+	})
+
+/**
+ * Create a new hash table with indirect entries.
+ *
+ * This macro is a wrapper for sht_new_indirect_().  It is used in exactly the
+ * same way as SHT_NEW(), but the size of @p etype is only limited by
+ * #SHT_MAX_INDIRECT_ESIZE (which is checked at runtime).
+ *
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ * @param	eqfn	Function to be used to compare keys for	equality.
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	etype	The type of the entries to be stored in the table.
+ * @param[out]	...	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table is returned.  On
+ *		error, `NULL` is returned, and an error code is returned in
+ *		@p err (if it is not `NULL`).
+ *
+ * @see		sht_new_indirect_()
+ */
+#define SHT_NEW_INDIRECT(hashfn, eqfn, freefn, etype, ...)		\
+	sht_new_indirect_(hashfn, eqfn, freefn,				\
+			  sizeof(etype), alignof(etype),		\
+			  SHT_ARG2(_, ##__VA_ARGS__, nullptr))
+
+/**
+ * Create a new keyed hash table.
+ *
+ * This macro is a wrapper for sht_new_keyed_().  Instead of an equality
+ * function, it takes the name of the member of @p etype that holds each
+ * entry's key.  Keys are compared byte by byte, and the table's hash function
+ * is optional; if it is `NULL`, the library hashes keys itself.
+ *
+ * ```c
+ * struct session {
+ *     uint64_t        id;
+ *     time_t          expires;
+ * };
+ *
+ * ht = SHT_NEW_KEYED(NULL, NULL, struct session, id);
+ * ```
+ *
+ * @param	hashfn	Function to be used to compute the hash values of keys.
+ *			(May be `NULL`.)
+ * @param	freefn	Function to be used to free entry resources.  (May be
+ *			`NULL`.)
+ * @param	etype	The type of the entries to be stored in the table.
+ * @param	kmember	The member of @p etype that holds the key.
+ * @param[out]	...	Optional output pointer for error reporting.
+ *
+ * @returns	On success, a pointer to the new hash table is returned.  On
+ *		error, `NULL` is returned, and an error code is returned in
+ *		@p err (if it is not `NULL`).
+ *
+ * @see		sht_new_keyed_()
+ */
+#define SHT_NEW_KEYED(hashfn, freefn, etype, kmember, ...)		\
+	({								\
+		static_assert(sizeof(etype) <= SHT_MAX_ESIZE,		\
+			       "Entry type (" #etype ") too large");	\
+		sht_new_keyed_(hashfn, freefn,				\
+			       sizeof(etype), alignof(etype),		\
+			       offsetof(etype, kmember),		\
+			       sizeof(((etype *)nullptr)->kmember),	\
+			       SHT_ARG2(_, ##__VA_ARGS__, nullptr));	\
+	})
+
 
 #endif		/* SHT_H */
@@ -13,14 +13,21 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/sht.h"
+#include "../src/sht-hash.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <xxhash.h>
 
 /*******************************************************************************
@@ -130,6 +137,18 @@ struct oversized_entry {
 	char data[16385];  /* Too large */
 };
 
+/* Large entry with a small key (for key array tests) */
+struct session_entry {
+	uint64_t id;
+	char data[504];
+};
+
+/* Entry that is too large to be stored directly (for indirect tables) */
+struct huge_entry {
+	int key;
+	char data[32764];
+};
+
 /* Entry with unusual alignment */
 struct __attribute__((aligned(64))) aligned_entry {
 	int value;
@@ -187,6 +206,23 @@ static uint32_t bad_hashfn(const void *restrict key, void *restrict ctx)
 	return 0;
 }
 
+/* Hash function that always returns the last position (tests wraparound) */
+static uint32_t end_hashfn(const void *restrict key, void *restrict ctx)
+{
+	(void)key;
+	(void)ctx;
+	return UINT32_MAX;
+}
+
+/* Hash function that maps groups of 8 keys to the same value (long runs) */
+static uint32_t clump_hashfn(const void *restrict key, void *restrict ctx)
+{
+	const int *k = key;
+	int group = *k / 8;
+	(void)ctx;
+	return XXH3_64bits(&group, sizeof(group));
+}
+
 /* Hash function with context */
 static uint32_t ctx_hashfn(const void *restrict key, void *restrict ctx)
 {
@@ -216,6 +252,89 @@ static void ctx_freefn(const void *restrict entry, void *restrict ctx)
 		free_context_used = 1;
 }
 
+/* Free function that counts the entries it frees */
+static void count_freefn(const void *restrict entry, void *restrict ctx)
+{
+	int *count = ctx;
+	(void)entry;
+	++*count;
+}
+
+/* Copy function for entries that own no resources */
+static _Bool nop_copyfn(void *restrict dest, const void *restrict src,
+			void *restrict ctx)
+{
+	(void)dest;
+	(void)src;
+	(void)ctx;
+	return 1;
+}
+
+/* Copy function that duplicates a string entry's strings */
+static _Bool str_copyfn(void *restrict dest, const void *restrict src,
+			void *restrict ctx)
+{
+	struct str_entry *d = dest;
+	const struct str_entry *s = src;
+	(void)ctx;
+	d->key = strdup(s->key);
+	d->value = strdup(s->value);
+	return d->key != NULL && d->value != NULL;
+}
+
+/* Copy function that fails after *ctx successful copies */
+static _Bool failing_copyfn(void *restrict dest, const void *restrict src,
+			    void *restrict ctx)
+{
+	int *remaining = ctx;
+	(void)dest;
+	(void)src;
+	return (*remaining)-- > 0;
+}
+
+/* Save a table of integers 0 to n - 1 to a new temporary file */
+static _Bool save_int_table(char *path, int n)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int fd, i;
+	_Bool ok;
+
+	strcpy(path, "/tmp/sht_test.XXXXXX");
+	if ((fd = mkstemp(path)) < 0)
+		return 0;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ok = ht != NULL && sht_init(ht, 0);
+	for (i = 0; ok && i < n; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ok = sht_add(ht, &e.key, &e) == 0;
+	}
+
+	ok = ok && sht_save(ht, fd);
+	close(fd);
+	if (ht != NULL)
+		sht_free(ht);
+	return ok;
+}
+
+/* Predicate that selects entries whose key modulo 10 is less than *ctx */
+static _Bool mod_predfn(const void *restrict entry, void *restrict ctx)
+{
+	const struct int_entry *e = entry;
+	const int *limit = ctx;
+	return e->key % 10 < *limit;
+}
+
+/* Predicate that selects string entries whose key starts with 'b' */
+static _Bool str_b_predfn(const void *restrict entry, void *restrict ctx)
+{
+	const struct str_entry *e = entry;
+	(void)ctx;
+	return e->key[0] == 'b';
+}
+
 /*******************************************************************************
  *
  *	Tests: Basic table creation and initialization
@@ -515,357 +634,798 @@ TEST(psl_threshold)
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Add operations
- *
- ******************************************************************************/
+static unsigned int session_eq_calls;
 
-TEST(add_new_entry)
+static uint32_t session_hashfn(const void *restrict key, void *restrict ctx)
 {
-	struct sht_ht *ht;
-	struct int_entry e;
-	int key = 42;
-
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
-	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
+	(void)ctx;
+	return XXH3_64bits(key, sizeof(uint64_t));
+}
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);  /* New entry */
+static _Bool session_eqfn(const void *restrict key,
+			  const void *restrict entry, void *restrict ctx)
+{
+	const struct session_entry *e = entry;
+	(void)ctx;
+	session_eq_calls++;
+	return *(const uint64_t *)key == e->id;
+}
 
-	sht_free(ht);
+static _Bool session_odd_predfn(const void *restrict entry, void *restrict ctx)
+{
+	const struct session_entry *e = entry;
+	(void)ctx;
+	return e->id % 2 == 1;
 }
 
-TEST(add_duplicate_entry)
+TEST(key_array)
 {
-	struct sht_ht *ht;
-	struct int_entry e1, e2;
-	int key = 42;
+	struct sht_ht *ht, *clone;
+	struct sht_iter *iter;
+	const struct session_entry *result;
+	struct session_entry e = {};
+	uint64_t id;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(session_hashfn, session_eqfn, NULL, struct session_entry);
 	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct session_entry, id),
+			  sizeof e.id);
 	ASSERT(sht_init(ht, 0));
+	session_eq_calls = 0;
 
-	e1.key = 42;
-	e1.value = 100;
-	ASSERT(sht_add(ht, &key, &e1) == 0);  /* New entry */
+	/* Add enough entries to force several rehashes */
+	for (id = 0; id < 2000; id++) {
+		e.id = id;
+		e.data[0] = (char)id;
+		ASSERT(sht_add(ht, &e.id, &e) == 0);
+	}
+	e.id = 10;
+	ASSERT(sht_add(ht, &e.id, &e) == 1);
 
-	e2.key = 42;
-	e2.value = 200;
-	ASSERT(sht_add(ht, &key, &e2) == 1);  /* Duplicate - not added */
+	e.id = 20;
+	e.data[0] = 'x';
+	ASSERT(sht_set(ht, &e.id, &e) == 1);
+	result = sht_get(ht, &e.id);
+	ASSERT(result != NULL && result->data[0] == 'x');
 
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result != NULL);
-	ASSERT(result->value == 100);  /* Original value unchanged */
+	for (id = 0; id < 2000; id++) {
+		result = sht_get(ht, &id);
+		ASSERT(result != NULL);
+		ASSERT(result->id == id);
+	}
+	ASSERT(sht_get(ht, &(uint64_t){ 2000 }) == NULL);
+
+	/* Removals shift keys along with entries */
+	for (id = 0; id < 2000; id += 3)
+		ASSERT(sht_delete(ht, &id));
+	ASSERT(sht_remove_if(ht, session_odd_predfn, NULL) > 0);
 
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+	while ((result = sht_iter_next(iter)) != NULL) {
+		if (result->id % 4 == 0)
+			ASSERT(sht_iter_delete(iter));
+	}
+	sht_iter_free(iter);
+
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+
+	for (id = 0; id < 2000; id++) {
+		_Bool present = id % 3 != 0 && id % 2 == 0 && id % 4 != 0;
+		ASSERT((sht_get(ht, &id) != NULL) == present);
+		ASSERT((sht_get(clone, &id) != NULL) == present);
+	}
+
+	/* The equality function is never called */
+	ASSERT(session_eq_calls == 0);
+
+	sht_free(clone);
 	sht_free(ht);
 }
 
-TEST(add_multiple_entries)
+/* Entry with a 16-byte key */
+struct uuid_entry {
+	uint8_t uuid[16];
+	int value;
+};
+
+TEST(keyed_table)
 {
-	struct sht_ht *ht;
-	struct int_entry e;
+	struct sht_ht *ht, *clone;
+	const struct session_entry *result;
+	const struct uuid_entry *uresult;
+	struct session_entry e = {};
+	struct uuid_entry u = {};
+	enum sht_err err;
+	uint64_t id;
 	int i;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	/* Library hashes and compares the 8-byte keys */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct session_entry, id, &err);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
-
-	for (i = 0; i < 100; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	for (id = 0; id < 2000; id++) {
+		e.id = id;
+		e.data[0] = (char)id;
+		ASSERT(sht_add(ht, &e.id, &e) == 0);
 	}
+	e.id = 10;
+	ASSERT(sht_add(ht, &e.id, &e) == 1);
+	for (id = 0; id < 2000; id += 3)
+		ASSERT(sht_delete(ht, &id));
+
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+	for (id = 0; id < 2000; id++) {
+		result = sht_get(ht, &id);
+		ASSERT((result != NULL) == (id % 3 != 0));
+		ASSERT(result == NULL || result->data[0] == (char)id);
+		ASSERT((sht_get(clone, &id) != NULL) == (id % 3 != 0));
+	}
+	sht_free(clone);
+	sht_free(ht);
 
-	/* Verify all entries */
-	for (i = 0; i < 100; i++) {
-		const struct int_entry *result = sht_get(ht, &i);
-		ASSERT(result != NULL);
-		ASSERT(result->key == i);
-		ASSERT(result->value == i * 10);
+	/* Keyed table with its own hash function and a key array */
+	ht = SHT_NEW_KEYED(session_hashfn, NULL, struct session_entry, id);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct session_entry, id),
+			  sizeof e.id);
+	ASSERT(sht_init(ht, 0));
+	for (id = 0; id < 500; id++) {
+		e.id = id;
+		ASSERT(sht_add(ht, &e.id, &e) == 0);
 	}
+	for (id = 0; id < 500; id++)
+		ASSERT(sht_get(ht, &id) != NULL);
+	ASSERT(sht_get(ht, &(uint64_t){ 500 }) == NULL);
+	sht_free(ht);
 
+	/* 16-byte keys */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct uuid_entry, uuid);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 1000; i++) {
+		memset(u.uuid, 0, sizeof u.uuid);
+		memcpy(u.uuid + 12, &i, sizeof i);
+		u.value = i;
+		ASSERT(sht_add(ht, u.uuid, &u) == 0);
+	}
+	for (i = 0; i < 1000; i++) {
+		memset(u.uuid, 0, sizeof u.uuid);
+		memcpy(u.uuid + 12, &i, sizeof i);
+		uresult = sht_get(ht, u.uuid);
+		ASSERT(uresult != NULL && uresult->value == i);
+	}
+	u.uuid[0] = 1;
+	ASSERT(sht_get(ht, u.uuid) == NULL);
 	sht_free(ht);
-}
 
-/*******************************************************************************
- *
- *	Tests: Set operations
- *
- ******************************************************************************/
+	/* Entry size is checked at runtime by sht_new_keyed_() */
+	ASSERT(sht_new_keyed_(NULL, NULL, SHT_MAX_ESIZE + 8, 8, 0, 8, &err)
+	       == NULL);
+	ASSERT(err == SHT_ERR_BAD_ESIZE);
+}
 
-TEST(set_new_entry)
+TEST(int_keys)
 {
-	struct sht_ht *ht;
-	struct int_entry e;
-	int key = 42;
+	struct sht_ht *ht, *clone;
+	const struct session_entry *result;
+	const struct int_entry *iresult;
+	const void *victims[500];
+	struct session_entry e = {};
+	struct int_entry ie;
+	uint64_t id, vids[500];
+	size_t size;
+	int i;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	/* 64-bit keys stored in the buckets */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct session_entry, id);
 	ASSERT(ht != NULL);
+	size = sht_buffer_size(ht, 1000);
+	sht_set_int_keys(ht);
+	ASSERT(sht_buffer_size(ht, 1000) > size);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_set(ht, &key, &e) == 0);  /* New entry */
-
+	/* Keys are moved with their buckets as the table grows */
+	for (id = 0; id < 3000; id++) {
+		e.id = id * 0x100000001;
+		e.data[0] = (char)id;
+		ASSERT(sht_add(ht, &e.id, &e) == 0);
+	}
+	for (id = 0; id < 3000; id += 3) {
+		e.id = id * 0x100000001;
+		ASSERT(sht_delete(ht, &e.id));
+	}
+	for (i = 0; i < 500; i++) {
+		vids[i] = (uint64_t)(i * 6 + 1) * 0x100000001;
+		victims[i] = &vids[i];
+	}
+	ASSERT(sht_delete_many(ht, victims, 500) == 500);
+
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+	for (id = 0; id < 3000; id++) {
+		e.id = id * 0x100000001;
+		result = sht_get(ht, &e.id);
+		ASSERT((result != NULL) == (id % 3 != 0 && id % 6 != 1));
+		ASSERT(result == NULL || result->data[0] == (char)id);
+		ASSERT((sht_get(clone, &e.id) != NULL) == (result != NULL));
+	}
+	ASSERT(sht_size(ht) == 1500);
+	sht_free(clone);
 	sht_free(ht);
-}
 
-TEST(set_replace_entry)
-{
-	struct sht_ht *ht;
-	struct int_entry e1, e2;
-	int key = 42;
-
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	/* 32-bit keys in an interleaved table */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
 	ASSERT(ht != NULL);
+	sht_set_interleaved(ht);
+	sht_set_int_keys(ht);
 	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 1000; i++) {
+		ie.key = i;
+		ie.value = i * 10;
+		ASSERT(sht_add(ht, &ie.key, &ie) == 0);
+	}
+	for (i = 0; i < 1000; i += 2)
+		ASSERT(sht_delete(ht, &i));
+	for (i = 0; i < 1000; i++) {
+		iresult = sht_get(ht, &i);
+		ASSERT((iresult != NULL) == (i % 2 == 1));
+		ASSERT(iresult == NULL || iresult->value == i * 10);
+	}
+	sht_free(ht);
+}
 
-	e1.key = 42;
-	e1.value = 100;
-	ASSERT(sht_set(ht, &key, &e1) == 0);  /* New entry */
+/* Entry with a string key and value in a blob arena */
+struct kv_entry {
+	struct sht_blob key;
+	struct sht_blob value;
+	int n;
+};
 
-	e2.key = 42;
-	e2.value = 200;
-	ASSERT(sht_set(ht, &key, &e2) == 1);  /* Replace */
+/* Adds an entry whose value is "value-<n>" (with a repeated suffix) */
+static int kv_add(struct sht_ht *ht, const char *key, int n, _Bool replace)
+{
+	struct kv_entry e = { .n = n };
+	char buf[64];
+	int len;
 
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result != NULL);
-	ASSERT(result->value == 200);  /* Updated value */
+	len = snprintf(buf, sizeof buf, "value-%d-%.*s", n, n % 20,
+		       "xxxxxxxxxxxxxxxxxxxx");
+	if (!sht_arena_add(ht, buf, (size_t)len, &e.value))
+		return -1;
 
-	sht_free(ht);
+	return replace ? sht_set(ht, key, &e) : sht_add(ht, key, &e);
 }
 
-TEST(set_with_freefn)
+/* Checks that the entry for a key has the expected value */
+static _Bool kv_check(struct sht_ht *ht, const char *key, int n)
 {
-	struct sht_ht *ht;
-	struct str_entry e1, e2;
-	const char *key = "test";
-
-	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
-	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
+	const struct kv_entry *r;
+	char buf[64];
+	int len;
 
-	e1.key = strdup("test");
-	e1.value = strdup("value1");
-	ASSERT(sht_set(ht, key, &e1) == 0);
+	if ((r = sht_get(ht, key)) == NULL || r->n != n)
+		return 0;
 
-	e2.key = strdup("test");
-	e2.value = strdup("value2");
-	ASSERT(sht_set(ht, key, &e2) == 1);  /* Should free e1's strings */
+	len = snprintf(buf, sizeof buf, "value-%d-%.*s", n, n % 20,
+		       "xxxxxxxxxxxxxxxxxxxx");
 
-	sht_free(ht);  /* Should free e2's strings */
+	return strcmp(sht_blob(ht, r->key), key) == 0
+		&& r->value.len == (uint32_t)len
+		&& memcmp(sht_blob(ht, r->value), buf, (size_t)len) == 0;
 }
 
-/*******************************************************************************
- *
- *	Tests: Get operations
- *
- ******************************************************************************/
-
-TEST(get_existing_entry)
+TEST(arena_table)
 {
-	struct sht_ht *ht;
-	struct int_entry e;
-	int key = 42;
+	struct sht_ht *ht, *clone;
+	const struct kv_entry *result;
+	struct kv_entry e = {}, out;
+	char key[32];
+	int i;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
 	ASSERT(ht != NULL);
+	sht_set_arena(ht, offsetof(struct kv_entry, value));
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
-
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result != NULL);
-	ASSERT(result->key == 42);
-	ASSERT(result->value == 100);
+	/* Keys are copied into the arena; the arena is compacted as needed */
+	for (i = 0; i < 2000; i++) {
+		snprintf(key, sizeof key, "key-%d", i);
+		ASSERT(kv_add(ht, key, i, 0) == 0);
+	}
+	ASSERT(kv_add(ht, "key-10", 10, 0) == 1);
+	for (i = 0; i < 2000; i += 3) {
+		snprintf(key, sizeof key, "key-%d", i);
+		ASSERT(sht_delete(ht, key));
+	}
+	for (i = 1; i < 2000; i += 3) {
+		snprintf(key, sizeof key, "key-%d", i);
+		ASSERT(kv_add(ht, key, i + 1, 1) == 1);
+	}
 
+	/* Prefixes and extensions of stored keys are different keys */
+	ASSERT(sht_get(ht, "key-1") != NULL);
+	ASSERT(sht_get(ht, "key-") == NULL);
+	ASSERT(sht_get(ht, "key-10000") == NULL);
+
+	/* Replacing and swapping keep the stored key */
+	e.n = -1;
+	ASSERT(sht_arena_add(ht, "replaced", 8, &e.value));
+	ASSERT(sht_replace(ht, "key-2", &e));
+	out = e;
+	ASSERT(sht_swap(ht, "key-5", &out, &out));
+	ASSERT(out.n == 5);
+	ASSERT(strcmp(sht_blob(ht, out.key), "key-5") == 0);
+	ASSERT(!sht_replace(ht, "key-3", &e));
+
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+	for (i = 0; i < 2000; i++) {
+		snprintf(key, sizeof key, "key-%d", i);
+		if (i == 2 || i == 5) {
+			result = sht_get(clone, key);
+			ASSERT(result != NULL && result->n == -1);
+			continue;
+		}
+		ASSERT(kv_check(ht, key, i % 3 == 1 ? i + 1 : i)
+		       == (i % 3 != 0));
+		ASSERT(kv_check(clone, key, i % 3 == 1 ? i + 1 : i)
+		       == (i % 3 != 0));
+	}
+	sht_free(clone);
+
+	/* Full arena is compacted without growing the table */
+	sht_clear(ht);
+	ASSERT(sht_reserve(ht, 100));
+	for (i = 0; i < 10000; i++)
+		ASSERT(kv_add(ht, "key", i, 1) == (i != 0));
+	ASSERT(sht_size(ht) == 1);
+	ASSERT(kv_check(ht, "key", 9999));
 	sht_free(ht);
-}
-
-TEST(get_nonexistent_entry)
-{
-	struct sht_ht *ht;
-	int key = 42;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	/* No value blob */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
 	ASSERT(ht != NULL);
+	sht_set_arena(ht, SHT_NO_BLOB);
 	ASSERT(sht_init(ht, 0));
-
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result == NULL);
-
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof key, "%d", i);
+		e.n = i;
+		ASSERT(sht_add(ht, key, &e) == 0);
+	}
+	result = sht_get(ht, "999");
+	ASSERT(result != NULL && result->n == 999);
+	ASSERT(strcmp(sht_blob(ht, result->key), "999") == 0);
+	ASSERT(sht_get(ht, "1000") == NULL);
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Replace operations
- *
- ******************************************************************************/
+/* Eviction function that counts evicted entries */
+static void count_evictfn(const void *restrict entry, void *restrict ctx)
+{
+	int *count = ctx;
+	(void)entry;
+	++*count;
+}
 
-TEST(replace_existing_entry)
+TEST(cache_mode)
 {
-	struct sht_ht *ht;
-	struct int_entry e1, e2;
-	int key = 42;
+	struct sht_ht *ht, *clone;
+	struct int_entry e;
+	_Bool hot[50];
+	int i, found, freed = 0, evicted = 0;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, count_freefn, struct int_entry);
 	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	sht_set_cache(ht, 100, count_evictfn, &evicted);
 	ASSERT(sht_init(ht, 0));
 
-	e1.key = 42;
-	e1.value = 100;
-	ASSERT(sht_add(ht, &key, &e1) == 0);
-
-	e2.key = 42;
-	e2.value = 200;
-	ASSERT(sht_replace(ht, &key, &e2));
-
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result != NULL);
-	ASSERT(result->value == 200);
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_size(ht) == 100 && evicted == 0);
+
+	/* Existing keys don't cause evictions */
+	e.key = 10;
+	ASSERT(sht_set(ht, &e.key, &e) == 1);
+	ASSERT(sht_add(ht, &e.key, &e) == 1);
+	ASSERT(evicted == 0 && freed == 1);
+
+	/* Every entry has been referenced; the first sweep clears them all */
+	e.key = 100;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(sht_size(ht) == 100 && evicted == 1 && freed == 2);
+
+	/* Referenced entries get a second chance */
+	for (i = 0; i < 50; i++)
+		hot[i] = sht_get(ht, &i) != NULL;
+	for (i = 101; i < 141; i++) {
+		e.key = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+		ASSERT(sht_size(ht) == 100);
+	}
+	ASSERT(evicted == 41 && freed == 42);
+	for (i = 0; i < 50; i++)
+		ASSERT((sht_get(ht, &i) != NULL) == hot[i]);
+
+	/* The cache doesn't grow */
+	ASSERT(sht_reserve(ht, 1000));
+	clone = sht_clone(ht, nop_copyfn, NULL);
+	ASSERT(clone != NULL);
+	for (i = 1000; i < 2000; i++) {
+		e.key = i;
+		ASSERT(sht_set(clone, &e.key, &e) == 0);
+		ASSERT(sht_size(clone) == 100);
+	}
+	ASSERT(sht_get(clone, &(int){ 1999 }) != NULL);
+	ASSERT(evicted == 1041);
+	sht_free(clone);
+
+	/* No evictions until the cache is full again */
+	ASSERT(sht_delete(ht, &(int){ 140 }));
+	e.key = 140;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(evicted == 1041);
+	sht_clear(ht);
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(evicted == 1041);
+	sht_free(ht);
 
+	/* Every victim is in the same run as the new key */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_cache(ht, 10, NULL, NULL);
+	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+		ASSERT(sht_get(ht, &i) != NULL);
+	}
+	for (i = 0, found = 0; i < 100; i++)
+		found += sht_get(ht, &i) != NULL;
+	ASSERT(found == 10 && sht_size(ht) == 10);
 	sht_free(ht);
 }
 
-TEST(replace_nonexistent_entry)
+TEST(entry_ttl)
 {
-	struct sht_ht *ht;
+	struct sht_ht *ht, *clone;
 	struct int_entry e;
-	int key = 42;
+	int i, freed = 0;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, count_freefn, struct int_entry);
 	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(!sht_replace(ht, &key, &e));
+	/* Even keys expire at 100 + key */
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+		if (i % 2 == 0)
+			ASSERT(sht_set_ttl(ht, &i, 100 + (uint64_t)i) == 1);
+	}
+	ASSERT(sht_set_ttl(ht, &(int){ 1 }, 0) == 1);
+	ASSERT(sht_set_ttl(ht, &(int){ 5000 }, 100) == 0);
+	ASSERT(sht_expire(ht, 50, UINT32_MAX) == 0);
+	ASSERT(sht_get(ht, &(int){ 0 }) != NULL);
+
+	/* Expired entries are absent, even before they are removed */
+	ASSERT(sht_expire(ht, 299, 10) == 10);
+	ASSERT(sht_size(ht) == 990 && freed == 10);
+	for (i = 0; i < 200; i += 2) {
+		ASSERT(sht_get(ht, &i) == NULL);
+		ASSERT(sht_set_ttl(ht, &i, 1000) == 0);
+	}
+	ASSERT(sht_get(ht, &(int){ 200 }) != NULL);
+
+	/* Adding an expired key replaces its entry, which has no deadline */
+	for (i = 0; i < 200; i += 2) {
+		e.key = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_size(ht) == 1000 && freed == 100);
+	ASSERT(sht_expire(ht, 299, UINT32_MAX) == 0);
+	ASSERT(sht_get(ht, &(int){ 0 }) != NULL);
+
+	/* Deadlines survive growth and cloning */
+	ASSERT(sht_reserve(ht, 10000));
+	ASSERT(sht_expire(ht, 599, UINT32_MAX) == 150);
+	clone = sht_clone(ht, nop_copyfn, NULL);
+	ASSERT(clone != NULL);
+	ASSERT(sht_expire(clone, 2000, UINT32_MAX) == 250);
+	ASSERT(sht_size(clone) == 600);
+	sht_free(clone);
+
+	/* A deleted entry's deadline is not inherited by a new entry */
+	freed = 0;
+	ASSERT(sht_delete(ht, &(int){ 600 }));
+	e.key = 600;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(sht_expire(ht, 2000, 100) == 100);
+	ASSERT(sht_expire(ht, 2000, 200) == 149);
+	ASSERT(sht_size(ht) == 601 && freed == 250);
+	ASSERT(sht_get(ht, &(int){ 600 }) != NULL);
+
+	/* Clearing the table drops its deadlines */
+	ASSERT(sht_set_ttl(ht, &(int){ 600 }, 3000) == 1);
+	sht_clear(ht);
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(sht_expire(ht, 5000, UINT32_MAX) == 0);
+	ASSERT(sht_get(ht, &(int){ 600 }) != NULL);
 
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Swap operations
- *
- ******************************************************************************/
-
-TEST(swap_existing_entry)
+TEST(key_array_mapped)
 {
 	struct sht_ht *ht;
-	struct int_entry e1, e2;
-	int key = 42;
+	struct session_entry e = {};
+	char path[] = "/tmp/sht_test.XXXXXX";
+	uint64_t id;
+	int fd;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(session_hashfn, session_eqfn, NULL, struct session_entry);
 	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct session_entry, id),
+			  sizeof e.id);
 	ASSERT(sht_init(ht, 0));
+	for (id = 0; id < 100; id++) {
+		e.id = id;
+		ASSERT(sht_add(ht, &e.id, &e) == 0);
+	}
 
-	e1.key = 42;
-	e1.value = 100;
-	ASSERT(sht_add(ht, &key, &e1) == 0);
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+	ASSERT(sht_save(ht, fd));
+	sht_free(ht);
 
-	e2.key = 42;
-	e2.value = 200;
-	ASSERT(sht_swap(ht, &key, &e2, &e2));
-	ASSERT(e2.key == 42);
-	ASSERT(e2.value == 100);  /* Old value */
+	/* Keys are compared to the keys within the mapped entries */
+	ht = SHT_NEW(session_hashfn, session_eqfn, NULL, struct session_entry);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct session_entry, id),
+			  sizeof e.id);
+	ASSERT(sht_map_fd(ht, fd));
+	ASSERT(close(fd) == 0);
 
-	const struct int_entry *result = sht_get(ht, &key);
-	ASSERT(result != NULL);
-	ASSERT(result->value == 200);
+	session_eq_calls = 0;
+	for (id = 0; id < 100; id++)
+		ASSERT(sht_get(ht, &id) != NULL);
+	ASSERT(sht_get(ht, &id) == NULL);
+	ASSERT(session_eq_calls == 0);
 
 	sht_free(ht);
 }
 
-TEST(swap_nonexistent_entry)
+TEST(buffer_storage)
 {
 	struct sht_ht *ht;
+	const struct int_entry *result;
 	struct int_entry e;
-	int key = 42;
+	uint64_t buf[64];
+	size_t size;
+	int i;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
+	size = sht_buffer_size(ht, 6);
+	ASSERT(size != 0 && size <= sizeof buf);
+	ASSERT(sht_buffer_size(ht, UINT32_MAX) == 0);
+	ASSERT(sht_get_err(ht) == SHT_ERR_TOOBIG);
+	memset(buf, 0xa5, sizeof buf);  /* Contents of the buffer don't matter */
+	sht_set_buffer(ht, buf, size);
+	ASSERT(sht_init(ht, 6));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(!sht_swap(ht, &key, &e, &e));
+	/* Entries are stored in the buffer */
+	for (i = 0; i < 6; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 6; i++) {
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+		ASSERT((const char *)result >= (const char *)buf);
+		ASSERT((const char *)result < (const char *)buf + size);
+	}
+
+	/* The table outgrows the buffer, which is no longer used */
+	for (i = 6; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	memset(buf, 0, sizeof buf);
+	for (i = 0; i < 100; i++) {
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+	sht_free(ht);
 
+	/* A buffer that is too small is not used */
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_buffer(ht, buf, sht_buffer_size(ht, 6) - 1);
+	ASSERT(sht_init(ht, 6));
+	e.key = 1;
+	e.value = 10;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	result = sht_get(ht, &e.key);
+	ASSERT(result != NULL);
+	ASSERT((const char *)result < (const char *)buf
+	       || (const char *)result >= (const char *)buf + sizeof buf);
 	sht_free(ht);
 }
 
-TEST(swap_separate_buffers)
+TEST(interleaved_layout)
 {
-	struct sht_ht *ht;
-	struct int_entry e1, e2, old;
-	int key = 42;
+	alignas(64) unsigned char buf[512];
+	struct sht_ht *ht, *clone;
+	const struct int_entry *result;
+	struct int_entry e;
+	size_t size;
+	int i;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
-
-	e1.key = 42;
-	e1.value = 100;
-	ASSERT(sht_add(ht, &key, &e1) == 0);
+	sht_set_interleaved(ht);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof e.key);
+	size = sht_buffer_size(ht, 6);
+	ASSERT(size != 0 && size <= sizeof buf && size % 64 == 0);
+	sht_set_buffer(ht, buf, size);
+	ASSERT(sht_init(ht, 6));
+
+	/* Entries are stored in the buffer until the table grows */
+	for (i = 0; i < 6; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 6; i++) {
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+		ASSERT((const unsigned char *)result >= buf);
+		ASSERT((const unsigned char *)result < buf + size);
+	}
 
-	e2.key = 42;
-	e2.value = 200;
-	ASSERT(sht_swap(ht, &key, &e2, &old));
-	ASSERT(old.value == 100);
-	ASSERT(e2.value == 200);  /* Unchanged */
+	for (i = 6; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i += 2)
+		ASSERT(sht_delete(ht, &i));
+	ASSERT(sht_size(ht) == 500);
 
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
 	sht_free(ht);
-}
 
-/*******************************************************************************
- *
- *	Tests: Delete operations
- *
- ******************************************************************************/
+	for (i = 0; i < 1000; i++) {
+		result = sht_get(clone, &i);
+		ASSERT((result != NULL) == (i % 2 == 1));
+		ASSERT(result == NULL || result->value == i * 10);
+	}
 
-TEST(delete_existing_entry)
+	sht_clear(clone);
+	ASSERT(sht_empty(clone));
+	sht_free(clone);
+}
+
+TEST(compact_buckets)
 {
 	struct sht_ht *ht;
+	const struct int_entry *result;
 	struct int_entry e;
-	int key = 42;
+	size_t size;
+	int i;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof e.key);
+	size = sht_buffer_size(ht, 1000);
+	sht_set_compact(ht);
+	ASSERT(sht_buffer_size(ht, 1000) < size);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
-	ASSERT(sht_delete(ht, &key));
-	ASSERT(sht_get(ht, &key) == NULL);
+	/* Hashes are recomputed from the key array as the table grows */
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i += 3)
+		ASSERT(sht_delete(ht, &i));
+	for (i = 0; i < 1000; i++) {
+		result = sht_get(ht, &i);
+		ASSERT((result != NULL) == (i % 3 != 0));
+		ASSERT(result == NULL || result->value == i * 10);
+	}
+	sht_free(ht);
 
+	/* Compact buckets in an interleaved table */
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof e.key);
+	sht_set_interleaved(ht);
+	size = sht_buffer_size(ht, 1000);
+	sht_set_compact(ht);
+	ASSERT(sht_buffer_size(ht, 1000) < size);
+	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i++) {
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
 	sht_free(ht);
 }
 
-TEST(delete_nonexistent_entry)
+TEST(inplace_table)
 {
+	struct {
+		struct sht_storage storage;
+		uint64_t buf[64];
+	} owner;
 	struct sht_ht *ht;
-	int key = 42;
-
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
-	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
+	const struct int_entry *result;
+	struct int_entry e;
+	enum sht_err err;
+	int i, pass;
+
+	/* The same storage can be reused after the table is freed */
+	for (pass = 0; pass < 2; pass++) {
+		ht = SHT_INIT_INPLACE(&owner.storage, int_hashfn, int_eqfn,
+				      NULL, struct int_entry, &err);
+		ASSERT(ht != NULL);
+		ASSERT((void *)ht == (void *)&owner.storage);
+		sht_set_buffer(ht, owner.buf, sht_buffer_size(ht, 6));
+		ASSERT(sht_init(ht, 6));
+
+		for (i = 0; i < 100; i++) {
+			e.key = i;
+			e.value = i * 10 + pass;
+			ASSERT(sht_add(ht, &e.key, &e) == 0);
+		}
+		for (i = 0; i < 100; i++) {
+			result = sht_get(ht, &i);
+			ASSERT(result != NULL);
+			ASSERT(result->value == i * 10 + pass);
+		}
 
-	ASSERT(!sht_delete(ht, &key));
+		sht_free(ht);
+	}
 
-	sht_free(ht);
+	/* Call sht_init_inplace_() directly to test runtime validation */
+	ht = sht_init_inplace_(&owner.storage, int_hashfn, int_eqfn, NULL,
+			       sizeof(struct oversized_entry),
+			       _Alignof(struct oversized_entry), &err);
+	ASSERT(ht == NULL);
+	ASSERT(err == SHT_ERR_BAD_ESIZE);
 }
 
-TEST(pop_existing_entry)
+/*******************************************************************************
+ *
+ *	Tests: Add operations
+ *
+ ******************************************************************************/
+
+TEST(add_new_entry)
 {
 	struct sht_ht *ht;
-	struct int_entry e, popped;
+	struct int_entry e;
 	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
@@ -874,37 +1434,37 @@ TEST(pop_existing_entry)
 
 	e.key = 42;
 	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
-	ASSERT(sht_pop(ht, &key, &popped));
-	ASSERT(popped.key == 42);
-	ASSERT(popped.value == 100);
-	ASSERT(sht_get(ht, &key) == NULL);
+	ASSERT(sht_add(ht, &key, &e) == 0);  /* New entry */
 
 	sht_free(ht);
 }
 
-TEST(pop_nonexistent_entry)
+TEST(add_duplicate_entry)
 {
 	struct sht_ht *ht;
-	struct int_entry popped;
+	struct int_entry e1, e2;
 	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	ASSERT(!sht_pop(ht, &key, &popped));
+	e1.key = 42;
+	e1.value = 100;
+	ASSERT(sht_add(ht, &key, &e1) == 0);  /* New entry */
+
+	e2.key = 42;
+	e2.value = 200;
+	ASSERT(sht_add(ht, &key, &e2) == 1);  /* Duplicate - not added */
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result != NULL);
+	ASSERT(result->value == 100);  /* Original value unchanged */
 
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Table growth and rehashing
- *
- ******************************************************************************/
-
-TEST(table_growth)
+TEST(add_multiple_entries)
 {
 	struct sht_ht *ht;
 	struct int_entry e;
@@ -912,17 +1472,16 @@ TEST(table_growth)
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 2));  /* Very small initial size */
+	ASSERT(sht_init(ht, 0));
 
-	/* Add enough entries to force multiple rehashes */
-	for (i = 0; i < 1000; i++) {
+	for (i = 0; i < 100; i++) {
 		e.key = i;
 		e.value = i * 10;
 		ASSERT(sht_add(ht, &e.key, &e) == 0);
 	}
 
-	/* Verify all entries survived rehashing */
-	for (i = 0; i < 1000; i++) {
+	/* Verify all entries */
+	for (i = 0; i < 100; i++) {
 		const struct int_entry *result = sht_get(ht, &i);
 		ASSERT(result != NULL);
 		ASSERT(result->key == i);
@@ -932,206 +1491,219 @@ TEST(table_growth)
 	sht_free(ht);
 }
 
-TEST(collision_handling)
+/*******************************************************************************
+ *
+ *	Tests: Set operations
+ *
+ ******************************************************************************/
+
+TEST(set_new_entry)
 {
 	struct sht_ht *ht;
 	struct int_entry e;
-	int i;
+	int key = 42;
 
-	/* Use pathological hash function to force collisions */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	/* Add entries that will all hash to the same value */
-	for (i = 0; i < 50; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
-
-	/* Verify all entries can be retrieved */
-	for (i = 0; i < 50; i++) {
-		const struct int_entry *result = sht_get(ht, &i);
-		ASSERT(result != NULL);
-		ASSERT(result->key == i);
-		ASSERT(result->value == i * 10);
-	}
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_set(ht, &key, &e) == 0);  /* New entry */
 
 	sht_free(ht);
 }
 
-TEST(excessive_collisions)
+TEST(set_replace_entry)
 {
 	struct sht_ht *ht;
-	struct int_entry e;
-	int i;
-	int result;
+	struct int_entry e1, e2;
+	int key = 42;
 
-	/* Use pathological hash function and small table */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	sht_set_lft(ht, 95);  /* High load factor to delay growth */
-	ASSERT(sht_init(ht, 128));
+	ASSERT(sht_init(ht, 0));
 
-	/* Add entries until we exceed max PSL (127) - this MUST happen
-	   because bad_hashfn forces all entries to the same bucket */
-	for (i = 0; i < 200; i++) {
-		e.key = i;
-		e.value = i * 10;
-		result = sht_add(ht, &e.key, &e);
-		if (result == -1) {
-			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-			sht_free(ht);
-			return;
-		}
-	}
+	e1.key = 42;
+	e1.value = 100;
+	ASSERT(sht_set(ht, &key, &e1) == 0);  /* New entry */
+
+	e2.key = 42;
+	e2.value = 200;
+	ASSERT(sht_set(ht, &key, &e2) == 1);  /* Replace */
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result != NULL);
+	ASSERT(result->value == 200);  /* Updated value */
 
-	/* Should never get here - bad_hashfn forces PSL limit */
-	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
 	sht_free(ht);
 }
 
-TEST(excessive_collisions_psl_10)
+TEST(set_with_freefn)
 {
 	struct sht_ht *ht;
-	struct int_entry e;
-	int i;
-	int result;
+	struct str_entry e1, e2;
+	const char *key = "test";
 
-	/* Use pathological hash function with low PSL threshold */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
 	ASSERT(ht != NULL);
-	sht_set_lft(ht, 95);  /* High load factor to delay growth */
-	sht_set_psl_limit(ht, 10);  /* Low PSL threshold */
-	ASSERT(sht_init(ht, 32));
+	ASSERT(sht_init(ht, 0));
 
-	/* Add entries until we hit the PSL limit - this MUST happen
-	   because bad_hashfn forces all entries to the same bucket */
-	for (i = 0; i < 50; i++) {
-		e.key = i;
-		e.value = i * 10;
-		result = sht_add(ht, &e.key, &e);
-		if (result == -1) {
-			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-			sht_free(ht);
-			return;
-		}
-	}
+	e1.key = strdup("test");
+	e1.value = strdup("value1");
+	ASSERT(sht_set(ht, key, &e1) == 0);
 
-	/* Should never get here - bad_hashfn forces PSL limit */
-	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
-	sht_free(ht);
+	e2.key = strdup("test");
+	e2.value = strdup("value2");
+	ASSERT(sht_set(ht, key, &e2) == 1);  /* Should free e1's strings */
+
+	sht_free(ht);  /* Should free e2's strings */
 }
 
-TEST(excessive_collisions_psl_50)
+/* Merge function that adds the new entry's value to the existing entry's */
+static void sum_mergefn(void *restrict existing, const void *restrict entry,
+			void *restrict ctx)
+{
+	struct int_entry *e = existing;
+	const struct int_entry *n = entry;
+	int *count = ctx;
+
+	e->value += n->value;
+	++*count;
+}
+
+TEST(upsert_merge)
 {
 	struct sht_ht *ht;
+	const struct int_entry *result;
 	struct int_entry e;
-	int i;
-	int result;
+	int i, merged = 0, freed = 0;
 
-	/* Use pathological hash function with medium PSL threshold */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, count_freefn, struct int_entry);
 	ASSERT(ht != NULL);
-	sht_set_lft(ht, 95);  /* High load factor to delay growth */
-	sht_set_psl_limit(ht, 50);  /* Medium PSL threshold */
-	ASSERT(sht_init(ht, 64));
+	sht_set_free_ctx(ht, &freed);
+	ASSERT(sht_init(ht, 0));
+
+	/* Keys 0 - 99 are inserted, then merged 4 more times */
+	for (i = 0; i < 500; i++) {
+		e.key = i % 100;
+		e.value = i;
+		ASSERT(sht_upsert(ht, &e.key, &e, sum_mergefn, &merged)
+			== (i < 100 ? 0 : 1));
+	}
+	ASSERT(sht_size(ht) == 100 && merged == 400 && freed == 0);
 
-	/* Add entries until we hit the PSL limit - this MUST happen
-	   because bad_hashfn forces all entries to the same bucket */
 	for (i = 0; i < 100; i++) {
-		e.key = i;
-		e.value = i * 10;
-		result = sht_add(ht, &e.key, &e);
-		if (result == -1) {
-			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-			sht_free(ht);
-			return;
-		}
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == 5 * i + 1000);
 	}
 
-	/* Should never get here - bad_hashfn forces PSL limit */
-	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
+	/* An expired entry is replaced, not merged */
+	ASSERT(sht_set_ttl(ht, &(int){ 7 }, 10) == 1);
+	ASSERT(sht_expire(ht, 10, 0) == 0);
+	e.key = 7;
+	e.value = 1;
+	ASSERT(sht_upsert(ht, &e.key, &e, sum_mergefn, &merged) == 0);
+	ASSERT(merged == 400 && freed == 1);
+	result = sht_get(ht, &e.key);
+	ASSERT(result != NULL && result->value == 1);
+
 	sht_free(ht);
 }
 
-TEST(excessive_collisions_psl_1)
+/*******************************************************************************
+ *
+ *	Tests: Get operations
+ *
+ ******************************************************************************/
+
+TEST(get_existing_entry)
 {
 	struct sht_ht *ht;
 	struct int_entry e;
-	int i;
-	int result;
+	int key = 42;
 
-	/* Use pathological hash function with minimal PSL threshold */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	sht_set_lft(ht, 95);  /* High load factor to delay growth */
-	sht_set_psl_limit(ht, 1);  /* Minimal PSL threshold */
-	ASSERT(sht_init(ht, 16));
+	ASSERT(sht_init(ht, 0));
 
-	/* Add entries until we hit the PSL limit - this MUST happen
-	   because bad_hashfn forces all entries to the same bucket */
-	for (i = 0; i < 20; i++) {
-		e.key = i;
-		e.value = i * 10;
-		result = sht_add(ht, &e.key, &e);
-		if (result == -1) {
-			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-			sht_free(ht);
-			return;
-		}
-	}
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result != NULL);
+	ASSERT(result->key == 42);
+	ASSERT(result->value == 100);
 
-	/* Should never get here - bad_hashfn forces PSL limit */
-	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
 	sht_free(ht);
 }
 
-TEST(psl_tracking_after_delete)
+TEST(get_nonexistent_entry)
+{
+	struct sht_ht *ht;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result == NULL);
+
+	sht_free(ht);
+}
+
+TEST(get_with_token)
 {
 	struct sht_ht *ht;
 	struct int_entry e;
-	int keys[20];
+	uint32_t tokens[200];
+	int keys[200];
 	int i;
-	int result;
 
-	/* Use pathological hash with very low PSL threshold */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	sht_set_lft(ht, 95);  /* High load factor to prevent growth */
-	sht_set_psl_limit(ht, 3);  /* Very low PSL threshold */
-	ASSERT(sht_init(ht, 16));
+	ASSERT(sht_init(ht, 0));
 
-	/* Add entries to create a chain up to PSL threshold */
-	for (i = 0; i < 10; i++) {
-		keys[i] = i;
+	for (i = 0; i < 100; ++i) {
 		e.key = i;
 		e.value = i * 10;
-		result = sht_add(ht, &keys[i], &e);
-		if (result == -1) {
-			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-			break;
-		}
+		ASSERT(sht_add(ht, &i, &e) == 0);
 	}
 
-	/* If we successfully added entries, try deleting and re-adding
-	   to test psl_maxxed tracking after deletions */
-	if (i > 0) {
-		/* Delete the last entry added */
-		sht_delete(ht, &keys[i - 1]);
+	for (i = 0; i < 200; ++i) {
+		keys[i] = i;
+		tokens[i] = sht_prefetch(ht, &keys[i]);
+	}
 
-		/* Try to add more entries - should still respect PSL limit */
-		for (; i < 20; i++) {
-			keys[i] = i;
-			e.key = i;
-			e.value = i * 10;
-			result = sht_add(ht, &keys[i], &e);
-			if (result == -1) {
-				ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
-				break;
-			}
+	for (i = 0; i < 200; ++i) {
+		const struct int_entry *result;
+
+		result = sht_get_token(ht, &keys[i], tokens[i]);
+		if (i < 100) {
+			ASSERT(result == sht_get(ht, &keys[i]));
+			ASSERT(result->value == i * 10);
 		}
+		else {
+			ASSERT(result == NULL);
+		}
+	}
+
+	// Tokens remain valid after the table is resized
+	for (i = 100; i < 1000; ++i) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &i, &e) == 0);
+	}
+
+	for (i = 0; i < 200; ++i) {
+		const struct int_entry *result;
+
+		result = sht_get_token(ht, &keys[i], tokens[i]);
+		ASSERT(result != NULL);
+		ASSERT(result->key == i);
+		ASSERT(result->value == i * 10);
 	}
 
 	sht_free(ht);
@@ -1139,822 +1711,3067 @@ TEST(psl_tracking_after_delete)
 
 /*******************************************************************************
  *
- *	Tests: Read-only iterators
+ *	Tests: Replace operations
  *
  ******************************************************************************/
 
-TEST(ro_iterator_empty_table)
+TEST(replace_existing_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e1, e2;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e1.key = 42;
+	e1.value = 100;
+	ASSERT(sht_add(ht, &key, &e1) == 0);
+
+	e2.key = 42;
+	e2.value = 200;
+	ASSERT(sht_replace(ht, &key, &e2));
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result != NULL);
+	ASSERT(result->value == 200);
+
+	sht_free(ht);
+}
+
+TEST(replace_nonexistent_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(!sht_replace(ht, &key, &e));
+
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Swap operations
+ *
+ ******************************************************************************/
+
+TEST(swap_existing_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e1, e2;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e1.key = 42;
+	e1.value = 100;
+	ASSERT(sht_add(ht, &key, &e1) == 0);
+
+	e2.key = 42;
+	e2.value = 200;
+	ASSERT(sht_swap(ht, &key, &e2, &e2));
+	ASSERT(e2.key == 42);
+	ASSERT(e2.value == 100);  /* Old value */
+
+	const struct int_entry *result = sht_get(ht, &key);
+	ASSERT(result != NULL);
+	ASSERT(result->value == 200);
+
+	sht_free(ht);
+}
+
+TEST(swap_nonexistent_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(!sht_swap(ht, &key, &e, &e));
+
+	sht_free(ht);
+}
+
+TEST(swap_separate_buffers)
+{
+	struct sht_ht *ht;
+	struct int_entry e1, e2, old;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e1.key = 42;
+	e1.value = 100;
+	ASSERT(sht_add(ht, &key, &e1) == 0);
+
+	e2.key = 42;
+	e2.value = 200;
+	ASSERT(sht_swap(ht, &key, &e2, &old));
+	ASSERT(old.value == 100);
+	ASSERT(e2.value == 200);  /* Unchanged */
+
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Delete operations
+ *
+ ******************************************************************************/
+
+TEST(delete_existing_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT(sht_delete(ht, &key));
+	ASSERT(sht_get(ht, &key) == NULL);
+
+	sht_free(ht);
+}
+
+TEST(delete_nonexistent_entry)
+{
+	struct sht_ht *ht;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT(!sht_delete(ht, &key));
+
+	sht_free(ht);
+}
+
+TEST(pop_existing_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry e, popped;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT(sht_pop(ht, &key, &popped));
+	ASSERT(popped.key == 42);
+	ASSERT(popped.value == 100);
+	ASSERT(sht_get(ht, &key) == NULL);
+
+	sht_free(ht);
+}
+
+TEST(pop_nonexistent_entry)
+{
+	struct sht_ht *ht;
+	struct int_entry popped;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT(!sht_pop(ht, &key, &popped));
+
+	sht_free(ht);
+}
+
+TEST(delete_many_entries)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int keys[1000];
+	const void *victims[700];
+	int i, n;
+
+	ht = SHT_NEW(clump_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		keys[i] = i;
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &keys[i], &e) == 0);
+	}
+
+	/* Delete every key divisible by 2 or 3, plus duplicates & misses */
+	for (i = 0, n = 0; i < 1000; i++) {
+		if (i % 2 == 0 || i % 3 == 0)
+			victims[n++] = &keys[i];
+	}
+	victims[n++] = &keys[0];	/* duplicate */
+	victims[n++] = &keys[6];	/* duplicate */
+
+	ASSERT(sht_delete_many(ht, victims, n) == 667);
+	ASSERT(sht_size(ht) == 333);
+
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i % 2 == 0 || i % 3 == 0) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	/* Nothing left to delete */
+	ASSERT(sht_delete_many(ht, victims, n) == 0);
+	ASSERT(sht_delete_many(ht, victims, 0) == 0);
+	ASSERT(sht_size(ht) == 333);
+
+	sht_free(ht);
+}
+
+TEST(delete_many_wraparound)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int keys[6] = { 0, 1, 2, 3, 4, 5 };
+	const void *victims[] = { &keys[0], &keys[3], &keys[4] };
+	int i;
+
+	/* All entries hash to the last position, so the run wraps around */
+	ht = SHT_NEW(end_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 8));
+
+	for (i = 0; i < 6; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &keys[i], &e) == 0);
+	}
+
+	ASSERT(sht_delete_many(ht, victims, 3) == 3);
+	ASSERT(sht_size(ht) == 3);
+
+	for (i = 0; i < 6; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i == 0 || i == 3 || i == 4) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	/* Remaining entries must still be in their ideal positions or later */
+	ASSERT(sht_delete(ht, &keys[1]));
+	ASSERT(sht_get(ht, &keys[2]) != NULL);
+	ASSERT(sht_get(ht, &keys[5]) != NULL);
+
+	sht_free(ht);
+}
+
+TEST(remove_if_entries)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i, limit;
+
+	ht = SHT_NEW(clump_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &i, &e) == 0);
+	}
+
+	/* Remove 30% of the entries */
+	limit = 3;
+	ASSERT(sht_remove_if(ht, mod_predfn, &limit) == 300);
+	ASSERT(sht_size(ht) == 700);
+
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i % 10 < 3) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	/* No matches */
+	ASSERT(sht_remove_if(ht, mod_predfn, &limit) == 0);
+	ASSERT(sht_size(ht) == 700);
+
+	/* Everything matches */
+	limit = 10;
+	ASSERT(sht_remove_if(ht, mod_predfn, &limit) == 700);
+	ASSERT(sht_empty(ht));
+
+	sht_free(ht);
+}
+
+TEST(remove_if_wraparound)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i, limit;
+
+	/* All entries hash to the last position, so the run wraps around */
+	ht = SHT_NEW(end_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 8));
+
+	for (i = 0; i < 6; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &i, &e) == 0);
+	}
+
+	limit = 2;
+	ASSERT(sht_remove_if(ht, mod_predfn, &limit) == 2);
+	ASSERT(sht_size(ht) == 4);
+
+	for (i = 0; i < 6; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i < 2) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	sht_free(ht);
+}
+
+TEST(remove_if_with_freefn)
+{
+	struct sht_ht *ht;
+	struct str_entry e;
+	const char *keys[] = { "foo", "bar", "baz", "qux" };
+	int i;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 4; i++) {
+		e.key = strdup(keys[i]);
+		e.value = strdup("value");
+		ASSERT(sht_add(ht, keys[i], &e) == 0);
+	}
+
+	/* Free function releases the removed entries' strings */
+	ASSERT(sht_remove_if(ht, str_b_predfn, NULL) == 2);
+	ASSERT(sht_size(ht) == 2);
+	ASSERT(sht_get(ht, "foo") != NULL);
+	ASSERT(sht_get(ht, "bar") == NULL);
+	ASSERT(sht_get(ht, "baz") == NULL);
+	ASSERT(sht_get(ht, "qux") != NULL);
+
+	sht_free(ht);
+}
+
+TEST(delete_many_with_freefn)
+{
+	struct sht_ht *ht;
+	struct str_entry e;
+	const char *keys[] = { "foo", "bar", "baz", "qux" };
+	const void *victims[] = { "bar", "qux", "missing" };
+	int i;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 4; i++) {
+		e.key = strdup(keys[i]);
+		e.value = strdup("value");
+		ASSERT(sht_add(ht, keys[i], &e) == 0);
+	}
+
+	/* Free function releases the deleted entries' strings */
+	ASSERT(sht_delete_many(ht, victims, 3) == 2);
+	ASSERT(sht_size(ht) == 2);
+	ASSERT(sht_get(ht, "foo") != NULL);
+	ASSERT(sht_get(ht, "bar") == NULL);
+	ASSERT(sht_get(ht, "baz") != NULL);
+	ASSERT(sht_get(ht, "qux") == NULL);
+
+	sht_free(ht);
+}
+
+TEST(clear_entries)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	/* Clearing an empty table is a no-op */
+	sht_clear(ht);
+	ASSERT(sht_empty(ht));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	sht_clear(ht);
+	ASSERT(sht_empty(ht));
+	for (i = 0; i < 100; i++)
+		ASSERT(sht_get(ht, &i) == NULL);
+
+	/* Table is reusable */
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 20;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	ASSERT(sht_size(ht) == 100);
+	for (i = 0; i < 100; i++) {
+		const struct int_entry *result = sht_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 20);
+	}
+
+	sht_free(ht);
+}
+
+TEST(clear_with_freefn)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i, freed = 0;
+
+	/* All entries hash to the last position, so the run wraps around */
+	ht = SHT_NEW(end_hashfn, int_eqfn, count_freefn, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 5; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	sht_clear(ht);
+	ASSERT(freed == 5);
+	ASSERT(sht_empty(ht));
+
+	for (i = 0; i < 5; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+		ASSERT(sht_get(ht, &i) != NULL);
+	}
+
+	sht_free(ht);
+	ASSERT(freed == 10);
+}
+
+/* Allocates a copy of a string from a table's resource arena */
+static char *bulk_strdup(struct sht_ht *ht, const char *str)
+{
+	char *copy;
+
+	if ((copy = sht_bulk_alloc(ht, strlen(str) + 1)) != NULL)
+		strcpy(copy, str);
+
+	return copy;
+}
+
+TEST(bulk_free)
+{
+	struct sht_ht *ht;
+	const struct str_entry *result;
+	struct str_entry e;
+	char key[32], *big;
+	int i, freed = 0;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, count_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	sht_set_bulk_free(ht);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 5000; i++) {
+		snprintf(key, sizeof key, "key-%d", i);
+		e.key = bulk_strdup(ht, key);
+		e.value = bulk_strdup(ht, "value");
+		ASSERT(e.key != NULL && e.value != NULL);
+		ASSERT((uintptr_t)e.key % alignof(max_align_t) == 0);
+		ASSERT(sht_add(ht, e.key, &e) == 0);
+	}
+
+	/* Large allocations don't disturb the current chunk */
+	big = sht_bulk_alloc(ht, 1 << 20);
+	ASSERT(big != NULL);
+	memset(big, 0xff, 1 << 20);
+	e.key = bulk_strdup(ht, "big");
+	e.value = big;
+	ASSERT(sht_add(ht, e.key, &e) == 0);
+
+	/* Individual removals still call the free function */
+	ASSERT(sht_delete(ht, "key-0"));
+	ASSERT(freed == 1);
+	for (i = 1; i < 5000; i++) {
+		snprintf(key, sizeof key, "key-%d", i);
+		result = sht_get(ht, key);
+		ASSERT(result != NULL && strcmp(result->value, "value") == 0);
+	}
+
+	/* Clearing releases the arena without calling the free function */
+	sht_clear(ht);
+	ASSERT(freed == 1);
+	ASSERT(sht_empty(ht));
+
+	e.key = bulk_strdup(ht, "again");
+	e.value = NULL;
+	ASSERT(sht_add(ht, e.key, &e) == 0);
+	ASSERT(sht_get(ht, "again") != NULL);
+
+	sht_free(ht);
+	ASSERT(freed == 1);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Table cloning
+ *
+ ******************************************************************************/
+
+TEST(clone_table)
+{
+	struct sht_ht *ht, *clone;
+	struct int_entry e;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+	ASSERT(sht_size(clone) == 100);
+	for (i = 0; i < 100; i++) {
+		const struct int_entry *result = sht_get(clone, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 10);
+	}
+
+	/* Tables are independent */
+	for (i = 0; i < 50; i++)
+		ASSERT(sht_delete(ht, &i));
+	for (i = 100; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(clone, &e.key, &e) == 0);
+	}
+
+	ASSERT(sht_size(ht) == 50);
+	ASSERT(sht_size(clone) == 1000);
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *result = sht_get(clone, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 10);
+		ASSERT((sht_get(ht, &i) != NULL) == (i >= 50 && i < 100));
+	}
+
+	sht_free(ht);
+	sht_free(clone);
+}
+
+TEST(clone_with_copyfn)
+{
+	struct sht_ht *ht, *clone;
+	struct str_entry e;
+	const struct str_entry *result;
+	const char *keys[] = { "foo", "bar", "baz", "qux" };
+	int i;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 4; i++) {
+		e.key = strdup(keys[i]);
+		e.value = strdup("value");
+		ASSERT(sht_add(ht, keys[i], &e) == 0);
+	}
+
+	clone = sht_clone(ht, str_copyfn, NULL);
+	ASSERT(clone != NULL);
+
+	/* Clone owns its own copies of the strings */
+	sht_free(ht);
+
+	ASSERT(sht_size(clone) == 4);
+	for (i = 0; i < 4; i++) {
+		result = sht_get(clone, keys[i]);
+		ASSERT(result != NULL);
+		ASSERT(strcmp(result->key, keys[i]) == 0);
+		ASSERT(strcmp(result->value, "value") == 0);
+	}
+
+	sht_free(clone);
+}
+
+TEST(clone_copy_failure)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i, freed = 0, remaining = 5;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, count_freefn, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 20; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* Entries copied before the failure are freed */
+	ASSERT(sht_clone(ht, failing_copyfn, &remaining) == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_COPY);
+	ASSERT(strcmp(sht_get_msg(ht), "Entry copy function failed") == 0);
+	ASSERT(freed == 5);
+
+	/* Original table is unchanged */
+	ASSERT(sht_size(ht) == 20);
+	for (i = 0; i < 20; i++)
+		ASSERT(sht_get(ht, &i) != NULL);
+
+	sht_free(ht);
+	ASSERT(freed == 25);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Indirect entries
+ *
+ ******************************************************************************/
+
+TEST(indirect_entries)
+{
+	struct sht_ht *ht;
+	const struct int_entry *p7, *p8, *result;
+	struct int_entry e;
+	int i, freed = 0;
+
+	ht = SHT_NEW_INDIRECT(int_hashfn, int_eqfn, count_freefn,
+			      struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 7;
+	e.value = 70;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	e.key = 8;
+	e.value = 80;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	p7 = sht_get(ht, &(int){ 7 });
+	p8 = sht_get(ht, &(int){ 8 });
+	ASSERT(p7 != NULL && p8 != NULL);
+
+	/* Entries don't move when the table grows or other entries move */
+	for (i = 100; i < 3000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 100; i < 3000; i += 2)
+		ASSERT(sht_delete(ht, &i));
+	ASSERT(freed == 1450);
+
+	ASSERT(sht_get(ht, &(int){ 7 }) == p7);
+	ASSERT(sht_get(ht, &(int){ 8 }) == p8);
+
+	/* Duplicate keys don't change the existing entry */
+	e.key = 7;
+	e.value = 0;
+	ASSERT(sht_add(ht, &e.key, &e) == 1);
+	ASSERT(p7->value == 70);
+
+	/* Replacing an entry keeps its address */
+	e.value = 71;
+	ASSERT(sht_set(ht, &e.key, &e) == 1);
+	ASSERT(freed == 1451);
+	ASSERT(sht_get(ht, &e.key) == p7 && p7->value == 71);
+
+	e.value = 72;
+	ASSERT(sht_swap(ht, &e.key, &e, &e));
+	ASSERT(e.value == 71 && p7->value == 72);
+
+	/* Removed entries are reused */
+	ASSERT(sht_pop(ht, &(int){ 8 }, &e));
+	ASSERT(e.key == 8 && e.value == 80);
+	ASSERT(freed == 1451);
+	e.key = 9;
+	e.value = 90;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(sht_get(ht, &e.key) == p8);
+
+	for (i = 101; i < 3000; i += 2) {
+		result = sht_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+
+	sht_clear(ht);
+	ASSERT(freed == 1451 + 1452);
+	ASSERT(sht_empty(ht));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_size(ht) == 100);
+
+	sht_free(ht);
+	ASSERT(freed == 1451 + 1452 + 100);
+}
+
+TEST(indirect_large_entries)
+{
+	struct sht_ht *ht;
+	struct huge_entry *e;
+	const struct huge_entry *result;
+	enum sht_err err = SHT_ERR_OK;
+	int i;
+
+	ht = sht_new_indirect_(int_hashfn, int_eqfn, NULL,
+			       SHT_MAX_INDIRECT_ESIZE + 1, 1, &err);
+	ASSERT(ht == NULL);
+	ASSERT(err == SHT_ERR_BAD_ESIZE);
+
+	ht = SHT_NEW_INDIRECT(int_hashfn, int_eqfn, NULL, struct huge_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	e = calloc(1, sizeof *e);
+	ASSERT(e != NULL);
+
+	for (i = 0; i < 50; i++) {
+		e->key = i;
+		memset(e->data, 'a' + i % 26, sizeof e->data);
+		ASSERT(sht_add(ht, &e->key, e) == 0);
+	}
+
+	for (i = 0; i < 50; i += 5)
+		ASSERT(sht_delete(ht, &i));
+
+	for (i = 0; i < 50; i++) {
+		result = sht_get(ht, &i);
+		if (i % 5 == 0) {
+			ASSERT(result == NULL);
+			continue;
+		}
+		ASSERT(result != NULL);
+		ASSERT(result->data[0] == 'a' + i % 26);
+		ASSERT(result->data[sizeof e->data - 1] == 'a' + i % 26);
+	}
+
+	free(e);
+	sht_free(ht);
+}
+
+TEST(indirect_clone)
+{
+	struct sht_ht *ht, *clone;
+	struct str_entry e;
+	const struct str_entry *a, *b;
+	struct int_entry ie;
+	char key[16];
+	int i, freed = 0, remaining = 5;
+
+	ht = SHT_NEW_INDIRECT(str_hashfn, str_eqfn, str_freefn,
+			      struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof key, "key%d", i);
+		e.key = strdup(key);
+		e.value = strdup(key);
+		ASSERT(sht_add(ht, e.key, &e) == 0);
+	}
+
+	clone = sht_clone(ht, str_copyfn, NULL);
+	ASSERT(clone != NULL);
+
+	/* The clone has its own copies of the entries */
+	a = sht_get(ht, "key42");
+	b = sht_get(clone, "key42");
+	ASSERT(a != NULL && b != NULL && a != b);
+	ASSERT(a->value != b->value && strcmp(a->value, b->value) == 0);
+
+	ASSERT(sht_delete(ht, "key42"));
+	ASSERT(sht_get(clone, "key42") == b);
+	sht_free(ht);
+	ASSERT(sht_size(clone) == 100);
+	sht_free(clone);
+
+	/* Entries copied before a failure are freed */
+	ht = SHT_NEW_INDIRECT(int_hashfn, int_eqfn, count_freefn,
+			      struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_free_ctx(ht, &freed);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 20; i++) {
+		ie.key = i;
+		ie.value = i;
+		ASSERT(sht_add(ht, &ie.key, &ie) == 0);
+	}
+
+	ASSERT(sht_clone(ht, failing_copyfn, &remaining) == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_COPY);
+	ASSERT(freed == 5);
+
+	sht_free(ht);
+	ASSERT(freed == 25);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Saving and mapping tables
+ *
+ ******************************************************************************/
+
+TEST(save_and_map)
+{
+	struct sht_ht *ht, *clone;
+	struct sht_iter *iter;
+	struct int_entry e;
+	char path[32];
+	int i, count;
+
+	ASSERT(save_int_table(path, 1000));
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_map(ht, path));
+	ASSERT(unlink(path) == 0);  /* Mapping remains valid */
+
+	ASSERT(sht_size(ht) == 1000);
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *result = sht_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 10);
+	}
+	i = 1000;
+	ASSERT(sht_get(ht, &i) == NULL);
+
+	/* Read-only iterators are allowed */
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+	for (count = 0; sht_iter_next(iter) != NULL; count++)
+		;
+	ASSERT(count == 1000);
+	sht_iter_free(iter);
+
+	/* A clone of a mapped table is modifiable */
+	clone = sht_clone(ht, NULL, NULL);
+	ASSERT(clone != NULL);
+	for (i = 1000; i < 2000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(clone, &e.key, &e) == 0);
+	}
+	ASSERT(sht_delete(clone, &(int){ 0 }));
+	ASSERT(sht_size(clone) == 1999);
+	ASSERT(sht_size(ht) == 1000);
+
+	sht_free(clone);
+	sht_free(ht);
+}
+
+TEST(map_errors)
+{
+	struct sht_ht *ht;
+	char path[32];
+	FILE *fp;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct aligned_entry);
+	ASSERT(ht != NULL);
+
+	/* Nonexistent file */
+	ASSERT(!sht_map(ht, "/nonexistent/sht_test"));
+	ASSERT(sht_get_err(ht) == SHT_ERR_IO);
+	ASSERT(errno == ENOENT);
+
+	/* Different entry size */
+	ASSERT(save_int_table(path, 10));
+	ASSERT(!sht_map(ht, path));
+	ASSERT(sht_get_err(ht) == SHT_ERR_BAD_FILE);
+	ASSERT(strcmp(sht_get_msg(ht),
+		      "Invalid or incompatible table file") == 0);
+
+	/* Truncated file */
+	ASSERT((fp = fopen(path, "w")) != NULL);
+	ASSERT(fputs("SHTF", fp) >= 0);
+	ASSERT(fclose(fp) == 0);
+	ASSERT(!sht_map(ht, path));
+	ASSERT(sht_get_err(ht) == SHT_ERR_BAD_FILE);
+	ASSERT(unlink(path) == 0);
+
+	/* Table can still be initialized */
+	ASSERT(sht_init(ht, 0));
+	sht_free(ht);
+}
+
+TEST(shared_table)
+{
+	struct sht_ht *writer, *reader;
+	struct int_entry e, out;
+	char path[32];
+	int fd, i;
+
+	strcpy(path, "/tmp/sht_test.XXXXXX");
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+
+	writer = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(writer != NULL);
+	ASSERT(sht_init_shared(writer, 100, fd));
+
+	reader = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(reader != NULL);
+	ASSERT(sht_map_fd(reader, fd));
+	ASSERT(close(fd) == 0);  /* Mappings remain valid */
+	ASSERT(sht_empty(reader));
+
+	/* Reader sees changes made by the writer */
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(writer, &e.key, &e) == 0);
+	}
+	ASSERT(sht_size(reader) == 100);
+	for (i = 0; i < 100; i++) {
+		ASSERT(sht_read(reader, &i, &out));
+		ASSERT(out.key == i && out.value == i * 10);
+	}
+
+	ASSERT(sht_delete(writer, &(int){ 50 }));
+	ASSERT(sht_size(reader) == 99);
+	ASSERT(!sht_read(reader, &(int){ 50 }, &out));
+
+	/* sht_read() also works on the writer's table */
+	ASSERT(sht_read(writer, &(int){ 51 }, &out));
+	ASSERT(out.value == 510);
+
+	/* Shared tables cannot grow */
+	e.key = 50;
+	e.value = 500;
+	ASSERT(sht_add(writer, &e.key, &e) == 0);
+	for (i = 100; i < 200; i++) {
+		e.key = i;
+		e.value = i * 10;
+		if (sht_add(writer, &e.key, &e) == -1)
+			break;
+	}
+	ASSERT(i < 200);
+	ASSERT(sht_get_err(writer) == SHT_ERR_TOOBIG);
+	ASSERT(sht_size(reader) == (uint32_t)i);
+	ASSERT(!sht_reserve(writer, 200));
+	ASSERT(sht_get_err(writer) == SHT_ERR_TOOBIG);
+
+	sht_free(reader);
+	sht_free(writer);
+}
+
+TEST(shared_concurrent_reader)
+{
+	struct sht_ht *writer;
+	struct int_entry e;
+	char path[32];
+	int fd, i, round, status;
+	pid_t pid;
+
+	strcpy(path, "/tmp/sht_test.XXXXXX");
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+
+	writer = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(writer != NULL);
+	ASSERT(sht_init_shared(writer, 1000, fd));
+
+	ASSERT((pid = fork()) >= 0);
+
+	if (pid == 0) {
+		struct sht_ht *reader;
+		struct int_entry out;
+		int key, found = 0;
+
+		reader = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+		if (reader == NULL || !sht_map_fd(reader, fd))
+			_exit(2);
+
+		/* Every entry that is found must be consistent */
+		for (i = 0; i < 200000; i++) {
+			key = i % 1000;
+			if (!sht_read(reader, &key, &out))
+				continue;
+			if (out.key != key || out.value != key * 10)
+				_exit(1);
+			found++;
+		}
+
+		_exit(found > 0 ? 0 : 3);
+	}
+
+	/* Repeatedly fill and drain the table while the child reads it */
+	for (round = 0; waitpid(pid, &status, WNOHANG) == 0; round++) {
+		for (i = 0; i < 1000; i++) {
+			e.key = (i * 7 + round) % 1000;
+			e.value = e.key * 10;
+			ASSERT(sht_set(writer, &e.key, &e) >= 0);
+		}
+		for (i = 0; i < 1000; i += 2)
+			ASSERT(sht_delete(writer, &i));
+	}
+
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	ASSERT(close(fd) == 0);
+	sht_free(writer);
+}
+
+/* Check that a table file contains integers 0 to n - 1, except skip (or -1) */
+static _Bool check_int_file(int fd, int n, int skip)
+{
+	struct sht_ht *ht;
+	const struct int_entry *e;
+	_Bool ok;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	if (ht == NULL)
+		return 0;
+	if (!sht_map_fd(ht, fd)) {
+		free(ht);
+		return 0;
+	}
+
+	ok = sht_size(ht) == (uint32_t)(skip >= 0 && skip < n ? n - 1 : n);
+	for (i = 0; ok && i < n; i++) {
+		e = sht_get(ht, &i);
+		ok = i == skip ? e == NULL : e != NULL && e->value == i * 10;
+	}
+
+	sht_free(ht);
+	return ok;
+}
+
+TEST(checkpoint_incremental)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	unsigned char saved[4], junk[4] = { 0xaa, 0xaa, 0xaa, 0xaa };
+	unsigned char check[4];
+	char path[32];
+	off_t end;
+	int fd, i;
+
+	strcpy(path, "/tmp/sht_test.XXXXXX");
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 1000));
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* First checkpoint writes a complete file */
+	ASSERT(sht_checkpoint(ht, fd));
+	ASSERT(check_int_file(fd, 1000, -1));
+
+	/* Unmodified regions are not rewritten */
+	ASSERT((end = lseek(fd, 0, SEEK_END)) > 4);
+	ASSERT(pread(fd, saved, 4, end - 4) == 4);
+	ASSERT(pwrite(fd, junk, 4, end - 4) == 4);
+	ASSERT(sht_checkpoint(ht, fd));
+	ASSERT(pread(fd, check, 4, end - 4) == 4);
+	ASSERT(memcmp(check, junk, 4) == 0);
+	ASSERT(pwrite(fd, saved, 4, end - 4) == 4);
+
+	/* Modified regions are */
+	e.key = 5;
+	e.value = 50;
+	ASSERT(sht_set(ht, &e.key, &e) == 1);
+	ASSERT(sht_delete(ht, &(int){ 501 }));
+	ASSERT(sht_remove_if(ht, mod_predfn, &(int){ 1 }) == 100);
+	for (i = 0; i < 1000; i += 10) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_checkpoint(ht, fd));
+	ASSERT(check_int_file(fd, 1000, 501));
+
+	/* Growing the table requires a complete checkpoint */
+	for (i = 1000; i < 5000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_checkpoint(ht, fd));
+	ASSERT(check_int_file(fd, 5000, 501));
+
+	/* So does emptying it */
+	sht_clear(ht);
+	ASSERT(sht_checkpoint(ht, fd));
+	ASSERT(check_int_file(fd, 0, -1));
+
+	ASSERT(close(fd) == 0);
+	sht_free(ht);
+}
+
+TEST(checkpoint_other_file)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	char path1[32], path2[32];
+	int fd1, fd2, i;
+
+	strcpy(path1, "/tmp/sht_test.XXXXXX");
+	strcpy(path2, "/tmp/sht_test.XXXXXX");
+	ASSERT((fd1 = mkstemp(path1)) >= 0);
+	ASSERT((fd2 = mkstemp(path2)) >= 0);
+	ASSERT(unlink(path1) == 0);
+	ASSERT(unlink(path2) == 0);
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 100));
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	ASSERT(sht_checkpoint(ht, fd1));
+	ASSERT(sht_delete(ht, &(int){ 7 }));
+	ASSERT(sht_checkpoint(ht, fd2));
+	ASSERT(sht_delete(ht, &(int){ 8 }));
+	e.key = 8;
+	e.value = 80;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+
+	/* fd1 is out of date, so a complete file is written */
+	ASSERT(sht_checkpoint(ht, fd1));
+	ASSERT(check_int_file(fd1, 100, 7));
+	ASSERT(check_int_file(fd2, 100, 7));
+
+	ASSERT(close(fd1) == 0);
+	ASSERT(close(fd2) == 0);
+	sht_free(ht);
+}
+
+TEST(checkpoint_swapped_files)
+{
+	struct sht_ht *ht1, *ht2;
+	struct int_entry e;
+	char path1[32], path2[32];
+	int fd1, fd2, i;
+
+	strcpy(path1, "/tmp/sht_test.XXXXXX");
+	strcpy(path2, "/tmp/sht_test.XXXXXX");
+	ASSERT((fd1 = mkstemp(path1)) >= 0);
+	ASSERT((fd2 = mkstemp(path2)) >= 0);
+	ASSERT(unlink(path1) == 0);
+	ASSERT(unlink(path2) == 0);
+
+	ht1 = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht2 = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht1 != NULL && ht2 != NULL);
+	ASSERT(sht_init(ht1, 1000));
+	ASSERT(sht_init(ht2, 1000));
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		if (i != 7)
+			ASSERT(sht_add(ht1, &e.key, &e) == 0);
+		ASSERT(sht_add(ht2, &e.key, &e) == 0);
+	}
+
+	ASSERT(sht_checkpoint(ht1, fd1));
+	ASSERT(sht_checkpoint(ht2, fd2));
+	e.key = 800;
+	e.value = 8000;
+	ASSERT(sht_set(ht1, &e.key, &e) == 1);
+	ASSERT(sht_set(ht2, &e.key, &e) == 1);
+
+	/* Same layout and generation, but each file belongs to the other table */
+	ASSERT(sht_checkpoint(ht1, fd2));
+	ASSERT(sht_checkpoint(ht2, fd1));
+	ASSERT(check_int_file(fd2, 1000, 7));
+	ASSERT(check_int_file(fd1, 1000, -1));
+
+	ASSERT(close(fd1) == 0);
+	ASSERT(close(fd2) == 0);
+	sht_free(ht1);
+	sht_free(ht2);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Table growth and rehashing
+ *
+ ******************************************************************************/
+
+TEST(table_growth)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 2));  /* Very small initial size */
+
+	/* Add enough entries to force multiple rehashes */
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* Verify all entries survived rehashing */
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *result = sht_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->key == i);
+		ASSERT(result->value == i * 10);
+	}
+
+	sht_free(ht);
+}
+
+TEST(reserve_capacity)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 2));  /* Very small initial size */
+
+	for (i = 0; i < 10; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* Existing entries must survive the single rehash */
+	ASSERT(sht_reserve(ht, 1000));
+	ASSERT(sht_size(ht) == 10);
+
+	/* Smaller reservations are no-ops */
+	ASSERT(sht_reserve(ht, 0));
+	ASSERT(sht_reserve(ht, 5));
+
+	for (i = 10; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	ASSERT(sht_size(ht) == 1000);
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *result = sht_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->key == i);
+		ASSERT(result->value == i * 10);
+	}
+
+	sht_free(ht);
+}
+
+TEST(sparse_large_table)
+{
+	struct sht_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	/* Bucket array is zero-filled memory (empty buckets are all zeros) */
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 4000000));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i * 40000;
+		e.value = i;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(sht_size(ht) == 100);
+	for (i = 0; i < 4000000; i += 1000) {
+		result = sht_get(ht, &i);
+		ASSERT((result != NULL) == (i % 40000 == 0));
+		ASSERT(result == NULL || result->value == i / 40000);
+	}
+
+	/* Clearing restores the all-zero empty buckets */
+	sht_clear(ht);
+	ASSERT(sht_empty(ht));
+	i = 0;
+	ASSERT(sht_get(ht, &i) == NULL);
+	e.key = 0;
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+
+	sht_free(ht);
+}
+
+static _Bool u32_eqfn(const void *restrict key, const void *restrict entry,
+		      void *restrict ctx)
+{
+	(void)ctx;
+	return *(const uint32_t *)key == *(const uint32_t *)entry;
+}
+
+static _Bool u64_eqfn(const void *restrict key, const void *restrict entry,
+		      void *restrict ctx)
+{
+	(void)ctx;
+	return *(const uint64_t *)key == *(const uint64_t *)entry;
+}
+
+TEST(builtin_hash_functions)
+{
+	static const char zeros[32];
+	struct sht_ht *ht;
+	uint32_t hashes[33];
+	uint64_t k64;
+	uint32_t k32;
+	char buf[16];
+	int i, j;
+
+	k32 = 12345;
+	ASSERT(sht_hash_u32(&k32) == sht_hashfn_u32(&k32, NULL));
+	k64 = UINT64_C(1) << 40;
+	ASSERT(sht_hash_u64(&k64) == sht_hashfn_u64(&k64, NULL));
+	ASSERT(sht_hash_str("hello") == sht_hash_bytes("hello", 5));
+	ASSERT(sht_hashfn_str("hello", NULL) == sht_hash_str("hello"));
+
+	/* The length of a key is part of its hash */
+	for (i = 0; i <= 32; i++) {
+		hashes[i] = sht_hash_bytes(zeros, i);
+		for (j = 0; j < i; j++)
+			ASSERT(hashes[j] != hashes[i]);
+	}
+
+	/* Integer keys that differ only in their high bits */
+	ht = sht_new_(sht_hashfn_u64, u64_eqfn, NULL, sizeof(uint64_t),
+		      alignof(uint64_t), NULL);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 20000; i++) {
+		k64 = (uint64_t)i << 40;
+		ASSERT(sht_add(ht, &k64, &k64) == 0);
+	}
+	for (i = 0; i < 20000; i++) {
+		k64 = (uint64_t)i << 40;
+		ASSERT(sht_get(ht, &k64) != NULL);
+	}
+	sht_free(ht);
+
+	ht = sht_new_(sht_hashfn_u32, u32_eqfn, NULL, sizeof(uint32_t),
+		      alignof(uint32_t), NULL);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	for (k32 = 0; k32 < 20000; k32++)
+		ASSERT(sht_add(ht, &k32, &k32) == 0);
+	sht_free(ht);
+
+	ht = SHT_NEW(sht_hashfn_str, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	for (i = 0; i < 20000; i++) {
+		struct str_entry e = { .value = NULL };
+		snprintf(buf, sizeof buf, "key%d", i);
+		e.key = strdup(buf);
+		ASSERT(sht_add(ht, e.key, &e) == 0);
+	}
+	for (i = 0; i < 20000; i++) {
+		snprintf(buf, sizeof buf, "key%d", i);
+		ASSERT(sht_get(ht, buf) != NULL);
+	}
+	sht_free(ht);
+}
+
+TEST(reserve_too_large)
+{
+	struct sht_ht *ht;
+	struct int_entry e = { .key = 1, .value = 10 };
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+
+	ASSERT(!sht_reserve(ht, UINT32_C(1) << 25));  /* > 16,777,216 */
+	ASSERT(sht_get_err(ht) == SHT_ERR_TOOBIG);
+	ASSERT(!sht_reserve(ht, UINT32_C(1) << 24));  /* > max at 85% LFT */
+	ASSERT(sht_get_err(ht) == SHT_ERR_TOOBIG);
+
+	/* Table is unchanged */
+	ASSERT(sht_size(ht) == 1);
+	ASSERT(sht_get(ht, &e.key) != NULL);
+
+	sht_free(ht);
+}
+
+TEST(collision_handling)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+
+	/* Use pathological hash function to force collisions */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	/* Add entries that will all hash to the same value */
+	for (i = 0; i < 50; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* Verify all entries can be retrieved */
+	for (i = 0; i < 50; i++) {
+		const struct int_entry *result = sht_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->key == i);
+		ASSERT(result->value == i * 10);
+	}
+
+	sht_free(ht);
+}
+
+TEST(excessive_collisions)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+	int result;
+
+	/* Use pathological hash function and small table */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_lft(ht, 95);  /* High load factor to delay growth */
+	ASSERT(sht_init(ht, 128));
+
+	/* Add entries until we exceed max PSL (127) - this MUST happen
+	   because bad_hashfn forces all entries to the same bucket */
+	for (i = 0; i < 200; i++) {
+		e.key = i;
+		e.value = i * 10;
+		result = sht_add(ht, &e.key, &e);
+		if (result == -1) {
+			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+			sht_free(ht);
+			return;
+		}
+	}
+
+	/* Should never get here - bad_hashfn forces PSL limit */
+	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
+	sht_free(ht);
+}
+
+TEST(excessive_collisions_psl_10)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+	int result;
+
+	/* Use pathological hash function with low PSL threshold */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_lft(ht, 95);  /* High load factor to delay growth */
+	sht_set_psl_limit(ht, 10);  /* Low PSL threshold */
+	ASSERT(sht_init(ht, 32));
+
+	/* Add entries until we hit the PSL limit - this MUST happen
+	   because bad_hashfn forces all entries to the same bucket */
+	for (i = 0; i < 50; i++) {
+		e.key = i;
+		e.value = i * 10;
+		result = sht_add(ht, &e.key, &e);
+		if (result == -1) {
+			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+			sht_free(ht);
+			return;
+		}
+	}
+
+	/* Should never get here - bad_hashfn forces PSL limit */
+	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
+	sht_free(ht);
+}
+
+TEST(excessive_collisions_psl_50)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+	int result;
+
+	/* Use pathological hash function with medium PSL threshold */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_lft(ht, 95);  /* High load factor to delay growth */
+	sht_set_psl_limit(ht, 50);  /* Medium PSL threshold */
+	ASSERT(sht_init(ht, 64));
+
+	/* Add entries until we hit the PSL limit - this MUST happen
+	   because bad_hashfn forces all entries to the same bucket */
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		result = sht_add(ht, &e.key, &e);
+		if (result == -1) {
+			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+			sht_free(ht);
+			return;
+		}
+	}
+
+	/* Should never get here - bad_hashfn forces PSL limit */
+	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
+	sht_free(ht);
+}
+
+TEST(excessive_collisions_psl_1)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+	int result;
+
+	/* Use pathological hash function with minimal PSL threshold */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_lft(ht, 95);  /* High load factor to delay growth */
+	sht_set_psl_limit(ht, 1);  /* Minimal PSL threshold */
+	ASSERT(sht_init(ht, 16));
+
+	/* Add entries until we hit the PSL limit - this MUST happen
+	   because bad_hashfn forces all entries to the same bucket */
+	for (i = 0; i < 20; i++) {
+		e.key = i;
+		e.value = i * 10;
+		result = sht_add(ht, &e.key, &e);
+		if (result == -1) {
+			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+			sht_free(ht);
+			return;
+		}
+	}
+
+	/* Should never get here - bad_hashfn forces PSL limit */
+	ASSERT(0 && "Should have hit SHT_ERR_BAD_HASH");
+	sht_free(ht);
+}
+
+TEST(psl_tracking_after_delete)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int keys[20];
+	int i;
+	int result;
+
+	/* Use pathological hash with very low PSL threshold */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_lft(ht, 95);  /* High load factor to prevent growth */
+	sht_set_psl_limit(ht, 3);  /* Very low PSL threshold */
+	ASSERT(sht_init(ht, 16));
+
+	/* Add entries to create a chain up to PSL threshold */
+	for (i = 0; i < 10; i++) {
+		keys[i] = i;
+		e.key = i;
+		e.value = i * 10;
+		result = sht_add(ht, &keys[i], &e);
+		if (result == -1) {
+			ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+			break;
+		}
+	}
+
+	/* If we successfully added entries, try deleting and re-adding
+	   to test psl_maxxed tracking after deletions */
+	if (i > 0) {
+		/* Delete the last entry added */
+		sht_delete(ht, &keys[i - 1]);
+
+		/* Try to add more entries - should still respect PSL limit */
+		for (; i < 20; i++) {
+			keys[i] = i;
+			e.key = i;
+			e.value = i * 10;
+			result = sht_add(ht, &keys[i], &e);
+			if (result == -1) {
+				ASSERT(sht_get_err(ht) == SHT_ERR_BAD_HASH);
+				break;
+			}
+		}
+	}
+
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Read-only iterators
+ *
+ ******************************************************************************/
+
+TEST(ro_iterator_empty_table)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+	ASSERT(sht_iter_next(iter) == NULL);
+	sht_iter_free(iter);
+
+	sht_free(ht);
+}
+
+TEST(ro_iterator_all_entries)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	const struct int_entry *result;
+	int i, count;
+	int seen[100] = {0};
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	count = 0;
+	while ((result = sht_iter_next(iter)) != NULL) {
+		ASSERT(result->key >= 0 && result->key < 100);
+		ASSERT(result->value == result->key * 10);
+		ASSERT(seen[result->key] == 0);
+		seen[result->key] = 1;
+		count++;
+	}
+	ASSERT(count == 100);
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(multiple_ro_iterators)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter1, *iter2;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter1 = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter1 != NULL);
+
+	iter2 = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter2 != NULL);
+
+	sht_iter_free(iter1);
+	sht_iter_free(iter2);
+
+	sht_free(ht);
+}
+
+TEST(ro_iterator_max_count)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iters[32767];  /* SHT_MAX_ITERS */
+	struct int_entry e;
+	int i, key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	/* Create maximum number of iterators */
+	for (i = 0; i < 32767; i++) {
+		iters[i] = sht_iter_new(ht, SHT_ITER_RO);
+		ASSERT(iters[i] != NULL);
+	}
+
+	/* Try to create one more - should fail */
+	struct sht_iter *extra = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(extra == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_COUNT);
+
+	/* Free all iterators */
+	for (i = 0; i < 32767; i++) {
+		sht_iter_free(iters[i]);
+	}
+
+	sht_free(ht);
+}
+
+TEST(ro_iterator_replace)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	const struct int_entry *result;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 10; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	/* Get first entry and replace it */
+	result = sht_iter_next(iter);
+	ASSERT(result != NULL);
+
+	e.key = result->key;
+	e.value = 9999;
+	ASSERT(sht_iter_replace(iter, &e));
+
+	sht_iter_free(iter);
+
+	/* Verify replacement */
+	result = sht_get(ht, &e.key);
+	ASSERT(result != NULL);
+	ASSERT(result->value == 9999);
+
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Read/write iterators
+ *
+ ******************************************************************************/
+
+TEST(rw_iterator_empty_table)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+	ASSERT(sht_iter_next(iter) == NULL);
+	sht_iter_free(iter);
+
+	sht_free(ht);
+}
+
+TEST(rw_iterator_exclusive)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+
+	/* Try to create another rw iterator - should fail */
+	struct sht_iter *iter2 = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter2 == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+
+	/* Try to create ro iterator - should also fail */
+	struct sht_iter *ro_iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(ro_iter == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(ro_iterator_blocks_rw)
+{
+	struct sht_ht *ht;
+	struct sht_iter *ro_iter;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	ro_iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(ro_iter != NULL);
+
+	/* Try to create rw iterator - should fail */
+	struct sht_iter *rw_iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(rw_iter == NULL);
+	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+
+	sht_iter_free(ro_iter);
+	sht_free(ht);
+}
+
+TEST(rw_iterator_delete)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	const struct int_entry *result;
+	int i, count;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 10; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+
+	count = 0;
+	while ((result = sht_iter_next(iter)) != NULL) {
+		if (result->key % 2 == 0) {
+			ASSERT(sht_iter_delete(iter));
+		}
+		count++;
+	}
+	ASSERT(count == 10);
+
+	sht_iter_free(iter);
+
+	/* Verify even keys are gone */
+	for (i = 0; i < 10; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i % 2 == 0) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	sht_free(ht);
+}
+
+TEST(rw_iterator_replace)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	const struct int_entry *result;
+	int i;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 10; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+
+	while ((result = sht_iter_next(iter)) != NULL) {
+		e.key = result->key;
+		e.value = result->key * 100;
+		ASSERT(sht_iter_replace(iter, &e));
+	}
+
+	sht_iter_free(iter);
+
+	/* Verify all values updated */
+	for (i = 0; i < 10; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		ASSERT(r != NULL);
+		ASSERT(r->value == i * 100);
+	}
+
+	sht_free(ht);
+}
+
+TEST(iterator_delete_no_last)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+
+	/* Try to delete before calling NEXT */
+	ASSERT(!sht_iter_delete(iter));
+	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+
+	/* Advance iterator */
+	ASSERT(sht_iter_next(iter) != NULL);
+	ASSERT(sht_iter_next(iter) == NULL);
+
+	/* Try to delete after reaching end */
+	ASSERT(!sht_iter_delete(iter));
+	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(iterator_replace_no_last)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(iter != NULL);
+
+	/* Try to replace before calling NEXT */
+	e.value = 200;
+	ASSERT(!sht_iter_replace(iter, &e));
+	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(iterator_error_messages)
+{
+	struct sht_ht *ht;
+	struct sht_iter *ro_iter;
+	struct sht_iter *rw_iter;
+	struct int_entry e;
+	int key = 42;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	e.key = 42;
+	e.value = 100;
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	/* Test read-only iterator error messages */
+	ro_iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(ro_iter != NULL);
+
+	e.value = 200;
+	ASSERT(!sht_iter_replace(ro_iter, &e));
+	ASSERT(sht_iter_err(ro_iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(ro_iter), "Iterator at beginning or end") == 0);
+
+	sht_iter_free(ro_iter);
+
+	/* Test read/write iterator error messages */
+	rw_iter = sht_iter_new(ht, SHT_ITER_RW);
+	ASSERT(rw_iter != NULL);
+
+	ASSERT(!sht_iter_delete(rw_iter));
+	ASSERT(sht_iter_err(rw_iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(rw_iter), "Iterator at beginning or end") == 0);
+
+	e.value = 300;
+	ASSERT(!sht_iter_replace(rw_iter, &e));
+	ASSERT(sht_iter_err(rw_iter) == SHT_ERR_ITER_NO_LAST);
+	ASSERT(strcmp(sht_iter_msg(rw_iter), "Iterator at beginning or end") == 0);
+
+	sht_iter_free(rw_iter);
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Edge cases and stress tests
+ *
+ ******************************************************************************/
+
+TEST(delete_and_readd)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i, key;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	/* Add, delete, and re-add entries multiple times */
+	for (i = 0; i < 100; i++) {
+		key = i % 10;
+		e.key = key;
+		e.value = i;
+
+		if (i % 3 == 0 && sht_get(ht, &key) != NULL) {
+			ASSERT(sht_delete(ht, &key));
+		}
+
+		int result = sht_add(ht, &key, &e);
+		ASSERT(result == 0 || result == 1);
+	}
+
+	sht_free(ht);
+}
+
+TEST(wraparound_deletion)
+{
+	struct sht_ht *ht;
+	struct int_entry e;
+	int i;
+
+	/* Use bad hash to force entries at end of table */
+	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 8));
+
+	/* Fill table to force wraparound */
+	for (i = 0; i < 6; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(sht_add(ht, &e.key, &e) == 0);
+	}
+
+	/* Delete entries to test wraparound shifting */
+	for (i = 0; i < 6; i += 2) {
+		ASSERT(sht_delete(ht, &i));
+	}
+
+	/* Verify remaining entries */
+	for (i = 0; i < 6; i++) {
+		const struct int_entry *r = sht_get(ht, &i);
+		if (i % 2 == 0) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	sht_free(ht);
+}
+
+TEST(string_keys)
+{
+	struct sht_ht *ht;
+	struct str_entry e;
+	const struct str_entry *result;
+	const char *keys[] = {"foo", "bar", "baz", "qux"};
+	int i;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	for (i = 0; i < 4; i++) {
+		e.key = strdup(keys[i]);
+		e.value = strdup("value");
+		ASSERT(sht_add(ht, keys[i], &e) == 0);
+	}
+
+	for (i = 0; i < 4; i++) {
+		result = sht_get(ht, keys[i]);
+		ASSERT(result != NULL);
+		ASSERT(strcmp(result->key, keys[i]) == 0);
+	}
+
+	sht_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Abort conditions
+ *
+ ******************************************************************************/
+
+TEST(abort_invalid_error_code)
+{
+	ASSERT_ABORTS(sht_msg(SHT_ERR_COUNT), "Invalid error code");
+}
+
+TEST(abort_ealign_not_power_of_2)
+{
+	ASSERT_ABORTS(sht_new_(int_hashfn, int_eqfn, NULL, sizeof(struct int_entry), 3, NULL),
+		      "ealign not a power of 2");
+}
+
+TEST(abort_esize_ealign_incompatible)
+{
+	ASSERT_ABORTS(sht_new_(int_hashfn, int_eqfn, NULL, 10, 8, NULL),
+		      "Incompatible values of esize and ealign");
+}
+
+TEST(abort_new_keyed_invalid_key)
+{
+	ASSERT_ABORTS(sht_new_keyed_(NULL, NULL, 8, 4, 6, 4, NULL),
+		      "Invalid key offset or size");
+	ASSERT_ABORTS(sht_new_keyed_(NULL, NULL, 8, 4, 0, 0, NULL),
+		      "Invalid key offset or size");
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wnonnull"
+TEST(abort_null_hashfn)
+{
+	ASSERT_ABORTS(sht_new_(NULL, int_eqfn, NULL, sizeof(struct int_entry),
+			       _Alignof(struct int_entry), NULL),
+		      "hashfn must not be NULL");
+}
+
+TEST(abort_null_eqfn)
+{
+	ASSERT_ABORTS(sht_new_(int_hashfn, NULL, NULL, sizeof(struct int_entry),
+			       _Alignof(struct int_entry), NULL),
+		      "eqfn must not be NULL");
+}
+#pragma GCC diagnostic pop
+
+TEST(abort_set_hash_ctx_after_init)
+{
+	struct sht_ht *ht;
+	int ctx = 1;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_hash_ctx(ht, &ctx), "already initialized");
+
+	sht_free(ht);
+}
+
+TEST(abort_set_eq_ctx_after_init)
+{
+	struct sht_ht *ht;
+	int ctx = 1;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_eq_ctx(ht, &ctx), "already initialized");
+
+	sht_free(ht);
+}
+
+TEST(abort_set_free_ctx_after_init)
+{
+	struct sht_ht *ht;
+	int ctx = 1;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, ctx_freefn, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_free_ctx(ht, &ctx), "already initialized");
+
+	sht_free(ht);
+}
+
+TEST(abort_set_lft_after_init)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(iter != NULL);
-	ASSERT(sht_iter_next(iter) == NULL);
-	sht_iter_free(iter);
+	ASSERT_ABORTS(sht_set_lft(ht, 50), "already initialized");
 
 	sht_free(ht);
 }
 
-TEST(ro_iterator_all_entries)
+TEST(abort_set_lft_invalid_low)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	const struct int_entry *result;
-	int i, count;
-	int seen[100] = {0};
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	for (i = 0; i < 100; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
+	ASSERT_ABORTS(sht_set_lft(ht, 0), "Invalid load factor");
 
-	iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(iter != NULL);
+	free(ht);
+}
 
-	count = 0;
-	while ((result = sht_iter_next(iter)) != NULL) {
-		ASSERT(result->key >= 0 && result->key < 100);
-		ASSERT(result->value == result->key * 10);
-		ASSERT(seen[result->key] == 0);
-		seen[result->key] = 1;
-		count++;
-	}
-	ASSERT(count == 100);
+TEST(abort_set_lft_invalid_high)
+{
+	struct sht_ht *ht;
 
-	sht_iter_free(iter);
-	sht_free(ht);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+
+	ASSERT_ABORTS(sht_set_lft(ht, 101), "Invalid load factor");
+
+	free(ht);
 }
 
-TEST(multiple_ro_iterators)
+TEST(abort_set_psl_thold_after_init)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter1, *iter2;
-	struct int_entry e;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT_ABORTS(sht_set_psl_limit(ht, 100), "already initialized");
 
-	iter1 = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(iter1 != NULL);
+	sht_free(ht);
+}
 
-	iter2 = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(iter2 != NULL);
+TEST(abort_set_psl_thold_invalid_low)
+{
+	struct sht_ht *ht;
 
-	sht_iter_free(iter1);
-	sht_iter_free(iter2);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
 
-	sht_free(ht);
+	ASSERT_ABORTS(sht_set_psl_limit(ht, 0), "Invalid PSL threshold");
+
+	free(ht);
 }
 
-TEST(ro_iterator_max_count)
+TEST(abort_set_psl_thold_invalid_high)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iters[32767];  /* SHT_MAX_ITERS */
-	struct int_entry e;
-	int i, key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT_ABORTS(sht_set_psl_limit(ht, 128), "Invalid PSL threshold");
 
-	/* Create maximum number of iterators */
-	for (i = 0; i < 32767; i++) {
-		iters[i] = sht_iter_new(ht, SHT_ITER_RO);
-		ASSERT(iters[i] != NULL);
-	}
+	free(ht);
+}
 
-	/* Try to create one more - should fail */
-	struct sht_iter *extra = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(extra == NULL);
-	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_COUNT);
+TEST(abort_set_key_array_after_init)
+{
+	struct sht_ht *ht;
 
-	/* Free all iterators */
-	for (i = 0; i < 32767; i++) {
-		sht_iter_free(iters[i]);
-	}
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_key_array(ht, 0, sizeof(int)),
+		      "already initialized");
 
 	sht_free(ht);
 }
 
-TEST(ro_iterator_replace)
+TEST(abort_set_key_array_invalid)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	const struct int_entry *result;
-	int i;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	for (i = 0; i < 10; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
+	ASSERT_ABORTS(sht_set_key_array(ht, sizeof(int), 2 * sizeof(int)),
+		      "Invalid key offset or size");
+	ASSERT_ABORTS(sht_set_key_array(ht, 0, 0),
+		      "Invalid key offset or size");
 
-	iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(iter != NULL);
+	free(ht);
 
-	/* Get first entry and replace it */
-	result = sht_iter_next(iter);
-	ASSERT(result != NULL);
+	/* A keyed table's key array must hold its key */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, value);
+	ASSERT(ht != NULL);
 
-	e.key = result->key;
-	e.value = 9999;
-	ASSERT(sht_iter_replace(iter, &e));
+	ASSERT_ABORTS(sht_set_key_array(ht, 0, sizeof(int)),
+		      "Invalid key offset or size");
 
-	sht_iter_free(iter);
+	free(ht);
+}
 
-	/* Verify replacement */
-	result = sht_get(ht, &e.key);
-	ASSERT(result != NULL);
-	ASSERT(result->value == 9999);
+TEST(abort_set_buffer_after_init)
+{
+	struct sht_ht *ht;
+	uint64_t buf[16];
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_buffer(ht, buf, sizeof buf),
+		      "already initialized");
 
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Read/write iterators
- *
- ******************************************************************************/
-
-TEST(rw_iterator_empty_table)
+TEST(abort_set_buffer_misaligned)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
+	uint64_t buf[16];
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
-	ASSERT(sht_iter_next(iter) == NULL);
-	sht_iter_free(iter);
+	ASSERT_ABORTS(sht_set_buffer(ht, (char *)buf + 1, sizeof buf - 1),
+		      "Misaligned buffer");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(rw_iterator_exclusive)
+TEST(abort_set_interleaved_after_init)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT_ABORTS(sht_set_interleaved(ht), "already initialized");
 
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
+	sht_free(ht);
+}
 
-	/* Try to create another rw iterator - should fail */
-	struct sht_iter *iter2 = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter2 == NULL);
-	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+TEST(abort_set_interleaved_too_large)
+{
+	struct sht_ht *ht;
 
-	/* Try to create ro iterator - should also fail */
-	struct sht_iter *ro_iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(ro_iter == NULL);
-	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct large_entry);
+	ASSERT(ht != NULL);
 
-	sht_iter_free(iter);
-	sht_free(ht);
+	ASSERT_ABORTS(sht_set_interleaved(ht), "Entries too large");
+
+	free(ht);
 }
 
-TEST(ro_iterator_blocks_rw)
+TEST(abort_set_interleaved_misaligned)
 {
+	alignas(64) uint64_t buf[16];
 	struct sht_ht *ht;
-	struct sht_iter *ro_iter;
-	struct int_entry e;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	/* Either order */
+	sht_set_buffer(ht, buf + 1, sizeof buf - 8);
+	ASSERT_ABORTS(sht_set_interleaved(ht), "Misaligned buffer");
+	sht_set_buffer(ht, buf, sizeof buf);
+	sht_set_interleaved(ht);
+	ASSERT_ABORTS(sht_set_buffer(ht, buf + 1, sizeof buf - 8),
+		      "Misaligned buffer");
 
-	ro_iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(ro_iter != NULL);
+	free(ht);
+}
 
-	/* Try to create rw iterator - should fail */
-	struct sht_iter *rw_iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(rw_iter == NULL);
-	ASSERT(sht_get_err(ht) == SHT_ERR_ITER_LOCK);
+TEST(abort_set_compact_after_init)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof(int));
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_set_compact(ht), "already initialized");
 
-	sht_iter_free(ro_iter);
 	sht_free(ht);
 }
 
-TEST(rw_iterator_delete)
+TEST(abort_set_compact_no_key_array)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	const struct int_entry *result;
-	int i, count;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
+
+	ASSERT_ABORTS(sht_set_compact(ht), "no key array");
+
+	free(ht);
+}
+
+TEST(abort_set_int_keys_after_init)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
+	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	for (i = 0; i < 10; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
+	ASSERT_ABORTS(sht_set_int_keys(ht), "already initialized");
 
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
+	sht_free(ht);
+}
 
-	count = 0;
-	while ((result = sht_iter_next(iter)) != NULL) {
-		if (result->key % 2 == 0) {
-			ASSERT(sht_iter_delete(iter));
-		}
-		count++;
-	}
-	ASSERT(count == 10);
+TEST(abort_set_int_keys_invalid)
+{
+	struct sht_ht *ht;
 
-	sht_iter_free(iter);
+	/* Not a keyed table */
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_int_keys(ht), "not integers");
+	free(ht);
 
-	/* Verify even keys are gone */
-	for (i = 0; i < 10; i++) {
-		const struct int_entry *r = sht_get(ht, &i);
-		if (i % 2 == 0) {
-			ASSERT(r == NULL);
-		} else {
-			ASSERT(r != NULL);
-			ASSERT(r->value == i * 10);
-		}
-	}
+	/* Key is not 4 or 8 bytes */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct uuid_entry, uuid);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_int_keys(ht), "not integers");
+	free(ht);
+
+	/* Key array and integer keys are mutually exclusive */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof(int));
+	ASSERT_ABORTS(sht_set_int_keys(ht), "has a key array");
+	free(ht);
 
-	sht_free(ht);
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
+	ASSERT(ht != NULL);
+	sht_set_int_keys(ht);
+	ASSERT_ABORTS(sht_set_key_array(ht, offsetof(struct int_entry, key),
+					sizeof(int)),
+		      "has integer keys");
+	free(ht);
 }
 
-TEST(rw_iterator_replace)
+TEST(abort_set_arena_after_init)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	const struct int_entry *result;
-	int i;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	for (i = 0; i < 10; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
-
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
-
-	while ((result = sht_iter_next(iter)) != NULL) {
-		e.key = result->key;
-		e.value = result->key * 100;
-		ASSERT(sht_iter_replace(iter, &e));
-	}
-
-	sht_iter_free(iter);
-
-	/* Verify all values updated */
-	for (i = 0; i < 10; i++) {
-		const struct int_entry *r = sht_get(ht, &i);
-		ASSERT(r != NULL);
-		ASSERT(r->value == i * 100);
-	}
+	ASSERT_ABORTS(sht_set_arena(ht, SHT_NO_BLOB), "already initialized");
 
 	sht_free(ht);
 }
 
-TEST(iterator_delete_no_last)
+TEST(abort_set_arena_invalid)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	int key = 42;
 
+	/* Not a keyed table */
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
+	ASSERT_ABORTS(sht_set_arena(ht, SHT_NO_BLOB), "not a blob");
+	free(ht);
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	/* Key is not a struct sht_blob */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_arena(ht, SHT_NO_BLOB), "not a blob");
+	free(ht);
 
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
+	/* Key array */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
+	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct kv_entry, key),
+			  sizeof(struct sht_blob));
+	ASSERT_ABORTS(sht_set_arena(ht, SHT_NO_BLOB), "has a key array");
+	free(ht);
 
-	/* Try to delete before calling NEXT */
-	ASSERT(!sht_iter_delete(iter));
-	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+	/* Value blob overlaps the key or extends past the entry */
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_arena(ht, 4), "Invalid value offset");
+	ASSERT_ABORTS(sht_set_arena(ht, sizeof(struct kv_entry) - 4),
+		      "Invalid value offset");
+	sht_set_arena(ht, offsetof(struct kv_entry, value));
+	ASSERT_ABORTS(sht_set_key_array(ht, offsetof(struct kv_entry, key),
+					sizeof(struct sht_blob)),
+		      "has a blob arena");
+	free(ht);
+}
 
-	/* Advance iterator */
-	ASSERT(sht_iter_next(iter) != NULL);
-	ASSERT(sht_iter_next(iter) == NULL);
+TEST(abort_arena_no_arena)
+{
+	struct sht_ht *ht;
+	struct sht_blob b = {};
 
-	/* Try to delete after reaching end */
-	ASSERT(!sht_iter_delete(iter));
-	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_arena_add(ht, "x", 1, &b), "not initialized");
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_arena_add(ht, "x", 1, &b), "no blob arena");
+	ASSERT_ABORTS(sht_blob(ht, b), "no blob arena");
 
-	sht_iter_free(iter);
 	sht_free(ht);
 }
 
-TEST(iterator_replace_no_last)
+TEST(abort_arena_invalid_blob)
 {
 	struct sht_ht *ht;
-	struct sht_iter *iter;
-	struct int_entry e;
-	int key = 42;
+	struct kv_entry e = {};
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
 	ASSERT(ht != NULL);
+	sht_set_arena(ht, offsetof(struct kv_entry, value));
 	ASSERT(sht_init(ht, 0));
+	ASSERT(sht_add(ht, "key", &e) == 0);
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
-
-	iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(iter != NULL);
-
-	/* Try to replace before calling NEXT */
-	e.value = 200;
-	ASSERT(!sht_iter_replace(iter, &e));
-	ASSERT(sht_iter_err(iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(iter), "Iterator at beginning or end") == 0);
+	e.value.off = 1000;
+	ASSERT_ABORTS(sht_add(ht, "other", &e), "Invalid value blob");
+	ASSERT_ABORTS(sht_set(ht, "key", &e), "Invalid value blob");
+	ASSERT_ABORTS(sht_replace(ht, "key", &e), "Invalid value blob");
+	ASSERT(sht_size(ht) == 1);
 
-	sht_iter_free(iter);
 	sht_free(ht);
 }
 
-TEST(iterator_error_messages)
+TEST(abort_set_bulk_free_after_init)
 {
 	struct sht_ht *ht;
-	struct sht_iter *ro_iter;
-	struct sht_iter *rw_iter;
-	struct int_entry e;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	e.key = 42;
-	e.value = 100;
-	ASSERT(sht_add(ht, &key, &e) == 0);
+	ASSERT_ABORTS(sht_set_bulk_free(ht), "already initialized");
 
-	/* Test read-only iterator error messages */
-	ro_iter = sht_iter_new(ht, SHT_ITER_RO);
-	ASSERT(ro_iter != NULL);
+	sht_free(ht);
+}
 
-	e.value = 200;
-	ASSERT(!sht_iter_replace(ro_iter, &e));
-	ASSERT(sht_iter_err(ro_iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(ro_iter), "Iterator at beginning or end") == 0);
+TEST(abort_bulk_free_invalid)
+{
+	struct sht_ht *ht;
 
-	sht_iter_free(ro_iter);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	ASSERT_ABORTS(sht_bulk_alloc(ht, 16), "not free resources in bulk");
+	sht_free(ht);
 
-	/* Test read/write iterator error messages */
-	rw_iter = sht_iter_new(ht, SHT_ITER_RW);
-	ASSERT(rw_iter != NULL);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_bulk_free(ht);
+	ASSERT_ABORTS(sht_bulk_alloc(ht, 16), "not initialized");
+	ASSERT(sht_init(ht, 0));
+	ASSERT_ABORTS(sht_clone(ht, NULL, NULL), "resources in bulk");
+	sht_free(ht);
+}
 
-	ASSERT(!sht_iter_delete(rw_iter));
-	ASSERT(sht_iter_err(rw_iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(rw_iter), "Iterator at beginning or end") == 0);
+TEST(abort_set_cache_invalid)
+{
+	struct sht_ht *ht;
 
-	e.value = 300;
-	ASSERT(!sht_iter_replace(rw_iter, &e));
-	ASSERT(sht_iter_err(rw_iter) == SHT_ERR_ITER_NO_LAST);
-	ASSERT(strcmp(sht_iter_msg(rw_iter), "Iterator at beginning or end") == 0);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_cache(ht, 0, NULL, NULL), "Invalid maximum size");
+	ASSERT(sht_init(ht, 0));
+	ASSERT_ABORTS(sht_set_cache(ht, 10, NULL, NULL), "already initialized");
+	sht_free(ht);
 
-	sht_iter_free(rw_iter);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	sht_set_cache(ht, 10, NULL, NULL);
+	ASSERT(sht_init(ht, 0));
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "is a cache");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "is a cache");
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Edge cases and stress tests
- *
- ******************************************************************************/
-
-TEST(delete_and_readd)
+TEST(abort_ttl_invalid)
 {
 	struct sht_ht *ht;
-	struct int_entry e;
-	int i, key;
+	struct sht_iter *iter;
+	struct int_entry e = { .key = 1, .value = 1 };
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
+	ASSERT_ABORTS(sht_set_ttl(ht, &e.key, 10), "not initialized");
+	ASSERT_ABORTS(sht_expire(ht, 10, 1), "not initialized");
 	ASSERT(sht_init(ht, 0));
+	ASSERT(sht_add(ht, &e.key, &e) == 0);
+	ASSERT(sht_set_ttl(ht, &e.key, 10) == 1);
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "entry deadlines");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "entry deadlines");
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+	ASSERT_ABORTS(sht_expire(ht, 10, 1), "iterator(s)");
+	sht_iter_free(iter);
+	sht_free(ht);
+}
 
-	/* Add, delete, and re-add entries multiple times */
-	for (i = 0; i < 100; i++) {
-		key = i % 10;
-		e.key = key;
-		e.value = i;
+TEST(abort_init_twice)
+{
+	struct sht_ht *ht;
 
-		if (i % 3 == 0 && sht_get(ht, &key) != NULL) {
-			ASSERT(sht_delete(ht, &key));
-		}
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
 
-		int result = sht_add(ht, &key, &e);
-		ASSERT(result == 0 || result == 1);
-	}
+	ASSERT_ABORTS(sht_init(ht, 0), "already initialized");
 
 	sht_free(ht);
 }
 
-TEST(wraparound_deletion)
+TEST(abort_map_after_init)
 {
 	struct sht_ht *ht;
-	struct int_entry e;
-	int i;
 
-	/* Use bad hash to force entries at end of table */
-	ht = SHT_NEW(bad_hashfn, int_eqfn, NULL, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 8));
-
-	/* Fill table to force wraparound */
-	for (i = 0; i < 6; i++) {
-		e.key = i;
-		e.value = i * 10;
-		ASSERT(sht_add(ht, &e.key, &e) == 0);
-	}
-
-	/* Delete entries to test wraparound shifting */
-	for (i = 0; i < 6; i += 2) {
-		ASSERT(sht_delete(ht, &i));
-	}
+	ASSERT(sht_init(ht, 0));
 
-	/* Verify remaining entries */
-	for (i = 0; i < 6; i++) {
-		const struct int_entry *r = sht_get(ht, &i);
-		if (i % 2 == 0) {
-			ASSERT(r == NULL);
-		} else {
-			ASSERT(r != NULL);
-			ASSERT(r->value == i * 10);
-		}
-	}
+	ASSERT_ABORTS(sht_map(ht, "/nonexistent/sht_test"),
+		      "already initialized");
 
 	sht_free(ht);
 }
 
-TEST(string_keys)
+TEST(abort_init_shared_after_init)
 {
 	struct sht_ht *ht;
-	struct str_entry e;
-	const struct str_entry *result;
-	const char *keys[] = {"foo", "bar", "baz", "qux"};
-	int i;
 
-	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 	ASSERT(sht_init(ht, 0));
 
-	for (i = 0; i < 4; i++) {
-		e.key = strdup(keys[i]);
-		e.value = strdup("value");
-		ASSERT(sht_add(ht, keys[i], &e) == 0);
-	}
-
-	for (i = 0; i < 4; i++) {
-		result = sht_get(ht, keys[i]);
-		ASSERT(result != NULL);
-		ASSERT(strcmp(result->key, keys[i]) == 0);
-	}
+	ASSERT_ABORTS(sht_init_shared(ht, 0, -1), "already initialized");
 
 	sht_free(ht);
 }
 
-/*******************************************************************************
- *
- *	Tests: Abort conditions
- *
- ******************************************************************************/
-
-TEST(abort_invalid_error_code)
-{
-	ASSERT_ABORTS(sht_msg(SHT_ERR_COUNT), "Invalid error code");
-}
-
-TEST(abort_ealign_not_power_of_2)
+TEST(abort_size_not_initialized)
 {
-	ASSERT_ABORTS(sht_new_(int_hashfn, int_eqfn, NULL, sizeof(struct int_entry), 3, NULL),
-		      "ealign not a power of 2");
-}
+	struct sht_ht *ht;
 
-TEST(abort_esize_ealign_incompatible)
-{
-	ASSERT_ABORTS(sht_new_(int_hashfn, int_eqfn, NULL, 10, 8, NULL),
-		      "Incompatible values of esize and ealign");
-}
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wnonnull"
-TEST(abort_null_hashfn)
-{
-	ASSERT_ABORTS(sht_new_(NULL, int_eqfn, NULL, sizeof(struct int_entry),
-			       _Alignof(struct int_entry), NULL),
-		      "hashfn must not be NULL");
-}
+	ASSERT_ABORTS(sht_size(ht), "not initialized");
 
-TEST(abort_null_eqfn)
-{
-	ASSERT_ABORTS(sht_new_(int_hashfn, NULL, NULL, sizeof(struct int_entry),
-			       _Alignof(struct int_entry), NULL),
-		      "eqfn must not be NULL");
+	free(ht);
 }
-#pragma GCC diagnostic pop
 
-TEST(abort_set_hash_ctx_after_init)
+TEST(abort_empty_not_initialized)
 {
 	struct sht_ht *ht;
-	int ctx = 1;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_set_hash_ctx(ht, &ctx), "already initialized");
+	ASSERT_ABORTS(sht_empty(ht), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_set_eq_ctx_after_init)
+TEST(abort_get_not_initialized)
 {
 	struct sht_ht *ht;
-	int ctx = 1;
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_set_eq_ctx(ht, &ctx), "already initialized");
+	ASSERT_ABORTS(sht_get(ht, &key), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_set_free_ctx_after_init)
+TEST(abort_prefetch_not_initialized)
 {
 	struct sht_ht *ht;
-	int ctx = 1;
+	int key = 42;
 
-	ht = SHT_NEW(int_hashfn, int_eqfn, ctx_freefn, struct int_entry);
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_set_free_ctx(ht, &ctx), "already initialized");
+	ASSERT_ABORTS(sht_prefetch(ht, &key), "not initialized");
+	ASSERT_ABORTS(sht_get_token(ht, &key, 0), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_set_lft_after_init)
+TEST(abort_add_not_initialized)
 {
 	struct sht_ht *ht;
+	struct int_entry e = { .key = 42, .value = 100 };
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_set_lft(ht, 50), "already initialized");
+	ASSERT_ABORTS(sht_add(ht, &key, &e), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_set_lft_invalid_low)
+TEST(abort_set_not_initialized)
 {
 	struct sht_ht *ht;
+	struct int_entry e = { .key = 42, .value = 100 };
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_set_lft(ht, 0), "Invalid load factor");
+	ASSERT_ABORTS(sht_set(ht, &key, &e), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_set_lft_invalid_high)
+TEST(abort_replace_not_initialized)
 {
 	struct sht_ht *ht;
+	struct int_entry e = { .key = 42, .value = 100 };
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_set_lft(ht, 101), "Invalid load factor");
+	ASSERT_ABORTS(sht_replace(ht, &key, &e), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_set_psl_thold_after_init)
+TEST(abort_swap_not_initialized)
 {
 	struct sht_ht *ht;
+	struct int_entry e = { .key = 42, .value = 100 };
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_set_psl_limit(ht, 100), "already initialized");
+	ASSERT_ABORTS(sht_swap(ht, &key, &e, &e), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_set_psl_thold_invalid_low)
+TEST(abort_pop_not_initialized)
 {
 	struct sht_ht *ht;
+	struct int_entry e;
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_set_psl_limit(ht, 0), "Invalid PSL threshold");
+	ASSERT_ABORTS(sht_pop(ht, &key, &e), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_set_psl_thold_invalid_high)
+TEST(abort_delete_not_initialized)
 {
 	struct sht_ht *ht;
+	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_set_psl_limit(ht, 128), "Invalid PSL threshold");
+	ASSERT_ABORTS(sht_delete(ht, &key), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_init_twice)
+TEST(abort_delete_many_not_initialized)
 {
 	struct sht_ht *ht;
+	int key = 42;
+	const void *keys[] = { &key };
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
-	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_init(ht, 0), "already initialized");
+	ASSERT_ABORTS(sht_delete_many(ht, keys, 1), "not initialized");
 
-	sht_free(ht);
+	free(ht);
 }
 
-TEST(abort_size_not_initialized)
+TEST(abort_remove_if_not_initialized)
 {
 	struct sht_ht *ht;
+	int limit = 1;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_size(ht), "not initialized");
+	ASSERT_ABORTS(sht_remove_if(ht, mod_predfn, &limit), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_empty_not_initialized)
+TEST(abort_reserve_not_initialized)
 {
 	struct sht_ht *ht;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_empty(ht), "not initialized");
+	ASSERT_ABORTS(sht_reserve(ht, 100), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_get_not_initialized)
+TEST(abort_clear_not_initialized)
 {
 	struct sht_ht *ht;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_get(ht, &key), "not initialized");
+	ASSERT_ABORTS(sht_clear(ht), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_add_not_initialized)
+TEST(abort_clone_not_initialized)
 {
 	struct sht_ht *ht;
-	struct int_entry e = { .key = 42, .value = 100 };
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_add(ht, &key, &e), "not initialized");
+	ASSERT_ABORTS(sht_clone(ht, NULL, NULL), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_set_not_initialized)
+TEST(abort_clone_without_copyfn)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW(str_hashfn, str_eqfn, str_freefn, struct str_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_clone(ht, NULL, NULL), "no copy function");
+
+	sht_free(ht);
+}
+
+TEST(abort_save_not_initialized)
 {
 	struct sht_ht *ht;
-	struct int_entry e = { .key = 42, .value = 100 };
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_set(ht, &key, &e), "not initialized");
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_replace_not_initialized)
+TEST(abort_read_not_initialized)
 {
 	struct sht_ht *ht;
-	struct int_entry e = { .key = 42, .value = 100 };
-	int key = 42;
+	struct int_entry out;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_replace(ht, &key, &e), "not initialized");
+	ASSERT_ABORTS(sht_read(ht, &(int){ 1 }, &out), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_swap_not_initialized)
+TEST(abort_checkpoint_not_initialized)
 {
 	struct sht_ht *ht;
-	struct int_entry e = { .key = 42, .value = 100 };
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
 
-	ASSERT_ABORTS(sht_swap(ht, &key, &e, &e), "not initialized");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "not initialized");
 
 	free(ht);
 }
 
-TEST(abort_pop_not_initialized)
+TEST(abort_save_indirect)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW_INDIRECT(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "indirect entries");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "indirect entries");
+
+	sht_free(ht);
+}
+
+TEST(abort_save_interleaved)
 {
 	struct sht_ht *ht;
-	struct int_entry e;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
+	sht_set_interleaved(ht);
+	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_pop(ht, &key, &e), "not initialized");
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "interleaved");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "interleaved");
 
-	free(ht);
+	sht_free(ht);
 }
 
-TEST(abort_delete_not_initialized)
+TEST(abort_save_compact)
 {
 	struct sht_ht *ht;
-	int key = 42;
 
 	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
 	ASSERT(ht != NULL);
+	sht_set_key_array(ht, offsetof(struct int_entry, key), sizeof(int));
+	sht_set_compact(ht);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "compact buckets");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "compact buckets");
+
+	sht_free(ht);
+}
+
+TEST(abort_save_int_keys)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW_KEYED(NULL, NULL, struct int_entry, key);
+	ASSERT(ht != NULL);
+	sht_set_int_keys(ht);
+	ASSERT(sht_init(ht, 0));
 
-	ASSERT_ABORTS(sht_delete(ht, &key), "not initialized");
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "integer keys");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "integer keys");
 
-	free(ht);
+	sht_free(ht);
+}
+
+TEST(abort_save_arena)
+{
+	struct sht_ht *ht;
+
+	ht = SHT_NEW_KEYED(NULL, NULL, struct kv_entry, key);
+	ASSERT(ht != NULL);
+	sht_set_arena(ht, SHT_NO_BLOB);
+	ASSERT(sht_init(ht, 0));
+
+	ASSERT_ABORTS(sht_save(ht, STDOUT_FILENO), "blob arena");
+	ASSERT_ABORTS(sht_checkpoint(ht, STDOUT_FILENO), "blob arena");
+
+	sht_free(ht);
 }
 
 TEST(abort_ro_iter_not_initialized)
@@ -2068,6 +4885,85 @@ TEST(abort_delete_with_iterator)
 	sht_free(ht);
 }
 
+TEST(abort_delete_many_with_iterator)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e = { .key = 1, .value = 10 };
+	int key = 1;
+	const void *keys[] = { &key };
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	ASSERT_ABORTS(sht_delete_many(ht, keys, 1), "iterator");
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(abort_reserve_with_iterator)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	ASSERT_ABORTS(sht_reserve(ht, 100), "iterator");
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(abort_remove_if_with_iterator)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e = { .key = 1, .value = 10 };
+	int key = 1, limit = 10;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+	ASSERT(sht_add(ht, &key, &e) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	ASSERT_ABORTS(sht_remove_if(ht, mod_predfn, &limit), "iterator");
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
+TEST(abort_clear_with_iterator)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_init(ht, 0));
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+
+	ASSERT_ABORTS(sht_clear(ht), "iterator");
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
 TEST(abort_free_with_iterator)
 {
 	struct sht_ht *ht;
@@ -2089,6 +4985,62 @@ TEST(abort_free_with_iterator)
 	sht_free(ht);
 }
 
+TEST(abort_add_read_only)
+{
+	struct sht_ht *ht;
+	struct int_entry e = { .key = 1000, .value = 10 };
+	char path[32];
+
+	ASSERT(save_int_table(path, 10));
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_map(ht, path));
+	ASSERT(unlink(path) == 0);
+
+	ASSERT_ABORTS(sht_add(ht, &e.key, &e), "read-only");
+
+	sht_free(ht);
+}
+
+TEST(abort_rw_iter_read_only)
+{
+	struct sht_ht *ht;
+	char path[32];
+
+	ASSERT(save_int_table(path, 10));
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_map(ht, path));
+	ASSERT(unlink(path) == 0);
+
+	ASSERT_ABORTS(sht_iter_new(ht, SHT_ITER_RW), "read-only");
+
+	sht_free(ht);
+}
+
+TEST(abort_iter_replace_read_only)
+{
+	struct sht_ht *ht;
+	struct sht_iter *iter;
+	struct int_entry e = { .key = 0, .value = 1 };
+	char path[32];
+
+	ASSERT(save_int_table(path, 10));
+	ht = SHT_NEW(int_hashfn, int_eqfn, NULL, struct int_entry);
+	ASSERT(ht != NULL);
+	ASSERT(sht_map(ht, path));
+	ASSERT(unlink(path) == 0);
+
+	iter = sht_iter_new(ht, SHT_ITER_RO);
+	ASSERT(iter != NULL);
+	ASSERT(sht_iter_next(iter) != NULL);
+
+	ASSERT_ABORTS(sht_iter_replace(iter, &e), "read-only");
+
+	sht_iter_free(iter);
+	sht_free(ht);
+}
+
 TEST(abort_iter_delete_read_only)
 {
 	struct sht_ht *ht;
@@ -2156,6 +5108,17 @@ int main(void)
 	RUN_TEST(free_context);
 	RUN_TEST(load_factor_threshold);
 	RUN_TEST(psl_threshold);
+	RUN_TEST(key_array);
+	RUN_TEST(key_array_mapped);
+	RUN_TEST(keyed_table);
+	RUN_TEST(int_keys);
+	RUN_TEST(arena_table);
+	RUN_TEST(cache_mode);
+	RUN_TEST(entry_ttl);
+	RUN_TEST(buffer_storage);
+	RUN_TEST(interleaved_layout);
+	RUN_TEST(compact_buckets);
+	RUN_TEST(inplace_table);
 
 	/* Add operations */
 	RUN_TEST(add_new_entry);
@@ -2166,10 +5129,12 @@ int main(void)
 	RUN_TEST(set_new_entry);
 	RUN_TEST(set_replace_entry);
 	RUN_TEST(set_with_freefn);
+	RUN_TEST(upsert_merge);
 
 	/* Get operations */
 	RUN_TEST(get_existing_entry);
 	RUN_TEST(get_nonexistent_entry);
+	RUN_TEST(get_with_token);
 
 	/* Replace operations */
 	RUN_TEST(replace_existing_entry);
@@ -2185,9 +5150,41 @@ int main(void)
 	RUN_TEST(delete_nonexistent_entry);
 	RUN_TEST(pop_existing_entry);
 	RUN_TEST(pop_nonexistent_entry);
+	RUN_TEST(delete_many_entries);
+	RUN_TEST(delete_many_wraparound);
+	RUN_TEST(delete_many_with_freefn);
+	RUN_TEST(remove_if_entries);
+	RUN_TEST(remove_if_wraparound);
+	RUN_TEST(remove_if_with_freefn);
+	RUN_TEST(clear_entries);
+	RUN_TEST(clear_with_freefn);
+	RUN_TEST(bulk_free);
+
+	/* Table cloning */
+	RUN_TEST(clone_table);
+	RUN_TEST(clone_with_copyfn);
+	RUN_TEST(clone_copy_failure);
+
+	/* Indirect entries */
+	RUN_TEST(indirect_entries);
+	RUN_TEST(indirect_large_entries);
+	RUN_TEST(indirect_clone);
+
+	/* Saving and mapping tables */
+	RUN_TEST(save_and_map);
+	RUN_TEST(map_errors);
+	RUN_TEST(shared_table);
+	RUN_TEST(shared_concurrent_reader);
+	RUN_TEST(checkpoint_incremental);
+	RUN_TEST(checkpoint_other_file);
+	RUN_TEST(checkpoint_swapped_files);
 
 	/* Table growth and collision handling */
 	RUN_TEST(table_growth);
+	RUN_TEST(reserve_capacity);
+	RUN_TEST(sparse_large_table);
+	RUN_TEST(builtin_hash_functions);
+	RUN_TEST(reserve_too_large);
 	RUN_TEST(collision_handling);
 	RUN_TEST(excessive_collisions);
 	RUN_TEST(excessive_collisions_psl_10);
@@ -2221,6 +5218,7 @@ int main(void)
 	RUN_TEST(abort_invalid_error_code);
 	RUN_TEST(abort_ealign_not_power_of_2);
 	RUN_TEST(abort_esize_ealign_incompatible);
+	RUN_TEST(abort_new_keyed_invalid_key);
 	RUN_TEST(abort_null_hashfn);
 	RUN_TEST(abort_null_eqfn);
 	RUN_TEST(abort_set_hash_ctx_after_init);
@@ -2232,23 +5230,66 @@ int main(void)
 	RUN_TEST(abort_set_psl_thold_after_init);
 	RUN_TEST(abort_set_psl_thold_invalid_low);
 	RUN_TEST(abort_set_psl_thold_invalid_high);
+	RUN_TEST(abort_set_key_array_after_init);
+	RUN_TEST(abort_set_key_array_invalid);
+	RUN_TEST(abort_set_buffer_after_init);
+	RUN_TEST(abort_set_buffer_misaligned);
+	RUN_TEST(abort_set_interleaved_after_init);
+	RUN_TEST(abort_set_interleaved_too_large);
+	RUN_TEST(abort_set_interleaved_misaligned);
+	RUN_TEST(abort_set_compact_after_init);
+	RUN_TEST(abort_set_compact_no_key_array);
+	RUN_TEST(abort_set_int_keys_after_init);
+	RUN_TEST(abort_set_int_keys_invalid);
+	RUN_TEST(abort_set_arena_after_init);
+	RUN_TEST(abort_set_bulk_free_after_init);
+	RUN_TEST(abort_set_arena_invalid);
+	RUN_TEST(abort_arena_no_arena);
+	RUN_TEST(abort_arena_invalid_blob);
+	RUN_TEST(abort_bulk_free_invalid);
+	RUN_TEST(abort_set_cache_invalid);
+	RUN_TEST(abort_ttl_invalid);
 	RUN_TEST(abort_init_twice);
+	RUN_TEST(abort_map_after_init);
+	RUN_TEST(abort_init_shared_after_init);
 	RUN_TEST(abort_size_not_initialized);
 	RUN_TEST(abort_empty_not_initialized);
 	RUN_TEST(abort_get_not_initialized);
+	RUN_TEST(abort_prefetch_not_initialized);
 	RUN_TEST(abort_add_not_initialized);
 	RUN_TEST(abort_set_not_initialized);
 	RUN_TEST(abort_replace_not_initialized);
 	RUN_TEST(abort_swap_not_initialized);
 	RUN_TEST(abort_pop_not_initialized);
 	RUN_TEST(abort_delete_not_initialized);
+	RUN_TEST(abort_delete_many_not_initialized);
+	RUN_TEST(abort_remove_if_not_initialized);
+	RUN_TEST(abort_reserve_not_initialized);
+	RUN_TEST(abort_clear_not_initialized);
+	RUN_TEST(abort_clone_not_initialized);
+	RUN_TEST(abort_clone_without_copyfn);
+	RUN_TEST(abort_save_not_initialized);
+	RUN_TEST(abort_read_not_initialized);
+	RUN_TEST(abort_checkpoint_not_initialized);
+	RUN_TEST(abort_save_indirect);
+	RUN_TEST(abort_save_interleaved);
+	RUN_TEST(abort_save_compact);
+	RUN_TEST(abort_save_int_keys);
+	RUN_TEST(abort_save_arena);
 	RUN_TEST(abort_ro_iter_not_initialized);
 	RUN_TEST(abort_rw_iter_not_initialized);
 	RUN_TEST(abort_add_with_iterator);
 	RUN_TEST(abort_set_with_iterator);
 	RUN_TEST(abort_pop_with_iterator);
 	RUN_TEST(abort_delete_with_iterator);
+	RUN_TEST(abort_delete_many_with_iterator);
+	RUN_TEST(abort_remove_if_with_iterator);
+	RUN_TEST(abort_reserve_with_iterator);
+	RUN_TEST(abort_clear_with_iterator);
 	RUN_TEST(abort_free_with_iterator);
+	RUN_TEST(abort_add_read_only);
+	RUN_TEST(abort_rw_iter_read_only);
+	RUN_TEST(abort_iter_replace_read_only);
 	RUN_TEST(abort_iter_delete_read_only);
 
 	/* Summary */
@@ -13,14 +13,18 @@
  *
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "../src/sht-ts.h"
 
 #include <assert.h>
 #include <inttypes.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <xxhash.h>
 
 /*******************************************************************************
@@ -120,6 +124,12 @@ struct int_entry {
 	int value;
 };
 
+/* 32-bit unsigned integer key/value entry */
+struct u32_entry {
+	uint32_t key;
+	uint32_t value;
+};
+
 /* Large entry (to test size limits) */
 struct large_entry {
 	char data[16384];  /* Maximum size */
@@ -172,6 +182,11 @@ static _Bool int_eqfn(const int *restrict key, const struct int_entry *restrict
 	return *key == entry->key;
 }
 
+static _Bool u32_eqfn(const uint32_t *restrict key, const struct u32_entry *restrict entry)
+{
+	return *key == entry->key;
+}
+
 /* Large entry equality function (dummy - always returns true) */
 static _Bool large_eqfn(const int *restrict key, const struct large_entry *restrict entry)
 {
@@ -221,6 +236,23 @@ static void ctx_freefn(const struct int_entry *restrict entry, const int *restri
 		free_context_used = 1;
 }
 
+/* Predicate that selects entries with odd keys */
+static _Bool odd_predfn(const struct int_entry *restrict entry, void *restrict ctx)
+{
+	(void)ctx;
+	return entry->key % 2 != 0;
+}
+
+/* Type-safe copy function that duplicates a string entry's strings */
+static _Bool str_copyfn(struct str_entry *restrict dest,
+			const struct str_entry *restrict src, void *restrict ctx)
+{
+	(void)ctx;
+	dest->key = strdup(src->key);
+	dest->value = strdup(src->value);
+	return dest->key != NULL && dest->value != NULL;
+}
+
 /*******************************************************************************
  *
  *	Type-safe table type definitions
@@ -246,6 +278,46 @@ SHT_TABLE_TYPE(
 	int_eqfn		/* equality function */
 )
 
+/* Integer table with a built-in hash function */
+SHT_TABLE_TYPE(
+	u32_tbl,		/* prefix */
+	uint32_t,		/* key type */
+	struct u32_entry,	/* entry type */
+	sht_hash_u32,		/* hash function */
+	u32_eqfn		/* equality function */
+)
+
+/* String table with a built-in hash function */
+SHT_TABLE_TYPE(
+	bstr,			/* prefix */
+	char,			/* key type */
+	struct str_entry,	/* entry type */
+	sht_hash_str,		/* hash function */
+	str_eqfn,		/* equality function */
+	str_freefn		/* free function */
+)
+
+/* Keyed integer table (no hash or equality function) */
+SHT_KEYED_TABLE_TYPE(
+	kint,			/* prefix */
+	struct int_entry,	/* entry type */
+	key			/* key member */
+)
+
+/* Entry with a string key and value in a blob arena */
+struct blob_entry {
+	struct sht_blob key;
+	struct sht_blob value;
+};
+
+/* Blob arena table */
+SHT_ARENA_TABLE_TYPE(
+	arena,			/* prefix */
+	struct blob_entry,	/* entry type */
+	key,			/* key member */
+	value			/* value member */
+)
+
 /* Large entry table */
 SHT_TABLE_TYPE(
 	large,			/* prefix */
@@ -401,6 +473,43 @@ TEST(unusual_alignment)
 	aligned_free(ht);
 }
 
+TEST(indirect_table)
+{
+	struct int_tbl_ht *ht;
+	const struct int_entry *p1, *result;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new_indirect();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	e.key = 1;
+	e.value = 10;
+	ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	p1 = int_tbl_get(ht, &e.key);
+	ASSERT(p1 != NULL);
+
+	for (i = 2; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 2; i < 1000; i += 2)
+		ASSERT(int_tbl_delete(ht, &i));
+
+	/* The entry hasn't moved */
+	ASSERT(int_tbl_get(ht, &(int){ 1 }) == p1);
+	ASSERT(p1->value == 10);
+
+	for (i = 3; i < 1000; i += 2) {
+		result = int_tbl_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
 /*******************************************************************************
  *
  *	Tests: Table state query operations
@@ -555,6 +664,42 @@ TEST(hash_context)
 	ctx_hash_free(ht);
 }
 
+TEST(builtin_hash_functions)
+{
+	struct u32_tbl_ht *ht;
+	struct bstr_ht *sht;
+	struct u32_entry e;
+	char buf[16];
+	uint32_t i;
+
+	ht = u32_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(u32_tbl_init(ht, 0));
+	for (i = 0; i < 10000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(u32_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 10000; i++) {
+		const struct u32_entry *result = u32_tbl_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+	u32_tbl_free(ht);
+
+	sht = bstr_new();
+	ASSERT(sht != NULL);
+	ASSERT(bstr_init(sht, 0));
+	for (i = 0; i < 1000; i++) {
+		struct str_entry se = { .value = NULL };
+		snprintf(buf, sizeof buf, "key%" PRIu32, i);
+		se.key = strdup(buf);
+		ASSERT(bstr_add(sht, se.key, &se) == 0);
+	}
+	ASSERT(bstr_get(sht, "key999") != NULL);
+	ASSERT(bstr_get(sht, "key1000") == NULL);
+	bstr_free(sht);
+}
+
 TEST(eq_context)
 {
 	struct ctx_eq_ht *ht;
@@ -616,6 +761,294 @@ TEST(psl_threshold)
 	int_tbl_free(ht);
 }
 
+TEST(key_array)
+{
+	struct int_tbl_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	int_tbl_set_key_array(ht, offsetof(struct int_entry, key),
+			      sizeof e.key);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 100; i += 2)
+		ASSERT(int_tbl_delete(ht, &i));
+
+	for (i = 0; i < 100; i++) {
+		result = int_tbl_get(ht, &i);
+		if (i % 2 == 0) {
+			ASSERT(result == NULL);
+		}
+		else {
+			ASSERT(result != NULL);
+			ASSERT(result->value == i * 10);
+		}
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(keyed_table)
+{
+	struct kint_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = kint_new();
+	ASSERT(ht != NULL);
+	kint_set_key_array(ht, offsetof(struct int_entry, key), sizeof e.key);
+	ASSERT(kint_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(kint_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i += 2)
+		ASSERT(kint_delete(ht, &i));
+	for (i = 0; i < 1000; i++) {
+		result = kint_get(ht, &i);
+		ASSERT((result != NULL) == (i % 2 == 1));
+		ASSERT(result == NULL || result->value == i * 10);
+	}
+
+	kint_free(ht);
+}
+
+TEST(int_keys)
+{
+	struct kint_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = kint_new();
+	ASSERT(ht != NULL);
+	kint_set_int_keys(ht);
+	ASSERT(kint_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(kint_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i += 2)
+		ASSERT(kint_delete(ht, &i));
+	for (i = 0; i < 1000; i++) {
+		result = kint_get(ht, &i);
+		ASSERT((result != NULL) == (i % 2 == 1));
+		ASSERT(result == NULL || result->value == i * 10);
+	}
+
+	kint_free(ht);
+}
+
+TEST(arena_table)
+{
+	struct arena_ht *ht;
+	const struct blob_entry *result;
+	struct blob_entry e = {};
+	char key[16], value[16];
+	int i;
+
+	ht = arena_new();
+	ASSERT(ht != NULL);
+	ASSERT(arena_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof key, "k%d", i);
+		snprintf(value, sizeof value, "v%d", i * 10);
+		ASSERT(arena_arena_add(ht, value, strlen(value), &e.value));
+		ASSERT(arena_add(ht, key, &e) == 0);
+	}
+	for (i = 0; i < 1000; i += 2) {
+		snprintf(key, sizeof key, "k%d", i);
+		ASSERT(arena_delete(ht, key));
+	}
+	for (i = 0; i < 1000; i++) {
+		snprintf(key, sizeof key, "k%d", i);
+		snprintf(value, sizeof value, "v%d", i * 10);
+		result = arena_get(ht, key);
+		ASSERT((result != NULL) == (i % 2 == 1));
+		ASSERT(result == NULL
+		       || (strcmp(arena_blob(ht, result->key), key) == 0
+			   && result->value.len == strlen(value)
+			   && memcmp(arena_blob(ht, result->value), value,
+				     strlen(value)) == 0));
+	}
+
+	arena_free(ht);
+}
+
+TEST(cache_mode)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	int_tbl_set_cache(ht, 50);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_set(ht, &e.key, &e) == 0);
+		ASSERT(int_tbl_size(ht) == (i < 50 ? (uint32_t)i + 1 : 50));
+	}
+	ASSERT(int_tbl_get(ht, &(int){ 999 })->value == 9990);
+
+	int_tbl_free(ht);
+}
+
+TEST(entry_ttl)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+		ASSERT(int_tbl_set_ttl(ht, &e.key, (uint64_t)i + 1) == 1);
+	}
+
+	ASSERT(int_tbl_expire(ht, 50, 20) == 20);
+	ASSERT(int_tbl_size(ht) == 80);
+	ASSERT(int_tbl_get(ht, &(int){ 49 }) == NULL);
+	ASSERT(int_tbl_get(ht, &(int){ 50 })->value == 500);
+	ASSERT(int_tbl_expire(ht, 50, 100) == 30);
+	ASSERT(int_tbl_size(ht) == 50);
+
+	int_tbl_free(ht);
+}
+
+TEST(buffer_storage)
+{
+	struct int_tbl_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	uint64_t buf[64];
+	size_t size;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	size = int_tbl_buffer_size(ht, 6);
+	ASSERT(size != 0 && size <= sizeof buf);
+	int_tbl_set_buffer(ht, buf, size);
+	ASSERT(int_tbl_init(ht, 6));
+
+	for (i = 0; i < 50; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+		result = int_tbl_get(ht, &(int){ 0 });
+		ASSERT(result != NULL && result->value == 0);
+	}
+	for (i = 0; i < 50; i++) {
+		result = int_tbl_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(interleaved_layout)
+{
+	struct int_tbl_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	int_tbl_set_interleaved(ht);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 200; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 200; i += 2)
+		ASSERT(int_tbl_delete(ht, &i));
+	for (i = 0; i < 200; i++) {
+		result = int_tbl_get(ht, &i);
+		ASSERT((result != NULL) == (i % 2 == 1));
+		ASSERT(result == NULL || result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(compact_buckets)
+{
+	struct int_tbl_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	int_tbl_set_key_array(ht, offsetof(struct int_entry, key),
+			      sizeof e.key);
+	int_tbl_set_compact(ht);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 200; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 200; i++) {
+		result = int_tbl_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(inplace_table)
+{
+	struct sht_storage storage;
+	struct int_tbl_ht *ht;
+	const struct int_entry *result;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_init_inplace(&storage);
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 50; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	for (i = 0; i < 50; i++) {
+		result = int_tbl_get(ht, &i);
+		ASSERT(result != NULL && result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
 /*******************************************************************************
  *
  *	Tests: Add operations
@@ -753,11 +1186,49 @@ TEST(set_with_freefn)
 	e1.value = strdup("value1");
 	ASSERT(str_set(ht, key, &e1) == 0);
 
-	e2.key = strdup("test");
-	e2.value = strdup("value2");
-	ASSERT(str_set(ht, key, &e2) == 1);  /* Should free e1's strings */
+	e2.key = strdup("test");
+	e2.value = strdup("value2");
+	ASSERT(str_set(ht, key, &e2) == 1);  /* Should free e1's strings */
+
+	str_free(ht);  /* Should free e2's strings */
+}
+
+/* Type-safe merge function that keeps the larger value */
+static void max_mergefn(struct int_entry *restrict existing,
+			const struct int_entry *restrict entry,
+			void *restrict ctx)
+{
+	int *count = ctx;
+
+	if (entry->value > existing->value)
+		existing->value = entry->value;
+	++*count;
+}
+
+TEST(upsert_merge)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i, max[10] = { 0 }, merged = 0;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 300; i++) {
+		e.key = i % 10;
+		e.value = (i * 37) % 101;
+		if (e.value > max[e.key])
+			max[e.key] = e.value;
+		ASSERT(int_tbl_upsert(ht, &e.key, &e, max_mergefn, &merged)
+			== (i < 10 ? 0 : 1));
+	}
+	ASSERT(int_tbl_size(ht) == 10 && merged == 290);
 
-	str_free(ht);  /* Should free e2's strings */
+	for (i = 0; i < 10; i++)
+		ASSERT(int_tbl_get(ht, &i)->value == max[i]);
+
+	int_tbl_free(ht);
 }
 
 /*******************************************************************************
@@ -803,6 +1274,61 @@ TEST(get_nonexistent_entry)
 	int_tbl_free(ht);
 }
 
+TEST(get_with_token)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	uint32_t tokens[200];
+	int keys[200];
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 100; ++i) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &i, &e) == 0);
+	}
+
+	for (i = 0; i < 200; ++i) {
+		keys[i] = i;
+		tokens[i] = int_tbl_prefetch(ht, &keys[i]);
+	}
+
+	for (i = 0; i < 200; ++i) {
+		const struct int_entry *result;
+
+		result = int_tbl_get_token(ht, &keys[i], tokens[i]);
+		if (i < 100) {
+			ASSERT(result == int_tbl_get(ht, &keys[i]));
+			ASSERT(result->value == i * 10);
+		}
+		else {
+			ASSERT(result == NULL);
+		}
+	}
+
+	// Tokens remain valid after the table is resized
+	for (i = 100; i < 1000; ++i) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &i, &e) == 0);
+	}
+
+	for (i = 0; i < 200; ++i) {
+		const struct int_entry *result;
+
+		result = int_tbl_get_token(ht, &keys[i], tokens[i]);
+		ASSERT(result != NULL);
+		ASSERT(result->key == i);
+		ASSERT(result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
 /*******************************************************************************
  *
  *	Tests: Replace operations
@@ -999,6 +1525,297 @@ TEST(pop_nonexistent_entry)
 	int_tbl_free(ht);
 }
 
+TEST(delete_many_entries)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int keys[100];
+	const int *victims[51];
+	int i, n;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0, n = 0; i < 100; i++) {
+		keys[i] = i;
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &keys[i], &e) == 0);
+		if (i % 2 == 0)
+			victims[n++] = &keys[i];
+	}
+	victims[n++] = &keys[0];	/* duplicate */
+
+	ASSERT(int_tbl_delete_many(ht, victims, n) == 50);
+	ASSERT(int_tbl_size(ht) == 50);
+
+	for (i = 0; i < 100; i++) {
+		const struct int_entry *r = int_tbl_get(ht, &i);
+		if (i % 2 == 0) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(remove_if_entries)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &i, &e) == 0);
+	}
+
+	ASSERT(int_tbl_remove_if(ht, odd_predfn, NULL) == 50);
+	ASSERT(int_tbl_size(ht) == 50);
+
+	for (i = 0; i < 100; i++) {
+		const struct int_entry *r = int_tbl_get(ht, &i);
+		if (i % 2 != 0) {
+			ASSERT(r == NULL);
+		} else {
+			ASSERT(r != NULL);
+			ASSERT(r->value == i * 10);
+		}
+	}
+
+	int_tbl_free(ht);
+}
+
+TEST(clear_entries)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 20; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+
+	int_tbl_clear(ht);
+	ASSERT(int_tbl_empty(ht));
+	for (i = 0; i < 20; i++)
+		ASSERT(int_tbl_get(ht, &i) == NULL);
+
+	e.key = 1;
+	e.value = 100;
+	ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	ASSERT(int_tbl_size(ht) == 1);
+
+	int_tbl_free(ht);
+}
+
+TEST(bulk_free)
+{
+	struct str_ht *ht;
+	struct str_entry e;
+	int i;
+
+	/* The free function would free() the arena strings; it isn't called */
+	ht = str_new();
+	ASSERT(ht != NULL);
+	str_set_bulk_free(ht);
+	ASSERT(str_init(ht, 0));
+
+	for (i = 0; i < 1000; i++) {
+		e.key = str_bulk_alloc(ht, 16);
+		e.value = str_bulk_alloc(ht, 16);
+		ASSERT(e.key != NULL && e.value != NULL);
+		snprintf(e.key, 16, "key%d", i);
+		snprintf(e.value, 16, "value%d", i);
+		ASSERT(str_add(ht, e.key, &e) == 0);
+	}
+	ASSERT(strcmp(str_get(ht, "key999")->value, "value999") == 0);
+
+	str_clear(ht);
+	ASSERT(str_empty(ht));
+
+	e.key = str_bulk_alloc(ht, 4);
+	ASSERT(e.key != NULL);
+	strcpy(e.key, "abc");
+	e.value = e.key;
+	ASSERT(str_add(ht, e.key, &e) == 0);
+
+	str_free(ht);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Table cloning
+ *
+ ******************************************************************************/
+
+TEST(clone_table)
+{
+	struct str_ht *ht, *clone;
+	struct str_entry e;
+	const struct str_entry *result;
+	const char *keys[] = { "foo", "bar", "baz" };
+	int i;
+
+	ht = str_new();
+	ASSERT(ht != NULL);
+	ASSERT(str_init(ht, 0));
+
+	for (i = 0; i < 3; i++) {
+		e.key = strdup(keys[i]);
+		e.value = strdup("value");
+		ASSERT(str_add(ht, keys[i], &e) == 0);
+	}
+
+	clone = str_clone(ht, str_copyfn, NULL);
+	ASSERT(clone != NULL);
+	str_free(ht);
+
+	ASSERT(str_size(clone) == 3);
+	for (i = 0; i < 3; i++) {
+		result = str_get(clone, keys[i]);
+		ASSERT(result != NULL);
+		ASSERT(strcmp(result->value, "value") == 0);
+	}
+
+	str_free(clone);
+}
+
+/*******************************************************************************
+ *
+ *	Tests: Saving and mapping tables
+ *
+ ******************************************************************************/
+
+TEST(save_and_map)
+{
+	struct int_tbl_ht *ht, *mapped;
+	struct int_entry e;
+	char path[] = "/tmp/sht_ts_test.XXXXXX";
+	int fd, i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 0));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(int_tbl_save(ht, fd));
+	ASSERT(close(fd) == 0);
+	int_tbl_free(ht);
+
+	mapped = int_tbl_new();
+	ASSERT(mapped != NULL);
+	ASSERT(int_tbl_map(mapped, path));
+	ASSERT(unlink(path) == 0);
+
+	ASSERT(int_tbl_size(mapped) == 100);
+	for (i = 0; i < 100; i++) {
+		const struct int_entry *result = int_tbl_get(mapped, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 10);
+	}
+
+	int_tbl_free(mapped);
+}
+
+TEST(shared_table)
+{
+	struct int_tbl_ht *writer, *reader;
+	struct int_entry e, out;
+	char path[] = "/tmp/sht_ts_test.XXXXXX";
+	int fd, i;
+
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+
+	writer = int_tbl_new();
+	ASSERT(writer != NULL);
+	ASSERT(int_tbl_init_shared(writer, 100, fd));
+
+	reader = int_tbl_new();
+	ASSERT(reader != NULL);
+	ASSERT(int_tbl_map_fd(reader, fd));
+	ASSERT(close(fd) == 0);
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(writer, &e.key, &e) == 0);
+	}
+
+	ASSERT(int_tbl_size(reader) == 100);
+	for (i = 0; i < 100; i++) {
+		ASSERT(int_tbl_read(reader, &i, &out));
+		ASSERT(out.value == i * 10);
+	}
+	i = 100;
+	ASSERT(!int_tbl_read(reader, &i, &out));
+
+	int_tbl_free(reader);
+	int_tbl_free(writer);
+}
+
+TEST(checkpoint_table)
+{
+	struct int_tbl_ht *ht, *mapped;
+	struct int_entry e;
+	char path[] = "/tmp/sht_ts_test.XXXXXX";
+	int fd, i;
+
+	ASSERT((fd = mkstemp(path)) >= 0);
+	ASSERT(unlink(path) == 0);
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 100));
+
+	for (i = 0; i < 100; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+	ASSERT(int_tbl_checkpoint(ht, fd));
+
+	/* Incremental checkpoint */
+	i = 50;
+	ASSERT(int_tbl_delete(ht, &i));
+	ASSERT(int_tbl_checkpoint(ht, fd));
+
+	mapped = int_tbl_new();
+	ASSERT(mapped != NULL);
+	ASSERT(int_tbl_map_fd(mapped, fd));
+	ASSERT(close(fd) == 0);
+
+	ASSERT(int_tbl_size(mapped) == 99);
+	ASSERT(int_tbl_get(mapped, &i) == NULL);
+	i = 51;
+	ASSERT(int_tbl_get(mapped, &i) != NULL);
+
+	int_tbl_free(mapped);
+	int_tbl_free(ht);
+}
+
 /*******************************************************************************
  *
  *	Tests: Table growth and collision handling
@@ -1033,6 +1850,40 @@ TEST(table_growth)
 	int_tbl_free(ht);
 }
 
+TEST(reserve_capacity)
+{
+	struct int_tbl_ht *ht;
+	struct int_entry e;
+	int i;
+
+	ht = int_tbl_new();
+	ASSERT(ht != NULL);
+	ASSERT(int_tbl_init(ht, 2));  /* Very small initial size */
+
+	for (i = 0; i < 10; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+
+	ASSERT(int_tbl_reserve(ht, 1000));
+	ASSERT(int_tbl_size(ht) == 10);
+
+	for (i = 10; i < 1000; i++) {
+		e.key = i;
+		e.value = i * 10;
+		ASSERT(int_tbl_add(ht, &e.key, &e) == 0);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		const struct int_entry *result = int_tbl_get(ht, &i);
+		ASSERT(result != NULL);
+		ASSERT(result->value == i * 10);
+	}
+
+	int_tbl_free(ht);
+}
+
 TEST(collision_handling)
 {
 	struct bad_ht *ht;
@@ -2242,6 +3093,7 @@ int main(void)
 	RUN_TEST(entry_size_maximum);
 	RUN_TEST(capacity_too_large);
 	RUN_TEST(unusual_alignment);
+	RUN_TEST(indirect_table);
 
 	/* Table state query operations */
 	RUN_TEST(size_empty_table);
@@ -2253,10 +3105,21 @@ int main(void)
 
 	/* Context and configuration */
 	RUN_TEST(hash_context);
+	RUN_TEST(builtin_hash_functions);
 	RUN_TEST(eq_context);
 	RUN_TEST(free_context);
 	RUN_TEST(load_factor_threshold);
 	RUN_TEST(psl_threshold);
+	RUN_TEST(key_array);
+	RUN_TEST(keyed_table);
+	RUN_TEST(int_keys);
+	RUN_TEST(arena_table);
+	RUN_TEST(cache_mode);
+	RUN_TEST(entry_ttl);
+	RUN_TEST(buffer_storage);
+	RUN_TEST(interleaved_layout);
+	RUN_TEST(compact_buckets);
+	RUN_TEST(inplace_table);
 
 	/* Add operations */
 	RUN_TEST(add_new_entry);
@@ -2267,10 +3130,12 @@ int main(void)
 	RUN_TEST(set_new_entry);
 	RUN_TEST(set_replace_entry);
 	RUN_TEST(set_with_freefn);
+	RUN_TEST(upsert_merge);
 
 	/* Get operations */
 	RUN_TEST(get_existing_entry);
 	RUN_TEST(get_nonexistent_entry);
+	RUN_TEST(get_with_token);
 
 	/* Replace operations */
 	RUN_TEST(replace_existing_entry);
@@ -2286,9 +3151,22 @@ int main(void)
 	RUN_TEST(delete_nonexistent_entry);
 	RUN_TEST(pop_existing_entry);
 	RUN_TEST(pop_nonexistent_entry);
+	RUN_TEST(delete_many_entries);
+	RUN_TEST(remove_if_entries);
+	RUN_TEST(clear_entries);
+	RUN_TEST(bulk_free);
+
+	/* Table cloning */
+	RUN_TEST(clone_table);
+
+	/* Saving and mapping tables */
+	RUN_TEST(save_and_map);
+	RUN_TEST(shared_table);
+	RUN_TEST(checkpoint_table);
 
 	/* Table growth and collision handling */
 	RUN_TEST(table_growth);
+	RUN_TEST(reserve_capacity);
 	RUN_TEST(collision_handling);
 	RUN_TEST(excessive_collisions);
 	RUN_TEST(excessive_collisions_psl_10);